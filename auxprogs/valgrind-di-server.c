@@ -107,6 +107,10 @@
 
 #include "../coregrind/m_debuginfo/minilzo.h"
 
+#if defined(HAVE_LIBZSTD)
+#include <zstd.h>
+#endif
+
 /*---------------------------------------------------------------*/
 
 /* The default allowable number of concurrent connections. */
@@ -119,6 +123,15 @@ unsigned M_CONNECTIONS = 0;
 
 static const char* clo_serverpath = ".";
 
+/* Feature bits returned in the reply (FEOK) to a FEAT request.  A
+   client that doesn't send FEAT, or that talks to a server too old to
+   know about it, uses only the original VERS/OPEN/READ/CRC3 requests. */
+#define DI_FEAT_RDZS  (1ULL << 0)  // RDZS: like READ, but zstd-compressed
+
+/* The zstd compression level used for RDZS replies.  Level 1 is both
+   faster and compresses better than LZO1X-1. */
+#define DI_ZSTD_LEVEL 1
+
 
 /*---------------------------------------------------------------*/
 
@@ -187,6 +200,7 @@ typedef
       ULong stats_n_rdok_frames;
       ULong stats_n_read_unz_bytes; // bytes via READ (uncompressed)
       ULong stats_n_read_z_bytes;   // bytes via READ (compressed)
+      ULong stats_n_rdzk_frames;    // how many of the frames used zstd
    }
    ConnState;
 
@@ -733,6 +747,14 @@ static Bool handle_transaction ( int conn_no )
       res = mk_Frame_asciiz("VEOK", "Valgrind Debuginfo Server, Version 1");
    }
    else
+   if (parse_Frame_noargs(req, "FEAT")) {
+      ULong features = 0;
+#     if defined(HAVE_LIBZSTD)
+      features |= DI_FEAT_RDZS;
+#     endif
+      res = mk_Frame_le64("FEOK", features);
+   }
+   else
    if (parse_Frame_noargs(req, "CRC3")) {
       /* FIXME: add a session ID to this request, and check it */
       if (conn_state[conn_no].file_fd == 0) {
@@ -796,7 +818,13 @@ static Bool handle_transaction ( int conn_no )
    }
    else
    if (parse_Frame_le64_le64_le64(req, "READ", &req_session_id,
-                                  &req_offset, &req_len)) {
+                                  &req_offset, &req_len)
+       || parse_Frame_le64_le64_le64(req, "RDZS", &req_session_id,
+                                     &req_offset, &req_len)) {
+      /* RDZS is the same as READ, except that the data is compressed
+         with zstd rather than LZO, and the reply is RDZK rather than
+         RDOK.  Clients only send it if FEAT said we support it. */
+      Bool zstd = memcmp(&req->data[0], "RDZS", 4) == 0;
       /* Because each new connection is associated with its own socket
          descriptor and hence with a particular conn_no, the requested
          session-ID is redundant -- it must be the one associated with
@@ -832,7 +860,36 @@ static Bool handle_transaction ( int conn_no )
             res = mk_Frame_asciiz("FAIL", "READ: I/O error reading file");
             ok = False;
          }         
-         if (ok) {
+         if (ok && zstd) {
+#           if defined(HAVE_LIBZSTD)
+            size_t zLenMax = ZSTD_compressBound(req_len);
+            UChar* zBuf = my_malloc(zLenMax);
+            size_t zLen = ZSTD_compress(zBuf, zLenMax, unzBuf, req_len,
+                                        DI_ZSTD_LEVEL);
+            if (!ZSTD_isError(zLen)) {
+               assert(zLen <= zLenMax);
+               UChar* buf = NULL;
+               res = mk_Frame_le64_le64_le64_bytes
+                 ("RDZK", req_session_id, req_offset, req_len, zLen, &buf);
+               assert(res);
+               assert(buf);
+               memcpy(buf, zBuf, zLen);
+               // Update stats
+               conn_state[conn_no].stats_n_rdok_frames++;
+               conn_state[conn_no].stats_n_rdzk_frames++;
+               conn_state[conn_no].stats_n_read_unz_bytes += req_len;
+               conn_state[conn_no].stats_n_read_z_bytes   += zLen;
+            } else {
+               ok = False;
+               res = mk_Frame_asciiz("FAIL", "RDZS: zstd failed");
+            }
+            free(zBuf);
+#           else
+            res = mk_Frame_asciiz("FAIL", "RDZS: zstd is not supported");
+            ok = False;
+#           endif
+         }
+         else if (ok) {
             // Now compress it with LZO.  LZO appears to recommend
             // the worst-case output size as (in_len + in_len / 16 + 67).
             // Be more conservative here.
@@ -918,10 +975,11 @@ static Bool handle_transaction ( int conn_no )
       close(conn_state[conn_no].file_fd);
 
    if (conn_state[conn_no].stats_n_rdok_frames > 0) {
-      printf("(%d) SessionID %llu:   sent %llu frames, "
+      printf("(%d) SessionID %llu:   sent %llu frames (%llu zstd), "
              "%llu MB (unz), %llu MB (z), ratio %4.2f:1\n",
              conn_count, conn_state[conn_no].session_id,
              conn_state[conn_no].stats_n_rdok_frames,
+             conn_state[conn_no].stats_n_rdzk_frames,
              conn_state[conn_no].stats_n_read_unz_bytes / 1000000,
              conn_state[conn_no].stats_n_read_z_bytes / 1000000,
              (double)conn_state[conn_no].stats_n_read_unz_bytes
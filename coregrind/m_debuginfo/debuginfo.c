@@ -344,6 +344,7 @@ static void free_DebugInfo ( DebugInfo* di )
    if (di->inltab)       ML_(dinfo_free)(di->inltab);
    if (di->cfsi_base)    ML_(dinfo_free)(di->cfsi_base);
    if (di->cfsi_m_ix)    ML_(dinfo_free)(di->cfsi_m_ix);
+   if (di->cfsi_page_ix) ML_(dinfo_free)(di->cfsi_page_ix);
    if (di->cfsi_rd)      ML_(dinfo_free)(di->cfsi_rd);
    if (di->cfsi_m_pool)  VG_(deleteDedupPA)(di->cfsi_m_pool);
    if (di->cfsi_exprs)   VG_(deleteXA)(di->cfsi_exprs);
@@ -1470,6 +1471,11 @@ void VG_(di_load_di)( DebugInfo *di )
 #if defined(VGO_darwin)
       ML_(read_macho_debug_info) (di);
 #else
+      /* Only the symbol tables and CFI are needed to record stack
+         traces and to resolve redirections.  Leave the (much bigger)
+         DWARF line number, inlined call and variable info until
+         something asks for it. */
+      di->deferred_dwarf = True;
       ML_(read_elf_debug) (di);
 #endif
       ML_(canonicaliseTables)( di );
@@ -1482,6 +1488,20 @@ void VG_(di_load_di)( DebugInfo *di )
    }
 }
 
+/* Load DI, including its DWARF line number, inlined call and variable
+   info, if that hasn't already been done. */
+void VG_(di_load_dwarf)( DebugInfo *di )
+{
+   VG_(di_load_di)(di);
+   if (di->deferred_dwarf) {
+      di->deferred_dwarf = False;
+#if !defined(VGO_darwin)
+      ML_(read_elf_debug_dwarf) (di);
+#endif
+      ML_(canonicaliseDwarfTables)( di );
+   }
+}
+
 /* Load DI if it has a text segment containing A and DI hasn't already
    been loaded.  */
 
@@ -3136,6 +3156,9 @@ UWord evalCfiExpr ( const XArray* exprs, Int ix,
    Per comments at the top of this section, we only look for CFI in
    DebugInfos that are valid for the current epoch.
 */
+static UWord stats__cfsi_n_search = 0;
+static UWord stats__cfsi_n_steps = 0;
+
 __attribute__((noinline))
 static void find_DiCfSI ( /*OUT*/DebugInfo** diP, 
                           /*OUT*/DiCfSI_m** cfsi_mP,
@@ -3144,9 +3167,7 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    DebugInfo* di;
    Word       i = -1;
 
-   static UWord n_search = 0;
-   static UWord n_steps = 0;
-   n_search++;
+   stats__cfsi_n_search++;
 
    if (0) VG_(printf)("search for %#lx\n", ip);
 
@@ -3154,7 +3175,7 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
 
    for (di = debugInfo_list; di != NULL; di = di->next) {
       Word j;
-      n_steps++;
+      stats__cfsi_n_steps++;
 
       if (!is_DI_valid_for_epoch(di, curr_epoch))
          continue;
@@ -3211,16 +3232,16 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
          amd64, this in fact reduces the total amount of searching
          done by the above find-the-right-DebugInfo loop by more than
          a factor of 20. */
-      if ((n_search & 0xF) == 0) {
+      if ((stats__cfsi_n_search & 0xF) == 0) {
          /* Move di one step closer to the start of the list. */
          move_DebugInfo_one_step_forward( di );
       }
       /* End of performance-enhancing hack. */
 
-      if (0 && ((n_search & 0x7FFFF) == 0))
+      if (0 && ((stats__cfsi_n_search & 0x7FFFF) == 0))
          VG_(printf)("find_DiCfSI: %lu searches, "
                      "%lu DebugInfos looked at\n", 
-                     n_search, n_steps);
+                     stats__cfsi_n_search, stats__cfsi_n_steps);
 
    }
 
@@ -3244,42 +3265,89 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    once a DebugInfo is read, adding new DiCfSI_m* is not possible
    anymore, as the cfsi_m_pool is frozen once the reading is terminated.
    Also, the cache is invalidated when new debuginfo is read due to
-   an mmap or some debuginfo is discarded due to an munmap. */
+   an mmap or some debuginfo is discarded due to an munmap.
 
-// Prime number, giving about 6Kbytes cache on 32 bits,
-//                           12Kbytes cache on 64 bits.
-#define N_CFSI_M_CACHE 509
+   Stack unwinding queries the cache for every frame of every stack
+   trace, and a tool such as memcheck records a stack trace for each
+   malloc and free, so the cache is set-associative to avoid
+   conflicts between hot return addresses: an ip selects a set of
+   N_CFSI_M_CACHE_WAYS entries.  A hit in any but the first entry of a
+   set moves the entry one place towards the front of the set, and a
+   miss discards the last entry and puts the new one at the front.
+   Hence entries in use stay near the front, and a CFSI_m_CacheEnt*
+   is only valid until the next cache lookup.
+
+   The cache has about VG_(clo_cfi_cache_size) entries (the number of
+   sets is rounded up to a power of 2), and is allocated on first
+   use. */
+
+#define N_CFSI_M_CACHE_WAYS 4
 
 typedef
    struct { Addr ip; DebugInfo* di; DiCfSI_m* cfsi_m; }
    CFSI_m_CacheEnt;
 
-static CFSI_m_CacheEnt cfsi_m_cache[N_CFSI_M_CACHE];
+static CFSI_m_CacheEnt* cfsi_m_cache = NULL;
+static UWord            cfsi_m_cache_n_sets = 0;
+
+static ULong stats__cfsi_m_cache_queries = 0;
+static ULong stats__cfsi_m_cache_misses = 0;
+
+static void cfsi_m_cache__init ( void )
+{
+   vg_assert(cfsi_m_cache == NULL);
+   cfsi_m_cache_n_sets = 1;
+   while (cfsi_m_cache_n_sets * N_CFSI_M_CACHE_WAYS
+          < (UWord)VG_(clo_cfi_cache_size))
+      cfsi_m_cache_n_sets *= 2;
+   cfsi_m_cache = ML_(dinfo_zalloc)("di.debuginfo.cmci.1",
+                                    cfsi_m_cache_n_sets * N_CFSI_M_CACHE_WAYS
+                                    * sizeof(CFSI_m_CacheEnt));
+}
 
 static void cfsi_m_cache__invalidate ( void ) {
-   VG_(memset)(&cfsi_m_cache, 0, sizeof(cfsi_m_cache));
+   if (cfsi_m_cache != NULL)
+      VG_(memset)(cfsi_m_cache, 0,
+                  cfsi_m_cache_n_sets * N_CFSI_M_CACHE_WAYS
+                  * sizeof(CFSI_m_CacheEnt));
 }
 
 static inline CFSI_m_CacheEnt* cfsi_m_cache__find ( Addr ip )
 {
-   UWord         hash = ip % N_CFSI_M_CACHE;
-   CFSI_m_CacheEnt* ce = &cfsi_m_cache[hash];
-#  ifdef N_Q_M_STATS
-   static UWord  n_q = 0, n_m = 0;
-   n_q++;
-   if (0 == (n_q & 0x1FFFFF))
-      VG_(printf)("QQQ %lu %lu\n", n_q, n_m);
-#  endif
+   CFSI_m_CacheEnt* set;
+   CFSI_m_CacheEnt* ce;
+   UWord            w;
+
+   if (UNLIKELY(cfsi_m_cache == NULL))
+      cfsi_m_cache__init();
 
-   if (LIKELY(ce->ip == ip) && LIKELY(ce->di != NULL)) {
-      /* found an entry in the cache .. */
+   stats__cfsi_m_cache_queries++;
+   set = &cfsi_m_cache[((ip ^ (ip >> 13)) & (cfsi_m_cache_n_sets - 1))
+                       * N_CFSI_M_CACHE_WAYS];
+
+   if (LIKELY(set[0].ip == ip) && LIKELY(set[0].di != NULL)) {
+      /* found an entry at the front of its set .. */
+      ce = &set[0];
    } else {
-      /* not found in cache.  Search and update. */
-#     ifdef N_Q_M_STATS
-      n_m++;
-#     endif
-      ce->ip = ip;
-      find_DiCfSI( &ce->di, &ce->cfsi_m, ip );
+      for (w = 1; w < N_CFSI_M_CACHE_WAYS; w++) {
+         if (set[w].ip == ip && set[w].di != NULL)
+            break;
+      }
+      if (w < N_CFSI_M_CACHE_WAYS) {
+         /* found an entry further back.  Move it one step forward. */
+         CFSI_m_CacheEnt tmp = set[w-1];
+         set[w-1] = set[w];
+         set[w] = tmp;
+         ce = &set[w-1];
+      } else {
+         /* not found in cache.  Search and update. */
+         stats__cfsi_m_cache_misses++;
+         for (w = N_CFSI_M_CACHE_WAYS-1; w > 0; w--)
+            set[w] = set[w-1];
+         ce = &set[0];
+         ce->ip = ip;
+         find_DiCfSI( &ce->di, &ce->cfsi_m, ip );
+      }
    }
 
    if (UNLIKELY(ce->di == (DebugInfo*)1)) {
@@ -3469,35 +3537,52 @@ Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
 
 void VG_(ppUnwindInfo) (Addr from, Addr to)
 {
-   DebugInfo*         di;
    CFSI_m_CacheEnt*   ce;
    Addr ce_from;
-   CFSI_m_CacheEnt*   next_ce;
-
+   /* Copies of the cache entries found, as looking up 'from' may
+      move the entry found for 'from - 1'. */
+   DebugInfo*         di;
+   DiCfSI_m*          cfsi_m;
+   DiCfSI_m*          next_cfsi_m;
+   DebugInfo*         next_di;
 
    ce = cfsi_m_cache__find(from);
+   di = ce ? ce->di : NULL;
+   cfsi_m = ce ? ce->cfsi_m : NULL;
    ce_from = from;
    while (from <= to) {
       from++;
-      next_ce = cfsi_m_cache__find(from);
-      if ((ce == NULL && next_ce != NULL)
-          || (ce != NULL && next_ce == NULL)
-          || (ce != NULL && next_ce != NULL && ce->cfsi_m != next_ce->cfsi_m)
-          || from > to) {
-         if (ce == NULL) {
+      ce = cfsi_m_cache__find(from);
+      next_di = ce ? ce->di : NULL;
+      next_cfsi_m = ce ? ce->cfsi_m : NULL;
+      if (cfsi_m != next_cfsi_m || from > to) {
+         if (cfsi_m == NULL) {
             VG_(printf)("[%#lx .. %#lx]: no CFI info\n", ce_from, from-1);
          } else {
-            di = ce->di;
             ML_(ppDiCfSI)(di->cfsi_exprs,
                           ce_from, from - ce_from,
-                          ce->cfsi_m);
+                          cfsi_m);
          }
-         ce = next_ce;
+         di = next_di;
+         cfsi_m = next_cfsi_m;
          ce_from = from;
       }
    }
 }
 
+void VG_(print_debuginfo_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+                "di-cfsi: cache: %'lu sets x %d ways, %'llu lookups, "
+                "%'llu misses\n",
+                cfsi_m_cache_n_sets, N_CFSI_M_CACHE_WAYS,
+                stats__cfsi_m_cache_queries, stats__cfsi_m_cache_misses);
+   VG_(message)(Vg_DebugMsg,
+                "di-cfsi: %'lu searches, %'lu DebugInfos looked at\n",
+                stats__cfsi_n_search, stats__cfsi_n_steps);
+   ML_(img_print_stats)();
+}
+
 
 /* The main function for DWARF2/3 CFI-based stack unwinding.  Given a
    set of registers in UREGS, modify it to hold the register values
@@ -3860,6 +3945,14 @@ Bool VG_(FPO_info_present)(void)
 */
 #define  p2XA  VG_(xaprintf)
 
+/* Make sure that the variable info for DI has been read in, if the
+   user or tool asked for it at all. */
+static void load_varinfo ( DebugInfo* di )
+{
+   if (VG_(clo_read_var_info))
+      VG_(di_load_dwarf)(di);
+}
+
 /* Add a zero-terminating byte to DST, which must be an XArray* of
    HChar. */
 static void zterm_XA ( XArray* dst )
@@ -4291,6 +4384,7 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
    /* End of performance-enhancing hack. */
 
    /* any var info at all? */
+   load_varinfo(di);
    if (!di->varinfo)
       return False;
 
@@ -4409,6 +4503,7 @@ Bool VG_(get_data_description)(
       if (!di->text_present || di->text_size == 0)
          continue;
       /* any var info at all? */
+      load_varinfo(di);
       if (!di->varinfo)
          continue;
       /* perhaps this object didn't contribute any vars at all? */
@@ -4735,6 +4830,7 @@ VG_(di_get_stack_blocks_at_ip)( Addr ip, Bool arrays_only )
    /* End of performance-enhancing hack. */
 
    /* any var info at all? */
+   load_varinfo(di);
    if (!di->varinfo)
       return res; /* currently empty */
 
@@ -4827,6 +4923,7 @@ VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle, Bool  arrays_only )
                        ML_(dinfo_free), sizeof(GlobalBlock) );
 
    /* any var info at all? */
+   load_varinfo(di);
    if (!di->varinfo)
       return gvars;
 
@@ -5169,7 +5266,7 @@ static void caches__invalidate ( void ) {
 void VG_(load_all_debuginfo) (void)
 {
    for (DebugInfo* di = debugInfo_list; di; di = di->next) {
-      VG_(di_load_di)(di);
+      VG_(di_load_dwarf)(di);
    }
 }
 #endif
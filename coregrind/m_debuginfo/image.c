@@ -39,26 +39,50 @@
 #include "pub_core_libcprint.h"
 #include "pub_core_libcproc.h"     /* VG_(read_millisecond_timer) */
 #include "pub_core_libcfile.h"
+#include "pub_core_aspacemgr.h"    /* VG_(am_mmap_file_float_valgrind) */
+#include "pub_core_options.h"
 #include "priv_misc.h"             /* dinfo_zalloc/free/strdup */
 #include "priv_image.h"            /* self */
 
+#include "priv_unzstd.h"         /* ML_(unzstd_mem_to_mem) */
+
 #include "minilzo.h"
 #define TINFL_HEADER_FILE_ONLY
 #include "tinfl.c"
 
-/* These values (1024 entries of 8192 bytes each) gives a cache
-   size of 8MB. */
+/* The cache holds blocks of 8192 bytes.  Each image may use between
+   CACHE_MIN_ENTRIES and CACHE_MAX_ENTRIES of them (8MB .. 32MB),
+   depending on the size of the underlying file; see
+   cache_limit_for_size.  Entries are allocated on demand, so small
+   files don't pay for the larger limit. */
 #define CACHE_ENTRY_SIZE_BITS (12+1)
-#define CACHE_N_ENTRIES       1024
+#define CACHE_MIN_ENTRIES     1024
+#define CACHE_MAX_ENTRIES     4096
 
 #define CACHE_ENTRY_SIZE      (1 << CACHE_ENTRY_SIZE_BITS)
 
+/* Number of hash chains used to find cache entries by block offset.
+   Must be a power of 2. */
+#define CACHE_N_BUCKETS       CACHE_MAX_ENTRIES
+
 #define COMPRESSED_SLICE_ARRAY_GROW_SIZE 64
 
+/* Limits for reading from a debuginfo server; see fetch_from_server.
+   The read-ahead sizes are in blocks. */
+#define SERVER_MAX_PENDING   4
+#define SERVER_MIN_RA_BLOCKS 2
+#define SERVER_MAX_RA_BLOCKS 32
+
+/* Feature bits in the server's reply (FEOK) to a FEAT request.  These
+   must agree with auxprogs/valgrind-di-server.c. */
+#define DI_FEAT_RDZS (1ULL << 0)  // RDZS: like READ, but zstd-compressed
+
 /* An entry in the cache. */
 typedef
-   struct {
+   struct _CEnt {
       Bool   fromC;  // True === contains decompressed data
+      Bool   ref;    // referenced since the clock hand last passed
+      struct _CEnt* hnext; // next in hash chain (non-fromC entries only)
       DiOffT off;    // file offset for data[0]
       SizeT  size;   // sizeof(data)
       SizeT  used;   // 1 .. sizeof(data), or 0 to denote not-in-use
@@ -73,6 +97,8 @@ typedef
       SizeT  szD;   // size of decompressed data
       DiOffT offC;  // offset of compressed data
       SizeT  szC;   // size of compressed data
+      DiCmpKind kind; // how it is compressed
+      CEnt*  ce;    // the decompressed data, or NULL if not yet needed
    }
    CSlc;
 
@@ -100,13 +126,25 @@ struct _DiImage {
    SizeT size;
    // Real size of image
    SizeT real_size;
-   // The number of entries used.  0 .. CACHE_N_ENTRIES
+   // If non-NULL, the whole of [0, real_size) is mapped here (see
+   // --debuginfo-mmap) and the block cache is used only for
+   // decompressed slices.
+   const UChar* map;
+   // The most recently used entry.  Never NULL: it points at
+   // empty_CEnt until something has been read.
+   CEnt* last;
+   // The number of entries used.  0 .. ces_limit
    UInt  ces_used;
-   // Pointers to the entries.  ces[0 .. ces_used-1] are non-NULL.
-   // ces[ces_used .. CACHE_N_ENTRIES-1] are NULL.
-   // The non-NULL entries may be arranged arbitrarily.  We expect to use
-   // a pseudo-LRU scheme though.
-   CEnt* ces[CACHE_N_ENTRIES];
+   // The maximum number of entries for this image.
+   UInt  ces_limit;
+   // Position of the clock hand used to choose the entry to recycle.
+   UInt  ces_hand;
+   // Pointers to the block entries.  ces[0 .. ces_used-1] are non-NULL,
+   // in no particular order.  Entries holding decompressed data are not
+   // in here; they hang off the CSlc they belong to instead.
+   CEnt* ces[CACHE_MAX_ENTRIES];
+   // Hash chains of the entries in ces[], keyed by block offset.
+   CEnt* buckets[CACHE_N_BUCKETS];
 
    // Array of compressed slices
    CSlc* cslc;
@@ -114,8 +152,25 @@ struct _DiImage {
    UInt  cslc_used;
    // Size of cslc array
    UInt  cslc_size;
+
+   // The rest of these fields are only used when reading from a
+   // debuginfo server.
+   // Does the server support RDZS, zstd-compressed reads?
+   Bool  srv_zstd;
+   // The read requests which have been sent, but whose replies have
+   // not yet been received, oldest first.
+   UInt  srv_n_pending;
+   struct { DiOffT off; SizeT len; } srv_pending[SERVER_MAX_PENDING];
+   // Where the next read-ahead request starts, and how many blocks it
+   // asks for.  Zero blocks means access isn't sequential, so don't.
+   DiOffT srv_ra_off;
+   UInt   srv_ra_blocks;
 };
 
+/* A CEnt with no data in it, so that DiImage.last can be dereferenced
+   without an is-it-NULL check on the fast path in get(). */
+static CEnt empty_CEnt;
+
 
 /* Sanity check code for CEnts. */
 static void pp_CEnt(const HChar* msg, CEnt* ce)
@@ -125,12 +180,12 @@ static void pp_CEnt(const HChar* msg, CEnt* ce)
                (ULong)ce->used, (ULong)ce->size, (ULong)ce->off);
 }
 
-static Bool is_sane_CEnt ( const HChar* who, const DiImage* img, UInt i )
+static Bool is_sane_CEnt ( const HChar* who, const DiImage* img,
+                           CEnt* ce )
 {
    vg_assert(img);
-   vg_assert(i <= CACHE_N_ENTRIES);
+   vg_assert(ce);
 
-   CEnt* ce = img->ces[i];
    if (!(ce->used <= ce->size)) goto fail;
    if (ce->fromC) {
       // ce->size can be anything, but ce->used must be either the
@@ -147,7 +202,7 @@ static Bool is_sane_CEnt ( const HChar* who, const DiImage* img, UInt i )
    return True;
 
  fail:
-   VG_(printf)("is_sane_CEnt[%u]: fail: %s\n", i, who);
+   VG_(printf)("is_sane_CEnt: fail: %s\n", who);
    pp_CEnt("failing CEnt", ce);
    return False;
 }
@@ -270,11 +325,9 @@ static void give_up__image_overrun(void)
    /*NOTREACHED*/
 }
 
-/* "Do" a transaction: that is, send the given frame to the server and
-   return the frame it sends back.  Caller owns the resulting frame
-   and must free it.  A NULL return means the transaction failed for
-   some reason. */
-static Frame* do_transaction ( Int sd, const Frame* req )
+/* Send the given frame to the server.  Returns False if that failed
+   for some reason. */
+static Bool send_Frame ( Int sd, const Frame* req )
 {
    if (0) VG_(printf)("CLIENT: send %c%c%c%c\n",
                       req->data[0], req->data[1], req->data[2], req->data[3]);
@@ -295,15 +348,22 @@ static Frame* do_transaction ( Int sd, const Frame* req )
    write_UInt_le(&wr_first8[0], adler);
 
    Int r = my_write(sd, &wr_first8[0], 8);
-   if (r != 8) return NULL;
+   if (r != 8) return False;
    vg_assert(req->n_data >= 4); // else ill formed -- no KIND field
    r = my_write(sd, req->data, req->n_data);
-   if (r != req->n_data) return NULL;
+   if (r != req->n_data) return False;
+   return True;
+}
 
-   /* So, the request is sent.  Now get a request of the same format
-      out of the channel. */
+/* Receive the next frame from the server.  Caller owns the resulting
+   frame and must free it.  A NULL return means that failed for some
+   reason. */
+static Frame* recv_Frame ( Int sd )
+{
+   /* Get a frame in the same format as send_Frame sends out of the
+      channel. */
    UChar rd_first8[8];  // adler32; length32
-   r = my_read(sd, &rd_first8[0], 8);
+   Int r = my_read(sd, &rd_first8[0], 8);
    if (r != 8) return NULL;
    UInt rd_adler = read_UInt_le(&rd_first8[0]);
    UInt rd_len   = read_UInt_le(&rd_first8[4]);
@@ -320,7 +380,7 @@ static Frame* do_transaction ( Int sd, const Frame* req )
                       res->data[0], res->data[1], res->data[2], res->data[3]);
 
    /* Compute the checksum for the received data, and check it. */
-   adler = VG_(adler32)(0, NULL, 0); // initial value
+   UInt adler = VG_(adler32)(0, NULL, 0); // initial value
    adler = VG_(adler32)(adler, &rd_first8[4], 4);
    if (res->n_data > 0)
       adler = VG_(adler32)(adler, res->data, res->n_data);
@@ -329,6 +389,18 @@ static Frame* do_transaction ( Int sd, const Frame* req )
    return res;
 }
 
+/* "Do" a transaction: that is, send the given frame to the server and
+   return the frame it sends back.  Caller owns the resulting frame
+   and must free it.  A NULL return means the transaction failed for
+   some reason.  There must be no READ requests outstanding; see
+   drain_server_requests. */
+static Frame* do_transaction ( Int sd, const Frame* req )
+{
+   if (!send_Frame(sd, req))
+      return NULL;
+   return recv_Frame(sd);
+}
+
 static void free_Frame ( Frame* fr )
 {
    vg_assert(fr && fr->data);
@@ -475,86 +547,126 @@ static inline Bool is_in_CEnt ( const CEnt* cent, DiOffT off )
    return off - cent->off < cent->used;
 }
 
-/* Returns pointer to CSlc or NULL */
+/* Returns pointer to CSlc or NULL.  Slices are added with increasing
+   offD (see ML_(img_mark_compressed_part)), so a binary search will
+   do. */
 static inline CSlc* find_cslc ( DiImage* img, DiOffT off )
 {
-   for (UInt i = 0; i < img->cslc_used; i++) {
-      if ( (img->cslc[i].offD <= off)
-           && (img->cslc[i].offD + img->cslc[i].szD > off)
-         )
-         return &img->cslc[i];
+   UInt lo = 0, hi = img->cslc_used;
+   while (lo < hi) {
+      UInt mid = lo + (hi - lo) / 2;
+      CSlc* cslc = &img->cslc[mid];
+      if (off < cslc->offD)
+         hi = mid;
+      else if (off >= cslc->offD + cslc->szD)
+         lo = mid + 1;
+      else
+         return cslc;
    }
    return NULL;
 }
 
-/* Allocate a new CEnt, connect it to |img|, and return its index. */
-static UInt alloc_CEnt ( DiImage* img, SizeT szB, Bool fromC )
+/* Cache statistics, shown by --stats=yes. */
+static ULong stats__n_slow     = 0; // lookups missing DiImage.last
+static ULong stats__n_hits     = 0; // .. found in the block cache
+static ULong stats__n_misses   = 0; // .. that needed a block read
+static ULong stats__n_recycled = 0; // .. of which recycled an entry
+static ULong stats__read_szB   = 0; // bytes read for those misses
+static ULong stats__n_mapped   = 0; // images mapped by --debuginfo-mmap
+static ULong stats__mapped_szB = 0; // .. and their total size
+static ULong stats__srv_requests    = 0; // READs sent to a di-server
+static ULong stats__srv_ra_requests = 0; // .. of which were read-ahead
+static ULong stats__srv_rx_szB      = 0; // compressed bytes received
+
+/* How many block entries may an image of |size| bytes use?  Allow
+   enough to hold an eighth of the file, within the limits given by
+   CACHE_MIN_ENTRIES and CACHE_MAX_ENTRIES. */
+static UInt cache_limit_for_size ( SizeT size )
+{
+   SizeT n = (size >> CACHE_ENTRY_SIZE_BITS) / 8;
+   if (n < CACHE_MIN_ENTRIES) n = CACHE_MIN_ENTRIES;
+   if (n > CACHE_MAX_ENTRIES) n = CACHE_MAX_ENTRIES;
+   return (UInt)n;
+}
+
+static inline UInt bucket_for ( DiOffT off )
+{
+   return (UInt)(off >> CACHE_ENTRY_SIZE_BITS) & (CACHE_N_BUCKETS-1);
+}
+
+/* Allocate a new CEnt with space for |szB| bytes of data. */
+static CEnt* alloc_CEnt ( SizeT szB, Bool fromC )
 {
-   vg_assert(img != NULL);
-   vg_assert(img->ces_used < CACHE_N_ENTRIES);
    if (fromC) {
       // szB can be arbitrary
    } else {
       vg_assert(szB == CACHE_ENTRY_SIZE);
    }
-   UInt entNo = img->ces_used;
-   img->ces_used++;
-   vg_assert(img->ces[entNo] == NULL);
-   img->ces[entNo] = ML_(dinfo_zalloc)("di.alloc_CEnt.1",
-                                       offsetof(CEnt, data) + szB);
-   img->ces[entNo]->size = szB;
-   img->ces[entNo]->fromC = fromC;
-   vg_assert(is_sane_CEnt("alloc_CEnt", img, entNo));
-   return entNo;
+   CEnt* ce = ML_(dinfo_zalloc)("di.alloc_CEnt.1",
+                                offsetof(CEnt, data) + szB);
+   ce->size = szB;
+   ce->fromC = fromC;
+   return ce;
 }
 
-static void realloc_CEnt ( DiImage* img, UInt entNo, SizeT szB, Bool fromC )
+/* Find the block entry containing |off|, or NULL. */
+static CEnt* lookup_CEnt ( const DiImage* img, DiOffT off )
 {
-   vg_assert(img != NULL);
-   vg_assert(fromC || szB >= CACHE_ENTRY_SIZE);
-   vg_assert(is_sane_CEnt("realloc_CEnt-pre", img, entNo));
-   img->ces[entNo] = ML_(dinfo_realloc)("di.realloc_CEnt.1",
-                                        img->ces[entNo],
-                                        offsetof(CEnt, data) + szB);
-}
-
-/* Move the given entry to the top and slide those above it down by 1,
-   to make space. */
-static void move_CEnt_to_top ( DiImage* img, UInt entNo )
-{
-   vg_assert(entNo < img->ces_used);
-   if (LIKELY(entNo == 1)) {
-      CEnt* tmp = img->ces[1];
-      img->ces[entNo] = img->ces[0];
-      img->ces[0] = tmp;
-   } else {
-      vg_assert(entNo > 1); // a.k.a. >= 2
-      CEnt* tmp = img->ces[entNo];
-      img->ces[entNo] = img->ces[entNo-1];
-      entNo--;
-      img->ces[entNo] = img->ces[entNo-1];
-      entNo--;
-      while (entNo > 0) {
-         img->ces[entNo] = img->ces[entNo-1];
-         entNo--;
-      }
-      img->ces[0] = tmp;
+   DiOffT boff = block_round_down(off);
+   CEnt*  ce;
+   for (ce = img->buckets[bucket_for(boff)]; ce != NULL; ce = ce->hnext) {
+      if (ce->off == boff)
+         return ce;
    }
+   return NULL;
+}
+
+static void hash_CEnt ( DiImage* img, CEnt* ce )
+{
+   UInt b = bucket_for(ce->off);
+   ce->hnext = img->buckets[b];
+   img->buckets[b] = ce;
+}
+
+static void unhash_CEnt ( DiImage* img, CEnt* ce )
+{
+   CEnt** pp = &img->buckets[bucket_for(ce->off)];
+   while (*pp != ce) {
+      vg_assert(*pp != NULL);
+      pp = &(*pp)->hnext;
+   }
+   *pp = ce->hnext;
+   ce->hnext = NULL;
 }
 
-/* Set the given entry so that it has a chunk of the file containing
-   the given offset.  It is this function that brings data into the
-   cache, either by reading the local file or pulling it from the
-   remote server. */
-static void set_CEnt ( const DiImage* img, UInt entNo, DiOffT off )
+/* Choose a block entry to recycle, using the clock algorithm: sweep
+   round ces[], giving each entry that has been used since the hand
+   last passed it a second chance.  This approximates LRU without
+   having to reorder anything on a hit. */
+static CEnt* choose_CEnt_to_recycle ( DiImage* img )
+{
+   vg_assert(img->ces_used > 0);
+   while (True) {
+      if (img->ces_hand >= img->ces_used)
+         img->ces_hand = 0;
+      CEnt* ce = img->ces[img->ces_hand++];
+      if (!ce->ref)
+         return ce;
+      ce->ref = False;
+   }
+}
+
+/* Set the given entry so that it has a chunk of the local file
+   containing the given offset.  It is this function that brings data
+   into the cache from a local file; for a remote server, see
+   fetch_from_server. */
+static void set_CEnt ( const DiImage* img, CEnt* ce, DiOffT off )
 {
    SizeT len;
    DiOffT off_orig = off;
    vg_assert(img != NULL);
-   vg_assert(img->ces_used <= CACHE_N_ENTRIES);
-   vg_assert(entNo < img->ces_used);
+   vg_assert(img->source.is_local);
    vg_assert(off < img->real_size);
-   CEnt* ce = img->ces[entNo];
    vg_assert(ce != NULL);
    /* Compute [off, +len) as the slice we are going to read. */
    off = block_round_down(off);
@@ -580,270 +692,412 @@ static void set_CEnt ( const DiImage* img, UInt entNo, DiOffT off )
                   nread, len, off, delay);
    }
 
-   if (img->source.is_local) {
-      // Simple: just read it
-
-      // PJF not quite so simple - see
-      // https://bugs.kde.org/show_bug.cgi?id=480405
-      // if img->source.fd was opened with O_DIRECT the memory needs
-      // to be aligned and also the length
-      // that's a lot of hassle just to take a quick peek to see if
-      // is an ELF binary so just twiddle the flag before and after
-      // peeking.
-      // This doesn't seem to be a problem on FreeBSD. I haven't tested
-      // on macOS or Solaris, hence the conditional compilation
+   // Simple: just read it
+
+   // PJF not quite so simple - see
+   // https://bugs.kde.org/show_bug.cgi?id=480405
+   // if img->source.fd was opened with O_DIRECT the memory needs
+   // to be aligned and also the length
+   // that's a lot of hassle just to take a quick peek to see if
+   // is an ELF binary so just twiddle the flag before and after
+   // peeking.
+   // This doesn't seem to be a problem on FreeBSD. I haven't tested
+   // on macOS or Solaris, hence the conditional compilation
 #if defined(VKI_O_DIRECT)
-      Int flags = VG_(fcntl)(img->source.fd, VKI_F_GETFL, 0);
-      if (flags & VKI_O_DIRECT) {
-          VG_(fcntl)(img->source.fd, VKI_F_SETFL, flags & ~VKI_O_DIRECT);
-      }
+   Int flags = VG_(fcntl)(img->source.fd, VKI_F_GETFL, 0);
+   if (flags & VKI_O_DIRECT) {
+       VG_(fcntl)(img->source.fd, VKI_F_SETFL, flags & ~VKI_O_DIRECT);
+   }
 #endif
-      SysRes sr = VG_(pread)(img->source.fd, &ce->data[0], (Int)len, off);
+   SysRes sr = VG_(pread)(img->source.fd, &ce->data[0], (Int)len, off);
 #if defined(VKI_O_DIRECT)
-      if (flags & VKI_O_DIRECT) {
-         VG_(fcntl)(img->source.fd, VKI_F_SETFL, flags);
-      }
-#endif
-      vg_assert(!sr_isError(sr));
-   } else {
-      // Not so simple: poke the server
-      vg_assert(img->source.session_id > 0);
-      Frame* req
-         = mk_Frame_le64_le64_le64("READ", img->source.session_id, off, len);
-      Frame* res = do_transaction(img->source.fd, req);
-      free_Frame(req); req = NULL;
-      if (!res) goto server_fail;
-      ULong  rx_session_id = 0, rx_off = 0, rx_len = 0, rx_zdata_len = 0;
-      UChar* rx_data = NULL;
-      /* Pretty confusing.  rx_sessionid, rx_off and rx_len are copies
-         of the values that we requested in the READ frame just above,
-         so we can be sure that the server is responding to the right
-         request.  It just copies them from the request into the
-         response.  rx_data is the actual data, and rx_zdata_len is
-         its compressed length.  Hence rx_len must equal len, but
-         rx_zdata_len can be different -- smaller, hopefully.. */
-      if (!parse_Frame_le64_le64_le64_bytes
-          (res, "RDOK", &rx_session_id, &rx_off,
-                        &rx_len, &rx_data, &rx_zdata_len))
-         goto server_fail;
-      if (rx_session_id != img->source.session_id
-          || rx_off != off || rx_len != len || rx_data == NULL)
-         goto server_fail;
-
-      //VG_(memcpy)(&ce->data[0], rx_data, len);
-      // Decompress into the destination buffer
-      // Tell the lib the max number of output bytes it can write.
-      // After the call, this holds the number of bytes actually written,
-      // and it's an error if it is different.
-      lzo_uint out_len = len;
-      Int lzo_rc = lzo1x_decompress_safe(rx_data, rx_zdata_len,
-                                         &ce->data[0], &out_len,
-                                         NULL);
-      Bool ok = lzo_rc == LZO_E_OK && out_len == len;
-      if (!ok) goto server_fail;
-
-      free_Frame(res); res = NULL;
-      goto end_of_else_clause;
-     server_fail:
-      /* The server screwed up somehow.  Now what? */
-      if (res) {
-         UChar* reason = NULL;
-         if (parse_Frame_asciiz(res, "FAIL", &reason)) {
-            VG_(umsg)("set_CEnt (reading data from DI server): fail: "
-                      "%s\n", reason);
-         } else {
-            VG_(umsg)("set_CEnt (reading data from DI server): fail: "
-                      "unknown reason\n");
-         }
-         free_Frame(res); res = NULL;
-      } else {
-         VG_(umsg)("set_CEnt (reading data from DI server): fail: "
-                   "server unexpectedly closed the connection\n");
-      }
-      give_up__comms_lost();
-      /* NOTREACHED */
-      vg_assert(0);
-     end_of_else_clause:
-      {}
+   if (flags & VKI_O_DIRECT) {
+      VG_(fcntl)(img->source.fd, VKI_F_SETFL, flags);
    }
-   
+#endif
+   vg_assert(!sr_isError(sr));
+
    ce->off  = off;
    ce->used = len;
    ce->fromC = False;
-   vg_assert(ce == img->ces[entNo]);
-   vg_assert(is_sane_CEnt("set_CEnt", img, entNo));
+   vg_assert(is_sane_CEnt("set_CEnt", img, ce));
 }
 
-__attribute__((noinline))
-static UChar get_slowcase ( DiImage* img, DiOffT off )
+/* Get a block entry to fill with new data: a fresh one if |img| is
+   below its limit, otherwise a recycled one.  The result is not in the
+   hash chains. */
+static CEnt* get_free_CEnt ( DiImage* img )
 {
-   /* Stay sane .. */
-   vg_assert(off < img->size);
-   vg_assert(img->ces_used <= CACHE_N_ENTRIES);
-   UInt i;
-   /* Start the search at entry 1, since the fast-case function
-      checked slot zero already. */
-   for (i = 1; i < img->ces_used; i++) {
-      vg_assert(img->ces[i]);
-      if (is_in_CEnt(img->ces[i], off))
-         break;
+   CEnt* ce;
+   if (img->ces_used < img->ces_limit) {
+      ce = alloc_CEnt(CACHE_ENTRY_SIZE, False/*!fromC*/);
+      img->ces[img->ces_used++] = ce;
+   } else {
+      stats__n_recycled++;
+      ce = choose_CEnt_to_recycle(img);
+      unhash_CEnt(img, ce);
    }
-   vg_assert(i >= 1);
+   return ce;
+}
 
-   if (LIKELY(i < img->ces_used)) {
-      // Found it.  Move to the top and stop.
-      move_CEnt_to_top(img, i);
-      vg_assert(is_in_CEnt(img->ces[0], off));
-      return img->ces[0]->data[ off - img->ces[0]->off ];
+/* Reading from a debuginfo server.  To hide the round trip time, we
+   don't wait for each READ to complete before sending the next: up to
+   SERVER_MAX_PENDING requests may be outstanding, and the server
+   answers them in order.  When the blocks of the file are being
+   requested sequentially, we also read ahead, asking for a run of
+   following blocks in a single request (and hence a single reply),
+   and double the length of the run each time the read-ahead turns out
+   to be useful, up to SERVER_MAX_RA_BLOCKS. */
+
+/* If we lost communication with the remote server, or it sent us
+   something we didn't ask for, give up. */
+static void server_fail ( Frame* res, const HChar* who )
+{
+   if (res) {
+      UChar* reason = NULL;
+      if (parse_Frame_asciiz(res, "FAIL", &reason)) {
+         VG_(umsg)("%s (reading data from DI server): fail: %s\n",
+                   who, reason);
+      } else {
+         VG_(umsg)("%s (reading data from DI server): fail: "
+                   "unknown reason\n", who);
+      }
+      free_Frame(res);
+   } else {
+      VG_(umsg)("%s (reading data from DI server): fail: "
+                "server unexpectedly closed the connection\n", who);
    }
+   give_up__comms_lost();
+   /* NOTREACHED */
+   vg_assert(0);
+}
 
-   vg_assert(i <= img->ces_used);
-
-   // It's not in any entry.  Either allocate a new one or recycle the LRU
-   // one.  This is where the presence of compressed sections makes things
-   // tricky.  There are 4 cases to consider:
-   //
-   // (1) not from a compressed slice, we can allocate a new entry
-   // (2) not from a compressed slice, we have to recycle the LRU entry
-   // (3) from a compressed slice, we can allocate a new entry
-   // (4) from a compressed slice, we have to recycle the LRU entry
-   //
-   // Cases (3) and (4) are complex because we will have to call
-   // ML_(img_get_some) to get the compressed data.  But this function is
-   // reachable from ML_(img_get_some), so we may re-enter get_slowcase a
-   // second time as a result.  Given that the compressed data will be cause
-   // only cases (1) and (2) to happen, this guarantees no infinite recursion.
-   // It does however mean that we can't carry (in this function invokation)
-   // any local copies of the overall cache state across the ML_(img_get_some)
-   // call, since it may become invalidated by the recursive call to
-   // get_slowcase.
-
-   // First of all, see if it is in a compressed slice, and if so, pull the
-   // compressed data into an intermediate buffer.  Given the preceding
-   // comment, this is a safe place to do it, since we are not carrying any
-   // cache state here apart from the knowledge that the requested offset is
-   // not in the cache at all, and the recursive call won't change that fact.
-
-   CSlc* cslc = find_cslc(img, off);
-   UChar* cbuf = NULL;
-   if (cslc != NULL) {
-      SizeT len = 0;
-      cbuf = ML_(dinfo_zalloc)("di.image.get_slowcase.cbuf-1", cslc->szC);
-      // get compressed data
-      while (len < cslc->szC)
-         len += ML_(img_get_some)(cbuf + len, img, cslc->offC + len,
-                                  cslc->szC - len);
+/* Ask the server for [off, +len) of the file, but don't wait for the
+   reply. */
+static void send_read_request ( DiImage* img, DiOffT off, SizeT len )
+{
+   vg_assert(img->srv_n_pending < SERVER_MAX_PENDING);
+   vg_assert(len > 0 && off + len <= img->real_size);
+   vg_assert(img->source.session_id > 0);
+   Frame* req = mk_Frame_le64_le64_le64(img->srv_zstd ? "RDZS" : "READ",
+                                        img->source.session_id, off, len);
+   Bool ok = send_Frame(img->source.fd, req);
+   free_Frame(req);
+   if (!ok)
+      server_fail(NULL, "send_read_request");
+   img->srv_pending[img->srv_n_pending].off = off;
+   img->srv_pending[img->srv_n_pending].len = len;
+   img->srv_n_pending++;
+   stats__srv_requests++;
+}
+
+/* Receive the reply to the oldest outstanding request, and put the
+   blocks it carries into the cache, except for those which are there
+   already.  The block at |want| (if any) is marked as referenced;
+   the others are not, so they are the first to go if they turn out
+   not to be needed. */
+static void recv_read_reply ( DiImage* img, DiOffT want )
+{
+   vg_assert(img->srv_n_pending > 0);
+   DiOffT off = img->srv_pending[0].off;
+   SizeT  len = img->srv_pending[0].len;
+   img->srv_n_pending--;
+   VG_(memmove)(&img->srv_pending[0], &img->srv_pending[1],
+                img->srv_n_pending * sizeof(img->srv_pending[0]));
+
+   Frame* res = recv_Frame(img->source.fd);
+   if (!res)
+      server_fail(NULL, "recv_read_reply");
+   ULong  rx_session_id = 0, rx_off = 0, rx_len = 0, rx_zdata_len = 0;
+   UChar* rx_data = NULL;
+   /* Pretty confusing.  rx_sessionid, rx_off and rx_len are copies
+      of the values that we requested in the READ frame, so we can be
+      sure that the server is responding to the right request.  It
+      just copies them from the request into the response.  rx_data is
+      the actual data, and rx_zdata_len is its compressed length.
+      Hence rx_len must equal len, but rx_zdata_len can be different
+      -- smaller, hopefully.. */
+   if (!parse_Frame_le64_le64_le64_bytes
+       (res, img->srv_zstd ? "RDZK" : "RDOK", &rx_session_id, &rx_off,
+                                              &rx_len, &rx_data, &rx_zdata_len))
+      server_fail(res, "recv_read_reply");
+   if (rx_session_id != img->source.session_id
+       || rx_off != off || rx_len != len || rx_data == NULL)
+      server_fail(res, "recv_read_reply");
+
+   // Decompress into a temporary buffer.
+   UChar* buf = ML_(dinfo_zalloc)("di.image.recv_read_reply.1", len);
+   Bool ok;
+   if (img->srv_zstd) {
+      ok = ML_(unzstd_mem_to_mem)(buf, len, rx_data, rx_zdata_len) == len;
+   } else {
+      // Tell the lib the max number of output bytes it can write.
+      // After the call, this holds the number of bytes actually
+      // written, and it's an error if it is different.
+      lzo_uint out_len = len;
+      Int lzo_rc = lzo1x_decompress_safe(rx_data, rx_zdata_len,
+                                         buf, &out_len, NULL);
+      ok = lzo_rc == LZO_E_OK && out_len == len;
+   }
+   if (!ok) {
+      ML_(dinfo_free)(buf);
+      server_fail(res, "recv_read_reply");
    }
+   stats__srv_rx_szB += rx_zdata_len;
+   free_Frame(res);
 
-   // Now we can do what we like.
-   vg_assert((cslc == NULL && cbuf == NULL) || (cslc != NULL && cbuf != NULL));
-
-   // Note, we can't capture this earlier, for exactly the reasons detailed
-   // above.
-   UInt ces_used_at_entry = img->ces_used;
-
-   // This is the size of the CEnt that we want to have after allocation or
-   // recycling.
-   SizeT size = (cslc == NULL) ? CACHE_ENTRY_SIZE : cslc->szD;
-
-   // Cases (1) and (3)
-   if (img->ces_used < CACHE_N_ENTRIES) {
-      /* Allocate a new cache entry, and fill it in. */
-      i = alloc_CEnt(img, size, /*fromC?*/cslc != NULL);
-      if (cslc == NULL) {
-         set_CEnt(img, i, off);
-         img->ces[i]->fromC = False;
-         vg_assert(is_sane_CEnt("get_slowcase-case-1", img, i));
-         vg_assert(img->ces_used == ces_used_at_entry + 1);
-      } else {
-         SizeT len = tinfl_decompress_mem_to_mem(
-                        img->ces[i]->data, cslc->szD,
-                        cbuf, cslc->szC,
-                        TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
-                        | TINFL_FLAG_PARSE_ZLIB_HEADER);
-         vg_assert(len == cslc->szD); // sanity check on data, FIXME
-         vg_assert(cslc->szD == size);
-         img->ces[i]->used = cslc->szD;
-         img->ces[i]->off = cslc->offD;
-         img->ces[i]->fromC = True;
-         vg_assert(is_sane_CEnt("get_slowcase-case-3", img, i));
-         vg_assert(img->ces_used == ces_used_at_entry + 1);
-      }
-      vg_assert(img->ces_used == ces_used_at_entry + 1);
-      if (i > 0) {
-         move_CEnt_to_top(img, i);
-         i = 0;
-      }
-      vg_assert(is_in_CEnt(img->ces[i], off));
-      if (cbuf != NULL) {
-         ML_(dinfo_free)(cbuf);
-      }
-      return img->ces[i]->data[ off - img->ces[i]->off ];
+   // And move it into the cache, a block at a time.
+   SizeT done;
+   for (done = 0; done < len; done += CACHE_ENTRY_SIZE) {
+      DiOffT boff = off + done;
+      vg_assert(boff == block_round_down(boff));
+      if (lookup_CEnt(img, boff) != NULL)
+         continue;
+      CEnt* ce = get_free_CEnt(img);
+      ce->off   = boff;
+      ce->used  = len - done < CACHE_ENTRY_SIZE ? len - done
+                                                : CACHE_ENTRY_SIZE;
+      ce->fromC = False;
+      ce->ref   = boff == want;
+      VG_(memcpy)(&ce->data[0], &buf[done], ce->used);
+      vg_assert(is_sane_CEnt("recv_read_reply", img, ce));
+      hash_CEnt(img, ce);
+      stats__read_szB += ce->used;
    }
+   ML_(dinfo_free)(buf);
+}
 
-   // Cases (2) and (4)
-   /* All entries in use.  Recycle the (ostensibly) LRU one.  But try to find
-      a non-fromC entry to recycle, though, since discarding and reloading
-      fromC entries is very expensive.  The result is that -- unless all
-      CACHE_N_ENTRIES wind up being used by decompressed slices, which is
-      highly unlikely -- we'll wind up keeping all the decompressed data in
-      the cache for its entire remaining life.  We could probably do better
-      but it would make the cache management even more complex. */
-   vg_assert(img->ces_used == CACHE_N_ENTRIES);
-
-   // Select entry to recycle.
-   for (i = CACHE_N_ENTRIES-1; i > 0; i--) {
-      if (!img->ces[i]->fromC)
+/* Receive the replies to all outstanding requests.  This must be done
+   before any other kind of transaction with the server. */
+static void drain_server_requests ( DiImage* img )
+{
+   while (img->srv_n_pending > 0)
+      recv_read_reply(img, DiOffT_INVALID);
+}
+
+/* If access is sequential, ask for the next run of blocks, and double
+   the run length for next time. */
+static void send_readahead_request ( DiImage* img )
+{
+   if (img->srv_ra_blocks == 0
+       || img->srv_n_pending == SERVER_MAX_PENDING
+       || img->srv_ra_off >= img->real_size)
+      return;
+   SizeT len = (SizeT)img->srv_ra_blocks * CACHE_ENTRY_SIZE;
+   if (len > img->real_size - img->srv_ra_off)
+      len = img->real_size - img->srv_ra_off;
+   send_read_request(img, img->srv_ra_off, len);
+   stats__srv_ra_requests++;
+   img->srv_ra_off += len;
+   if (img->srv_ra_blocks < SERVER_MAX_RA_BLOCKS)
+      img->srv_ra_blocks *= 2;
+}
+
+/* Get the block containing |off| from the server into the cache, and
+   return its entry. */
+static CEnt* fetch_from_server ( DiImage* img, DiOffT off )
+{
+   DiOffT boff = block_round_down(off);
+   UInt   i;
+
+   /* If we asked for it already, wait for it to arrive.  The pending
+      requests other than the most recent demand fetch are all
+      read-aheads, so this also tells us that the read-ahead paid
+      off; ask for the next run. */
+   for (i = 0; i < img->srv_n_pending; i++) {
+      if (boff - img->srv_pending[i].off < img->srv_pending[i].len)
          break;
    }
-   vg_assert(i < CACHE_N_ENTRIES);
-
-   realloc_CEnt(img, i, size, /*fromC?*/cslc != NULL);
-   img->ces[i]->size = size;
-   img->ces[i]->used = 0;
-   if (cslc == NULL) {
-      set_CEnt(img, i, off);
-      img->ces[i]->fromC = False;
-      vg_assert(is_sane_CEnt("get_slowcase-case-2", img, i));
+   if (i < img->srv_n_pending) {
+      for (; i > 0; i--)
+         recv_read_reply(img, DiOffT_INVALID);
+      recv_read_reply(img, boff);
+      send_readahead_request(img);
    } else {
-      SizeT len = tinfl_decompress_mem_to_mem(
-                     img->ces[i]->data, cslc->szD,
-                     cbuf, cslc->szC,
-                     TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
-                     | TINFL_FLAG_PARSE_ZLIB_HEADER);
-      vg_assert(len == size);
-      img->ces[i]->used = size;
-      img->ces[i]->off = cslc->offD;
-      img->ces[i]->fromC = True;
-      vg_assert(is_sane_CEnt("get_slowcase-case-4", img, i));
+      /* A plain miss.  If it's just after the last block we asked
+         for, start reading ahead; if not, stop. */
+      if (boff == img->srv_ra_off) {
+         if (img->srv_ra_blocks == 0)
+            img->srv_ra_blocks = SERVER_MIN_RA_BLOCKS;
+      } else {
+         img->srv_ra_blocks = 0;
+      }
+      SizeT len = img->real_size - boff;
+      if (len > CACHE_ENTRY_SIZE)
+         len = CACHE_ENTRY_SIZE;
+      if (img->srv_n_pending == SERVER_MAX_PENDING)
+         recv_read_reply(img, DiOffT_INVALID);
+      send_read_request(img, boff, len);
+      i = img->srv_n_pending - 1;
+      img->srv_ra_off = boff + len;
+      /* Send the read-ahead request before waiting for the reply to
+         this one, so that the server can get on with it meanwhile. */
+      send_readahead_request(img);
+      /* Wait for replies up to and including the one for |boff|. */
+      for (; i > 0; i--)
+         recv_read_reply(img, DiOffT_INVALID);
+      vg_assert(img->srv_pending[0].off == boff);
+      recv_read_reply(img, boff);
    }
-   vg_assert(img->ces_used == ces_used_at_entry);
-   if (i > 0) {
-      move_CEnt_to_top(img, i);
-      i = 0;
+
+   /* It's conceivable, but very unlikely, that a big read-ahead reply
+      received after the one we wanted caused its entry to be
+      recycled.  In which case, fetch just that block again. */
+   CEnt* ce = lookup_CEnt(img, boff);
+   if (UNLIKELY(ce == NULL)) {
+      drain_server_requests(img);
+      send_read_request(img, boff, img->real_size - boff < CACHE_ENTRY_SIZE
+                                   ? img->real_size - boff : CACHE_ENTRY_SIZE);
+      recv_read_reply(img, boff);
+      ce = lookup_CEnt(img, boff);
    }
-   vg_assert(is_in_CEnt(img->ces[i], off));
-   if (cbuf != NULL) {
-      ML_(dinfo_free)(cbuf);
+   vg_assert(ce != NULL);
+   return ce;
+}
+
+/* Decompression statistics, per DiCmpKind, shown by --stats=yes. */
+static ULong stats__n_decomp[2]    = { 0, 0 };
+static ULong stats__decomp_szC[2]  = { 0, 0 };
+static ULong stats__decomp_szD[2]  = { 0, 0 };
+static ULong stats__decomp_msec[2] = { 0, 0 };
+
+/* Decompress |cbuf|, holding the compressed data of |cslc|, into
+   |dst|, which must have space for cslc->szD bytes. */
+static void decompress_CSlc ( UChar* dst, const CSlc* cslc, const UChar* cbuf )
+{
+   SizeT len = 0;
+   UInt  t0  = VG_(read_millisecond_timer)();
+
+   switch (cslc->kind) {
+      case DiCmp_ZLIB:
+         len = tinfl_decompress_mem_to_mem(
+                  dst, cslc->szD, cbuf, cslc->szC,
+                  TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF
+                  | TINFL_FLAG_PARSE_ZLIB_HEADER);
+         break;
+      case DiCmp_ZSTD:
+         len = ML_(unzstd_mem_to_mem)(dst, cslc->szD, cbuf, cslc->szC);
+         break;
+      default:
+         vg_assert(0);
+   }
+   vg_assert(len == cslc->szD); // sanity check on data, FIXME
+
+   stats__n_decomp[cslc->kind]++;
+   stats__decomp_szC[cslc->kind]  += cslc->szC;
+   stats__decomp_szD[cslc->kind]  += cslc->szD;
+   stats__decomp_msec[cslc->kind] += VG_(read_millisecond_timer)() - t0;
+}
+
+__attribute__((noinline))
+static UChar get_slowcase ( DiImage* img, DiOffT off )
+{
+   /* Stay sane .. */
+   vg_assert(off < img->size);
+   vg_assert(img->ces_used <= img->ces_limit);
+   stats__n_slow++;
+
+   CEnt* ce;
+
+   if (off >= img->real_size) {
+      // It's in a compressed slice.  Each slice is decompressed in one
+      // go the first time it is needed, and then kept for the rest of
+      // the life of the image, since discarding and reloading it is
+      // very expensive.
+      CSlc* cslc = find_cslc(img, off);
+      vg_assert(cslc != NULL);
+      if (cslc->ce == NULL) {
+         // Get the compressed data.  This calls back into get_slowcase
+         // for the underlying blocks, which is fine: we're not holding
+         // any cache state across the call.
+         UChar* cbuf = ML_(dinfo_zalloc)("di.image.get_slowcase.cbuf-1",
+                                         cslc->szC);
+         SizeT len = 0;
+         while (len < cslc->szC)
+            len += ML_(img_get_some)(cbuf + len, img, cslc->offC + len,
+                                     cslc->szC - len);
+         ce = alloc_CEnt(cslc->szD, True/*fromC*/);
+         decompress_CSlc(ce->data, cslc, cbuf);
+         ce->used = cslc->szD;
+         ce->off  = cslc->offD;
+         vg_assert(is_sane_CEnt("get_slowcase-decompress", img, ce));
+         ML_(dinfo_free)(cbuf);
+         cslc->ce = ce;
+      } else {
+         stats__n_hits++;
+      }
+      ce = cslc->ce;
+   } else {
+      ce = lookup_CEnt(img, off);
+      if (LIKELY(ce != NULL)) {
+         stats__n_hits++;
+      } else {
+         // Not in the cache.  Either allocate a new entry or recycle
+         // one, and read the block into it.
+         stats__n_misses++;
+         if (img->source.is_local) {
+            ce = get_free_CEnt(img);
+            set_CEnt(img, ce, off);
+            hash_CEnt(img, ce);
+            stats__read_szB += ce->used;
+         } else {
+            ce = fetch_from_server(img, off);
+         }
+      }
+      ce->ref = True;
    }
-   return img->ces[i]->data[ off - img->ces[i]->off ];
+
+   vg_assert(is_in_CEnt(ce, off));
+   img->last = ce;
+   return ce->data[ off - ce->off ];
 }
 
 // This is called a lot, so do the usual fast/slow split stuff on it. */
 static inline UChar get ( DiImage* img, DiOffT off )
 {
-   /* Most likely case is, it's in the ces[0] position. */
-   /* ML_(img_from_local_file) requests a read for ces[0] when
-      creating the image.  Hence slot zero is always non-NULL, so we
-      can skip this test. */
-   if (LIKELY(/* img->ces[0] != NULL && */
-              is_in_CEnt(img->ces[0], off))) {
-      return img->ces[0]->data[ off - img->ces[0]->off ];
+   /* If the file is mapped, reading it is trivial. */
+   if (img->map != NULL && off < img->real_size)
+      return img->map[off];
+   /* Otherwise the most likely case is, it's in the same entry as the
+      previous access.  img->last is never NULL, so we can skip that
+      test. */
+   if (LIKELY(is_in_CEnt(img->last, off))) {
+      return img->last->data[ off - img->last->off ];
    }
    /* Else we'll have to fish around for it. */
    return get_slowcase(img, off);
 }
 
+/* Set up the cache for the newly created |img|.  For a local file,
+   when --debuginfo-mmap=yes, first try to map the whole file instead,
+   so that reads of it don't go through the cache at all. */
+static void init_cache ( DiImage* img )
+{
+   /* img->ces and img->buckets are already zeroed out */
+   img->map       = NULL;
+   img->last      = &empty_CEnt;
+   img->ces_used  = 0;
+   img->ces_limit = cache_limit_for_size(img->real_size);
+   img->ces_hand  = 0;
+
+   if (img->source.is_local && VG_(clo_debuginfo_mmap)) {
+      SysRes sres
+         = VG_(am_mmap_file_float_valgrind)(VG_PGROUNDUP(img->real_size),
+                                            VKI_PROT_READ, img->source.fd, 0);
+      if (!sr_isError(sres)) {
+         img->map = (const UChar*)sr_Res(sres);
+         stats__n_mapped++;
+         stats__mapped_szB += img->real_size;
+         return;
+      }
+      /* Fall back to reading the file through the cache. */
+   }
+
+   /* Read in the first chunk of the file.  That's likely to be the
+      first part that's requested anyway. */
+   (void)get_slowcase(img, 0);
+}
+
 /* Create an image from a file in the local filesystem.  This is
    relatively straightforward. */
 DiImage* ML_(img_from_local_file)(const HChar* fullpath)
@@ -874,22 +1128,13 @@ DiImage* ML_(img_from_local_file)(const HChar* fullpath)
    img->source.fd       = sr_Res(fd);
    img->size            = size;
    img->real_size       = size;
-   img->ces_used        = 0;
    img->source.name     = ML_(dinfo_strdup)("di.image.ML_iflf.2", fullpath);
    img->cslc            = NULL;
    img->cslc_size       = 0;
    img->cslc_used       = 0;
-   /* img->ces is already zeroed out */
    vg_assert(img->source.fd >= 0);
 
-   /* Force the zeroth entry to be the first chunk of the file.
-      That's likely to be the first part that's requested anyway, and
-      loading it at this point forcing img->cent[0] to always be
-      non-empty, thereby saving us an is-it-empty check on the fast
-      path in get(). */
-   UInt entNo = alloc_CEnt(img, CACHE_ENTRY_SIZE, False/*!fromC*/);
-   vg_assert(entNo == 0);
-   set_CEnt(img, 0, 0);
+   init_cache(img);
 
    return img;
 }
@@ -916,22 +1161,13 @@ DiImage* ML_(img_from_fd)(Int fd, const HChar* fullpath)
    img->source.fd       = fd;
    img->size            = size;
    img->real_size       = size;
-   img->ces_used        = 0;
    img->source.name     = ML_(dinfo_strdup)("di.image.ML_iflf.2", fullpath);
    img->cslc            = NULL;
    img->cslc_size       = 0;
    img->cslc_used       = 0;
-   /* img->ces is already zeroed out */
    vg_assert(img->source.fd >= 0);
 
-   /* Force the zeroth entry to be the first chunk of the file.
-      That's likely to be the first part that's requested anyway, and
-      loading it at this point forcing img->cent[0] to always be
-      non-empty, thereby saving us an is-it-empty check on the fast
-      path in get(). */
-   UInt entNo = alloc_CEnt(img, CACHE_ENTRY_SIZE, False/*!fromC*/);
-   vg_assert(entNo == 0);
-   set_CEnt(img, 0, 0);
+   init_cache(img);
 
    return img;
 }
@@ -986,6 +1222,21 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
    req = NULL;
    res = NULL;
 
+   /* Ask which protocol extensions it supports.  Servers which predate
+      the FEAT request reply with FAIL, in which case we stick to the
+      original requests. */
+   req = mk_Frame_noargs("FEAT");
+   res = do_transaction(sd, req);
+   if (res == NULL)
+      goto fail;
+   ULong features = 0;
+   if (!parse_Frame_le64(res, "FEOK", &features))
+      features = 0;
+   free_Frame(req);
+   free_Frame(res);
+   req = NULL;
+   res = NULL;
+
    /* Server seems plausible.  Present it with the name of the file we
       want and see if it'll give us back a session ID for it. */
    req = mk_Frame_asciiz("OPEN", filename);
@@ -1007,7 +1258,6 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
    img->source.session_id = session_id;
    img->size              = size;
    img->real_size         = size;
-   img->ces_used          = 0;
    img->source.name       = ML_(dinfo_zalloc)("di.image.ML_ifds.2",
                                               20 + VG_(strlen)(filename)
                                                  + VG_(strlen)(serverAddr));
@@ -1015,15 +1265,13 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
    img->cslc            = NULL;
    img->cslc_size       = 0;
    img->cslc_used       = 0;
-
-   /* img->ces is already zeroed out */
+   img->srv_zstd        = (features & DI_FEAT_RDZS) != 0;
+   img->srv_n_pending   = 0;
+   img->srv_ra_off      = DiOffT_INVALID;
+   img->srv_ra_blocks   = 0;
    vg_assert(img->source.fd >= 0);
 
-   /* See comment on equivalent bit in ML_(img_from_local_file) for
-      rationale. */
-   UInt entNo = alloc_CEnt(img, CACHE_ENTRY_SIZE, False/*!fromC*/);
-   vg_assert(entNo == 0);
-   set_CEnt(img, 0, 0);
+   init_cache(img);
 
    return img;
 
@@ -1047,8 +1295,8 @@ DiImage* ML_(img_from_di_server)(const HChar* filename,
    return NULL;
 }
 
-DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
-                                     SizeT szD)
+DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiCmpKind kind,
+                                     DiOffT offset, SizeT szC, SizeT szD)
 {
    DiOffT ret;
    vg_assert(img != NULL);
@@ -1065,25 +1313,82 @@ DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
    img->cslc[img->cslc_used].szC = szC;
    img->cslc[img->cslc_used].offD = img->size;
    img->cslc[img->cslc_used].szD = szD;
+   img->cslc[img->cslc_used].kind = kind;
+   img->cslc[img->cslc_used].ce = NULL;
    img->size += szD;
    img->cslc_used++;
    return ret;
 }
 
+void ML_(img_print_stats)(void)
+{
+   static const HChar* names[2] = { "zlib", "zstd" };
+   UInt k;
+   VG_(message)(Vg_DebugMsg,
+                "di-image: cache: %'llu slow lookups, %'llu hits, "
+                "%'llu misses (%'llu recycled)\n",
+                stats__n_slow, stats__n_hits, stats__n_misses,
+                stats__n_recycled);
+   VG_(message)(Vg_DebugMsg,
+                "di-image: cache: %'llu bytes read, "
+                "%'llu images (%'llu bytes) mapped\n",
+                stats__read_szB, stats__n_mapped, stats__mapped_szB);
+   if (stats__srv_requests > 0)
+      VG_(message)(Vg_DebugMsg,
+                   "di-image: server: %'llu reads (%'llu read-ahead), "
+                   "%'llu compressed bytes received\n",
+                   stats__srv_requests, stats__srv_ra_requests,
+                   stats__srv_rx_szB);
+   for (k = 0; k < 2; k++) {
+      if (stats__n_decomp[k] == 0)
+         continue;
+      VG_(message)(Vg_DebugMsg,
+                   "di-image: %s: %'llu sections, %'llu -> %'llu bytes "
+                   "in %'llu ms\n",
+                   names[k], stats__n_decomp[k], stats__decomp_szC[k],
+                   stats__decomp_szD[k], stats__decomp_msec[k]);
+      if (stats__decomp_msec[k] > 0)
+         VG_(message)(Vg_DebugMsg,
+                      "di-image: %s: %'llu KB/s decompressed\n", names[k],
+                      stats__decomp_szD[k] / stats__decomp_msec[k]
+                      * 1000 / 1024);
+   }
+}
+
+void ML_(img_prefetch)(const DiImage* img, DiOffT offset, SizeT size)
+{
+   vg_assert(img != NULL);
+   if (!img->source.is_local || size == 0 || offset >= img->real_size)
+      return;
+   if (size > img->real_size - offset)
+      size = img->real_size - offset;
+   (void)VG_(fadvise_willneed)(img->source.fd, offset, size);
+}
+
 void ML_(img_free)(DiImage* img)
 {
    vg_assert(img != NULL);
 
-   /* Free up the cache entries, ultimately |img| itself. */
+   /* Free up the cache entries and the mapping, ultimately |img|
+      itself. */
    UInt i;
-   vg_assert(img->ces_used <= CACHE_N_ENTRIES);
+   vg_assert(img->ces_used <= img->ces_limit);
    for (i = 0; i < img->ces_used; i++) {
       ML_(dinfo_free)(img->ces[i]);
    }
    /* Take the opportunity to sanity check the rest. */
-   for (i = i; i < img->ces_used; i++) {
+   for (i = i; i < CACHE_MAX_ENTRIES; i++) {
       vg_assert(img->ces[i] == NULL);
    }
+   for (i = 0; i < img->cslc_used; i++) {
+      if (img->cslc[i].ce)
+         ML_(dinfo_free)(img->cslc[i].ce);
+   }
+   if (img->map) {
+      SysRes sres = VG_(am_munmap_valgrind)((Addr)img->map,
+                                            VG_PGROUNDUP(img->real_size));
+      vg_assert(!sr_isError(sres));
+   }
    ML_(dinfo_free)(img->source.name);
    ML_(dinfo_free)(img->cslc);
    ML_(dinfo_free)(img);
@@ -1099,8 +1404,11 @@ void ML_(img_done)(DiImage* img)
    } else {
       /* Close the socket.  The server can detect this and will scrub
          the connection when it happens, so there's no need to tell it
-         explicitly by sending it a "CLOSE" message, or any such. */
+         explicitly by sending it a "CLOSE" message, or any such.  But
+         don't leave it trying to send us the replies to read-ahead
+         requests. */
       vg_assert(img->source.session_id != 0);
+      drain_server_requests(img);
       VG_(close)(img->source.fd);
    }
 
@@ -1176,13 +1484,21 @@ SizeT ML_(img_get_some)(/*OUT*/void* dst,
    vg_assert(size > 0);
    ensure_valid(img, offset, size, "ML_(img_get_some)");
    UChar* dstU = (UChar*)dst;
+   /* If the range starts in the mapped part of the file, copy
+      directly from there. */
+   if (img->map != NULL && offset < img->real_size) {
+      SizeT nToCopy = img->real_size - offset;
+      if (nToCopy > size) nToCopy = size;
+      VG_(memcpy)(dstU, &img->map[offset], nToCopy);
+      return nToCopy;
+   }
    /* Use |get| in the normal way to get the first byte of the range.
-      This guarantees to put the cache entry containing |offset| in
-      position zero. */
+      This guarantees to make the cache entry containing |offset| be
+      img->last. */
    dstU[0] = get(img, offset);
    /* Now just read as many bytes as we can (or need) directly out of
-      entry zero, without bothering to call |get| each time. */
-   const CEnt* ce = img->ces[0];
+      that entry, without bothering to call |get| each time. */
+   const CEnt* ce = img->last;
    vg_assert(ce && ce->used >= 1);
    vg_assert(is_in_CEnt(ce, offset));
    SizeT nToCopy = size - 1;
@@ -1371,6 +1687,7 @@ UInt ML_(img_calc_gnu_debuglink_crc32)(DiImage* img)
       }
       return ~crc & 0xFFFFFFFF;
    } else {
+      drain_server_requests(img);
       Frame* req = mk_Frame_noargs("CRC3");
       Frame* res = do_transaction(img->source.fd, req);
       if (!res) goto remote_crc_fail;
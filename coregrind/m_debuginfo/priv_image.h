@@ -137,12 +137,31 @@ ULong  ML_(img_get_ULong) (DiImage* img, DiOffT offset);
    connection, making the client/server split pointless. */
 UInt ML_(img_calc_gnu_debuglink_crc32)(DiImage* img);
 
-/* Mark compressed part of image defined with (offset, szC).
+/* Compression formats understood by ML_(img_mark_compressed_part). */
+typedef
+   enum {
+      DiCmp_ZLIB,   // zlib stream (RFC 1950), decoded by tinfl.c
+      DiCmp_ZSTD    // zstd frames (RFC 8878), decoded by unzstd.c
+   }
+   DiCmpKind;
+
+/* Mark compressed part of image defined with (offset, szC), compressed
+   in format kind.
    szD is length of uncompressed data (should be known before decompression).
    Returns (virtual) position in image from which decompressed data can be
    read. */
-DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiOffT offset, SizeT szC,
-                                     SizeT szD);
+DiOffT ML_(img_mark_compressed_part)(DiImage* img, DiCmpKind kind,
+                                     DiOffT offset, SizeT szC, SizeT szD);
+
+/* Show statistics about decompression of compressed parts, for
+   --stats=yes. */
+void ML_(img_print_stats)(void);
+
+/* Hint that [offset, +size) of the underlying file -- a real offset,
+   not one in a decompressed part -- will be read soon.  For a local
+   file this asks the kernel to start reading it in the background.
+   Does nothing for images from a debuginfo server. */
+void ML_(img_prefetch)(const DiImage* img, DiOffT offset, SizeT size);
 
 
 /*------------------------------------------------------------*/
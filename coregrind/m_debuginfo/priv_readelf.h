@@ -59,9 +59,16 @@ extern Bool ML_(read_elf_object) ( DebugInfo* di );
    object.
 
    ML_(read_elf_object) should be called on DI before calling this
-   function.  */
+   function.  If DI->deferred_dwarf is set, only the symbol tables and
+   CFI are read; the DWARF line number, inlined call and variable info
+   is left for ML_(read_elf_debug_dwarf).  */
 extern Bool ML_(read_elf_debug) ( DebugInfo* di );
 
+/* Read the DWARF line number, inlined call and variable info whose
+   reading was deferred by ML_(read_elf_debug).  The caller must clear
+   DI->deferred_dwarf before calling this function.  */
+extern Bool ML_(read_elf_debug_dwarf) ( DebugInfo* di );
+
 extern Bool ML_(check_elf_and_get_rw_loads) ( Int fd, const HChar* filename, Int * rw_load_count );
 
 
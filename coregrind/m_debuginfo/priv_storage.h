@@ -701,6 +701,13 @@ struct _DebugInfo {
       been deferred. */
    Bool deferred;
 
+   /* If true then, although the symbol tables and CFI have been read,
+      the reading of DWARF line number, inlined call and variable info
+      has been deferred further, until a lookup needs it (for example
+      when a stack trace is printed, rather than merely recorded).
+      Only ever set for ELF objects. */
+   Bool deferred_dwarf;
+
    /* All the rest of the fields in this structure are filled in once
       we have committed to reading the symbols and debug info (that
       is, at the point where .have_dinfo is set to True). */
@@ -998,7 +1005,19 @@ struct _DebugInfo {
       Also includes summary address bounds, showing the min and max address
       covered by any of the records, as an aid to fast searching.  And, if the
       records require any expression nodes, they are stored in
-      cfsi_exprs. */
+      cfsi_exprs.
+
+      Finally, ML_(finish_CFSI_arrays) builds a page index over
+      cfsi_base, so that looking up an address does not need a binary
+      search of the whole of cfsi_base.  [cfsi_minavma, cfsi_maxavma]
+      is split into cfsi_n_pages pages of (1 << cfsi_page_shift) bytes.
+      cfsi_page_ix[p] is the position in cfsi_base of the range holding
+      the first byte of page p, and cfsi_page_ix[cfsi_n_pages] is
+      cfsi_used-1.  So an address in page p lies in one of the ranges
+      cfsi_page_ix[p] .. cfsi_page_ix[p+1], and only those need to be
+      searched.  The page size is chosen so that the index has only
+      about a quarter as many entries as cfsi_base.  cfsi_page_ix is
+      NULL until the index is built. */
    Addr* cfsi_base;
    UInt  sizeof_cfsi_m_ix; /* size in byte of indexes stored in cfsi_m_ix. */
    void* cfsi_m_ix; /* Each index occupies sizeof_cfsi_m_ix bytes.
@@ -1015,6 +1034,10 @@ struct _DebugInfo {
    Addr    cfsi_maxavma;
    XArray* cfsi_exprs; /* XArray of CfiExpr */
 
+   UInt*   cfsi_page_ix;
+   UWord   cfsi_n_pages;
+   UInt    cfsi_page_shift;
+
    /* Optimized code under Wine x86: MSVC++ PDB FramePointerOmitted
       data.  Non-expandable array, hence .size == .used. */
    FPO_DATA* fpo;
@@ -1165,13 +1188,19 @@ extern void ML_(addVar)( struct _DebugInfo* di,
    this after finishing adding entries to these tables. */
 extern void ML_(canonicaliseTables) ( struct _DebugInfo* di );
 
+/* Canonicalise just the line number, inlined call and variable info
+   tables, after the deferred reading of the DWARF info that fills
+   them in. */
+extern void ML_(canonicaliseDwarfTables) ( struct _DebugInfo* di );
+
 /* Canonicalise the call-frame-info table held by 'di', in preparation
    for use. This is called by ML_(canonicaliseTables) but can also be
    called on it's own to sort just this table. */
 extern void ML_(canonicaliseCFI) ( struct _DebugInfo* di );
 
 /* ML_(finish_CFSI_arrays) fills in the cfsi_base and cfsi_m_ix arrays
-   from cfsi_rd array. cfsi_rd is then freed. */
+   from cfsi_rd array. cfsi_rd is then freed, and the cfsi_page_ix
+   index is built. */
 extern void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di );
 
 /* ------ Searching ------ */
@@ -1186,7 +1215,8 @@ extern Word ML_(search_one_symtab) ( DebugInfo* di, Addr ptr,
 extern Word ML_(search_one_loctab) ( DebugInfo* di, Addr ptr );
 
 /* Find a CFI-table index containing the specified pointer, or -1 if
-   not found.  Binary search.  */
+   not found.  Binary search, within the bounds given by the page
+   index if there is one.  */
 extern Word ML_(search_one_cfitab) ( DebugInfo* di, Addr ptr );
 
 /* Find a FPO-table index containing the specified pointer, or -1
@@ -0,0 +1,48 @@
+/*--------------------------------------------------------------------*/
+/*--- A small, self-contained zstd decompressor.   priv_unzstd.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_UNZSTD_H
+#define __PRIV_UNZSTD_H
+
+#include "pub_core_basics.h"    // SizeT
+
+/* Returned by ML_(unzstd_mem_to_mem) if the input is not a valid
+   zstd stream, uses a feature we don't support, or does not fit in
+   the output buffer. */
+#define UNZSTD_FAILED ((SizeT)(-1))
+
+/* Decompress the zstd data in [src, +src_len) (one or more frames, as
+   described in RFC 8878) into [dst, +dst_len).  Returns the number of
+   bytes written, or UNZSTD_FAILED.  Dictionaries are not supported
+   and content checksums are not verified.  The whole output is
+   assumed to be addressable, so back references may reach anywhere
+   into the data already produced by the current frame. */
+extern SizeT ML_(unzstd_mem_to_mem) ( UChar* dst, SizeT dst_len,
+                                      const UChar* src, SizeT src_len );
+
+#endif /* ndef __PRIV_UNZSTD_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                            priv_unzstd.h ---*/
+/*--------------------------------------------------------------------*/
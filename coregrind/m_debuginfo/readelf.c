@@ -90,6 +90,10 @@
    #define ELFCOMPRESS_ZLIB 1
 #endif
 
+#if !defined(ELFCOMPRESS_ZSTD)
+   #define ELFCOMPRESS_ZSTD 2
+#endif
+
 #define SIZE_OF_ZLIB_HEADER 12
 
 /*------------------------------------------------------------*/
@@ -1502,14 +1506,18 @@ out:
    acceptable.  If |buildid| is NULL or doesn't specify a findable
    debug object, then we look in various places to find a file with
    the specified CRC.  And if that doesn't work out then we give
-   up. */
+   up.  If |local_only| is True, the --debuginfo-server and debuginfod
+   are not asked, and the name of the file found is not recorded in
+   |di|; this is for looking ahead of the real search. */
 static
 DiImage* find_debug_file( struct _DebugInfo* di,
                           const HChar* objpath, const HChar* buildid,
-                          const HChar* debugname, UInt crc, Bool rel_ok )
+                          const HChar* debugname, UInt crc, Bool rel_ok,
+                          Bool local_only )
 {
    const HChar* extrapath  = VG_(clo_extra_debuginfo_path);
-   const HChar* serverpath = VG_(clo_debuginfo_server);
+   const HChar* serverpath = local_only ? NULL
+                                        : VG_(clo_debuginfo_server);
 
    DiImage* dimg      = NULL; /* the img that we found */
    HChar*   debugpath = NULL; /* where we found it */
@@ -1596,7 +1604,7 @@ DiImage* find_debug_file( struct _DebugInfo* di,
    }
 
 #  if defined(VGO_linux)
-   if (VG_(clo_enable_debuginfod) && dimg == NULL)
+   if (VG_(clo_enable_debuginfod) && dimg == NULL && !local_only)
       dimg = find_debug_file_debuginfod(objpath, &debugpath, buildid, crc, rel_ok);
 #  endif
 
@@ -1606,7 +1614,7 @@ DiImage* find_debug_file( struct _DebugInfo* di,
       TRACE_SYMTAB("------ Found a debuginfo file: %s\n", debugpath);
 
       /* Only set once, we might be called again for opening the altfile. */
-      if (di->fsm.dbgname == NULL)
+      if (di->fsm.dbgname == NULL && !local_only)
          di->fsm.dbgname = ML_(dinfo_strdup)("di.fdf.4", debugpath);
    }
 
@@ -1729,10 +1737,15 @@ Word file_offset_from_svma ( /*OUT*/Bool* ok,
 static Bool check_compression(ElfXX_Shdr* h, DiSlice* s) {
    if (h->sh_flags & SHF_COMPRESSED) {
       ElfXX_Chdr chdr;
+      DiCmpKind kind;
       ML_(img_get)(&chdr, s->img, s->ioff, sizeof(ElfXX_Chdr));
-      if (chdr.ch_type != ELFCOMPRESS_ZLIB)
+      if (chdr.ch_type == ELFCOMPRESS_ZLIB)
+         kind = DiCmp_ZLIB;
+      else if (chdr.ch_type == ELFCOMPRESS_ZSTD)
+         kind = DiCmp_ZSTD;
+      else
          return False;
-      s->ioff = ML_(img_mark_compressed_part)(s->img,
+      s->ioff = ML_(img_mark_compressed_part)(s->img, kind,
                                               s->ioff + sizeof(ElfXX_Chdr),
                                               s->szB - sizeof(ElfXX_Chdr),
                                               (SizeT)chdr.ch_size);
@@ -1758,7 +1771,7 @@ static Bool check_compression(ElfXX_Shdr* h, DiSlice* s) {
           size += tmp[9]; size <<= 8;
           size += tmp[10]; size <<= 8;
           size += tmp[11];
-          s->ioff = ML_(img_mark_compressed_part)(s->img,
+          s->ioff = ML_(img_mark_compressed_part)(s->img, DiCmp_ZLIB,
                                                   s->ioff + SIZE_OF_ZLIB_HEADER,
                                                   s->szB - SIZE_OF_ZLIB_HEADER,
                                                   size);
@@ -1875,6 +1888,75 @@ static HChar* readlink_path (const HChar *path)
 #define FIND_MIMG(_sec_name, _sec_escn) \
    FINDX_MIMG(_sec_name, _sec_escn, /**/)
 
+/* For --debuginfo-readahead=yes.  Ask the kernel to start reading the
+   sections of |img| that ML_(read_elf_debug) and
+   ML_(read_elf_debug_dwarf) will want -- the symbol table and the
+   .debug_* sections -- so that by the time the deferred reading
+   happens, the data is already in the page cache.  Adjacent sections
+   are coalesced into a single request.  Returns True if |img| has a
+   .debug_info section of its own.  If |debuglink_escn| is non-NULL,
+   it is set to the .gnu_debuglink section, if any. */
+static Bool prefetch_debug_sections ( DiImage* img, DiSlice* debuglink_escn )
+{
+   ElfXX_Ehdr ehdr;
+   ElfXX_Shdr shstrtab_shdr;
+   DiOffT     run_lo = 0, run_hi = 0;
+   Bool       has_debug_info = False;
+   UWord      i;
+
+   if (!is_elf_object_file_by_DiImage(img, False))
+      return False;
+   ML_(img_get)(&ehdr, img, 0, sizeof(ehdr));
+   if (ehdr.e_shnum == 0 || ehdr.e_shstrndx == SHN_UNDEF
+       || !ML_(img_valid)(img, ehdr.e_shoff,
+                          ehdr.e_shnum * ehdr.e_shentsize))
+      return False;
+   ML_(img_get)(&shstrtab_shdr, img,
+                INDEX_BIS(ehdr.e_shoff, ehdr.e_shstrndx, ehdr.e_shentsize),
+                sizeof(shstrtab_shdr));
+
+   for (i = 0; i < ehdr.e_shnum; i++) {
+      ElfXX_Shdr a_shdr;
+      ML_(img_get)(&a_shdr, img,
+                   INDEX_BIS(ehdr.e_shoff, i, ehdr.e_shentsize),
+                   sizeof(a_shdr));
+      if (a_shdr.sh_type == SHT_NOBITS || a_shdr.sh_size == 0)
+         continue;
+      DiOffT name_ioff = shstrtab_shdr.sh_offset + a_shdr.sh_name;
+      if (!ML_(img_valid)(img, name_ioff, 1))
+         continue;
+      if (debuglink_escn != NULL
+          && 0 == ML_(img_strcmp_c)(img, name_ioff, ".gnu_debuglink")
+          && ML_(img_valid)(img, a_shdr.sh_offset, a_shdr.sh_size)) {
+         debuglink_escn->img  = img;
+         debuglink_escn->ioff = a_shdr.sh_offset;
+         debuglink_escn->szB  = a_shdr.sh_size;
+         continue;
+      }
+      if (0 == ML_(img_strcmp_c)(img, name_ioff, ".debug_info")
+          || 0 == ML_(img_strcmp_c)(img, name_ioff, ".zdebug_info"))
+         has_debug_info = True;
+      if (0 != ML_(img_strcmp_n)(img, name_ioff, ".debug_", 7)
+          && 0 != ML_(img_strcmp_n)(img, name_ioff, ".zdebug_", 8)
+          && 0 != ML_(img_strcmp_c)(img, name_ioff, ".symtab")
+          && 0 != ML_(img_strcmp_c)(img, name_ioff, ".strtab"))
+         continue;
+      if (run_hi > run_lo && a_shdr.sh_offset >= run_lo
+          && a_shdr.sh_offset <= run_hi) {
+         if (a_shdr.sh_offset + a_shdr.sh_size > run_hi)
+            run_hi = a_shdr.sh_offset + a_shdr.sh_size;
+         continue;
+      }
+      if (run_hi > run_lo)
+         ML_(img_prefetch)(img, run_lo, run_hi - run_lo);
+      run_lo = a_shdr.sh_offset;
+      run_hi = a_shdr.sh_offset + a_shdr.sh_size;
+   }
+   if (run_hi > run_lo)
+      ML_(img_prefetch)(img, run_lo, run_hi - run_lo);
+   return has_debug_info;
+}
+
 /* The central function for reading ELF debug info.  For the
    object/exe specified by the DebugInfo, find ELF sections, then read
    the symbols, line number info, file name info, CFA (stack-unwind
@@ -2969,6 +3051,39 @@ Bool ML_(read_elf_object) ( struct _DebugInfo* di )
                                           di->ehframe_avma[i],
                                           True/*is_ehframe*/ );
       }
+
+      /* TOPLEVEL */
+      /* Reading of the debug sections is deferred until the first
+         lookup that needs them.  If asked to, get the kernel to
+         start fetching them now, so that the I/O overlaps with
+         running the client rather than stalling that lookup.  If
+         there is no .debug_info here, do the same for the separate
+         debuginfo object, found as read_elf_debug_wrk will find it.
+         Only local files are worth prefetching, and only a build-id
+         can be checked without reading the whole candidate file, so
+         an object with just a .gnu_debuglink CRC is left alone. */
+      if (VG_(clo_debuginfo_readahead)) {
+         DiSlice debuglink_escn = DiSlice_INVALID;
+         HChar*  buildid = NULL;
+         if (!prefetch_debug_sections(mimg, &debuglink_escn))
+            buildid = find_buildid(mimg, False, False);
+         if (buildid != NULL) {
+            HChar* debuglink_str_m
+               = debuglink_escn.img == NULL ? NULL
+                    : ML_(img_strdup)(debuglink_escn.img,
+                                      "di.redo.pf.1", debuglink_escn.ioff);
+            DiImage* dimg = find_debug_file( di, di->fsm.filename, buildid,
+                                             debuglink_str_m, 0, False,
+                                             True/*local_only*/ );
+            if (dimg != NULL) {
+               prefetch_debug_sections(dimg, NULL);
+               ML_(img_done)(dimg);
+            }
+            if (debuglink_str_m)
+               ML_(dinfo_free)(debuglink_str_m);
+            ML_(dinfo_free)(buildid);
+         }
+      }
    }
 
    retval = True;
@@ -3023,7 +3138,13 @@ static void find_rodata(Word i, Word shnum, DiImage* dimg, struct _DebugInfo* di
       TRACE_SYMTAB("acquiring .rodata debug bias = %#lx\n", (UWord)di->rodata_debug_bias);
    }
 }
-Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
+/* Does the work for ML_(read_elf_debug) and ML_(read_elf_debug_dwarf).
+   If |dwarf_only| is True then only the DWARF line number, inlined call
+   and variable info is read, on the assumption that the symbol tables
+   and CFI have already been read by an earlier call.  Conversely, if
+   di->deferred_dwarf is set then the DWARF info is left for a later
+   call. */
+static Bool read_elf_debug_wrk ( struct _DebugInfo* di, Bool dwarf_only )
 {
    Word     i, j;
    Bool     res = True;
@@ -3265,13 +3386,13 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
                = ML_(img_strdup)(debuglink_escn.img,
                                  "di.redi_dlk.1", debuglink_escn.ioff);
             dimg = find_debug_file( di, di->fsm.filename, buildid,
-                                    debuglink_str_m, crc, False );
+                                    debuglink_str_m, crc, False, False );
             if (debuglink_str_m)
                ML_(dinfo_free)(debuglink_str_m);
          } else {
             /* See if we can find a matching debug file */
             dimg = find_debug_file( di, di->fsm.filename, buildid,
-                                    NULL, 0, False );
+                                    NULL, 0, False, False );
          }
       }
 
@@ -3560,7 +3681,9 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
          to it. */
       vg_assert(aimg == NULL);
 
-      if (debugaltlink_escn.img != NULL) {
+      /* The alternate file only supplies DWARF info, so there is no
+         need to look for it if reading that has been deferred. */
+      if (debugaltlink_escn.img != NULL && !di->deferred_dwarf) {
          HChar* altfile_str_m
              = ML_(img_strdup)(debugaltlink_escn.img,
                                "di.fbi.3", debugaltlink_escn.ioff);
@@ -3590,7 +3713,7 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
 
          /* See if we can find a matching debug file */
          aimg = find_debug_file( di, rdbgname, altbuildid,
-                                 altfile_str_m, 0, True );
+                                 altfile_str_m, 0, True, False );
 
          ML_(dinfo_free)(rdbgname);
 
@@ -3705,7 +3828,7 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
 
       /* TOPLEVEL */
       /* Read symbols */
-      {
+      if (!dwarf_only) {
          void (*read_elf_symtab)(struct _DebugInfo*, const HChar*,
                                  DiSlice*, DiSlice*, DiSlice*, Bool);
 #        if defined(VGP_ppc64be_linux)
@@ -3718,7 +3841,7 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
                             &symtab_escn, &strtab_escn, &opd_escn,
                             True);
       }
-      if (ML_(sli_is_valid)(debug_frame_escn)) {
+      if (!dwarf_only && ML_(sli_is_valid)(debug_frame_escn)) {
          ML_(read_callframe_info_dwarf3)( di,
                                           debug_frame_escn,
                                           0/*assume zero avma*/,
@@ -3731,7 +3854,8 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
          debuginfo reading for that reason, but, in
          read_unitinfo_dwarf2, do check that debugstr is non-NULL
          before using it. */
-      if (ML_(sli_is_valid)(debug_info_escn) 
+      if (!di->deferred_dwarf
+          && ML_(sli_is_valid)(debug_info_escn) 
           && ML_(sli_is_valid)(debug_abbv_escn)
           && ML_(sli_is_valid)(debug_line_escn)) {
          /* The old reader: line numbers and unwind info only */
@@ -3795,7 +3919,8 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
          * remove DebugInfo::{extab_bias, exidx_svma, extab_svma} since
            they are never used.
       */
-      if (di->exidx_present
+      if (!dwarf_only
+          && di->exidx_present
           && di->cfsi_used == 0
           && di->text_present && di->text_size > 0) {
          Addr text_last_svma = di->text_svma + di->text_size - 1;
@@ -3854,6 +3979,17 @@ Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
    /* NOTREACHED */
 }
 
+Bool ML_(read_elf_debug) ( struct _DebugInfo* di )
+{
+   return read_elf_debug_wrk(di, False/*!dwarf_only*/);
+}
+
+Bool ML_(read_elf_debug_dwarf) ( struct _DebugInfo* di )
+{
+   vg_assert(!di->deferred_dwarf);
+   return read_elf_debug_wrk(di, True/*dwarf_only*/);
+}
+
 Bool ML_(check_elf_and_get_rw_loads) ( Int fd, const HChar* filename, Int * rw_load_count )
 {
    Bool     res, ok;
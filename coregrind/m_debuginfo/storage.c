@@ -2304,6 +2304,50 @@ void ML_(canonicaliseCFI) ( struct _DebugInfo* di )
    }
 }
 
+/* Build di->cfsi_page_ix from the finished cfsi_base array.  See
+   the comments on cfsi_page_ix in priv_storage.h. */
+static void build_cfsi_page_ix ( struct _DebugInfo* di )
+{
+   UWord span, p, pos;
+   UInt  shift;
+
+   vg_assert (di->cfsi_used > 0);
+   vg_assert (di->cfsi_base[0] == di->cfsi_minavma);
+
+   if (di->cfsi_page_ix) {
+      ML_(dinfo_free) (di->cfsi_page_ix);
+      di->cfsi_page_ix = NULL;
+   }
+
+   /* Start with 256 byte pages, which typically hold a handful of
+      ranges, and use bigger ones if needed to keep the index to about
+      a quarter of the number of entries of cfsi_base. */
+   span = di->cfsi_maxavma - di->cfsi_minavma;
+   shift = 8;
+   while (shift < 8 * sizeof(Addr) - 1
+          && (span >> shift) > di->cfsi_used / 4)
+      shift++;
+
+   di->cfsi_page_shift = shift;
+   di->cfsi_n_pages = (span >> shift) + 1;
+   di->cfsi_page_ix = ML_(dinfo_zalloc)( "di.storage.bcpi.1",
+                                         (di->cfsi_n_pages + 1)
+                                         * sizeof(UInt) );
+   pos = 0;
+   for (p = 0; p < di->cfsi_n_pages; p++) {
+      Addr page_avma = di->cfsi_minavma + (p << shift);
+      while (pos + 1 < di->cfsi_used && di->cfsi_base[pos + 1] <= page_avma)
+         pos++;
+      di->cfsi_page_ix[p] = pos;
+   }
+   di->cfsi_page_ix[di->cfsi_n_pages] = di->cfsi_used - 1;
+
+   if (di->trace_cfi)
+      VG_(printf)("cfsi page index: %lu pages of %lu bytes "
+                  "for %lu entries\n",
+                  di->cfsi_n_pages, 1UL << shift, di->cfsi_used);
+}
+
 void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di )
 {
    UWord n_mergeables, n_holes;
@@ -2392,6 +2436,8 @@ void ML_(finish_CFSI_arrays) ( struct _DebugInfo* di )
    di->cfsi_size = new_used;
    ML_(dinfo_free) (di->cfsi_rd);
    di->cfsi_rd = NULL;
+
+   build_cfsi_page_ix (di);
 }
 
 
@@ -2410,6 +2456,26 @@ void ML_(canonicaliseTables) ( struct _DebugInfo* di )
 
    if (di->cfsi_m_pool)
       VG_(freezeDedupPA) (di->cfsi_m_pool, ML_(dinfo_shrink_block));
+
+   /* The deferred DWARF reading still needs to add file, directory
+      and function names. */
+   if (di->deferred_dwarf)
+      return;
+
+   if (di->strpool)
+      VG_(freezeDedupPA) (di->strpool, ML_(dinfo_shrink_block));
+   if (di->fndnpool)
+      VG_(freezeDedupPA) (di->fndnpool, ML_(dinfo_shrink_block));
+}
+
+void ML_(canonicaliseDwarfTables) ( struct _DebugInfo* di )
+{
+   vg_assert(!di->deferred && !di->deferred_dwarf);
+
+   canonicaliseLoctab ( di );
+   canonicaliseInltab ( di );
+   canonicaliseVarInfo ( di );
+
    if (di->strpool)
       VG_(freezeDedupPA) (di->strpool, ML_(dinfo_shrink_block));
    if (di->fndnpool)
@@ -2456,7 +2522,7 @@ Word ML_(search_one_symtab) ( DebugInfo* di, Addr ptr,
 
 Word ML_(search_one_loctab) ( DebugInfo* di, Addr ptr )
 {
-   VG_(di_load_di)(di);
+   VG_(di_load_dwarf)(di);
    Addr a_mid_lo, a_mid_hi;
    Word mid, 
         lo = 0, 
@@ -2486,6 +2552,17 @@ Word ML_(search_one_cfitab) ( DebugInfo* di, Addr ptr )
         lo = 0, 
         hi = di->cfsi_used-1;
 
+   /* If ptr is inside the page index, only the ranges starting in its
+      page, and the one covering the start of that page, need to be
+      looked at. */
+   if (LIKELY(di->cfsi_page_ix != NULL)
+       && ptr >= di->cfsi_minavma && ptr <= di->cfsi_maxavma) {
+      UWord page = (ptr - di->cfsi_minavma) >> di->cfsi_page_shift;
+      vg_assert(page < di->cfsi_n_pages);
+      lo = di->cfsi_page_ix[page];
+      hi = di->cfsi_page_ix[page+1];
+   }
+
    while (lo <= hi) {
       /* Invariants : hi == cfsi_used-1 || ptr < cfsi_base[hi+1]
                       lo == 0           || ptr > cfsi_base[lo-1]
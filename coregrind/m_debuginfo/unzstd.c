@@ -0,0 +1,979 @@
+/*--------------------------------------------------------------------*/
+/*--- A small, self-contained zstd decompressor.          unzstd.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* This is a decoder for the Zstandard format as described in RFC 8878,
+   written to decompress ELFCOMPRESS_ZSTD debug sections.  It only has
+   to deal with the mem-to-mem case, where the entire output buffer is
+   available and its final size is known up front, which makes it much
+   simpler than a streaming decoder: there is no window buffer, since
+   matches are copied straight out of the data already produced.
+
+   All inputs are untrusted.  Any malformed input makes
+   ML_(unzstd_mem_to_mem) return UNZSTD_FAILED; it never reads outside
+   [src, +src_len) or writes outside [dst, +dst_len). */
+
+#include "pub_core_basics.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_mallocfree.h"
+#include "priv_unzstd.h"           /* self */
+
+/* Format limits, from RFC 8878. */
+#define ZS_MAX_BLOCK_SIZE  (128 * 1024)
+#define ZS_LL_MAX_LOG      9
+#define ZS_ML_MAX_LOG      9
+#define ZS_OF_MAX_LOG      8
+#define ZS_HUFW_MAX_LOG    6
+#define ZS_HUF_MAX_BITS    12    /* RFC says 11; the reference accepts 12 */
+#define ZS_LL_MAX_SYM      35
+#define ZS_ML_MAX_SYM      52
+#define ZS_OF_MAX_SYM      31
+
+#define ZS_MAGIC           0xFD2FB528U
+#define ZS_SKIP_MAGIC      0x184D2A50U   /* low 4 bits are free */
+
+
+/*------------------------------------------------------------*/
+/*--- Decoder state                                        ---*/
+/*------------------------------------------------------------*/
+
+/* One FSE decoding table entry.  For the sequence code tables, |base|
+   and |extra| cache the baseline and number of extra bits of |sym|. */
+typedef
+   struct {
+      UInt   base;
+      UShort newState;
+      UChar  sym;
+      UChar  nbBits;
+      UChar  extra;
+   }
+   FSEEnt;
+
+/* One Huffman decoding table entry. */
+typedef
+   struct {
+      UChar sym;
+      UChar nbBits;
+   }
+   HufEnt;
+
+/* State that persists between the blocks of a frame: the entropy
+   tables (which later blocks may say to reuse) and the repeat
+   offsets. */
+typedef
+   struct {
+      FSEEnt ll[1 << ZS_LL_MAX_LOG];
+      FSEEnt of[1 << ZS_OF_MAX_LOG];
+      FSEEnt ml[1 << ZS_ML_MAX_LOG];
+      UInt   ll_log, of_log, ml_log;
+      Bool   ll_ok, of_ok, ml_ok;
+      HufEnt huf[1 << ZS_HUF_MAX_BITS];
+      UInt   huf_bits;
+      Bool   huf_ok;
+      UInt   rep[3];
+      UChar  lits[ZS_MAX_BLOCK_SIZE];
+   }
+   ZState;
+
+
+/*------------------------------------------------------------*/
+/*--- Bit readers                                          ---*/
+/*------------------------------------------------------------*/
+
+static inline UInt highbit ( UInt x )
+{
+   return 31 - __builtin_clz(x);
+}
+
+/* Load up to 8 little-endian bytes, of which only |avail| exist. */
+static inline ULong load_le ( const UChar* p, SizeT avail )
+{
+   ULong v = 0;
+   if (LIKELY(avail >= 8)) {
+      v = (ULong)p[0]         | ((ULong)p[1] << 8)
+          | ((ULong)p[2] << 16) | ((ULong)p[3] << 24)
+          | ((ULong)p[4] << 32) | ((ULong)p[5] << 40)
+          | ((ULong)p[6] << 48) | ((ULong)p[7] << 56);
+   } else {
+      SizeT i;
+      for (i = 0; i < avail; i++)
+         v |= (ULong)p[i] << (8 * i);
+   }
+   return v;
+}
+
+/* Return the |n| bits starting at bit |pos| of [src, +len), least
+   significant bit first.  Bits beyond the end read as zero.  Only used
+   for the (forwards) FSE table descriptions.  n <= 56. */
+static inline ULong get_bits ( const UChar* src, SizeT len, Long pos, UInt n )
+{
+   if (n == 0)
+      return 0;
+   SizeT byte = pos >> 3;
+   ULong v = byte < len ? load_le(src + byte, len - byte) : 0;
+   return (v >> (pos & 7)) & ((1ULL << n) - 1);
+}
+
+/* Huffman and FSE-coded data is read backwards, starting just below
+   the highest set bit of the last byte.  The reader keeps 8 bytes of
+   the stream in |bits|, of which the top |consumed| bits have been
+   used, and is refilled by bs_reload.  At most 57 bits may be read
+   between reloads.  Once the stream is exhausted, further reads
+   supply zero bits, and bs_remaining becomes negative. */
+typedef
+   struct {
+      ULong        bits;
+      UInt         consumed;
+      const UChar* ptr;     /* start of the 8 bytes in |bits| */
+      const UChar* start;
+   }
+   BStream;
+
+static Bool bs_init ( BStream* bs, const UChar* src, SizeT len )
+{
+   if (len == 0 || src[len-1] == 0)
+      return False;
+   bs->start = src;
+   if (len >= 8) {
+      bs->ptr      = src + len - 8;
+      bs->bits     = load_le(bs->ptr, 8);
+      bs->consumed = 8 - highbit(src[len-1]);
+   } else {
+      bs->ptr      = src;
+      bs->bits     = load_le(src, len);
+      bs->consumed = 8 - highbit(src[len-1]) + (8 - len) * 8;
+   }
+   return True;
+}
+
+static inline UInt bs_peek ( const BStream* bs, UInt n )
+{
+   /* Written so as to be well defined for n == 0. */
+   return (UInt)(((bs->bits << (bs->consumed & 63)) >> 1) >> ((63 - n) & 63));
+}
+
+static inline UInt bs_read ( BStream* bs, UInt n )
+{
+   UInt v = bs_peek(bs, n);
+   bs->consumed += n;
+   return v;
+}
+
+static inline void bs_reload ( BStream* bs )
+{
+   if (bs->consumed > 64)
+      return;   /* overread; stays that way */
+   if (LIKELY(bs->ptr >= bs->start + 8)) {
+      bs->ptr -= bs->consumed >> 3;
+      bs->consumed &= 7;
+   } else if (bs->ptr == bs->start) {
+      return;
+   } else {
+      SizeT nb = bs->consumed >> 3;
+      if (nb > (SizeT)(bs->ptr - bs->start))
+         nb = bs->ptr - bs->start;
+      bs->ptr      -= nb;
+      bs->consumed -= nb * 8;
+   }
+   bs->bits = load_le(bs->ptr, 8);
+}
+
+/* Number of bits not yet read; negative if the stream was overread. */
+static inline Long bs_remaining ( const BStream* bs )
+{
+   return (Long)(bs->ptr - bs->start) * 8 + 64 - (Long)bs->consumed;
+}
+
+
+/* Copy |n| bytes from |s| to |d|, which must not overlap.  Most
+   literal runs and matches are short, so avoid a call for those. */
+static inline void copy_bytes ( UChar* d, const UChar* s, SizeT n )
+{
+   if (n >= 32) {
+      VG_(memcpy)(d, s, n);
+   } else {
+      while (n-- > 0)
+         *d++ = *s++;
+   }
+}
+
+
+/*------------------------------------------------------------*/
+/*--- FSE tables                                           ---*/
+/*------------------------------------------------------------*/
+
+/* Predefined distributions for the sequence codes (RFC 8878
+   3.1.1.3.2.2). */
+static const Short ll_default_norm[ZS_LL_MAX_SYM + 1] = {
+   4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+   2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+   -1, -1, -1, -1
+};
+static const Short ml_default_norm[ZS_ML_MAX_SYM + 1] = {
+   1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+   -1, -1, -1, -1, -1
+};
+static const Short of_default_norm[29] = {
+   1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+   1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+/* Baselines and extra bits for the literal length and match length
+   codes (RFC 8878 3.1.1.3.2.1.1). */
+static const UInt ll_base[ZS_LL_MAX_SYM + 1] = {
+   0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+   16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+   8192, 16384, 32768, 65536
+};
+static const UChar ll_bits[ZS_LL_MAX_SYM + 1] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+   13, 14, 15, 16
+};
+static const UInt ml_base[ZS_ML_MAX_SYM + 1] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+   19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+   35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+   4099, 8195, 16387, 32771, 65539
+};
+static const UChar ml_bits[ZS_ML_MAX_SYM + 1] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+   1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+   12, 13, 14, 15, 16
+};
+
+/* Read an FSE table description (RFC 8878 4.1.1) from the front of
+   [src, +len).  Fills in norm[0 .. *nsyms-1] and *log.  Returns the
+   number of bytes consumed, or 0 on error. */
+static SizeT read_fse_norm ( const UChar* src, SizeT len,
+                             /*OUT*/Short* norm, /*OUT*/UInt* nsyms,
+                             /*OUT*/UInt* log, UInt max_sym, UInt max_log )
+{
+   Long pos = 0;
+   UInt al, nbBits, sym = 0;
+   Int  remaining, threshold;
+
+   if (len == 0)
+      return 0;
+   al = (UInt)get_bits(src, len, pos, 4) + 5;
+   pos += 4;
+   if (al > max_log)
+      return 0;
+
+   remaining = (1 << al) + 1;
+   threshold = 1 << al;
+   nbBits    = al + 1;
+   while (remaining > 1 && sym <= max_sym) {
+      Int max = (2 * threshold - 1) - remaining;
+      Int v   = (Int)get_bits(src, len, pos, nbBits);
+      Int count;
+      if ((v & (threshold - 1)) < max) {
+         count = v & (threshold - 1);
+         pos += nbBits - 1;
+      } else {
+         count = v & (2 * threshold - 1);
+         if (count >= threshold)
+            count -= max;
+         pos += nbBits;
+      }
+      count--;   /* -1 means "less than 1" */
+      remaining -= count < 0 ? -count : count;
+      norm[sym++] = (Short)count;
+      if (count == 0) {
+         /* Runs of zero probabilities are coded as 2-bit repeat
+            flags, 3 meaning "and more follow". */
+         UInt rep;
+         do {
+            rep = (UInt)get_bits(src, len, pos, 2);
+            pos += 2;
+            UInt j;
+            for (j = 0; j < rep; j++) {
+               if (sym > max_sym)
+                  return 0;
+               norm[sym++] = 0;
+            }
+         } while (rep == 3);
+      }
+      while (remaining < threshold) {
+         nbBits--;
+         threshold >>= 1;
+      }
+   }
+   if (remaining != 1 || pos > (Long)len * 8)
+      return 0;
+   *nsyms = sym;
+   *log   = al;
+   return (SizeT)((pos + 7) >> 3);
+}
+
+/* Build the decoding table for a normalised distribution
+   (RFC 8878 4.1.1). */
+static Bool build_fse ( /*OUT*/FSEEnt* tab, const Short* norm, UInt nsyms,
+                        UInt log )
+{
+   UInt   size = 1 << log;
+   Int    high = size - 1;
+   UInt   step = (size >> 1) + (size >> 3) + 3;
+   UInt   mask = size - 1;
+   UInt   pos  = 0;
+   UShort next[64];
+   UInt   s, u;
+   Int    j;
+
+   vg_assert(nsyms <= 64);
+   for (s = 0; s < nsyms; s++) {
+      if (norm[s] == -1) {
+         if (high < 0)
+            return False;
+         tab[high--].sym = s;
+         next[s] = 1;
+      } else {
+         next[s] = norm[s];
+      }
+   }
+   for (s = 0; s < nsyms; s++) {
+      for (j = 0; j < norm[s]; j++) {
+         tab[pos].sym = s;
+         do {
+            pos = (pos + step) & mask;
+         } while ((Int)pos > high);
+      }
+   }
+   if (pos != 0)
+      return False;
+   for (u = 0; u < size; u++) {
+      UInt ns = next[tab[u].sym]++;
+      UInt nb = log - highbit(ns);
+      tab[u].nbBits   = nb;
+      tab[u].newState = (ns << nb) - size;
+   }
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Literals                                             ---*/
+/*------------------------------------------------------------*/
+
+/* Read a Huffman tree description (RFC 8878 4.2.1) and build the
+   decoding table.  Returns bytes consumed, or 0 on error. */
+static SizeT read_huf_table ( ZState* zs, const UChar* src, SizeT len )
+{
+   UChar w[256];
+   UInt  nw = 0, i;
+   SizeT used;
+
+   if (len == 0)
+      return 0;
+   if (src[0] >= 128) {
+      /* Weights stored directly, 4 bits each. */
+      nw   = src[0] - 127;
+      used = 1 + (nw + 1) / 2;
+      if (used > len)
+         return 0;
+      for (i = 0; i < nw; i++) {
+         UChar b = src[1 + i / 2];
+         w[i] = (i & 1) ? (b & 15) : (b >> 4);
+      }
+   } else {
+      /* Weights FSE-compressed, with two interleaved states. */
+      FSEEnt  tab[1 << ZS_HUFW_MAX_LOG];
+      Short   norm[16];
+      UInt    nsyms, log, s1, s2;
+      BStream bs;
+      SizeT   n;
+
+      used = 1 + src[0];
+      if (src[0] == 0 || used > len)
+         return 0;
+      n = read_fse_norm(src + 1, src[0], norm, &nsyms, &log,
+                        15, ZS_HUFW_MAX_LOG);
+      if (n == 0 || !build_fse(tab, norm, nsyms, log)
+          || !bs_init(&bs, src + 1 + n, src[0] - n))
+         return 0;
+      s1 = bs_read(&bs, log);
+      s2 = bs_read(&bs, log);
+      /* Same termination rule as the reference decoder: stop after
+         the update that overreads the stream, emitting the other
+         state's symbol. */
+      while (1) {
+         if (nw + 2 > 255)
+            return 0;
+         w[nw++] = tab[s1].sym;
+         s1 = tab[s1].newState + bs_read(&bs, tab[s1].nbBits);
+         bs_reload(&bs);
+         if (bs_remaining(&bs) < 0) {
+            w[nw++] = tab[s2].sym;
+            break;
+         }
+         w[nw++] = tab[s2].sym;
+         s2 = tab[s2].newState + bs_read(&bs, tab[s2].nbBits);
+         bs_reload(&bs);
+         if (bs_remaining(&bs) < 0) {
+            w[nw++] = tab[s1].sym;
+            break;
+         }
+      }
+   }
+
+   /* The last weight is implied by the others. */
+   UInt total = 0;
+   for (i = 0; i < nw; i++) {
+      if (w[i] > ZS_HUF_MAX_BITS)
+         return 0;
+      if (w[i] > 0)
+         total += 1 << (w[i] - 1);
+   }
+   if (total == 0)
+      return 0;
+   UInt maxbits = highbit(total) + 1;
+   if (maxbits > ZS_HUF_MAX_BITS)
+      return 0;
+   UInt left = (1 << maxbits) - total;
+   if ((left & (left - 1)) != 0)
+      return 0;
+   w[nw++] = highbit(left) + 1;
+
+   /* Lay out the table: all the weight-1 (longest) codes first, each
+      in symbol order, then weight 2, etc. */
+   UInt rank[ZS_HUF_MAX_BITS + 1];
+   UInt next = 0, r;
+   VG_(memset)(rank, 0, sizeof(rank));
+   for (i = 0; i < nw; i++)
+      rank[w[i]]++;
+   for (r = 1; r <= maxbits; r++) {
+      UInt cur = next;
+      next += rank[r] << (r - 1);
+      rank[r] = cur;
+   }
+   for (i = 0; i < nw; i++) {
+      if (w[i] == 0)
+         continue;
+      UInt n = 1 << (w[i] - 1), u;
+      for (u = rank[w[i]]; u < rank[w[i]] + n; u++) {
+         zs->huf[u].sym    = i;
+         zs->huf[u].nbBits = maxbits + 1 - w[i];
+      }
+      rank[w[i]] += n;
+   }
+   zs->huf_bits = maxbits;
+   zs->huf_ok   = True;
+   return used;
+}
+
+static inline UChar huf_decode_sym ( const ZState* zs, BStream* bs )
+{
+   const HufEnt* e = &zs->huf[bs_peek(bs, zs->huf_bits)];
+   bs->consumed += e->nbBits;
+   return e->sym;
+}
+
+/* Decode the rest of a stream, from dst[i] to dst[n-1]. */
+static Bool huf_finish_stream ( const ZState* zs, BStream* bs,
+                                UChar* dst, SizeT i, SizeT n )
+{
+   /* Codes are at most 12 bits, so 4 fit between reloads. */
+   for (; i + 4 <= n; i += 4) {
+      dst[i]     = huf_decode_sym(zs, bs);
+      dst[i + 1] = huf_decode_sym(zs, bs);
+      dst[i + 2] = huf_decode_sym(zs, bs);
+      dst[i + 3] = huf_decode_sym(zs, bs);
+      bs_reload(bs);
+   }
+   for (; i < n; i++) {
+      dst[i] = huf_decode_sym(zs, bs);
+      bs_reload(bs);
+   }
+   return bs_remaining(bs) == 0;
+}
+
+static Bool huf_decode_1stream ( const ZState* zs, UChar* dst, SizeT n,
+                                 const UChar* src, SizeT len )
+{
+   BStream bs;
+   if (!bs_init(&bs, src, len))
+      return False;
+   return huf_finish_stream(zs, &bs, dst, 0, n);
+}
+
+/* Decode four streams of |seg| bytes each, except that the last one is
+   |n| - 3 * |seg| bytes.  They are independent, so decoding them in
+   lockstep lets the table lookups overlap. */
+static Bool huf_decode_4streams ( const ZState* zs, UChar* dst, SizeT n,
+                                  SizeT seg, const UChar* src,
+                                  const SizeT* sz )
+{
+   BStream bs[4];
+   UChar*  d[4];
+   SizeT   i, k, n4 = n - 3 * seg;
+
+   for (k = 0; k < 4; k++) {
+      if (!bs_init(&bs[k], src, sz[k]))
+         return False;
+      src += sz[k];
+      d[k] = dst + k * seg;
+   }
+   for (i = 0; i + 4 <= n4; i += 4) {
+      for (k = 0; k < 4; k++) {
+         d[k][i]     = huf_decode_sym(zs, &bs[k]);
+         d[k][i + 1] = huf_decode_sym(zs, &bs[k]);
+         d[k][i + 2] = huf_decode_sym(zs, &bs[k]);
+         d[k][i + 3] = huf_decode_sym(zs, &bs[k]);
+         bs_reload(&bs[k]);
+      }
+   }
+   for (k = 0; k < 4; k++) {
+      if (!huf_finish_stream(zs, &bs[k], d[k], i, k < 3 ? seg : n4))
+         return False;
+   }
+   return True;
+}
+
+/* Decode the literals section of a compressed block (RFC 8878
+   3.1.1.3.1).  Raw literals are left in place in |src|.  Returns
+   bytes consumed, or 0 on error. */
+static SizeT decode_literals ( ZState* zs, const UChar* src, SizeT len,
+                               /*OUT*/const UChar** lits, /*OUT*/SizeT* nlits )
+{
+   UInt  type, sf;
+   SizeT hsz, regen, csize;
+
+   if (len == 0)
+      return 0;
+   type = src[0] & 3;
+   sf   = (src[0] >> 2) & 3;
+
+   if (type == 0 || type == 1) {
+      /* Raw or RLE. */
+      hsz = sf == 1 ? 2 : sf == 3 ? 3 : 1;
+      if (hsz > len)
+         return 0;
+      switch (hsz) {
+         case 1: regen = src[0] >> 3; break;
+         case 2: regen = (src[0] >> 4) + (src[1] << 4); break;
+         default: regen = (src[0] >> 4) + (src[1] << 4)
+                          + ((SizeT)src[2] << 12); break;
+      }
+      if (regen > ZS_MAX_BLOCK_SIZE)
+         return 0;
+      if (type == 0) {
+         if (regen > len - hsz)
+            return 0;
+         *lits  = src + hsz;
+         *nlits = regen;
+         return hsz + regen;
+      }
+      if (hsz >= len)
+         return 0;
+      VG_(memset)(zs->lits, src[hsz], regen);
+      *lits  = zs->lits;
+      *nlits = regen;
+      return hsz + 1;
+   }
+
+   /* Huffman-compressed, with a new (type 2) or the previous (type 3)
+      tree, in one (sf 0) or four streams. */
+   hsz = sf <= 1 ? 3 : sf + 2;
+   if (hsz > len)
+      return 0;
+   ULong v = load_le(src, hsz);
+   switch (sf) {
+      case 0: case 1:
+         regen = (v >> 4) & 0x3FF;   csize = (v >> 14) & 0x3FF;   break;
+      case 2:
+         regen = (v >> 4) & 0x3FFF;  csize = (v >> 18) & 0x3FFF;  break;
+      default:
+         regen = (v >> 4) & 0x3FFFF; csize = (v >> 22) & 0x3FFFF; break;
+   }
+   if (regen > ZS_MAX_BLOCK_SIZE || csize > len - hsz)
+      return 0;
+
+   const UChar* p    = src + hsz;
+   SizeT        plen = csize;
+   if (type == 2) {
+      SizeT n = read_huf_table(zs, p, plen);
+      if (n == 0)
+         return 0;
+      p    += n;
+      plen -= n;
+   } else if (!zs->huf_ok) {
+      return 0;
+   }
+
+   if (sf == 0) {
+      if (!huf_decode_1stream(zs, zs->lits, regen, p, plen))
+         return 0;
+   } else {
+      SizeT sz[4], seg;
+      if (plen < 6)
+         return 0;
+      sz[0] = p[0] | (p[1] << 8);
+      sz[1] = p[2] | (p[3] << 8);
+      sz[2] = p[4] | (p[5] << 8);
+      if (sz[0] + sz[1] + sz[2] > plen - 6)
+         return 0;
+      sz[3] = plen - 6 - sz[0] - sz[1] - sz[2];
+      seg = (regen + 3) / 4;
+      if (3 * seg > regen)
+         return 0;
+      if (!huf_decode_4streams(zs, zs->lits, regen, seg, p + 6, sz))
+         return 0;
+   }
+   *lits  = zs->lits;
+   *nlits = regen;
+   return hsz + csize;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Sequences                                            ---*/
+/*------------------------------------------------------------*/
+
+/* Set up the decoding table for one of the three sequence codes,
+   according to its compression mode.  Returns bytes consumed, or
+   (SizeT)-1 on error. */
+static SizeT setup_seq_table ( FSEEnt* tab, UInt* log, Bool* ok, UInt mode,
+                               const UChar* src, SizeT len,
+                               const Short* def_norm, UInt def_nsyms,
+                               UInt def_log, UInt max_sym, UInt max_log,
+                               const UInt* base, const UChar* extra )
+{
+   Short norm[64];
+   UInt  nsyms, l, u;
+   SizeT n;
+
+   switch (mode) {
+      case 0: /* predefined */
+         if (!build_fse(tab, def_norm, def_nsyms, def_log))
+            return (SizeT)-1;
+         l = def_log;
+         n = 0;
+         break;
+      case 1: /* RLE */
+         if (len == 0 || src[0] > max_sym)
+            return (SizeT)-1;
+         tab[0].sym      = src[0];
+         tab[0].nbBits   = 0;
+         tab[0].newState = 0;
+         l = 0;
+         n = 1;
+         break;
+      case 2: /* FSE compressed */
+         n = read_fse_norm(src, len, norm, &nsyms, &l, max_sym, max_log);
+         if (n == 0 || !build_fse(tab, norm, nsyms, l))
+            return (SizeT)-1;
+         break;
+      default: /* repeat */
+         return *ok ? 0 : (SizeT)-1;
+   }
+
+   /* Offset codes have no table: code N means N extra bits on top
+      of 1 << N. */
+   for (u = 0; u < (1U << l); u++) {
+      UInt sym = tab[u].sym;
+      tab[u].base  = base ? base[sym] : 1U << sym;
+      tab[u].extra = extra ? extra[sym] : sym;
+   }
+   *log = l;
+   *ok  = True;
+   return n;
+}
+
+/* Decode the sequences section of a compressed block (RFC 8878
+   3.1.1.3.2) and execute the sequences, appending to dst at *op.
+   Matches may not reach back before frame_start. */
+static Bool decode_sequences ( ZState* zs, const UChar* src, SizeT len,
+                               const UChar* lits, SizeT nlits,
+                               UChar* dst, SizeT dst_len, SizeT* op,
+                               SizeT frame_start )
+{
+   UInt  nseq, i;
+   SizeT p, n, lp = 0, o = *op;
+
+   if (len == 0)
+      return False;
+   if (src[0] < 128) {
+      nseq = src[0];
+      p = 1;
+   } else if (src[0] < 255) {
+      if (len < 2)
+         return False;
+      nseq = ((src[0] - 128) << 8) + src[1];
+      p = 2;
+   } else {
+      if (len < 3)
+         return False;
+      nseq = src[1] + (src[2] << 8) + 0x7F00;
+      p = 3;
+   }
+
+   if (nseq > 0) {
+      if (p >= len)
+         return False;
+      UInt modes = src[p++];
+      if (modes & 3)
+         return False;
+      n = setup_seq_table(zs->ll, &zs->ll_log, &zs->ll_ok, modes >> 6,
+                          src + p, len - p, ll_default_norm,
+                          ZS_LL_MAX_SYM + 1, 6, ZS_LL_MAX_SYM, ZS_LL_MAX_LOG,
+                          ll_base, ll_bits);
+      if (n == (SizeT)-1)
+         return False;
+      p += n;
+      n = setup_seq_table(zs->of, &zs->of_log, &zs->of_ok, (modes >> 4) & 3,
+                          src + p, len - p, of_default_norm,
+                          29, 5, ZS_OF_MAX_SYM, ZS_OF_MAX_LOG,
+                          NULL, NULL);
+      if (n == (SizeT)-1)
+         return False;
+      p += n;
+      n = setup_seq_table(zs->ml, &zs->ml_log, &zs->ml_ok, (modes >> 2) & 3,
+                          src + p, len - p, ml_default_norm,
+                          ZS_ML_MAX_SYM + 1, 6, ZS_ML_MAX_SYM, ZS_ML_MAX_LOG,
+                          ml_base, ml_bits);
+      if (n == (SizeT)-1)
+         return False;
+      p += n;
+
+      BStream bs;
+      if (!bs_init(&bs, src + p, len - p))
+         return False;
+      UInt llS = bs_read(&bs, zs->ll_log);
+      UInt ofS = bs_read(&bs, zs->of_log);
+      UInt mlS = bs_read(&bs, zs->ml_log);
+      bs_reload(&bs);
+
+      for (i = 0; i < nseq; i++) {
+         const FSEEnt* lle = &zs->ll[llS];
+         const FSEEnt* ofe = &zs->of[ofS];
+         const FSEEnt* mle = &zs->ml[mlS];
+         /* There are 57 bits available after a reload.  The extra
+            bits take at most 31 + 16 + 16, and the state updates 26,
+            so one reload per sequence is usually enough. */
+         UInt ofv = ofe->base + bs_read(&bs, ofe->extra);
+         UInt ml  = mle->base + bs_read(&bs, mle->extra);
+         if (ofe->extra + mle->extra + lle->extra > 31)
+            bs_reload(&bs);
+         UInt ll  = lle->base + bs_read(&bs, lle->extra);
+         UInt off;
+
+         if (ofv > 3) {
+            off = ofv - 3;
+            zs->rep[2] = zs->rep[1];
+            zs->rep[1] = zs->rep[0];
+            zs->rep[0] = off;
+         } else {
+            UInt idx = ofv - 1 + (ll == 0 ? 1 : 0);
+            if (idx == 0) {
+               off = zs->rep[0];
+            } else {
+               off = idx == 3 ? zs->rep[0] - 1 : zs->rep[idx];
+               if (idx != 1)
+                  zs->rep[2] = zs->rep[1];
+               zs->rep[1] = zs->rep[0];
+               zs->rep[0] = off;
+            }
+         }
+
+         if (i + 1 < nseq) {
+            llS = lle->newState + bs_read(&bs, lle->nbBits);
+            mlS = mle->newState + bs_read(&bs, mle->nbBits);
+            ofS = ofe->newState + bs_read(&bs, ofe->nbBits);
+            bs_reload(&bs);
+         }
+
+         /* Execute: copy |ll| literals, then |ml| bytes from |off|
+            bytes back. */
+         if (ll > nlits - lp || ll > dst_len - o)
+            return False;
+         copy_bytes(dst + o, lits + lp, ll);
+         lp += ll;
+         o  += ll;
+         if (off == 0 || off > o - frame_start || ml > dst_len - o)
+            return False;
+         if (off >= ml) {
+            copy_bytes(dst + o, dst + o - off, ml);
+         } else {
+            UChar* d = dst + o;
+            UInt   k;
+            for (k = 0; k < ml; k++)
+               d[k] = d[(Int)k - (Int)off];
+         }
+         o += ml;
+      }
+      if (bs_remaining(&bs) != 0)
+         return False;
+   }
+
+   /* Whatever literals are left over go at the end. */
+   if (nlits - lp > dst_len - o)
+      return False;
+   VG_(memcpy)(dst + o, lits + lp, nlits - lp);
+   *op = o + nlits - lp;
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Frames                                               ---*/
+/*------------------------------------------------------------*/
+
+/* Decode one frame, the magic number having already been consumed.
+   Returns bytes consumed, or 0 on error. */
+static SizeT decode_frame ( ZState* zs, UChar* dst, SizeT dst_len, SizeT* op,
+                            const UChar* src, SizeT len )
+{
+   static const UChar did_size[4] = { 0, 1, 2, 4 };
+   UChar  fhd;
+   UInt   fcs_size;
+   SizeT  p, frame_start = *op;
+   ULong  fcs = 0;
+   Bool   last;
+
+   if (len == 0)
+      return 0;
+   fhd = src[0];
+   p = 1;
+   if (fhd & 8)
+      return 0;   /* reserved bit */
+   if ((fhd & 0x20) == 0)
+      p++;        /* Window_Descriptor; irrelevant for mem-to-mem */
+   fcs_size = (fhd >> 6) == 0 ? ((fhd & 0x20) ? 1 : 0) : 1 << (fhd >> 6);
+   if (p + did_size[fhd & 3] + fcs_size > len)
+      return 0;
+   if (load_le(src + p, did_size[fhd & 3]) != 0)
+      return 0;   /* dictionaries are not supported */
+   p += did_size[fhd & 3];
+   if (fcs_size > 0) {
+      fcs = load_le(src + p, fcs_size) + (fcs_size == 2 ? 256 : 0);
+      if (fcs > dst_len - *op)
+         return 0;
+   }
+   p += fcs_size;
+
+   zs->rep[0] = 1;
+   zs->rep[1] = 4;
+   zs->rep[2] = 8;
+   zs->ll_ok = zs->of_ok = zs->ml_ok = zs->huf_ok = False;
+
+   do {
+      if (len - p < 3)
+         return 0;
+      UInt  bh   = (UInt)load_le(src + p, 3);
+      SizeT bsz  = bh >> 3;
+      last = bh & 1;
+      p += 3;
+      switch ((bh >> 1) & 3) {
+         case 0: /* raw */
+            if (bsz > len - p || bsz > dst_len - *op)
+               return 0;
+            VG_(memcpy)(dst + *op, src + p, bsz);
+            *op += bsz;
+            p += bsz;
+            break;
+         case 1: /* RLE */
+            if (p >= len || bsz > dst_len - *op)
+               return 0;
+            VG_(memset)(dst + *op, src[p], bsz);
+            *op += bsz;
+            p += 1;
+            break;
+         case 2: { /* compressed */
+            const UChar* lits;
+            SizeT nlits, n;
+            if (bsz > len - p || bsz > ZS_MAX_BLOCK_SIZE)
+               return 0;
+            n = decode_literals(zs, src + p, bsz, &lits, &nlits);
+            if (n == 0
+                || !decode_sequences(zs, src + p + n, bsz - n, lits, nlits,
+                                     dst, dst_len, op, frame_start))
+               return 0;
+            p += bsz;
+            break;
+         }
+         default:
+            return 0;
+      }
+   } while (!last);
+
+   if (fcs_size > 0 && *op - frame_start != fcs)
+      return 0;
+   if (fhd & 4) {
+      /* Content_Checksum; not verified. */
+      if (len - p < 4)
+         return 0;
+      p += 4;
+   }
+   return p;
+}
+
+SizeT ML_(unzstd_mem_to_mem) ( UChar* dst, SizeT dst_len,
+                               const UChar* src, SizeT src_len )
+{
+   ZState* zs = VG_(arena_malloc)(VG_AR_DINFO, "di.unzstd.1",
+                                  sizeof(ZState));
+   SizeT   ip = 0, op = 0;
+   Bool    ok = True;
+
+   while (ok && ip < src_len) {
+      UInt magic;
+      if (src_len - ip < 4) {
+         ok = False;
+         break;
+      }
+      magic = (UInt)load_le(src + ip, 4);
+      ip += 4;
+      if ((magic & ~0xFU) == ZS_SKIP_MAGIC) {
+         SizeT sz;
+         if (src_len - ip < 4) {
+            ok = False;
+            break;
+         }
+         sz = (SizeT)load_le(src + ip, 4);
+         ip += 4;
+         if (sz > src_len - ip)
+            ok = False;
+         else
+            ip += sz;
+      } else if (magic == ZS_MAGIC) {
+         SizeT n = decode_frame(zs, dst, dst_len, &op, src + ip, src_len - ip);
+         if (n == 0)
+            ok = False;
+         else
+            ip += n;
+      } else {
+         ok = False;
+      }
+   }
+
+   VG_(arena_free)(VG_AR_DINFO, zs);
+   return ok ? op : UNZSTD_FAILED;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                 unzstd.c ---*/
+/*--------------------------------------------------------------------*/
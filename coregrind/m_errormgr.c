@@ -31,9 +31,11 @@
 #include "pub_core_threadstate.h"      // For VG_N_THREADS
 #include "pub_core_debuginfo.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_deduppoolalloc.h"
 #include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_gdbserver.h"
+#include "pub_core_hashtable.h"
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcfile.h"
@@ -72,11 +74,15 @@
 static Error* errors = NULL;
 
 /* The list of suppression directives, as read from the specified
-   suppressions file.  Note that the list gets rearranged as a result
-   of the searches done by is_suppressible_error(). */
+   suppressions file, most recently read first.  is_suppressible_error()
+   does not walk this list: it uses the suppression index built from it
+   (see "Matching errors to suppressions" below). */
 static Supp* suppressions = NULL;
 static Bool load_suppressions_called = False;
 
+/* Number of suppressions read so far. */
+static UInt n_suppressions = 0;
+
 /* Running count of unsuppressed errors detected. */
 static UInt n_errs_found = 0;
 
@@ -120,6 +126,18 @@ static UWord em_supplist_searches = 0;
    searching. */
 static UWord em_supplist_cmps = 0;
 
+/* Stats: number of suppression memo entries created, number of
+   searches that found their memo entry, and number of stack traces
+   matched against the callers of a suppression. */
+static UWord em_suppmemo_entries = 0;
+static UWord em_suppmemo_hits = 0;
+static UWord em_supp_callers_matchings = 0;
+
+/* Stats: number of IP name lookups, and number of those that had to
+   search the debug info. */
+static UWord em_ipnames_lookups = 0;
+static UWord em_ipnames_symbolised = 0;
+
 /*------------------------------------------------------------*/
 /*--- Error type                                           ---*/
 /*------------------------------------------------------------*/
@@ -259,6 +277,16 @@ struct _Supp {
    SuppKind skind;   // What kind of suppression.  Must use the range (0..).
    HChar* string;    // String -- use is optional.  NULL by default.
    void* extra;      // Anything else -- use is optional.  NULL by default.
+
+   // Load order of this suppression (0 for the first one read), and the
+   // value of supp_match_stamp when this suppression last suppressed an
+   // error (0 if never).  Together they give the order in which matching
+   // suppressions are preferred, see supp_ranks_before.
+   UInt  seq;
+   ULong last_match;
+
+   // Next suppression in the same chain of the suppression index.
+   struct _Supp* next_in_ix;
 };
 
 SuppKind VG_(get_supp_kind) ( const Supp* su )
@@ -1057,20 +1085,54 @@ static SizeT core_print_extra_suppression_use(const Supp* su,
 /*--- Exported fns                                         ---*/
 /*------------------------------------------------------------*/
 
+/* Does su1 come before su2 in the order in which suppressions are
+   preferred when several of them match an error?  The most recently
+   used one comes first, then the most recently read one.  This is the
+   order the suppression list had when it was kept in most-recently-used
+   order, and is the order in which used suppressions are shown. */
+static Bool supp_ranks_before ( const Supp* su1, const Supp* su2 )
+{
+   if (su1->last_match != su2->last_match)
+      return su1->last_match > su2->last_match;
+   return su1->seq > su2->seq;
+}
+
+static Int cmp_supp_rank ( const void* v1, const void* v2 )
+{
+   const Supp* su1 = *(const Supp* const *)v1;
+   const Supp* su2 = *(const Supp* const *)v2;
+   if (su1 == su2) return 0;
+   return supp_ranks_before(su1, su2) ? -1 : 1;
+}
+
 /* Show the used suppressions.  Returns False if no suppression
    got used. */
 static Bool show_used_suppressions ( void )
 {
    Supp  *su;
+   Supp  **used;
+   UInt  i, n_used;
    Bool  any_supp;
 
    if (VG_(clo_xml))
       VG_(printf_xml)("<suppcounts>\n");
 
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next)
+      if (su->count > 0)
+         n_used++;
+   used = n_used == 0 ? NULL
+                      : VG_(malloc)("errormgr.sus.2", n_used * sizeof(Supp*));
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next)
+      if (su->count > 0)
+         used[n_used++] = su;
+   if (n_used > 1)
+      VG_(ssort)(used, n_used, sizeof(Supp*), cmp_supp_rank);
+
    any_supp = False;
-   for (su = suppressions; su != NULL; su = su->next) {
-      if (su->count <= 0)
-         continue;
+   for (i = 0; i < n_used; i++) {
+      su = used[i];
       if (VG_(clo_xml)) {
          VG_(printf_xml)( "  <pair>\n"
                                  "    <count>%d</count>\n"
@@ -1109,6 +1171,8 @@ static Bool show_used_suppressions ( void )
       }
       any_supp = True;
    }
+   if (used)
+      VG_(free)(used);
 
    if (VG_(clo_xml))
       VG_(printf_xml)("</suppcounts>\n");
@@ -1615,6 +1679,9 @@ static void load_one_suppressions_file ( Int clo_suppressions_i )
          supp->callers[i] = tmp_callers[i];
       }
 
+      supp->seq = n_suppressions++;
+      supp->last_match = 0;
+      supp->next_in_ix = NULL;
       supp->next = suppressions;
       suppressions = supp;
    }
@@ -1648,6 +1715,7 @@ void VG_(load_suppressions) ( void )
 {
    Int i;
    suppressions = NULL;
+   n_suppressions = 0;
    load_suppressions_called = True;
    for (i = 0; i < VG_(sizeXA)(VG_(clo_suppressions)); i++) {
       if (VG_(clo_verbosity) > 1) {
@@ -1681,6 +1749,136 @@ static Bool supploc_IsQuery ( const void* supplocV )
    return False; /* there's no '?' equivalent in the supp syntax */
 }
 
+/* The names of the function(s) and of the object an IP belongs to, as
+   needed to match stack traces against suppressions.  Symbolising an
+   IP is expensive and the same IPs are found again and again in the
+   stack traces of errors (and of leaks, at each leak search), so the
+   names are cached in ipnames: each IP is symbolised at most once.
+   ipnames is flushed when the current DiEpoch changes, as loading or
+   discarding debug info can change the result of symbolising an IP. */
+typedef
+   struct _IPNames {
+      struct _IPNames* next;
+      UWord   key;     // The IP.
+      DiEpoch epoch;   // Epoch used to symbolise the IP.
+      // The function names of the IP (several of them if the IP is in
+      // inlined function calls, innermost call first), and their number.
+      // n_fun_names is 0 if they are not yet computed.
+      const HChar** fun_names;
+      UInt    n_fun_names;
+      const HChar* obj_name; // NULL if not yet computed.
+   }
+   IPNames;
+
+static VgHashTable*    ipnames = NULL;
+static DedupPoolAlloc* ipnames_strs = NULL; // Strings of ipnames.
+
+static Word cmp_IPNames_epoch ( const void* v1, const void* v2 )
+{
+   const IPNames* ipn1 = v1;
+   const IPNames* ipn2 = v2;
+   return ipn1->epoch.n == ipn2->epoch.n ? 0 : 1;
+}
+
+static void free_IPNames ( void* v )
+{
+   IPNames* ipn = v;
+   if (ipn->fun_names) VG_(free)(ipn->fun_names);
+   VG_(free)(ipn);
+}
+
+static void flush_ipnames ( void )
+{
+   if (ipnames == NULL)
+      return;
+   VG_(HT_destruct)(ipnames, free_IPNames);
+   VG_(deleteDedupPA)(ipnames_strs);
+   ipnames = NULL;
+   ipnames_strs = NULL;
+}
+
+static IPNames* get_IPNames ( DiEpoch ep, Addr ip )
+{
+   IPNames  key;
+   IPNames* ipn;
+
+   if (ipnames == NULL) {
+      ipnames = VG_(HT_construct)("errormgr.ipnames");
+      ipnames_strs = VG_(newDedupPA)(16000, 1, VG_(malloc),
+                                     "errormgr.ipnames.strs", VG_(free));
+   }
+   em_ipnames_lookups++;
+   key.key = ip;
+   key.epoch = ep;
+   ipn = VG_(HT_gen_lookup)(ipnames, &key, cmp_IPNames_epoch);
+   if (ipn == NULL) {
+      ipn = VG_(malloc)("errormgr.ipnames.1", sizeof(IPNames));
+      ipn->key = ip;
+      ipn->epoch = ep;
+      ipn->fun_names = NULL;
+      ipn->n_fun_names = 0;
+      ipn->obj_name = NULL;
+      VG_(HT_add_node)(ipnames, ipn);
+   }
+   return ipn;
+}
+
+/* Returns the function names of ip, innermost inlined call first, and
+   their number in *n_names.  Unknown function names are "???". */
+static const HChar* const* get_ip_fun_names ( DiEpoch ep, Addr ip,
+                                              UInt* n_names )
+{
+   IPNames* ipn = get_IPNames(ep, ip);
+
+   if (ipn->n_fun_names == 0) {
+      // Without inline info (or without inlined calls at ip), iipc is
+      // NULL and there is a single function name.
+      InlIPCursor* iipc = VG_(new_IIPC)(ep, ip);
+      UInt sz = 1;
+
+      em_ipnames_symbolised++;
+      ipn->fun_names = VG_(malloc)("errormgr.ipnames.2", sz * sizeof(HChar*));
+      do {
+         const HChar* caller;
+         // Nb: C++-mangled names are used in suppressions.  Do, though,
+         // Z-demangle them, since otherwise it's possible to wind
+         // up comparing "malloc" in the suppression against
+         // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
+         // two of them need to be made to match.
+         if (!VG_(get_fnname_no_cxx_demangle)(ep, ip, &caller, iipc))
+            caller = "???";
+         if (ipn->n_fun_names == sz) {
+            sz *= 2;
+            ipn->fun_names = VG_(realloc)("errormgr.ipnames.2",
+                                          ipn->fun_names,
+                                          sz * sizeof(HChar*));
+         }
+         ipn->fun_names[ipn->n_fun_names++]
+            = VG_(allocEltDedupPA)(ipnames_strs,
+                                   VG_(strlen)(caller) + 1, caller);
+      } while (VG_(next_IIPC)(iipc));
+      VG_(delete_IIPC)(iipc);
+   }
+   *n_names = ipn->n_fun_names;
+   return ipn->fun_names;
+}
+
+/* Returns the object name of ip, or "???" if unknown. */
+static const HChar* get_ip_obj_name ( DiEpoch ep, Addr ip )
+{
+   IPNames* ipn = get_IPNames(ep, ip);
+
+   if (ipn->obj_name == NULL) {
+      const HChar* caller;
+      em_ipnames_symbolised++;
+      if (!VG_(get_objname)(ep, ip, &caller))
+         caller = "???";
+      ipn->obj_name = VG_(allocEltDedupPA)(ipnames_strs,
+                                           VG_(strlen)(caller) + 1, caller);
+   }
+   return ipn->obj_name;
+}
+
 /* IPtoFunOrObjCompleter is a lazy completer of the IPs
    needed to match an error with the suppression patterns.
    The matching between an IP and a suppression pattern is done either
@@ -1846,20 +2044,13 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
                                       needFun ? "fun" : "obj",
                                       ixInput, ip2fo->names_free);
       if (needFun) {
+         UInt n_names;
          // With inline info, fn names must have been completed already.
          vg_assert (!VG_(clo_read_inline_info));
          /* Get the function name into 'caller_name', or "???"
             if unknown. */
-         // Nb: C++-mangled names are used in suppressions.  Do, though,
-         // Z-demangle them, since otherwise it's possible to wind
-         // up comparing "malloc" in the suppression against
-         // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
-         // two of them need to be made to match.
-         if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch,
-                                              ip2fo->ips[ixInput],
-                                              &caller,
-                                              NULL))
-            caller = "???";
+         caller = get_ip_fun_names(ip2fo->epoch, ip2fo->ips[ixInput],
+                                   &n_names)[0];
       } else {
          /* Get the object name into 'caller_name', or "???"
             if unknown. */
@@ -1877,8 +2068,7 @@ static HChar* foComplete(IPtoFunOrObjCompleter* ip2fo,
             last_expand_pos_ips is the last offset in fun/obj where
             ips[pos_ips] has been expanded. */
 
-         if (!VG_(get_objname)(ip2fo->epoch, ip2fo->ips[pos_ips], &caller))
-            caller = "???";
+         caller = get_ip_obj_name(ip2fo->epoch, ip2fo->ips[pos_ips]);
 
          // Have all inlined calls pointing at this object name
          for (i = last_expand_pos_ips - ip2fo->n_offsets_per_ip[pos_ips] + 1;
@@ -1945,30 +2135,26 @@ static void expandInput (IPtoFunOrObjCompleter* ip2fo, UWord ixInput )
       if (VG_(clo_read_inline_info)) {
          // Expand one more IP in one or more calls.
          const Addr IP = ip2fo->ips[ip2fo->n_ips_expanded];
-         InlIPCursor *iipc;
+         const HChar* const* callers;
+         UInt n_callers, i;
 
-         iipc = VG_(new_IIPC)(ip2fo->epoch, IP);
          // The only thing we really need is the nr of inlined fn calls
          // corresponding to the IP we will expand.
          // However, computing this is mostly the same as finding
-         // the function name. So, let's directly complete the function name.
-         do {
-            const HChar *caller;
+         // the function names. So, let's directly complete the function
+         // names.
+         callers = get_ip_fun_names(ip2fo->epoch, IP, &n_callers);
+         for (i = 0; i < n_callers; i++) {
             grow_offsets(ip2fo, ip2fo->n_expanded+1);
             ip2fo->fun_offsets[ip2fo->n_expanded] = ip2fo->names_free;
-            if (!VG_(get_fnname_no_cxx_demangle)(ip2fo->epoch, IP,
-                                                 &caller,
-                                                 iipc))
-               caller = "???";
-            SizeT  caller_len = VG_(strlen)(caller);
+            SizeT  caller_len = VG_(strlen)(callers[i]);
             HChar* caller_name = grow_names(ip2fo, caller_len + 1);
-            VG_(strcpy)(caller_name, caller);
+            VG_(strcpy)(caller_name, callers[i]);
             ip2fo->names_free += caller_len + 1;
             ip2fo->n_expanded++;
             ip2fo->n_offsets_per_ip[ip2fo->n_ips_expanded]++;
-         } while (VG_(next_IIPC)(iipc));
+         }
          ip2fo->n_ips_expanded++;
-         VG_(delete_IIPC) (iipc);
       } else {
          // Without inlined fn call info, expansion simply
          // consists in allocating enough elements in (fun|obj)_offsets.
@@ -2108,14 +2294,184 @@ Bool supp_matches_error(const Supp* su, const Error* err)
 
 /////////////////////////////////////////////////////
 
+/* The suppression index.  Matching a stack trace against the callers
+   of a suppression is expensive, and with big suppression files nearly
+   all suppressions already fail to match the first frame.  So, the
+   suppressions whose first caller is a plain function or object name
+   (i.e. the vast majority) are hashed on this name: the only ones that
+   can match a stack trace are in the two chains given by the function
+   name and the object name of its first frame.  The other suppressions
+   (first caller "...", a src: line or a name with wildcards) are all
+   in supp_ix_others.  The chains are linked through next_in_ix. */
+static Supp** supp_ix = NULL;
+static UInt   supp_ix_size = 0;  // Nr of chains in supp_ix, a power of 2.
+static Supp*  supp_ix_others = NULL;
+static UInt   supp_ix_n_suppressions = 0; // n_suppressions indexed.
+
+static UInt supp_ix_hash ( SuppLocTy ty, const HChar* name )
+{
+   UInt h = ty;
+   while (*name)
+      h = h * 31 + (UChar)*name++;
+   return h & (supp_ix_size - 1);
+}
+
+static void build_supp_ix ( void )
+{
+   Supp* su;
+
+   if (supp_ix)
+      VG_(free)(supp_ix);
+   supp_ix_size = 64;
+   while (supp_ix_size < n_suppressions)
+      supp_ix_size *= 2;
+   supp_ix = VG_(calloc)("errormgr.bsi.1", supp_ix_size, sizeof(Supp*));
+   supp_ix_others = NULL;
+   for (su = suppressions; su != NULL; su = su->next) {
+      const SuppLoc* first = &su->callers[0];
+      if ((first->ty == FunName || first->ty == ObjName)
+          && first->name_is_simple_str) {
+         UInt h = supp_ix_hash(first->ty, first->name);
+         su->next_in_ix = supp_ix[h];
+         supp_ix[h] = su;
+      } else {
+         su->next_in_ix = supp_ix_others;
+         supp_ix_others = su;
+      }
+   }
+   supp_ix_n_suppressions = n_suppressions;
+}
+
+/* The suppression memo.  For each ExeContext of an error that was
+   checked against the suppressions, it gives the candidate
+   suppressions (those that the suppression index gives for its first
+   frame) and, once computed, whether the stack trace matches their
+   callers.  So, for an error raised again and again at the same place
+   (or for the same leak at each leak search), the stack trace is
+   matched at most once against each suppression.
+   The memo cannot just remember which suppression matched an
+   ExeContext: whether a suppression matches an error also depends on
+   the error kind and on tool specific data (e.g. the size of an
+   access, or the syscall param name), so this (cheap) check is redone
+   for each error. */
+typedef
+   struct {
+      Supp* su;
+      Int   callers_match; // 1 match, 0 no match, -1 not yet computed.
+   }
+   SuppCand;
+
+typedef
+   struct _SuppMemo {
+      struct _SuppMemo* next;
+      UWord     key;     // The ExeContext.
+      UInt      n_cands;
+      SuppCand* cands;
+   }
+   SuppMemo;
+
+static VgHashTable* supp_memo = NULL;
+
+/* The current DiEpoch when ipnames and supp_memo were last flushed. */
+static DiEpoch supp_caches_epoch;
+
+/* Incremented each time an error is suppressed, and recorded in the
+   last_match of the suppression. */
+static ULong supp_match_stamp = 0;
+
+static void free_SuppMemo ( void* v )
+{
+   SuppMemo* memo = v;
+   if (memo->cands) VG_(free)(memo->cands);
+   VG_(free)(memo);
+}
+
+/* Flush what is not valid anymore, and (re)build the suppression index
+   if suppressions were read since it was built. */
+static void check_supp_caches ( void )
+{
+   const DiEpoch ep = VG_(current_DiEpoch)();
+   const Bool new_supps = supp_ix == NULL
+                          || supp_ix_n_suppressions != n_suppressions;
+
+   if (ep.n != supp_caches_epoch.n)
+      flush_ipnames();
+   if (new_supps || ep.n != supp_caches_epoch.n || supp_memo == NULL) {
+      if (supp_memo)
+         VG_(HT_destruct)(supp_memo, free_SuppMemo);
+      supp_memo = VG_(HT_construct)("errormgr.supp_memo");
+   }
+   if (new_supps)
+      build_supp_ix();
+   supp_caches_epoch = ep;
+}
+
+static SuppMemo* new_SuppMemo ( const ExeContext* ec,
+                                IPtoFunOrObjCompleter* ip2fo )
+{
+   SuppMemo* memo;
+   SuppCand  cand;
+   XArray*   cands;
+   Supp*     su;
+
+   cands = VG_(newXA)(VG_(malloc), "errormgr.nsm.1", VG_(free),
+                      sizeof(SuppCand));
+   cand.callers_match = -1;
+   if (haveInputInpC(ip2fo, 0)) {
+      // Note: a name returned by foComplete is only valid until
+      // the next foComplete call.
+      const HChar* name = foComplete(ip2fo, 0, True/*needFun*/);
+      for (su = supp_ix[supp_ix_hash(FunName, name)]; su != NULL;
+           su = su->next_in_ix) {
+         if (su->callers[0].ty == FunName
+             && VG_(strcmp)(su->callers[0].name, name) == 0) {
+            cand.su = su;
+            VG_(addToXA)(cands, &cand);
+         }
+      }
+      name = foComplete(ip2fo, 0, False/*needFun*/);
+      for (su = supp_ix[supp_ix_hash(ObjName, name)]; su != NULL;
+           su = su->next_in_ix) {
+         if (su->callers[0].ty == ObjName
+             && VG_(strcmp)(su->callers[0].name, name) == 0) {
+            cand.su = su;
+            VG_(addToXA)(cands, &cand);
+         }
+      }
+      for (su = supp_ix_others; su != NULL; su = su->next_in_ix) {
+         if (su->callers[0].ty == DotDotDot
+             || supp_pattEQinp(&su->callers[0], NULL, ip2fo, 0)) {
+            cand.su = su;
+            VG_(addToXA)(cands, &cand);
+         }
+      }
+   }
+
+   memo = VG_(malloc)("errormgr.nsm.2", sizeof(SuppMemo));
+   memo->key = (UWord)ec;
+   memo->n_cands = VG_(sizeXA)(cands);
+   memo->cands = memo->n_cands == 0 ? NULL
+      : VG_(malloc)("errormgr.nsm.3", memo->n_cands * sizeof(SuppCand));
+   if (memo->n_cands > 0)
+      VG_(memcpy)(memo->cands, VG_(indexXA)(cands, 0),
+                  memo->n_cands * sizeof(SuppCand));
+   VG_(deleteXA)(cands);
+   em_suppmemo_entries++;
+   return memo;
+}
+
 /* Does an error context match a suppression?  ie is this a suppressible
    error?  If so, return a pointer to the Supp record, otherwise NULL.
+   When several suppressions match, the one ranking first according to
+   supp_ranks_before is returned.
    Tries to minimise the number of symbol searches since they are expensive.  
 */
 static Supp* is_suppressible_error ( const Error* err )
 {
-   Supp* su;
-   Supp* su_prev;
+   Supp*     su;
+   Supp*     best;
+   SuppMemo* memo;
+   UInt      i;
 
    IPtoFunOrObjCompleter ip2fo;
    /* Conceptually, ip2fo contains an array of function names and an array of
@@ -2130,7 +2486,8 @@ static Supp* is_suppressible_error ( const Error* err )
       supp_pattEQinp which will then lazily complete the IP function name or
       object name inside ip2fo. Next time the fun or obj name for the same
       IP is needed (i.e. for the matching with the next suppr pattern), then
-      the fun or obj name will not be searched again in the debug info. */
+      the fun or obj name will not be searched again in the debug info
+      (nor in ipnames). */
 
    if (err->where == NULL)
       return NULL;
@@ -2138,6 +2495,10 @@ static Supp* is_suppressible_error ( const Error* err )
    /* stats gathering */
    em_supplist_searches++;
 
+   if (n_suppressions == 0)
+      return NULL;
+   check_supp_caches();
+
    /* Prepare the lazy input completer. */
    ip2fo.epoch = VG_(get_ExeContext_epoch)(err->where);
    ip2fo.ips = VG_(get_ExeContext_StackTrace)(err->where);
@@ -2155,31 +2516,40 @@ static Supp* is_suppressible_error ( const Error* err )
    /* See if the error context matches any suppression. */
    if (DEBUG_ERRORMGR || VG_(debugLog_getLevel)() >= 4)
      VG_(dmsg)("errormgr matching begin\n");
-   su_prev = NULL;
-   for (su = suppressions; su != NULL; su = su->next) {
+   memo = VG_(HT_lookup)(supp_memo, (UWord)err->where);
+   if (memo == NULL) {
+      memo = new_SuppMemo(err->where, &ip2fo);
+      VG_(HT_add_node)(supp_memo, memo);
+   } else {
+      em_suppmemo_hits++;
+   }
+
+   best = NULL;
+   for (i = 0; i < memo->n_cands; i++) {
+      SuppCand* cand = &memo->cands[i];
+      su = cand->su;
+      if (best != NULL && !supp_ranks_before(su, best))
+         continue;
       em_supplist_cmps++;
-      if (supp_matches_error(su, err) 
-          && supp_matches_callers(&ip2fo, su)) {
-         /* got a match.  */
-         /* Inform the tool that err is suppressed by su. */
-         if (su->skind >= 0)
-            (void)VG_TDICT_CALL(tool_update_extra_suppression_use, err, su);
-         /* No core errors need to update extra suppression info */
-         /* Move this entry to the head of the list
-            in the hope of making future searches cheaper. */
-         if (su_prev) {
-            vg_assert(su_prev->next == su);
-            su_prev->next = su->next;
-            su->next = suppressions;
-            suppressions = su;
-         }
-         clearIPtoFunOrObjCompleter(su, &ip2fo);
-         return su;
+      if (!supp_matches_error(su, err))
+         continue;
+      if (cand->callers_match == -1) {
+         em_supp_callers_matchings++;
+         cand->callers_match = supp_matches_callers(&ip2fo, su) ? 1 : 0;
       }
-      su_prev = su;
+      if (cand->callers_match == 1)
+         best = su;
+   }
+
+   if (best) {
+      /* Inform the tool that err is suppressed by best. */
+      if (best->skind >= 0)
+         (void)VG_TDICT_CALL(tool_update_extra_suppression_use, err, best);
+      /* No core errors need to update extra suppression info */
+      best->last_match = ++supp_match_stamp;
    }
-   clearIPtoFunOrObjCompleter(NULL, &ip2fo);
-   return NULL;      /* no matches */
+   clearIPtoFunOrObjCompleter(best, &ip2fo);
+   return best;
 }
 
 /* Show accumulated error-list and suppression-list search stats. 
@@ -2190,6 +2560,15 @@ void VG_(print_errormgr_stats) ( void )
       " errormgr: %'lu supplist searches, %'lu comparisons during search\n",
       em_supplist_searches, em_supplist_cmps
    );
+   VG_(dmsg)(
+      " errormgr: %'lu supp memo entries, %'lu memo hits, "
+      "%'lu stack trace matchings\n",
+      em_suppmemo_entries, em_suppmemo_hits, em_supp_callers_matchings
+   );
+   VG_(dmsg)(
+      " errormgr: %'lu IP name lookups, %'lu IP names symbolised\n",
+      em_ipnames_lookups, em_ipnames_symbolised
+   );
    VG_(dmsg)(
       " errormgr: %'lu errlist searches, %'lu comparisons during search\n",
       em_errlist_searches, em_errlist_cmps
@@ -46,33 +46,25 @@
    suppression specifications.  If not used in comparison, the rest
    are purely informational (but often important).
 
-   The contexts are stored in a traditional chained hash table, so as
-   to allow quick determination of whether a new context already
-   exists.  The hash table starts small and expands dynamically, so as
-   to keep the load factor below 1.0.
+   The contexts are stored in ec_array, indexed by their ECU, and
+   are found by their stack trace using an open-addressed hash table
+   (linear probing), so as to allow quick determination of whether a
+   new context already exists.  Each slot of the table holds the full
+   hash of the context it refers to: probing only touches the slots
+   (8 of them per cache line) and a context is only compared with a
+   candidate stack trace when the hashes are equal, which nearly
+   always means the context is found.  The hash table starts small and
+   doubles in size, so as to keep the load factor below 0.75.
 
    The idea is only to ever store any one context once, so as to save
    space and make exact comparisons faster. */
 
 
-/* Primes for the hash table */
-
-#define N_EC_PRIMES 18
-
-static SizeT ec_primes[N_EC_PRIMES] = {
-         769UL,         1543UL,         3079UL,          6151UL,
-       12289UL,        24593UL,        49157UL,         98317UL,
-      196613UL,       393241UL,       786433UL,       1572869UL,
-     3145739UL,      6291469UL,     12582917UL,      25165843UL,
-    50331653UL,    100663319UL
-};
-
-
-/* Each element is present in a hash chain, and also contains a
-   variable length array of guest code addresses (the useful part). */
+/* Each element contains a variable length array of guest code
+   addresses (the useful part).  Elements are allocated with
+   VG_(perm_malloc), so have no malloc header, and are never freed. */
 
 struct _ExeContext {
-   struct _ExeContext* chain;
    /* A 32-bit unsigned integer that uniquely identifies this
       ExeContext.  Memcheck uses these for origin tracking.  Values
       must be nonzero (else Memcheck's origin tracking is hosed), must
@@ -102,10 +94,23 @@ struct _ExeContext {
 };
 
 
+/* All the contexts, ec_array[i] being the one with ECU 4 + 4 * i. */
+static ExeContext** ec_array;
+static SizeT        ec_array_size;  /* allocated size of ec_array */
+
+/* A slot of the hash table. */
+typedef
+   struct {
+      UInt hash;  /* calc_hash of the context */
+      UInt ecix;  /* 1 + index of the context in ec_array, 0 if empty */
+   }
+   ECSlot;
+
 /* This is the dynamically expanding hash table. */
-static ExeContext** ec_htab; /* array [ec_htab_size] of ExeContext* */
-static SizeT        ec_htab_size;     /* one of the values in ec_primes */
-static SizeT        ec_htab_size_idx; /* 0 .. N_EC_PRIMES-1 */
+static ECSlot* ec_htab;      /* array [ec_htab_size] of ECSlot */
+static SizeT   ec_htab_size; /* a power of 2 */
+
+#define EC_HTAB_INITIAL_SIZE 1024
 
 /* ECU serial number */
 static UInt ec_next_ecu = 4; /* We must never issue zero */
@@ -148,12 +153,15 @@ static void init_ExeContext_storage ( void )
    ec_cmp4s = 0;
    ec_cmpAlls = 0;
 
-   ec_htab_size_idx = 0;
-   ec_htab_size = ec_primes[ec_htab_size_idx];
+   ec_htab_size = EC_HTAB_INITIAL_SIZE;
    ec_htab = VG_(malloc)("execontext.iEs1",
-                         sizeof(ExeContext*) * ec_htab_size);
+                         sizeof(ECSlot) * ec_htab_size);
    for (i = 0; i < ec_htab_size; i++)
-      ec_htab[i] = NULL;
+      ec_htab[i].ecix = 0;
+
+   ec_array_size = EC_HTAB_INITIAL_SIZE;
+   ec_array = VG_(malloc)("execontext.iEs2",
+                          sizeof(ExeContext*) * ec_array_size);
 
    {
       Addr ips[1];
@@ -185,14 +193,13 @@ void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
 
    if (with_stacktraces) {
       VG_(message)(Vg_DebugMsg, "   exectx: Printing contexts stacktraces\n");
-      for (i = 0; i < ec_htab_size; i++) {
-         for (ec = ec_htab[i]; ec; ec = ec->chain) {
-            VG_(message)(Vg_DebugMsg,
-                         "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
-                         ec->ecu, ec->epoch.n, ec->n_ips);
-            VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec),
-                                ec->ips, ec->n_ips );
-         }
+      for (i = 0; i < ec_totstored; i++) {
+         ec = ec_array[i];
+         VG_(message)(Vg_DebugMsg,
+                      "   exectx: stacktrace ecu %u epoch %u n_ips %u\n",
+                      ec->ecu, ec->epoch.n, ec->n_ips);
+         VG_(pp_StackTrace)( VG_(get_ExeContext_epoch)(ec),
+                             ec->ips, ec->n_ips );
       }
       VG_(message)(Vg_DebugMsg, 
                    "   exectx: Printed %'llu contexts stacktraces\n",
@@ -200,12 +207,10 @@ void VG_(print_ExeContext_stats) ( Bool with_stacktraces )
    }
    
    total_n_ips = 0;
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain)
-         total_n_ips += ec->n_ips;
-   }
+   for (i = 0; i < ec_totstored; i++)
+      total_n_ips += ec_array[i]->n_ips;
    VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'lu lists, %'llu contexts (avg %3.2f per list)"
+      "   exectx: %'lu slots, %'llu contexts (load %3.2f)"
       " (avg %3.2f IP per context)\n",
       ec_htab_size, ec_totstored, (Double)ec_totstored / (Double)ec_htab_size,
       (Double)total_n_ips / (Double)ec_totstored
@@ -247,18 +252,17 @@ void VG_(archive_ExeContext_in_range) (DiEpoch last_epoch,
 
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg, "Scanning and archiving ExeContexts ...\n");
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (is_DiEpoch_INVALID (ec->epoch))
-            for (UInt j = 0; j < ec->n_ips; j++) {
-               if (UNLIKELY(ec->ips[j] >= text_avma
-                            && ec->ips[j] <= text_avma_end)) {
-                  ec->epoch = last_epoch;
-                  n_archived++;
-                  break;
-               }
+   for (i = 0; i < ec_totstored; i++) {
+      ec = ec_array[i];
+      if (is_DiEpoch_INVALID (ec->epoch))
+         for (UInt j = 0; j < ec->n_ips; j++) {
+            if (UNLIKELY(ec->ips[j] >= text_avma
+                         && ec->ips[j] <= text_avma_end)) {
+               ec->epoch = last_epoch;
+               n_archived++;
+               break;
             }
-      }
+         }
    }
    if (VG_(clo_verbosity) > 1)
       VG_(message)(Vg_DebugMsg,
@@ -327,63 +331,78 @@ Bool VG_(eq_ExeContext) ( VgRes res, const ExeContext* e1,
    Also checks whether the hash table needs expanding, and expands it
    if so. */
 
-static inline UWord ROLW ( UWord w, Int n )
+/* Multiplicative hash of the stack trace: each IP is mixed in with
+   a multiply by (2^wordsize / golden ratio), and the high half of the
+   result is folded into the low half, as the table index is taken
+   from the low bits of the hash. */
+#if VG_WORDSIZE == 8
+#  define EC_HASH_MUL 0x9E3779B97F4A7C15ULL
+#else
+#  define EC_HASH_MUL 0x9E3779B9UL
+#endif
+
+static inline UInt calc_hash ( const Addr* ips, UInt n_ips )
 {
-   Int bpw = 8 * sizeof(UWord);
-   w = (w << n) | (w >> (bpw-n));
-   return w;
+   UInt  i;
+   UWord hash = n_ips;
+   for (i = 0; i < n_ips; i++)
+      hash = (hash ^ ips[i]) * EC_HASH_MUL;
+   hash ^= hash >> (4 * sizeof(UWord));
+   return (UInt)hash;
 }
 
-static UWord calc_hash ( const Addr* ips, UInt n_ips, UWord htab_sz )
+/* Are the n_ips IPs of ips1 and ips2 equal ?  The first and last IPs
+   differ the most between stack traces having the same hash and
+   length (e.g. the same call chain reached from two call sites), so
+   they are compared first. */
+static inline Bool eq_ips ( const Addr* ips1, const Addr* ips2, UInt n_ips )
 {
-   UInt  i;
-   UWord hash = 0;
-   vg_assert(htab_sz > 0);
-   for (i = 0; i < n_ips; i++) {
-      hash ^= ips[i];
-      hash = ROLW(hash, 19);
-   }
-   return hash % htab_sz;
+   UInt i;
+   if (ips1[0] != ips2[0] || ips1[n_ips-1] != ips2[n_ips-1])
+      return False;
+   for (i = 1; i + 1 < n_ips; i++)
+      if (ips1[i] != ips2[i])
+         return False;
+   return True;
 }
 
-static void resize_ec_htab ( void )
+/* Put the context ec_array[ecix-1], having hash value hash, in a free
+   slot of the hash table. */
+static void add_to_ec_htab ( UInt hash, UInt ecix )
 {
-   SizeT        i;
-   SizeT        new_size;
-   ExeContext** new_ec_htab;
+   const SizeT mask = ec_htab_size - 1;
+   SizeT       i    = hash & mask;
 
-   vg_assert(ec_htab_size_idx < N_EC_PRIMES);
-   if (ec_htab_size_idx == N_EC_PRIMES-1)
-      return; /* out of primes - can't resize further */
+   while (ec_htab[i].ecix != 0)
+      i = (i + 1) & mask;
+   ec_htab[i].hash = hash;
+   ec_htab[i].ecix = ecix;
+}
 
-   new_size = ec_primes[ec_htab_size_idx + 1];
-   new_ec_htab = VG_(malloc)("execontext.reh1",
-                             sizeof(ExeContext*) * new_size);
+static void resize_ec_htab ( void )
+{
+   SizeT   i;
+   SizeT   old_size = ec_htab_size;
+   ECSlot* old_ec_htab = ec_htab;
+
+   ec_htab_size = 2 * old_size;
+   ec_htab = VG_(malloc)("execontext.reh1", sizeof(ECSlot) * ec_htab_size);
 
    VG_(debugLog)(
       1, "execontext",
-         "resizing htab from size %lu to %lu (idx %lu)  Total#ECs=%llu\n",
-         ec_htab_size, new_size, ec_htab_size_idx + 1, ec_totstored);
-
-   for (i = 0; i < new_size; i++)
-      new_ec_htab[i] = NULL;
-
-   for (i = 0; i < ec_htab_size; i++) {
-      ExeContext* cur = ec_htab[i];
-      while (cur) {
-         ExeContext* next = cur->chain;
-         UWord hash = calc_hash(cur->ips, cur->n_ips, new_size);
-         vg_assert(hash < new_size);
-         cur->chain = new_ec_htab[hash];
-         new_ec_htab[hash] = cur;
-         cur = next;
-      }
+         "resizing htab from size %lu to %lu  Total#ECs=%llu\n",
+         old_size, ec_htab_size, ec_totstored);
+
+   for (i = 0; i < ec_htab_size; i++)
+      ec_htab[i].ecix = 0;
+
+   /* The slots keep the hash value: no need to recompute it. */
+   for (i = 0; i < old_size; i++) {
+      if (old_ec_htab[i].ecix != 0)
+         add_to_ec_htab(old_ec_htab[i].hash, old_ec_htab[i].ecix);
    }
 
-   VG_(free)(ec_htab);
-   ec_htab      = new_ec_htab;
-   ec_htab_size = new_size;
-   ec_htab_size_idx++;
+   VG_(free)(old_ec_htab);
 }
 
 /* Used by the outer as a marker to separate the frames of the inner valgrind
@@ -459,70 +478,34 @@ static ExeContext* record_ExeContext_wrk ( ThreadId tid, Word first_ip_delta,
    getting to this point. */
 static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
 {
-   Int         i;
-   Bool        same;
-   UWord       hash;
+   UInt        i;
+   UInt        hash;
+   SizeT       slot;
    ExeContext* new_ec;
-   ExeContext* list;
-   ExeContext  *prev2, *prev;
-
-   static UInt ctr = 0;
+   const SizeT mask = ec_htab_size - 1;
 
    vg_assert(n_ips >= 1 && n_ips <= VG_(clo_backtrace_size));
 
    /* Now figure out if we've seen this one before.  First hash it so
-      as to determine the list number. */
-   hash = calc_hash( ips, n_ips, ec_htab_size );
+      as to determine the first slot to look at. */
+   hash = calc_hash( ips, n_ips );
 
-   /* And (the expensive bit) look a for matching entry in the list. */
+   /* And look for a matching entry, starting from this slot. */
 
    ec_searchreqs++;
 
-   prev2 = NULL;
-   prev  = NULL;
-   list  = ec_htab[hash];
-
-   while (True) {
-      if (list == NULL) break;
+   for (slot = hash & mask; ec_htab[slot].ecix != 0; slot = (slot + 1) & mask) {
+      ExeContext* ec;
+      if (ec_htab[slot].hash != hash)
+         continue;
       ec_searchcmps++;
-      same = list->n_ips == n_ips && is_DiEpoch_INVALID (list->epoch);
-      for (i = 0; i < n_ips && same ; i++) {
-         same = list->ips[i] == ips[i];
-      }
-      if (same) break;
-      prev2 = prev;
-      prev  = list;
-      list  = list->chain;
-   }
-
-   if (list != NULL) {
-      /* Yay!  We found it.  Once every 8 searches, move it one step
-         closer to the start of the list to make future searches
-         cheaper. */
-      if (0 == ((ctr++) & 7)) {
-         if (prev2 != NULL && prev != NULL) {
-            /* Found at 3rd or later position in the chain. */
-            vg_assert(prev2->chain == prev);
-            vg_assert(prev->chain  == list);
-            prev2->chain = list;
-            prev->chain  = list->chain;
-            list->chain  = prev;
-         }
-         else if (prev2 == NULL && prev != NULL) {
-            /* Found at 2nd position in the chain. */
-            vg_assert(ec_htab[hash] == prev);
-            vg_assert(prev->chain == list);
-            prev->chain = list->chain;
-            list->chain = prev;
-            ec_htab[hash] = list;
-         }
-      }
-      return list;
+      ec = ec_array[ec_htab[slot].ecix - 1];
+      if (ec->n_ips == n_ips && is_DiEpoch_INVALID (ec->epoch)
+          && eq_ips(ec->ips, ips, n_ips))
+         return ec; /* Yay!  We found it. */
    }
 
    /* Bummer.  We have to allocate a new context record. */
-   ec_totstored++;
-
    new_ec = VG_(perm_malloc)( sizeof(struct _ExeContext) 
                               + n_ips * sizeof(Addr),
                               vg_alignof(struct _ExeContext));
@@ -540,16 +523,23 @@ static ExeContext* record_ExeContext_wrk2 ( const Addr* ips, UInt n_ips )
    }
 
    new_ec->n_ips = n_ips;
-   new_ec->chain = ec_htab[hash];
    new_ec->epoch = DiEpoch_INVALID();
-   ec_htab[hash] = new_ec;
 
-   /* Resize the hash table, maybe? */
-   if ( ((ULong)ec_totstored) > ((ULong)ec_htab_size) ) {
-      vg_assert(ec_htab_size_idx < N_EC_PRIMES);
-      if (ec_htab_size_idx < N_EC_PRIMES-1)
-         resize_ec_htab();
+   if (ec_totstored == ec_array_size) {
+      ec_array_size *= 2;
+      ec_array = VG_(realloc)("execontext.rEw2.1", ec_array,
+                              sizeof(ExeContext*) * ec_array_size);
    }
+   vg_assert((new_ec->ecu - 4) / 4 == ec_totstored);
+   ec_array[ec_totstored] = new_ec;
+   ec_totstored++;
+
+   ec_htab[slot].hash = hash;
+   ec_htab[slot].ecix = ec_totstored;
+
+   /* Resize the hash table, maybe? */
+   if (4 * (ULong)ec_totstored > 3 * (ULong)ec_htab_size)
+      resize_ec_htab();
 
    return new_ec;
 }
@@ -587,16 +577,13 @@ Int VG_(get_ExeContext_n_ips)( const ExeContext* e ) {
 ExeContext* VG_(get_ExeContext_from_ECU)( UInt ecu )
 {
    UWord i;
-   ExeContext* ec;
    vg_assert(VG_(is_plausible_ECU)(ecu));
    vg_assert(ec_htab_size > 0);
-   for (i = 0; i < ec_htab_size; i++) {
-      for (ec = ec_htab[i]; ec; ec = ec->chain) {
-         if (ec->ecu == ecu)
-            return ec;
-      }
-   }
-   return NULL;
+   i = (ecu - 4) / 4;
+   if (i >= ec_totstored)
+      return NULL;
+   vg_assert(ec_array[i]->ecu == ecu);
+   return ec_array[i];
 }
 
 ExeContext* VG_(make_ExeContext_from_StackTrace)( const Addr* ips, UInt n_ips )
@@ -34,6 +34,7 @@
 #include "pub_core_debuginfo.h"
 #include "pub_core_addrinfo.h"
 #include "pub_core_aspacemgr.h"
+#include "pub_core_stacktrace.h"
 
 unsigned long cont_thread;
 unsigned long general_thread;
@@ -170,6 +171,8 @@ void VG_(print_all_stats) (Bool memory_stats, Bool tool_stats)
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
    VG_(print_scheduler_stats)();
+   VG_(print_debuginfo_stats)();
+   VG_(print_stacktrace_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
    VG_(print_errormgr_stats)();
    if (tool_stats && VG_(needs).print_stats) {
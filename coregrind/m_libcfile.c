@@ -1183,6 +1183,19 @@ SysRes VG_(pread) ( Int fd, void* buf, Int count, OffT offset )
 #  endif
 }
 
+SysRes VG_(fadvise_willneed) ( Int fd, Off64T offset, Off64T len )
+{
+   /* On the 32-bit targets the 64-bit arguments are split over
+      register pairs in a platform-specific way, and it is not worth
+      the hassle for what is only a hint. */
+#  if defined(VGO_linux) && defined(__NR_fadvise64) && (VG_WORDSIZE == 8)
+   return VG_(do_syscall4)(__NR_fadvise64, fd, offset, len,
+                           VKI_POSIX_FADV_WILLNEED);
+#  else
+   return VG_(mk_SysRes_Error)(VKI_ENOSYS);
+#  endif
+}
+
 /* Return the name of a directory for temporary files. */
 const HChar *VG_(tmpdir)(void)
 {
@@ -187,6 +187,12 @@ static void usage_NORETURN ( int need_help )
 "    --allow-mismatched-debuginfo=no|yes  [no]\n"
 "                              for the above two flags only, accept debuginfo\n"
 "                              objects that don't \"match\" the main object\n"
+"    --debuginfo-readahead=no|yes  [no]\n"
+"                              start reading the debug info of objects in\n"
+"                              the background as soon as they are mapped\n"
+"    --debuginfo-mmap=no|yes   [no]\n"
+"                              map object files into memory to read their\n"
+"                              debug info, instead of using a block cache\n"
 "    --smc-check=none|stack|all|all-non-file [all-non-file]\n"
 "                              checks for self-modifying code: none, only for\n"
 "                              code found in stacks, for all code, or for all\n"
@@ -244,6 +250,10 @@ static void usage_NORETURN ( int need_help )
 "                  NOTE: stack scanning is only available on arm-linux.\n"
 "    --unw-stack-scan-frames=<number>   Max number of frames that can be\n"
 "                  recovered by stack scanning [5]\n"
+"    --unw-shadow-stack=no|yes  take stack traces from a shadow call stack\n"
+"                  kept up to date at each call and return [no]\n"
+"    --cfi-cache-size=<number>  number of entries in the cache of CFI\n"
+"                  unwind info used for stack traces [4096]\n"
 "    --resync-filter=no|yes|verbose [yes on MacOS, no on other OSes]\n"
 "              attempt to avoid expensive address-space-resync operations\n"
 "    --max-threads=<number>    maximum number of threads that valgrind can\n"
@@ -800,6 +810,11 @@ static void process_option (Clo_Mode mode,
    else if VG_BOOL_CLO(arg, "--allow-mismatched-debuginfo",
                        VG_(clo_allow_mismatched_debuginfo)) {}
 
+   else if VG_BOOL_CLO(arg, "--debuginfo-readahead",
+                       VG_(clo_debuginfo_readahead)) {}
+   else if VG_BOOL_CLO(arg, "--debuginfo-mmap",
+                       VG_(clo_debuginfo_mmap)) {}
+
    else if VG_STR_CLO(arg, "--xml-user-comment",
                       VG_(clo_xml_user_comment)) {}
 
@@ -894,6 +909,10 @@ static void process_option (Clo_Mode mode,
                        VG_(clo_unw_stack_scan_thresh), 0, 100) {}
    else if VG_BINT_CLO(arg, "--unw-stack-scan-frames",
                        VG_(clo_unw_stack_scan_frames), 0, 32) {}
+   else if VG_BOOL_CLO(arg, "--unw-shadow-stack",
+                       VG_(clo_unw_shadow_stack)) {}
+   else if VG_BINT_CLO(arg, "--cfi-cache-size",
+                       VG_(clo_cfi_cache_size), 4, 1048576) {}
 
    else if VG_XACT_CLO(arg, "--resync-filter=no",
                        VG_(clo_resync_filter), 0) {}
@@ -1070,6 +1089,11 @@ void main_process_cmd_line_options( void )
    }
 #  endif
 
+   /* The shadow call stack is updated at the end of the blocks that
+      do a call, so calls must not be chased into their callees. */
+   if (VG_(clo_unw_shadow_stack))
+      VG_(clo_vex_control).guest_chase = False;
+
    /* If XML output is requested, check that the tool actually
       supports it. */
    if (VG_(clo_xml) && !VG_(needs).xml_output) {
@@ -134,6 +134,8 @@ XArray *VG_(clo_fullpath_after); // array of strings
 const HChar* VG_(clo_extra_debuginfo_path) = NULL;
 const HChar* VG_(clo_debuginfo_server) = NULL;
 Bool   VG_(clo_allow_mismatched_debuginfo) = False;
+Bool   VG_(clo_debuginfo_readahead) = False;
+Bool   VG_(clo_debuginfo_mmap) = False;
 UChar  VG_(clo_trace_flags)    = 0; // 00000000b
 Bool   VG_(clo_profyle_sbs)    = False;
 UChar  VG_(clo_profyle_flags)  = 0; // 00000000b
@@ -195,6 +197,8 @@ Bool   VG_(clo_dsymutil)       = True;
 Bool   VG_(clo_sigill_diag)    = True;
 UInt   VG_(clo_unw_stack_scan_thresh) = 0; /* disabled by default */
 UInt   VG_(clo_unw_stack_scan_frames) = 5;
+Bool   VG_(clo_unw_shadow_stack) = False;
+UInt   VG_(clo_cfi_cache_size) = 4096;
 
 // Set clo_smc_check so that it provides transparent self modifying
 // code support for "correct" programs at the smallest achievable
@@ -617,6 +617,8 @@ void mostly_clear_thread_record ( ThreadId tid )
 
    VG_(clear_out_queued_signals)(tid, &savedmask);
 
+   VG_(shadow_stack_clear)(tid);
+
    VG_(threads)[tid].sched_jmpbuf_valid = False;
 }
 
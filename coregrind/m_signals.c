@@ -1598,6 +1598,9 @@ void push_signal_frame ( ThreadId tid, const vki_siginfo_t *siginfo,
                          scss.scss_per_sig[sigNo].scss_flags,
                          &tst->sig_mask,
                          scss.scss_per_sig[sigNo].scss_restorer);
+
+   /* The handler is not called by the interrupted code. */
+   VG_(shadow_stack_signal_frame)(tid);
 }
 
 
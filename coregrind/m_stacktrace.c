@@ -35,6 +35,7 @@
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_machine.h"
+#include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_stacks.h"        // VG_(stack_limits)
 #include "pub_core_stacktrace.h"
@@ -1612,6 +1613,221 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
 /*---                                                      ---*/
 /*------------------------------------------------------------*/
 
+/*------------------------------------------------------------*/
+/*--- The shadow call stack                                ---*/
+/*------------------------------------------------------------*/
+
+/* With --unw-shadow-stack=yes, each thread has a shadow call stack,
+   maintained by helper calls added by m_translate at the end of each
+   block that does a call or a return.  A frame records the return
+   address of a call and the caller's SP at the time of the call,
+   which is the CFA of the callee.  A return pops all frames whose SP
+   is at or below the SP after the return, and a call first pops the
+   frames at or below its own SP.  Hence frames left behind by
+   longjmp, exceptions or tail calls disappear at the next call or
+   return.
+
+   To take a stack trace, the top few frames are unwound as usual.
+   Once an unwound frame has the SP and return address of a shadow
+   frame, the rest of the trace is copied from the shadow stack
+   rather than unwound with CFI.  If no frame matches, or the shadow
+   stack may be incomplete, the whole stack is unwound as usual.
+
+   The shadow stack is incomplete while a signal handler runs, and
+   after the program switches stacks (makecontext/swapcontext,
+   sigaltstack, etc).  So a frame is pushed for each signal handler,
+   as if the handler was called by the signal return trampoline, and a
+   call a long way from the previous one pushes a frame for the new
+   stack.  Such frames are marked as starting a new segment, and the
+   shadow stack is not used while any of them is on it. */
+
+typedef
+   struct {
+      Addr sp;       /* the caller's SP at the time of the call */
+      Addr ret;      /* the return address */
+      Bool new_seg;  /* True if this frame starts a new segment */
+   }
+   ShadowFrame;
+
+typedef
+   struct {
+      ShadowFrame* frames;
+      UInt         used;
+      UInt         size;
+      UInt         n_new_segs;      /* frames[] with new_seg set */
+   }
+   ShadowStack;
+
+/* Indexed by ThreadId.  Allocated on first use. */
+static ShadowStack* shadow_stacks = NULL;
+
+/* Number of frames unwound as usual before giving up on finding a
+   frame that matches the shadow stack. */
+#define N_SHADOW_PROBE_FRAMES 8
+
+/* Stats */
+static ULong stats__shadow_traces    = 0;
+static ULong stats__shadow_fallbacks = 0;
+static ULong stats__shadow_frames    = 0;
+static UInt  stats__shadow_max_depth = 0;
+
+static ShadowStack* get_shadow_stack ( ThreadId tid )
+{
+   if (UNLIKELY(shadow_stacks == NULL))
+      shadow_stacks = VG_(calloc)("stacktrace.gss.1",
+                                  VG_N_THREADS, sizeof(ShadowStack));
+   vg_assert(tid > 0 && tid < VG_N_THREADS);
+   return &shadow_stacks[tid];
+}
+
+static void shadow_stack_pop_to ( ShadowStack* ss, Addr sp )
+{
+   while (ss->used > 0 && ss->frames[ss->used - 1].sp <= sp) {
+      ss->used--;
+      if (ss->frames[ss->used].new_seg)
+         ss->n_new_segs--;
+   }
+}
+
+static void shadow_stack_push ( ShadowStack* ss, Addr sp, Addr ret,
+                                Bool new_seg )
+{
+   ShadowFrame* f;
+
+   /* A call a long way from the previous one means the stack has
+      been switched. */
+   if (ss->used > 0) {
+      Addr prev_sp = ss->frames[ss->used - 1].sp;
+      Addr dist = prev_sp > sp ? prev_sp - sp : sp - prev_sp;
+      if (dist > (Addr)VG_(clo_max_stackframe))
+         new_seg = True;
+   }
+
+   shadow_stack_pop_to(ss, sp);
+
+   if (UNLIKELY(ss->used == ss->size)) {
+      ss->size = ss->size == 0 ? 64 : 2 * ss->size;
+      ss->frames = VG_(realloc)("stacktrace.ssp.1", ss->frames,
+                                ss->size * sizeof(ShadowFrame));
+   }
+   f = &ss->frames[ss->used++];
+   f->sp = sp;
+   f->ret = ret;
+   f->new_seg = new_seg;
+   if (new_seg)
+      ss->n_new_segs++;
+   if (UNLIKELY(ss->used > stats__shadow_max_depth))
+      stats__shadow_max_depth = ss->used;
+}
+
+VG_REGPARM(2)
+void VG_(shadow_stack_call) ( Addr sp, Addr ret )
+{
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   sp += sizeof(Addr); /* the call has pushed the return address */
+#  endif
+   shadow_stack_push(get_shadow_stack(VG_(get_running_tid)()),
+                     sp, ret, False);
+}
+
+VG_REGPARM(1)
+void VG_(shadow_stack_ret) ( Addr sp )
+{
+   shadow_stack_pop_to(get_shadow_stack(VG_(get_running_tid)()), sp);
+}
+
+void VG_(shadow_stack_signal_frame) ( ThreadId tid )
+{
+   Addr sp = VG_(get_SP)(tid);
+
+   if (!VG_(clo_unw_shadow_stack))
+      return;
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   sp += sizeof(Addr); /* the return address is on the stack */
+#  endif
+   /* The return address is never looked at, as the frame starts a
+      new segment. */
+   shadow_stack_push(get_shadow_stack(tid), sp, 0, True);
+}
+
+void VG_(shadow_stack_clear) ( ThreadId tid )
+{
+   if (shadow_stacks == NULL)
+      return;
+   ShadowStack* ss = get_shadow_stack(tid);
+   if (ss->frames)
+      VG_(free)(ss->frames);
+   VG_(memset)(ss, 0, sizeof(*ss));
+}
+
+/* Unwind up to N_SHADOW_PROBE_FRAMES frames as usual, then copy the
+   rest of the trace from tid's shadow stack.  Returns the number of
+   frames found, or 0 if the shadow stack can't be used, in which case
+   ips and sps have been trashed. */
+static UInt get_StackTrace_from_shadow_stack ( ThreadId tid,
+                                               /*OUT*/Addr* ips,
+                                               UInt max_n_ips,
+                                               /*OUT*/Addr* sps,
+                                               const UnwindStartRegs* regs,
+                                               Addr stack_highest_byte )
+{
+   ShadowStack* ss = get_shadow_stack(tid);
+   Addr         probe_sps[N_SHADOW_PROBE_FRAMES];
+   UInt         n_probe, n, i;
+   Int          k;
+
+   if (ss->n_new_segs > 0)
+      return 0;
+
+   n_probe = max_n_ips < N_SHADOW_PROBE_FRAMES
+             ? max_n_ips : N_SHADOW_PROBE_FRAMES;
+   n = VG_(get_StackTrace_wrk)(tid, ips, n_probe, probe_sps, NULL,
+                               regs, stack_highest_byte);
+   if (sps)
+      VG_(memcpy)(sps, probe_sps, n * sizeof(Addr));
+   if (n < n_probe)
+      return n; /* reached the bottom of the stack, so nothing to add */
+
+   /* Find the innermost unwound frame, other than the first, that is
+      also on the shadow stack.  ips[i] is the return address - 1 of
+      the call that is recorded with SP probe_sps[i]. */
+   k = ss->used - 1;
+   for (i = 1; i < n; i++) {
+      while (k >= 0 && ss->frames[k].sp < probe_sps[i])
+         k--;
+      if (k < 0)
+         return 0;
+      if (ss->frames[k].sp == probe_sps[i]
+          && ss->frames[k].ret - 1 == ips[i])
+         break;
+   }
+   if (i == n)
+      return 0;
+
+   /* Frames i+1 .. come from shadow frames k-1 .. 0. */
+   n = i + 1;
+   for (k--; k >= 0 && n < max_n_ips; k--) {
+      ips[n] = ss->frames[k].ret - 1;
+      if (sps)
+         sps[n] = ss->frames[k].sp;
+      n++;
+   }
+   stats__shadow_frames += n - (i + 1);
+   return n;
+}
+
+void VG_(print_stacktrace_stats) ( void )
+{
+   if (!VG_(clo_unw_shadow_stack))
+      return;
+   VG_(message)(Vg_DebugMsg,
+                "stacktrace: shadow stack: %'llu traces, %'llu fallbacks, "
+                "%'llu frames copied, max depth %'u\n",
+                stats__shadow_traces, stats__shadow_fallbacks,
+                stats__shadow_frames, stats__shadow_max_depth);
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Exported functions.                                  ---*/
 /*------------------------------------------------------------*/
@@ -1675,6 +1891,19 @@ UInt VG_(get_StackTrace_with_deltas)(
                   tid, stack_highest_byte,
                   startRegs.r_pc, startRegs.r_sp);
 
+   if (VG_(clo_unw_shadow_stack) && fps == NULL
+       && VG_(clo_merge_recursive_frames) == 0
+       && VG_(is_valid_tid)(tid)) {
+      UInt n_found = get_StackTrace_from_shadow_stack(tid, ips, n_ips, sps,
+                                                      &startRegs,
+                                                      stack_highest_byte);
+      if (n_found > 0) {
+         stats__shadow_traces++;
+         return n_found;
+      }
+      stats__shadow_fallbacks++;
+   }
+
    return VG_(get_StackTrace_wrk)(tid, ips, n_ips, 
                                        sps, fps,
                                        &startRegs,
@@ -44,6 +44,7 @@
 
 #include "pub_core_signals.h"    // VG_(synth_fault_{perms,mapping}
 #include "pub_core_stacks.h"     // VG_(unknown_SP_update*)()
+#include "pub_core_stacktrace.h" // VG_(shadow_stack_{call,ret})()
 #include "pub_core_tooliface.h"  // VG_(tdict)
 
 #include "pub_core_translate.h"
@@ -685,6 +686,69 @@ IRSB* vg_SP_update_pass ( void*             closureV,
 #undef DO_DIE
 }
 
+/* For --unw-shadow-stack=yes, add a call to VG_(shadow_stack_call) or
+   VG_(shadow_stack_ret) at the end of a block that ends in a call or
+   a return, so that m_stacktrace can keep the shadow call stack up to
+   date.  The return address of a call is the address following the
+   last instruction of the block.  Calls are not chased (see m_main),
+   so they always end a block. */
+static
+IRSB* vg_shadow_stack_pass ( IRSB* bb, const VexGuestLayout* layout,
+                             IRType gWordTy )
+{
+   Int      i;
+   IRTemp   sp;
+   IRDirty* dcall;
+
+   if (bb->jumpkind != Ijk_Call && bb->jumpkind != Ijk_Ret)
+      return bb;
+
+   sp = newIRTemp(bb->tyenv, gWordTy);
+   addStmtToIRSB( bb, IRStmt_WrTmp(sp, IRExpr_Get(layout->offset_SP,
+                                                  gWordTy)) );
+   if (bb->jumpkind == Ijk_Call) {
+      for (i = bb->stmts_used - 1; i >= 0; i--) {
+         if (bb->stmts[i]->tag == Ist_IMark)
+            break;
+      }
+      vg_assert(i >= 0);
+      Addr ret = bb->stmts[i]->Ist.IMark.addr + bb->stmts[i]->Ist.IMark.len;
+      dcall = unsafeIRDirty_0_N(
+                 2/*regparms*/,
+                 "VG_(shadow_stack_call)",
+                 VG_(fnptr_to_fnentry)( &VG_(shadow_stack_call) ),
+                 mkIRExprVec_2( IRExpr_RdTmp(sp), mkIRExpr_HWord(ret) )
+              );
+   } else {
+      dcall = unsafeIRDirty_0_N(
+                 1/*regparms*/,
+                 "VG_(shadow_stack_ret)",
+                 VG_(fnptr_to_fnentry)( &VG_(shadow_stack_ret) ),
+                 mkIRExprVec_1( IRExpr_RdTmp(sp) )
+              );
+   }
+   addStmtToIRSB( bb, IRStmt_Dirty(dcall) );
+   return bb;
+}
+
+/* The second instrumentation pass when the shadow call stack is in
+   use: the SP update pass if needed, then the shadow stack pass. */
+static
+IRSB* vg_SP_update_then_shadow_stack_pass ( void*             closureV,
+                                            IRSB*             sb_in,
+                                            const VexGuestLayout*  layout,
+                                            const VexGuestExtents* vge,
+                                            const VexArchInfo*     vai,
+                                            IRType            gWordTy,
+                                            IRType            hWordTy )
+{
+   IRSB* bb = sb_in;
+   if (need_to_handle_SP_assignment())
+      bb = vg_SP_update_pass(closureV, bb, layout, vge, vai,
+                             gWordTy, hWordTy);
+   return vg_shadow_stack_pass(bb, layout, gWordTy);
+}
+
 /*------------------------------------------------------------*/
 /*--- Main entry point for the JITter.                     ---*/
 /*------------------------------------------------------------*/
@@ -1791,7 +1855,9 @@ Bool VG_(translate) ( ThreadId tid,
      vta.instrument1     = g;
    }
    /* No need for type kludgery here. */
-   vta.instrument2       = need_to_handle_SP_assignment()
+   vta.instrument2       = VG_(clo_unw_shadow_stack)
+                              ? vg_SP_update_then_shadow_stack_pass
+                              : need_to_handle_SP_assignment()
                               ? vg_SP_update_pass
                               : NULL;
    vta.finaltidy         = VG_(needs).final_IR_tidy_pass
@@ -80,6 +80,10 @@ extern void VG_(addr_load_di)( Addr a );
 
 extern void VG_(di_load_di)( DebugInfo *di );
 
+/* As VG_(di_load_di), but also read the DWARF line number, inlined
+   call and variable info, which is otherwise only read on demand. */
+extern void VG_(di_load_dwarf)( DebugInfo *di );
+
 extern void VG_(load_di)( DebugInfo *di, Addr a );
 
 extern void VG_(di_discard_ALL_debuginfo)( void );
@@ -184,6 +188,9 @@ extern Bool VG_(use_FPO_info) ( /*MOD*/Addr* ipP,
    range [from,to]. */
 extern void VG_(ppUnwindInfo) (Addr from, Addr to);
 
+/* Show debuginfo reader statistics, for --stats=yes. */
+extern void VG_(print_debuginfo_stats) ( void );
+
 /* AVMAs for a symbol. Usually only the lowest address of the entity.
    On ppc64 platforms, also contains tocptr and local_ep.
    These fields should only be accessed using the macros
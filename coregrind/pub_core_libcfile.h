@@ -93,6 +93,12 @@ extern Int VG_(check_executable)(/*OUT*/Bool* is_setuid,
    in terms of pread()?) */
 extern SysRes VG_(pread) ( Int fd, void* buf, Int count, OffT offset );
 
+/* Tell the kernel that [offset, +len) of fd will be read soon, so that
+   it can start bringing it into the page cache in the background.
+   This is purely a hint.  It is only implemented on 64-bit Linux; on
+   other platforms it does nothing and returns an error. */
+extern SysRes VG_(fadvise_willneed) ( Int fd, Off64T offset, Off64T len );
+
 /* Size of fullname buffer needed for a call to VG_(mkstemp) with
    part_of_name having the given part_of_name_len. */
 extern SizeT VG_(mkstemp_fullname_bufsz) ( SizeT part_of_name_len );
@@ -173,6 +173,16 @@ extern const HChar* VG_(clo_debuginfo_server);
    _debuginfo_server. */
 extern Bool VG_(clo_allow_mismatched_debuginfo);
 
+/* Should we ask the kernel to start reading the debug sections of each
+   object in the background as soon as the object is mapped, rather
+   than waiting for the (deferred) reading of them?  Default: NO */
+extern Bool VG_(clo_debuginfo_readahead);
+
+/* Should local object files be mapped into memory for reading their
+   debug information, rather than read through a block cache?
+   Default: NO */
+extern Bool VG_(clo_debuginfo_mmap);
+
 /* DEBUG: print generated code?  default: 00000000 ( == NO ) */
 extern UChar VG_(clo_trace_flags);
 
@@ -420,6 +430,15 @@ extern UInt VG_(clo_unw_stack_scan_thresh);
    low by default.  Default: 5 */
 extern UInt VG_(clo_unw_stack_scan_frames);
 
+/* Should stack traces be taken from a shadow call stack, maintained
+   by instrumenting calls and returns, rather than by unwinding the
+   whole stack?  Default: NO */
+extern Bool VG_(clo_unw_shadow_stack);
+
+/* Approximate number of entries in the cache of CFI unwind info used
+   when unwinding stacks.  Default: 4096 */
+extern UInt VG_(clo_cfi_cache_size);
+
 /* Controls the resync-filter on MacOS.  Has no effect on Linux.
    0=disabled [default on Linux]   "no"
    1=enabled  [default on MacOS]   "yes"
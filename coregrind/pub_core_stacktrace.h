@@ -55,6 +55,24 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
                                const UnwindStartRegs* startRegs,
                                Addr fp_max_orig );
 
+// The shadow call stack, used by VG_(get_StackTrace) if
+// --unw-shadow-stack=yes.  VG_(shadow_stack_call) and
+// VG_(shadow_stack_ret) are called by the code generated for calls
+// and returns, with the SP and the return address after the call,
+// and the SP after the return.
+extern VG_REGPARM(2) void VG_(shadow_stack_call) ( Addr sp, Addr ret );
+extern VG_REGPARM(1) void VG_(shadow_stack_ret)  ( Addr sp );
+
+// Push a frame for the signal handler that tid is about to run, once
+// its signal frame has been built.  The handler's callers are not on
+// the shadow stack, so the shadow stack is not used until it returns.
+extern void VG_(shadow_stack_signal_frame) ( ThreadId tid );
+
+// Forget everything in the shadow stack of tid.
+extern void VG_(shadow_stack_clear) ( ThreadId tid );
+
+extern void VG_(print_stacktrace_stats) ( void );
+
 #endif   // __PUB_CORE_STACKTRACE_H
 
 /*--------------------------------------------------------------------*/
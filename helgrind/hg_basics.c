@@ -82,6 +82,14 @@ Bool  HG_(clo_delta_stacktrace) = False;
 
 UWord HG_(clo_conflict_cache_size) = 2000000;
 
+UWord HG_(clo_conflict_cache_max_age) = 0;
+
+UWord HG_(clo_vts_cache_size) = 16384;
+
+UWord HG_(clo_shadow_cache_size) = 65536;
+
+UWord HG_(clo_lock_trace_limit) = 1000;
+
 UWord HG_(clo_sanity_flags) = 0;
 
 Bool  HG_(clo_free_is_write) = False;
@@ -110,6 +110,25 @@ extern Bool  HG_(clo_delta_stacktrace);
    amd 10 million.  Default is 1 million. */
 extern UWord HG_(clo_conflict_cache_size);
 
+/* When doing "full" history collection, information about an access
+   is discarded once this many other accesses have been recorded since
+   it was, if not before.  Zero means no limit.  Default is zero. */
+extern UWord HG_(clo_conflict_cache_max_age);
+
+/* Minimum number of entries in each of the caches of vector
+   timestamp comparisons and joins.  Rounded up to a power of two.
+   Default is 16384. */
+extern UWord HG_(clo_vts_cache_size);
+
+/* Minimum number of lines in the cache in front of the compressed
+   shadow memory.  Rounded up to a power of two.  Default is 65536. */
+extern UWord HG_(clo_shadow_cache_size);
+
+/* Where a lock is acquired is no longer recorded once it has been
+   acquired this many times since it was last part of a new edge in
+   the lock order graph.  Zero means no limit.  Default is 1000. */
+extern UWord HG_(clo_lock_trace_limit);
+
 /* Sanity check level.  This is an or-ing of
    SCE_{THREADS,LOCKS,BIGRANGE,ACCESS,LAOG}. */
 extern UWord HG_(clo_sanity_flags);
@@ -171,8 +171,8 @@ static Lock* mk_LockP_from_LockN ( Lock* lkn,
       lkp->admin_prev = NULL;
       lkp->magic = LockP_MAGIC;
       /* Forget about the bag of lock holders - don't copy that.
-         Also, acquired_at should be NULL whenever heldBy is, and vice
-         versa.  Also forget about the associated libhb synch object. */
+         Also, acquired_at should be NULL whenever heldBy is.  Also
+         forget about the associated libhb synch object. */
       lkp->heldW  = False;
       lkp->heldBy = NULL;
       lkp->acquired_at = NULL;
@@ -73,8 +73,6 @@ static Bool is_sane_Lock_BASE ( Lock* lock )
       if (lock->acquired_at != NULL) return False;
       /* Unheld.  We arbitrarily require heldW to be False. */
       return !lock->heldW;
-   } else {
-      if (lock->acquired_at == NULL) return False;
    }
 
    /* If heldBy is non-NULL, we require it to contain at least one
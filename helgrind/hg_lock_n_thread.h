@@ -155,9 +155,13 @@ typedef
       /* Place where lock first came to the attention of Helgrind. */
       ExeContext*   appeared_at;
       /* If the lock is held, place where the lock most recently made
-         an unlocked->locked transition.  Must be sync'd with .heldBy:
-         either both NULL or both non-NULL. */
+         an unlocked->locked transition, or NULL if that was not
+         recorded.  Must be NULL if .heldBy is NULL. */
       ExeContext*   acquired_at;
+      /* Number of unlocked->locked transitions since the lock was last
+         part of a new edge in the lock order graph, saturating.  Once
+         it is large enough, .acquired_at is no longer recorded. */
+      UInt          n_acquires_since_new_edge;
       /* USEFUL-STATIC */
       SO*           hbso;      /* associated SO */
       Addr          guestaddr; /* Guest address of lock */
@@ -159,6 +159,7 @@ Lock* HG_(get_admin_locks) ( void ) { return admin_locks; }
 
 static UWord stats__lockN_acquires = 0;
 static UWord stats__lockN_releases = 0;
+static UWord stats__lockN_acquires_untraced = 0;
 
 #if defined(VGO_solaris)
 Bool HG_(clo_ignore_thread_creation) = True;
@@ -210,6 +211,7 @@ static Lock* mk_LockN ( LockKind kind, Addr guestaddr ) {
    lock->magic            = LockN_MAGIC;
    lock->appeared_at      = NULL;
    lock->acquired_at      = NULL;
+   lock->n_acquires_since_new_edge = 0;
    lock->hbso             = libhb_so_alloc();
    lock->guestaddr        = guestaddr;
    lock->kind             = kind;
@@ -246,6 +248,32 @@ static void del_LockN ( Lock* lk )
    HG_(free)(lk);
 }
 
+/* 'thr' is making 'lk' go from unlocked to locked.  Record where, so
+   as to produce better lock-order error messages.  Taking the stack
+   trace is most of the cost of an uncontended lock operation, and the
+   trace is only shown if an error involving the lock is reported
+   while it is held.  Such errors almost always come soon after the
+   lock order graph gains a new edge, and a program that keeps taking
+   the same locks in the same orders stops adding edges.  So a lock
+   that has been acquired HG_(clo_lock_trace_limit) times since it was
+   last part of a new edge is no longer traced.  If it becomes part of
+   a new edge again, laog__pre_thread_acquires_lock traces the
+   acquisition that causes it, and tracing resumes. */
+static void lockN_note_acquisition ( Lock* lk, Thread* thr )
+{
+   tl_assert(lk->heldBy == NULL);
+   tl_assert(lk->acquired_at == NULL);
+   if (HG_(clo_lock_trace_limit) == 0
+       || lk->n_acquires_since_new_edge < HG_(clo_lock_trace_limit)) {
+      ThreadId tid = map_threads_maybe_reverse_lookup_SLOW(thr);
+      lk->n_acquires_since_new_edge++;
+      lk->acquired_at
+         = VG_(record_ExeContext)(tid, 0/*first_ip_delta*/);
+   } else {
+      stats__lockN_acquires_untraced++;
+   }
+}
+
 /* Update 'lk' to reflect that 'thr' now has a write-acquisition of
    it.  This is done strictly: only combinations resulting from
    correct program and libpthread behaviour are allowed. */
@@ -257,17 +285,8 @@ static void lockN_acquire_writer ( Lock* lk, Thread* thr )
    stats__lockN_acquires++;
 
    /* EXPOSITION only */
-   /* We need to keep recording snapshots of where the lock was
-      acquired, so as to produce better lock-order error messages. */
-   if (lk->acquired_at == NULL) {
-      ThreadId tid;
-      tl_assert(lk->heldBy == NULL);
-      tid = map_threads_maybe_reverse_lookup_SLOW(thr);
-      lk->acquired_at
-         = VG_(record_ExeContext)(tid, 0/*first_ip_delta*/);
-   } else {
-      tl_assert(lk->heldBy != NULL);
-   }
+   if (lk->heldBy == NULL)
+      lockN_note_acquisition(lk, thr);
    /* end EXPOSITION only */
 
    switch (lk->kind) {
@@ -313,17 +332,8 @@ static void lockN_acquire_reader ( Lock* lk, Thread* thr )
    stats__lockN_acquires++;
 
    /* EXPOSITION only */
-   /* We need to keep recording snapshots of where the lock was
-      acquired, so as to produce better lock-order error messages. */
-   if (lk->acquired_at == NULL) {
-      ThreadId tid;
-      tl_assert(lk->heldBy == NULL);
-      tid = map_threads_maybe_reverse_lookup_SLOW(thr);
-      lk->acquired_at
-         = VG_(record_ExeContext)(tid, 0/*first_ip_delta*/);
-   } else {
-      tl_assert(lk->heldBy != NULL);
-   }
+   if (lk->heldBy == NULL)
+      lockN_note_acquisition(lk, thr);
    /* end EXPOSITION only */
 
    if (lk->heldBy) {
@@ -354,7 +364,6 @@ static void lockN_release ( Lock* lk, Thread* thr )
    /* thr must actually have been a holder of lk */
    tl_assert(b);
    /* normalise */
-   tl_assert(lk->acquired_at);
    if (VG_(isEmptyBag)(lk->heldBy)) {
       VG_(deleteBag)(lk->heldBy);
       lk->heldBy      = NULL;
@@ -3742,6 +3751,13 @@ static void laog__add_edge ( Lock* src, Lock* dst ) {
 
    tl_assert( (presentF && presentR) || (!presentF && !presentR) );
 
+   if (!presentF) {
+      /* Keep tracing acquisitions of both locks for a while: see
+         lockN_note_acquisition. */
+      src->n_acquires_since_new_edge = 0;
+      dst->n_acquires_since_new_edge = 0;
+   }
+
    if (!presentF && src->acquired_at && dst->acquired_at) {
       LAOGLinkExposition expo;
       /* If this edge is entering the graph, and we have acquired_at
@@ -3909,6 +3925,12 @@ Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
       'src' :-), so don't bother to try */
    if (HG_(isEmptyWS)( univ_lsets, dsts ))
       return NULL;
+   /* Likewise if 'src' has no successors and is not itself in
+      'dsts', which is the usual case for the innermost of a set of
+      nested locks. */
+   if (HG_(isEmptyWS)( univ_laog, laog__succs( src ) )
+       && !HG_(elemWS)( univ_lsets, dsts, (UWord)src ))
+      return NULL;
 
    ret     = NULL;
    stack   = VG_(newXA)( HG_(zalloc), "hg.lddft.1", HG_(free), sizeof(Lock*) );
@@ -4050,14 +4072,25 @@ static void laog__pre_thread_acquires_lock (
 
    /* Second, add to laog the pairs
         (old, lk)  |  old <- locks already held by thr
-      Since both old and lk are currently held by thr, their acquired_at
-      fields must be non-NULL.
+      If this acquisition of lk was not traced (see
+      lockN_note_acquisition) and is about to create a new edge, trace
+      it now, as we are still at the place where lk is being acquired.
+      An untraced old is only left without the exposition of the edge.
    */
-   tl_assert(lk->acquired_at);
    HG_(getPayloadWS)( &ls_words, &ls_size, univ_lsets, thr->locksetA );
+   if (lk->acquired_at == NULL) {
+      for (i = 0; i < ls_size; i++) {
+         if (!HG_(elemWS)( univ_laog, laog__succs( (Lock*)ls_words[i] ),
+                           (UWord)lk )) {
+            ThreadId tid = map_threads_maybe_reverse_lookup_SLOW(thr);
+            lk->acquired_at
+               = VG_(record_ExeContext)(tid, 0/*first_ip_delta*/);
+            break;
+         }
+      }
+   }
    for (i = 0; i < ls_size; i++) {
       Lock* old = (Lock*)ls_words[i];
-      tl_assert(old->acquired_at);
       laog__add_edge( old, lk );
    }
 
@@ -5805,6 +5838,18 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
    else if VG_BINT_CLO(arg, "--conflict-cache-size",
                        HG_(clo_conflict_cache_size), 10*1000, 150*1000*1000) {}
 
+   else if VG_BINT_CLO(arg, "--conflict-cache-max-age",
+                       HG_(clo_conflict_cache_max_age), 0, 2000*1000*1000) {}
+
+   else if VG_BINT_CLO(arg, "--vts-cache-size",
+                       HG_(clo_vts_cache_size), 1, 1 << 24) {}
+
+   else if VG_BINT_CLO(arg, "--shadow-cache-size",
+                       HG_(clo_shadow_cache_size), 1, 1 << 22) {}
+
+   else if VG_BINT_CLO(arg, "--lock-trace-limit",
+                       HG_(clo_lock_trace_limit), 0, 1000*1000*1000) {}
+
    /* "stuvwx" --> stuvwx (binary) */
    else if VG_STR_CLO(arg, "--hg-sanity-flags", tmp_str) {
       Int j;
@@ -5863,6 +5908,13 @@ static void hg_print_usage ( void )
 "        yes : derive a stacktrace from the previous stacktrace\n"
 "          if there was no call/return or similar instruction\n"
 "    --conflict-cache-size=N   size of 'full' history cache [2000000]\n"
+"    --conflict-cache-max-age=N  discard 'full' history older than\n"
+"                              N accesses, 0 for no limit [0]\n"
+"    --vts-cache-size=N        size of vector timestamp caches [16384]\n"
+"    --shadow-cache-size=N     lines in the shadow memory cache [65536]\n"
+"    --lock-trace-limit=N      stop recording where a lock is acquired\n"
+"                              after N acquisitions adding no new lock\n"
+"                              order, 0 for no limit [1000]\n"
 "    --check-stack-refs=no|yes race-check reads and writes on the\n"
 "                              main stack and thread stacks? [yes]\n"
 "    --ignore-thread-creation=yes|no Ignore activities during thread\n"
@@ -5947,9 +5999,10 @@ static void hg_print_stats (void)
    }
 
    VG_(printf)("           locks: %'8lu acquires, "
-               "%'lu releases\n",
+               "%'lu releases, %'lu acquires untraced\n",
                stats__lockN_acquires,
-               stats__lockN_releases
+               stats__lockN_releases,
+               stats__lockN_acquires_untraced
               );
    VG_(printf)("   sanity checks: %'8lu\n", stats__sanity_checks);
 
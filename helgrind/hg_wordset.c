@@ -121,6 +121,72 @@ typedef
       _cache->ent[0].res  = _res;                                    \
    } while (0)
 
+/* addTo and delFrom are done twice for each lock acquisition and
+   release, so a program using many locks soon has more distinct
+   (set, element) pairs in use than a WCache can usefully hold.  They
+   use instead a 2-way set associative cache hashed on both arguments,
+   whose lookup costs the same whatever its size.  A new entry goes in
+   the first way of its set, moving the previous one to the second
+   way.  Rather than clearing all the entries when a set dies (see
+   HG_(dieWS)), the whole cache is invalidated by bumping .gen: only
+   entries whose .gen matches are valid. */
+#define N_WHCACHE_BITS 10
+#define N_WHCACHE      (1 << N_WHCACHE_BITS)
+typedef
+   struct { UWord arg1; UWord arg2; UWord res; UWord gen; }
+   WHCacheEnt;
+typedef
+   struct {
+      WHCacheEnt ent[N_WHCACHE];
+      UWord      gen; /* never 0, so that zeroed entries are invalid */
+   }
+   WHCache;
+
+/* Index of the first way of the set for (arg1, arg2). */
+static inline UWord WHCache_hash ( UWord arg1, UWord arg2 )
+{
+   UInt h = ((UInt)arg1 * 0x9E3779B1U) ^ (UInt)(arg2 >> 3) ^ (UInt)(arg2 >> 17);
+   return ((h * 0x85EBCA6BU) >> (32 - N_WHCACHE_BITS)) & ~1U;
+}
+
+#define WHCache_INIT(_zzcache)                                       \
+   do {                                                              \
+      VG_(memset)(&(_zzcache), 0, sizeof(WHCache));                  \
+      (_zzcache).gen = 1;                                            \
+   } while (0)
+
+#define WHCache_LOOKUP_AND_RETURN(_retty,_zzcache,_zzarg1,_zzarg2)   \
+   do {                                                              \
+      UWord       _arg1  = (UWord)(_zzarg1);                         \
+      UWord       _arg2  = (UWord)(_zzarg2);                         \
+      WHCacheEnt* _ent   = &(_zzcache).ent[WHCache_hash(_arg1,_arg2)]; \
+      if (_ent[0].arg1 == _arg1 && _ent[0].arg2 == _arg2             \
+          && _ent[0].gen == (_zzcache).gen)                          \
+         return (_retty)_ent[0].res;                                 \
+      if (_ent[1].arg1 == _arg1 && _ent[1].arg2 == _arg2             \
+          && _ent[1].gen == (_zzcache).gen)                          \
+         return (_retty)_ent[1].res;                                 \
+   } while (0)
+
+#define WHCache_UPDATE(_zzcache,_zzarg1,_zzarg2,_zzresult)           \
+   do {                                                              \
+      UWord       _arg1  = (UWord)(_zzarg1);                         \
+      UWord       _arg2  = (UWord)(_zzarg2);                         \
+      WHCacheEnt* _ent   = &(_zzcache).ent[WHCache_hash(_arg1,_arg2)]; \
+      _ent[1]      = _ent[0];                                        \
+      _ent[0].arg1 = _arg1;                                          \
+      _ent[0].arg2 = _arg2;                                          \
+      _ent[0].res  = (UWord)(_zzresult);                             \
+      _ent[0].gen  = (_zzcache).gen;                                 \
+   } while (0)
+
+#define WHCache_INVALIDATE(_zzcache)                                 \
+   do {                                                              \
+      (_zzcache).gen++;                                              \
+      if (UNLIKELY((_zzcache).gen == 0))                             \
+         WHCache_INIT(_zzcache);                                     \
+   } while (0)
+
 
 //------------------------------------------------------------------//
 //---                          WordSet                           ---//
@@ -154,8 +220,8 @@ struct _WordSetU {
       WordVec** ix2vec_free;
       WordSet   empty; /* cached, for speed */
       /* Caches for some operations */
-      WCache    cache_addTo;
-      WCache    cache_delFrom;
+      WHCache   cache_addTo;
+      WHCache   cache_delFrom;
       WCache    cache_intersect;
       WCache    cache_minus;
       /* Stats */
@@ -367,8 +433,8 @@ WordSetU* HG_(newWordSetU) ( void* (*alloc_nofail)( const HChar*, SizeT ),
    wsu->ix2vec_size = 0;
    wsu->ix2vec      = NULL;
    wsu->ix2vec_free = NULL;
-   WCache_INIT(wsu->cache_addTo,     cacheSize);
-   WCache_INIT(wsu->cache_delFrom,   cacheSize);
+   WHCache_INIT(wsu->cache_addTo);
+   WHCache_INIT(wsu->cache_delFrom);
    WCache_INIT(wsu->cache_intersect, cacheSize);
    WCache_INIT(wsu->cache_minus,     cacheSize);
    empty = new_WV_of_size( wsu, 0 );
@@ -479,8 +545,8 @@ void HG_(dieWS) ( WordSetU* wsu, WordSet ws )
 
    delete_WV( wv );
 
-   wsu->cache_addTo.inUse = 0;
-   wsu->cache_delFrom.inUse = 0;
+   WHCache_INVALIDATE(wsu->cache_addTo);
+   WHCache_INVALIDATE(wsu->cache_delFrom);
    wsu->cache_intersect.inUse = 0;
    wsu->cache_minus.inUse = 0;
 }
@@ -602,7 +668,7 @@ WordSet HG_(addToWS) ( WordSetU* wsu, WordSet ws, UWord w )
    WordSet  result = (WordSet)(-1); /* bogus */
 
    wsu->n_add++;
-   WCache_LOOKUP_AND_RETURN(WordSet, wsu->cache_addTo, ws, w);
+   WHCache_LOOKUP_AND_RETURN(WordSet, wsu->cache_addTo, ws, w);
    wsu->n_add_uncached++;
 
    /* If already present, this is a no-op. */
@@ -631,7 +697,7 @@ WordSet HG_(addToWS) ( WordSetU* wsu, WordSet ws, UWord w )
    tl_assert(result != (WordSet)(-1));
 
   out:
-   WCache_UPDATE(wsu->cache_addTo, ws, w, result);
+   WHCache_UPDATE(wsu->cache_addTo, ws, w, result);
    return result;
 }
 
@@ -650,7 +716,7 @@ WordSet HG_(delFromWS) ( WordSetU* wsu, WordSet ws, UWord w )
       return ws;
    }
 
-   WCache_LOOKUP_AND_RETURN(WordSet, wsu->cache_delFrom, ws, w);
+   WHCache_LOOKUP_AND_RETURN(WordSet, wsu->cache_delFrom, ws, w);
    wsu->n_del_uncached++;
 
    /* If not already present, this is a no-op. */
@@ -682,7 +748,7 @@ WordSet HG_(delFromWS) ( WordSetU* wsu, WordSet ws, UWord w )
    }
 
   out:
-   WCache_UPDATE(wsu->cache_delFrom, ws, w, result);
+   WHCache_UPDATE(wsu->cache_delFrom, ws, w, result);
    return result;
 }
 
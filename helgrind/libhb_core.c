@@ -594,7 +594,15 @@ static inline Bool is_sane_SecMap ( SecMap* sm ) {
 
 /* ------ Cache ------ */
 
-#define N_WAY_BITS 16
+/* The cache is set associative, with N_WAY_NENT ways per set.  The
+   number of sets is a power of 2 derived from
+   HG_(clo_shadow_cache_size) at startup.  Within a set, the entries
+   are kept in most-recently-used order, so the common case of a hit
+   on the first entry costs the same as a direct-mapped lookup, and
+   the entry to evict on a miss is always the last one.  An entry only
+   holds the tag and a pointer to its CacheLine in lyns0[]; moving an
+   entry to the front of its set does not move the CacheLine. */
+#define N_WAY_BITS 2
 #define N_WAY_NENT (1 << N_WAY_BITS)
 
 /* Each tag is the address of the associated CacheLine, rounded down
@@ -606,8 +614,16 @@ static inline Bool is_sane_SecMap ( SecMap* sm ) {
    with a bogus tag. */
 typedef
    struct {
-      CacheLine lyns0[N_WAY_NENT];
-      Addr      tags0[N_WAY_NENT];
+      Addr       tag;
+      CacheLine* line; /* one of the lines in lyns0[] */
+   }
+   CacheEnt;
+
+typedef
+   struct {
+      CacheEnt*  ents0;    /* n_sets * N_WAY_NENT entries */
+      CacheLine* lyns0;    /* n_sets * N_WAY_NENT lines */
+      UWord      set_mask; /* n_sets - 1 */
    }
    Cache;
 
@@ -642,6 +658,9 @@ static UWord stats__cache_F_wbacks       = 0; // # F lines written back
 static UWord stats__cache_flushes_invals = 0; // # cache flushes and invals
 static UWord stats__cache_totrefs        = 0; // # total accesses
 static UWord stats__cache_totmisses      = 0; // # misses
+static UWord stats__cache_way_hits       = 0; // # hits not on the MRU way
+static UWord stats__cache_Z_fetches_uniform = 0; // # Z fetches of 1 SVal
+static UWord stats__cache_Z_wbacks_uniform  = 0; // # Z wbacks of 1 SVal
 static ULong stats__cache_make_New_arange = 0; // total arange made New
 static ULong stats__cache_make_New_inZrep = 0; // arange New'd on Z reps
 static UWord stats__cline_normalises     = 0; // # calls to cacheline_normalise
@@ -668,6 +687,8 @@ static UWord stats__cline_16to8pulldown  = 0; // # calls to pulldown_to_8
 static UWord stats__vts__tick            = 0; // # calls to VTS__tick
 static UWord stats__vts__join            = 0; // # calls to VTS__join
 static UWord stats__vts__cmpLEQ          = 0; // # calls to VTS__cmpLEQ
+static UWord stats__vts__join_same       = 0; // # of those with same thrids
+static UWord stats__vts__cmpLEQ_same     = 0; // # of those with same thrids
 static UWord stats__vts__cmp_structural  = 0; // # calls to VTS__cmp_structural
 static UWord stats__vts_tab_GC           = 0; // # nr of vts_tab GC
 static UWord stats__vts_pruning          = 0; // # nr of vts pruning
@@ -1492,14 +1513,32 @@ void sequentialise_CacheLine ( /*OUT*/CountedSVal* dst,
    *dstUsedP = dstUsed;
 }
 
-/* Write the cacheline 'wix' to backing store.  Where it ends up
-   is determined by its tag field. */
-static __attribute__((noinline)) void cacheline_wback ( UWord wix )
+/* Returns True, and the SVal in *svP, if every byte of the
+   cacheline has the same SVal and each tree is fully collapsed.  This
+   is the usual state of memory that has only been written as a whole
+   (eg freshly allocated memory), so it deserves a fast path in
+   cacheline_wback.  A line that is uniform but not normalised is
+   simply handled by the general path. */
+static inline Bool is_uniform_CacheLine ( const CacheLine* cl,
+                                          /*OUT*/SVal* svP )
+{
+   Word tno;
+   SVal sv = cl->svals[0];
+   for (tno = 0; tno < N_LINE_TREES; tno++) {
+      if (cl->descrs[tno] != TREE_DESCR_64 || cl->svals[tno << 3] != sv)
+         return False;
+   }
+   *svP = sv;
+   return True;
+}
+
+/* Write the cacheline 'cl' to backing store.  Where it ends up
+   is determined by 'tag'. */
+static __attribute__((noinline)) void cacheline_wback ( Addr tag,
+                                                        CacheLine* cl )
 {
    Word        i, j, k, m;
-   Addr        tag;
    SecMap*     sm;
-   CacheLine*  cl;
    LineZ* lineZ;
    LineF* lineF;
    Word        zix, fix, csvalsUsed;
@@ -1507,12 +1546,7 @@ static __attribute__((noinline)) void cacheline_wback ( UWord wix )
    SVal        sv;
 
    if (0)
-   VG_(printf)("scache wback line %d\n", (Int)wix);
-
-   tl_assert(wix < N_WAY_NENT);
-
-   tag =  cache_shmem.tags0[wix];
-   cl  = &cache_shmem.lyns0[wix];
+   VG_(printf)("scache wback line %#lx\n", tag);
 
    /* The cache line may have been invalidated; if so, ignore it. */
    if (!is_valid_scache_tag(tag))
@@ -1536,6 +1570,17 @@ static __attribute__((noinline)) void cacheline_wback ( UWord wix )
    if (CHECK_ZSM)
       tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
 
+   if (is_uniform_CacheLine(cl, &sv)) {
+      lineZ->dict[0] = sv;
+      lineZ->dict[1] = lineZ->dict[2] = lineZ->dict[3] = SVal_INVALID;
+      for (i = 0; i < N_LINE_ARANGE/4; i++)
+         lineZ->ix2s[i] = 0; /* all refer to dict[0] */
+      rcinc_LineZ(lineZ);
+      stats__cache_Z_wbacks++;
+      stats__cache_Z_wbacks_uniform++;
+      return;
+   }
+
    csvalsUsed = -1;
    sequentialise_CacheLine( csvals, &csvalsUsed, 
                             N_LINE_ARANGE, cl );
@@ -1633,25 +1678,16 @@ static __attribute__((noinline)) void cacheline_wback ( UWord wix )
    }
 }
 
-/* Fetch the cacheline 'wix' from the backing store.  The tag
-   associated with 'wix' is assumed to have already been filled in;
-   hence that is used to determine where in the backing store to read
-   from. */
-static __attribute__((noinline)) void cacheline_fetch ( UWord wix )
+/* Fetch into 'cl' the cacheline 'tag' from the backing store. */
+static __attribute__((noinline)) void cacheline_fetch ( Addr tag,
+                                                        CacheLine* cl )
 {
    Word       i;
-   Addr       tag;
-   CacheLine* cl;
    LineZ*     lineZ;
    LineF*     lineF;
 
    if (0)
-   VG_(printf)("scache fetch line %d\n", (Int)wix);
-
-   tl_assert(wix < N_WAY_NENT);
-
-   tag =  cache_shmem.tags0[wix];
-   cl  = &cache_shmem.lyns0[wix];
+   VG_(printf)("scache fetch line %#lx\n", tag);
 
    /* reject nonsense requests */
    tl_assert(is_valid_scache_tag(tag));
@@ -1668,6 +1704,22 @@ static __attribute__((noinline)) void cacheline_fetch ( UWord wix )
          cl->svals[i] = lineF->w64s[i];
       }
       stats__cache_F_fetches++;
+   } else if (lineZ->dict[1] == SVal_INVALID
+              && lineZ->dict[2] == SVal_INVALID
+              && lineZ->dict[3] == SVal_INVALID) {
+      /* All the bytes have the same SVal, so the normalised line is
+         known without looking at ix2s: one 64-bit node per tree. */
+      SVal sv = lineZ->dict[0];
+      if (CHECK_ZSM) tl_assert(sv != SVal_INVALID);
+      for (i = 0; i < N_LINE_ARANGE; i++)
+         cl->svals[i] = (i & 7) == 0 ? sv : SVal_INVALID;
+      for (i = 0; i < N_LINE_TREES; i++)
+         cl->descrs[i] = TREE_DESCR_64;
+      if (CHECK_ZSM)
+         tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
+      stats__cache_Z_fetches++;
+      stats__cache_Z_fetches_uniform++;
+      return;
    } else {
       for (i = 0; i < N_LINE_ARANGE; i++) {
          UWord ix = read_twobit_array( lineZ->ix2s, i );
@@ -1680,11 +1732,31 @@ static __attribute__((noinline)) void cacheline_fetch ( UWord wix )
    normalise_CacheLine( cl );
 }
 
+/* Index in cache_shmem.ents0 of the first entry of the set that
+   holds the CacheLine containing 'a'. */
+static inline UWord get_cacheset_base ( Addr a ) {
+   return ((a >> N_LINE_BITS) & cache_shmem.set_mask) << N_WAY_BITS;
+}
+
+/* Returns the CacheLine currently holding 'tag', or NULL if that line
+   is not in the cache.  Unlike get_cacheline, this neither fetches
+   the line nor changes the replacement order. */
+static CacheLine* find_cacheline_no_fetch ( Addr tag ) {
+   UWord base = get_cacheset_base(tag);
+   UWord w;
+   for (w = 0; w < N_WAY_NENT; w++) {
+      if (cache_shmem.ents0[base + w].tag == tag)
+         return cache_shmem.ents0[base + w].line;
+   }
+   return NULL;
+}
+
 /* Invalid the cachelines corresponding to the given range, which
    must start and end on a cacheline boundary. */
 static void shmem__invalidate_scache_range (Addr ga, SizeT szB)
 {
-   Word wix;
+   UWord n_sets = cache_shmem.set_mask + 1;
+   UWord set, w;
 
    /* ga must be on a cacheline boundary. */
    tl_assert (is_valid_scache_tag (ga));
@@ -1692,36 +1764,40 @@ static void shmem__invalidate_scache_range (Addr ga, SizeT szB)
    tl_assert (0 == (szB & (N_LINE_ARANGE - 1)));
    
 
-   Word ga_ix = (ga >> N_LINE_BITS) & (N_WAY_NENT - 1);
-   Word nwix = szB / N_LINE_ARANGE;
+   UWord ga_set = (ga >> N_LINE_BITS) & cache_shmem.set_mask;
+   UWord nset = szB / N_LINE_ARANGE;
 
-   if (nwix > N_WAY_NENT)
-      nwix = N_WAY_NENT; // no need to check several times the same entry.
+   if (nset > n_sets)
+      nset = n_sets; // no need to check several times the same set.
 
-   for (wix = 0; wix < nwix; wix++) {
-      if (address_in_range(cache_shmem.tags0[ga_ix], ga, szB))
-         cache_shmem.tags0[ga_ix] = 1/*INVALID*/;
-      ga_ix++;
-      if (UNLIKELY(ga_ix == N_WAY_NENT))
-         ga_ix = 0;
+   for (set = 0; set < nset; set++) {
+      CacheEnt* ents = &cache_shmem.ents0[ga_set << N_WAY_BITS];
+      for (w = 0; w < N_WAY_NENT; w++) {
+         if (address_in_range(ents[w].tag, ga, szB))
+            ents[w].tag = 1/*INVALID*/;
+      }
+      ga_set++;
+      if (UNLIKELY(ga_set == n_sets))
+         ga_set = 0;
    }
 }
 
 
 static void shmem__flush_and_invalidate_scache ( void ) {
-   Word wix;
+   UWord wix;
+   UWord n_ents = (cache_shmem.set_mask + 1) << N_WAY_BITS;
    Addr tag;
    if (0) VG_(printf)("%s","scache flush and invalidate\n");
    tl_assert(!is_valid_scache_tag(1));
-   for (wix = 0; wix < N_WAY_NENT; wix++) {
-      tag = cache_shmem.tags0[wix];
+   for (wix = 0; wix < n_ents; wix++) {
+      tag = cache_shmem.ents0[wix].tag;
       if (tag == 1/*INVALID*/) {
          /* already invalid; nothing to do */
       } else {
          tl_assert(is_valid_scache_tag(tag));
-         cacheline_wback( wix );
+         cacheline_wback( tag, cache_shmem.ents0[wix].line );
       }
-      cache_shmem.tags0[wix] = 1/*INVALID*/;
+      cache_shmem.ents0[wix].tag = 1/*INVALID*/;
    }
    stats__cache_flushes_invals++;
 }
@@ -1759,10 +1835,10 @@ static inline CacheLine* get_cacheline ( Addr a )
    /* tag is 'a' with the in-line offset masked out, 
       eg a[31]..a[4] 0000 */
    Addr       tag = a & ~(N_LINE_ARANGE - 1);
-   UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
+   CacheEnt*  ent = &cache_shmem.ents0[get_cacheset_base(a)];
    stats__cache_totrefs++;
-   if (LIKELY(tag == cache_shmem.tags0[wix])) {
-      return &cache_shmem.lyns0[wix];
+   if (LIKELY(tag == ent->tag)) {
+      return ent->line;
    } else {
       return get_cacheline_MISS( a );
    }
@@ -1775,27 +1851,44 @@ static __attribute__((noinline))
       eg a[31]..a[4] 0000 */
 
    CacheLine* cl;
-   Addr*      tag_old_p;
-   Addr       tag = a & ~(N_LINE_ARANGE - 1);
-   UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
-
-   tl_assert(tag != cache_shmem.tags0[wix]);
+   CacheEnt   hit;
+   Addr       tag  = a & ~(N_LINE_ARANGE - 1);
+   CacheEnt*  ents = &cache_shmem.ents0[get_cacheset_base(a)];
+   UWord      w;
+
+   tl_assert(tag != ents[0].tag);
+
+   /* Look in the other ways of the set.  If found, move the entry to
+      the front so that the next access to it takes the fast path. */
+   for (w = 1; w < N_WAY_NENT; w++) {
+      if (ents[w].tag == tag) {
+         hit = ents[w];
+         for (; w > 0; w--)
+            ents[w] = ents[w-1];
+         ents[0] = hit;
+         stats__cache_way_hits++;
+         return hit.line;
+      }
+   }
 
-   /* Dump the old line into the backing store. */
+   /* Dump the least recently used line into the backing store. */
    stats__cache_totmisses++;
 
-   cl        = &cache_shmem.lyns0[wix];
-   tag_old_p = &cache_shmem.tags0[wix];
+   hit = ents[N_WAY_NENT-1];
+   cl  = hit.line;
 
-   if (is_valid_scache_tag( *tag_old_p )) {
+   if (is_valid_scache_tag( hit.tag )) {
       /* EXPENSIVE and REDUNDANT: callee does it */
       if (CHECK_ZSM)
          tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
-      cacheline_wback( wix );
-   }
-   /* and reload the new one */
-   *tag_old_p = tag;
-   cacheline_fetch( wix );
+      cacheline_wback( hit.tag, cl );
+   }
+   /* and reload the new one, at the front of the set */
+   for (w = N_WAY_NENT-1; w > 0; w--)
+      ents[w] = ents[w-1];
+   hit.tag = tag;
+   ents[0] = hit;
+   cacheline_fetch( tag, cl );
    if (CHECK_ZSM)
       tl_assert(is_sane_CacheLine(cl)); /* EXPENSIVE */
    return cl;
@@ -1991,10 +2084,23 @@ static void zsm_init ( void )
    map_shmem = VG_(newFM)( HG_(zalloc), "libhb.zsm_init.1 (map_shmem)",
                            HG_(free), 
                            NULL/*unboxed UWord cmp*/);
-   /* Invalidate all cache entries. */
+   /* Allocate the cache, with at least one set, and invalidate all
+      its entries. */
+   UWord n_sets = 1;
+   while ((n_sets << N_WAY_BITS) < HG_(clo_shadow_cache_size))
+      n_sets <<= 1;
+   cache_shmem.set_mask = n_sets - 1;
+   cache_shmem.ents0 = HG_(zalloc)( "libhb.zsm_init.2 (cache ents)",
+                                    (n_sets << N_WAY_BITS) * sizeof(CacheEnt) );
+   /* The lines are not zeroed, as a line is only ever read after
+      cacheline_fetch has filled it.  This avoids touching all of the
+      cache's pages at startup. */
+   cache_shmem.lyns0 = VG_(malloc)( "libhb.zsm_init.3 (cache lines)",
+                                    (n_sets << N_WAY_BITS) * sizeof(CacheLine) );
    tl_assert(!is_valid_scache_tag(1));
-   for (UWord wix = 0; wix < N_WAY_NENT; wix++) {
-      cache_shmem.tags0[wix] = 1/*INVALID*/;
+   for (UWord wix = 0; wix < (n_sets << N_WAY_BITS); wix++) {
+      cache_shmem.ents0[wix].tag = 1/*INVALID*/;
+      cache_shmem.ents0[wix].line = &cache_shmem.lyns0[wix];
    }
 
    LineF_pool_allocator = VG_(newPA) (
@@ -2399,6 +2505,85 @@ static void VTS__tick ( /*OUT*/VTS* out, Thr* me, VTS* vts )
 }
 
 
+/* In a long running program with many threads, most VTSs mention
+   all of the live threads, so a and b very often hold the same
+   ThrIDs in the same order.  The join and comparison then don't need
+   the general merge below, and can be done entry by entry on the
+   ScalarTSs seen as ULongs: since the ThrID bits of each pair are
+   equal, comparing the ULongs compares the timestamps, whichever
+   bits the ThrID is allocated.  These loops have no data dependent
+   branches, and compilers can vectorise them. */
+
+static inline ULong ScalarTS__as_ULong ( const ScalarTS* st ) {
+   return *(const ULong*)st;
+}
+
+/* The bits of a ScalarTS seen as a ULong which hold the ThrID. */
+static inline ULong ScalarTS__thrid_mask ( void ) {
+   ScalarTS st;
+   st.thrid = ThrID_MAX_VALID;
+   st.tym   = 0;
+   return ScalarTS__as_ULong(&st);
+}
+
+/* If a and b, of the same length, hold the same ThrIDs, write their
+   join to out and return True.  Otherwise return False, leaving out
+   with an unspecified content but with .usedTS still zero. */
+static Bool VTS__join_same_thrids ( /*OUT*/VTS* out, VTS* a, VTS* b )
+{
+   const ULong  mask = ScalarTS__thrid_mask();
+   const ULong* pa   = (const ULong*)&a->ts[0];
+   const ULong* pb   = (const ULong*)&b->ts[0];
+   ULong*       po   = (ULong*)&out->ts[0];
+   ULong        diff = 0;
+   UInt         i, n = a->usedTS;
+
+   for (i = 0; i < n; i++) {
+      ULong x = pa[i], y = pb[i];
+      diff |= x ^ y;
+      po[i] = x > y ? x : y;
+   }
+   /* Exact same VTSs are usually caught by the VtsID callers, so
+      only the ThrIDs need checking here. */
+   if ((diff & mask) != 0)
+      return False;
+   out->usedTS = n;
+   return True;
+}
+
+/* If a and b, of the same length, hold the same ThrIDs, set *res to
+   what VTS__cmpLEQ would return and return True.  Otherwise return
+   False. */
+static Bool VTS__cmpLEQ_same_thrids ( /*OUT*/UInt* res, VTS* a, VTS* b )
+{
+   const ULong  mask = ScalarTS__thrid_mask();
+   const ULong* pa   = (const ULong*)&a->ts[0];
+   const ULong* pb   = (const ULong*)&b->ts[0];
+   ULong        diff = 0;
+   UInt         gt   = 0;
+   UInt         i, n = a->usedTS;
+
+   for (i = 0; i < n; i++) {
+      ULong x = pa[i], y = pb[i];
+      diff |= x ^ y;
+      gt   |= x > y;
+   }
+   if ((diff & mask) != 0)
+      return False;
+   *res = 0;
+   if (gt) {
+      for (i = 0; i < n; i++) {
+         if (a->ts[i].tym > b->ts[i].tym) {
+            *res = a->ts[i].thrid;
+            break;
+         }
+      }
+      tl_assert(*res >= 1024);
+   }
+   return True;
+}
+
+
 /* Return a new VTS constructed as the join (max) of the 2 args.
    Neither arg is modified.
 */
@@ -2424,6 +2609,12 @@ static void VTS__join ( /*OUT*/VTS* out, VTS* a, VTS* b )
       scalarts_limitations_fail_NORETURN( True/*due_to_nThrs*/ );
    tl_assert(out->sizeTS >= useda + usedb);
 
+   if (useda == usedb && VTS__join_same_thrids(out, a, b)) {
+      stats__vts__join_same++;
+      tl_assert(is_sane_VTS(out));
+      return;
+   }
+
    ia = ib = 0;
 
    while (1) {
@@ -2517,6 +2708,14 @@ static UInt/*ThrID*/ VTS__cmpLEQ ( VTS* a, VTS* b )
    useda = a->usedTS;
    usedb = b->usedTS;
 
+   if (useda == usedb) {
+      UInt res;
+      if (VTS__cmpLEQ_same_thrids(&res, a, b)) {
+         stats__vts__cmpLEQ_same++;
+         return res;
+      }
+   }
+
    ia = ib = 0;
 
    while (1) {
@@ -3410,29 +3609,47 @@ static inline UInt ROL32 ( UInt w, Int n ) {
    w = (w << n) | (w >> (32-n));
    return w;
 }
-static inline UInt hash_VtsIDs ( VtsID vi1, VtsID vi2, UInt nTab ) {
-   UInt hash = ROL32(vi1,19) ^ ROL32(vi2,13);
-   return hash % nTab;
+/* The caches have a power of two number of entries, at least
+   HG_(clo_vts_cache_size), so the hash must mix the VtsIDs into the
+   bits it keeps. */
+static UInt vtsid_cache_bits = 0;
+static inline UInt hash_VtsIDs ( VtsID vi1, VtsID vi2 ) {
+   UInt hash = (ROL32(vi1,19) ^ vi2) * 0x9E3779B1U;
+   return hash >> (32 - vtsid_cache_bits);
 }
 
-#define N_CMPLEQ_CACHE 1023
-static
+static UInt n_vtsid_caches = 0;
+
+typedef
    struct { VtsID vi1; VtsID vi2; Bool leq; }
-   cmpLEQ_cache[N_CMPLEQ_CACHE];
+   CmpLEQCacheEnt;
+static CmpLEQCacheEnt* cmpLEQ_cache = NULL;
 
-#define N_JOIN2_CACHE 1023
-static
+typedef
    struct { VtsID vi1; VtsID vi2; VtsID res; }
-   join2_cache[N_JOIN2_CACHE];
+   Join2CacheEnt;
+static Join2CacheEnt* join2_cache = NULL;
+
+static void VtsID__init_caches ( void ) {
+   vtsid_cache_bits = 1;
+   while ((1UL << vtsid_cache_bits) < HG_(clo_vts_cache_size))
+      vtsid_cache_bits++;
+   tl_assert(vtsid_cache_bits <= 31);
+   n_vtsid_caches = 1U << vtsid_cache_bits;
+   cmpLEQ_cache = HG_(zalloc)( "libhb.VtsID__init_caches.1",
+                               n_vtsid_caches * sizeof(CmpLEQCacheEnt) );
+   join2_cache  = HG_(zalloc)( "libhb.VtsID__init_caches.2",
+                               n_vtsid_caches * sizeof(Join2CacheEnt) );
+}
 
 static void VtsID__invalidate_caches ( void ) {
-   Int i;
-   for (i = 0; i < N_CMPLEQ_CACHE; i++) {
+   UInt i;
+   for (i = 0; i < n_vtsid_caches; i++) {
       cmpLEQ_cache[i].vi1 = VtsID_INVALID;
       cmpLEQ_cache[i].vi2 = VtsID_INVALID;
       cmpLEQ_cache[i].leq = False;
    }
-   for (i = 0; i < N_JOIN2_CACHE; i++) {
+   for (i = 0; i < n_vtsid_caches; i++) {
      join2_cache[i].vi1 = VtsID_INVALID;
      join2_cache[i].vi2 = VtsID_INVALID;
      join2_cache[i].res = VtsID_INVALID;
@@ -3472,7 +3689,7 @@ static Bool VtsID__cmpLEQ_WRK ( VtsID vi1, VtsID vi2 ) {
    tl_assert(vi1 != vi2);
    ////++
    stats__cmpLEQ_queries++;
-   hash = hash_VtsIDs(vi1, vi2, N_CMPLEQ_CACHE);
+   hash = hash_VtsIDs(vi1, vi2);
    if (cmpLEQ_cache[hash].vi1 == vi1
        && cmpLEQ_cache[hash].vi2 == vi2)
       return cmpLEQ_cache[hash].leq;
@@ -3502,7 +3719,7 @@ static VtsID VtsID__join2_WRK ( VtsID vi1, VtsID vi2 ) {
    tl_assert(vi1 != vi2);
    ////++
    stats__join2_queries++;
-   hash = hash_VtsIDs(vi1, vi2, N_JOIN2_CACHE);
+   hash = hash_VtsIDs(vi1, vi2);
    if (join2_cache[hash].vi1 == vi1
        && join2_cache[hash].vi2 == vi2)
       return join2_cache[hash].res;
@@ -4256,22 +4473,25 @@ static inline SVal Ptr2SVal (void* ptr)
 
    2. A Hash table of OldRefs.  These store information about each old
       ref that we need to record.  Hash table key is the address of the
-      location for which the information is recorded.  For LRU
-      purposes, each OldRef in the hash table is also on a doubly
-      linked list maintaining the order in which the OldRef were most
-      recently accessed.
+      location for which the information is recorded.  The OldRefs live
+      in a ring of chunks allocated as needed, and refer to each other
+      by 32 bit index rather than by pointer, to keep them small.
       Each OldRef also maintains the stamp at which it was last accessed.
       With these stamps, we can quickly check which of 2 OldRef is the
-      'newest', without having to scan the full list of LRU OldRef.
+      'newest'.
 
       The important part of an OldRef is, however, its acc component.
       This binds a TSW triple (thread, size, R/W) to an RCEC.
 
       We allocate a maximum of VG_(clo_conflict_cache_size) OldRef.
-      Then we do exact LRU discarding.  For each discarded OldRef we must
-      of course decrement the reference count on the RCEC it
-      refers to, in order that entries from (1) eventually get
-      discarded too.
+      Then the ring is managed with the CLOCK algorithm, an
+      approximation of LRU: an OldRef which has been accessed since
+      the hand last passed it is given a second chance, the first one
+      which has not is discarded.  OldRefs older than
+      HG_(clo_conflict_cache_max_age) accesses are also discarded.
+      For each discarded OldRef we must of course decrement the
+      reference count on the RCEC it refers to, in order that entries
+      from (1) eventually get discarded too.
 */
 
 static UWord stats__evm__lookup_found = 0;
@@ -4787,103 +5007,173 @@ typedef
    }
    Thr_n_RCEC;
 
+/* An OldRef is 32 bytes on a 64 bit target, 24 on a 32 bit one. */
 typedef
-   struct OldRef {
-      struct OldRef *ht_next; // to link hash table nodes together.
-      UWord  ga; // hash_table key, == address for which we record an access.
-      struct OldRef *prev; // to refs older than this one
-      struct OldRef *next; // to refs newer that this one
-      UWord stamp; // allows to order (by time of access) 2 OldRef
-      Thr_n_RCEC acc;
+   struct {
+      UWord ga; // hash_table key, == address for which we record an access.
+      Thr_n_RCEC acc; // acc.rcec is NULL for an OldRef on the free list.
+      UInt  stamp; // allows to order (by time of access) 2 OldRef
+      UInt  next;  // OLDREF_NONE or index of the next OldRef in the same
+                   // hash chain or free list, | OLDREF_REFD if accessed
+                   // since the CLOCK hand last passed.
    }
    OldRef;
 
+#define OLDREF_REFD  0x80000000U
+#define OLDREF_NONE  0x7FFFFFFFU
+
 /* Returns the or->tsw as an UInt */
 static inline UInt oldref_tsw (const OldRef* or)
 {
    return *(const UInt*)(&or->acc.tsw);
 }
 
-/* Compare the tsw component for 2 OldRef.
-   Used for OldRef hashtable (which already verifies equality of the
-   'key' part. */
-static Word cmp_oldref_tsw (const void* node1, const void* node2 )
+
+//////////// BEGIN OldRef ring
+// The OldRefs are allocated in chunks of OLDREF_CHUNK entries, which
+// are never freed.  We stop allocating chunks at
+// VG_(clo_conflict_cache_size) entries.
+#define OLDREF_CHUNK_BITS 14
+#define OLDREF_CHUNK      (1U << OLDREF_CHUNK_BITS)
+static OldRef** oldref_chunks = NULL;
+static UInt     oldrefN    = 0; /* # OldRefs allocated, in use or free */
+static UInt     oldrefLive = 0; /* # OldRefs in the hash table */
+static UInt     oldref_free = OLDREF_NONE; /* free list */
+static UInt     oldref_hand = 0; /* the CLOCK hand */
+//////////// END OldRef ring
+
+static inline OldRef* OldRef__at ( UInt ix )
 {
-   const UInt tsw1 = oldref_tsw(node1);
-   const UInt tsw2 = oldref_tsw(node2);
+   return &oldref_chunks[ix >> OLDREF_CHUNK_BITS][ix & (OLDREF_CHUNK - 1)];
+}
 
-   if (tsw1 < tsw2) return -1;
-   if (tsw1 > tsw2) return  1;
-   return 0;
+static inline UInt OldRef__next ( const OldRef* r )
+{
+   return r->next & ~OLDREF_REFD;
 }
 
+/* The hash table: for each bucket, the index of the first OldRef in
+   its chain, or OLDREF_NONE.  All the OldRefs for one address are in
+   the same chain, as libhb_event_map_lookup needs. */
+static UInt* oldref_buckets = NULL;
+static UInt  oldref_bucket_bits = 0;
+
+static inline UInt oldref_hash ( UWord ga )
+{
+   /* Nearby addresses go to nearby buckets, which is cache friendly
+      since accesses, and libhb_event_map_lookup, often go to nearby
+      addresses. */
+   return (UInt)(ga ^ (ga >> oldref_bucket_bits))
+          & ((1U << oldref_bucket_bits) - 1);
+}
 
-//////////// BEGIN OldRef pool allocator
-static PoolAlloc* oldref_pool_allocator;
-// Note: We only allocate elements in this pool allocator, we never free them.
-// We stop allocating elements at VG_(clo_conflict_cache_size).
-//////////// END OldRef pool allocator
+static void oldref_alloc_buckets ( UInt bits )
+{
+   UInt i, n = 1U << bits;
+   oldref_bucket_bits = bits;
+   oldref_buckets = HG_(zalloc)( "libhb.oldref_alloc_buckets.1",
+                                 n * sizeof(UInt) );
+   for (i = 0; i < n; i++)
+      oldref_buckets[i] = OLDREF_NONE;
+}
 
-static OldRef mru; 
-static OldRef lru; 
-// A double linked list, chaining all OldREf in a mru/lru order.
-// mru/lru are sentinel nodes.
-// Whenever an oldref is re-used, its position is changed as the most recently
-// used (i.e. pointed to by mru.prev).
-// When a new oldref is needed, it is allocated from the pool
-//  if we have not yet reached --conflict-cache-size.
-// Otherwise, if all oldref have already been allocated,
-// the least recently used (i.e. pointed to by lru.next) is re-used.
-// When an OldRef is used, it is moved as the most recently used entry
-// (i.e. pointed to by mru.prev).
+/* Double the number of buckets, and rehash. */
+static void oldref_grow_buckets ( void )
+{
+   UInt ix;
+   HG_(free)( oldref_buckets );
+   oldref_alloc_buckets( oldref_bucket_bits + 1 );
+   for (ix = 0; ix < oldrefN; ix++) {
+      OldRef* r = OldRef__at(ix);
+      UInt    h;
+      if (!r->acc.rcec)
+         continue;
+      h = oldref_hash(r->ga);
+      r->next = oldref_buckets[h] | (r->next & OLDREF_REFD);
+      oldref_buckets[h] = ix;
+   }
+}
 
-// Removes r from the double linked list
-// Note: we do not need to test for special cases such as
-// NULL next or prev pointers, because we have sentinel nodes
-// at both sides of the list. So, a node is always forward and
-// backward linked.
-static inline void OldRef_unchain(OldRef *r)
+static void OldRef__hash ( UInt ix )
 {
-   r->next->prev = r->prev;
-   r->prev->next = r->next;
+   OldRef* r = OldRef__at(ix);
+   UInt    h = oldref_hash(r->ga);
+   r->next = oldref_buckets[h];
+   oldref_buckets[h] = ix;
+   oldrefLive++;
+   if (UNLIKELY(oldrefLive > (1U << oldref_bucket_bits)))
+      oldref_grow_buckets();
 }
 
-// Insert new as the newest OldRef
-// Similarly to OldRef_unchain, no need to test for NULL
-// pointers, as e.g. mru.prev is always guaranteed to point
-// to a non NULL node (lru when the list is empty).
-static inline void OldRef_newest(OldRef *new)
+static void OldRef__unhash ( UInt ix )
 {
-   new->next = &mru;
-   new->prev = mru.prev;
-   mru.prev = new;
-   new->prev->next = new;
+   OldRef* r  = OldRef__at(ix);
+   UInt*   pp = &oldref_buckets[oldref_hash(r->ga)];
+   while ((*pp & ~OLDREF_REFD) != ix) {
+      tl_assert((*pp & ~OLDREF_REFD) != OLDREF_NONE);
+      pp = &OldRef__at(*pp & ~OLDREF_REFD)->next;
+   }
+   *pp = (*pp & OLDREF_REFD) | OldRef__next(r);
+   oldrefLive--;
 }
 
+/* Unhashes OldRef ix, releases its RCEC and puts it on the free list. */
+static void OldRef__discard ( UInt ix )
+{
+   OldRef* r = OldRef__at(ix);
+   OldRef__unhash(ix);
+   ctxt__rcdec( r->acc.rcec );
+   r->acc.rcec = NULL;
+   r->next = oldref_free;
+   oldref_free = ix;
+}
 
-static VgHashTable* oldrefHT    = NULL; /* Hash table* OldRef* */
-static UWord     oldrefHTN    = 0;    /* # elems in oldrefHT */
-/* Note: the nr of ref in the oldrefHT will always be equal to
-   the nr of elements that were allocated from the OldRef pool allocator
-   as we never free an OldRef : we just re-use them. */
+static UWord stats__oldref_clock_discards = 0;
+static UWord stats__oldref_clock_spared   = 0;
+static UWord stats__oldref_age_discards   = 0;
+static UWord stats__oldref_age_sweeps     = 0;
 
 
-/* allocates a new OldRef or re-use the lru one if all allowed OldRef
-   have already been allocated. */
-static OldRef* alloc_or_reuse_OldRef ( void )
+/* allocates a new OldRef or re-use one chosen by the CLOCK algorithm
+   if all allowed OldRef have already been allocated.  Returns its
+   index.  The caller must fill in the OldRef and then OldRef__hash
+   it. */
+static UInt alloc_or_reuse_OldRef ( void )
 {
-   if (oldrefHTN < HG_(clo_conflict_cache_size)) {
-      oldrefHTN++;
-      return VG_(allocEltPA) ( oldref_pool_allocator );
-   } else {
-      OldRef *oldref_ht;
-      OldRef *oldref = lru.next;
+   UInt ix;
+
+   if (oldref_free != OLDREF_NONE) {
+      ix = oldref_free;
+      oldref_free = OldRef__at(ix)->next;
+      return ix;
+   }
 
-      OldRef_unchain(oldref);
-      oldref_ht = VG_(HT_gen_remove) (oldrefHT, oldref, cmp_oldref_tsw);
-      tl_assert (oldref == oldref_ht);
-      ctxt__rcdec( oldref->acc.rcec );
-      return oldref;
+   if (oldrefN < HG_(clo_conflict_cache_size)) {
+      ix = oldrefN++;
+      if ((ix & (OLDREF_CHUNK - 1)) == 0)
+         oldref_chunks[ix >> OLDREF_CHUNK_BITS]
+            = HG_(zalloc)( "libhb.alloc_or_reuse_OldRef.1",
+                           OLDREF_CHUNK * sizeof(OldRef) );
+      return ix;
+   }
+
+   /* No free OldRef, so all of them are in the hash table.  Since the
+      hand clears the OLDREF_REFD bit of the OldRefs it spares, this
+      finds one within a turn of the ring. */
+   while (1) {
+      OldRef* r;
+      ix = oldref_hand;
+      oldref_hand = oldref_hand + 1 == oldrefN ? 0 : oldref_hand + 1;
+      r = OldRef__at(ix);
+      if (r->next & OLDREF_REFD) {
+         r->next &= ~OLDREF_REFD;
+         stats__oldref_clock_spared++;
+         continue;
+      }
+      stats__oldref_clock_discards++;
+      OldRef__unhash(ix);
+      ctxt__rcdec( r->acc.rcec );
+      return ix;
    }
 }
 
@@ -4911,12 +5201,55 @@ static inline Word cmp_nonempty_intervals ( Addr a1, SizeT n1,
    return 0;
 }
 
-static UWord event_map_stamp = 0; // Used to stamp each OldRef when touched.
+static UInt event_map_stamp = 0; // Used to stamp each OldRef when touched.
+
+/* The oldest an OldRef may get.  Even with no limit set, OldRefs must
+   be discarded before their stamp is 2^32 behind event_map_stamp, so
+   that stamps can be ordered.  event_map_bind calls
+   OldRef__age_sweep every half of this, so OldRefs are at most one
+   and a half times it old. */
+static UInt oldref_max_age ( void )
+{
+   if (HG_(clo_conflict_cache_max_age) > 0
+       && HG_(clo_conflict_cache_max_age) < (1U << 31))
+      return (UInt)HG_(clo_conflict_cache_max_age);
+   return 1U << 31;
+}
+
+static UInt event_map_next_sweep = 0;
+
+/* At least 1, else a --conflict-cache-max-age of 1 would schedule the
+   next sweep at the current stamp, which has already gone by. */
+static inline UInt oldref_sweep_interval ( void )
+{
+   UInt iv = oldref_max_age() / 2;
+   return iv > 0 ? iv : 1;
+}
+
+static inline Bool OldRef__too_old ( const OldRef* r )
+{
+   return event_map_stamp - r->stamp > oldref_max_age();
+}
+
+__attribute__((noinline))
+static void OldRef__age_sweep ( void )
+{
+   UInt ix;
+   stats__oldref_age_sweeps++;
+   for (ix = 0; ix < oldrefN; ix++) {
+      OldRef* r = OldRef__at(ix);
+      if (r->acc.rcec && OldRef__too_old(r)) {
+         OldRef__discard(ix);
+         stats__oldref_age_discards++;
+      }
+   }
+}
 
 static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 {
-   OldRef  example;
    OldRef* ref;
+   UInt    ix;
+   UInt    tsw;
    RCEC*   rcec;
 
    tl_assert(thr);
@@ -4927,15 +5260,24 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 
    rcec = get_RCEC( thr );
 
-   /* Look in the oldrefHT to see if we already have a record for this
-      address/thr/sz/isW. */
-   example.ga = a;
-   example.acc.tsw = (TSW) {.thrid = thrid,
-                            .szB = szB,
-                            .isW = (UInt)(isW & 1)};
-   ref = VG_(HT_gen_lookup) (oldrefHT, &example, cmp_oldref_tsw);
+   if (UNLIKELY(event_map_stamp == event_map_next_sweep)) {
+      if (oldrefLive > 0)
+         OldRef__age_sweep();
+      event_map_next_sweep = event_map_stamp + oldref_sweep_interval();
+   }
+
+   /* Look in the hash table to see if we already have a record for
+      this address/thr/sz/isW. */
+   { TSW example = {.thrid = thrid, .szB = szB, .isW = (UInt)(isW & 1)};
+     tsw = *(UInt*)&example; }
+   for (ix = oldref_buckets[oldref_hash(a)]; ix != OLDREF_NONE;
+        ix = OldRef__next(ref)) {
+      ref = OldRef__at(ix);
+      if (ref->ga == a && oldref_tsw(ref) == tsw)
+         break;
+   }
 
-   if (ref) {
+   if (ix != OLDREF_NONE) {
       /* We already have a record for this address and this (thrid, R/W,
          size) triple. */
       tl_assert (ref->ga == a);
@@ -4953,9 +5295,7 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
       /* Update the stamp, RCEC and the W-held lockset. */
       ref->stamp = event_map_stamp;
       ref->acc.locksHeldW = locksHeldW;
-
-      OldRef_unchain(ref);
-      OldRef_newest(ref);
+      ref->next |= OLDREF_REFD;
 
    } else {
       tl_assert (szB == 4 || szB == 8 ||szB == 1 || szB == 2);
@@ -4965,7 +5305,8 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 
       /* We don't have a record for this address+triple.  Create a new one. */
       stats__ctxt_neq_tsw_neq_rcec++;
-      ref = alloc_or_reuse_OldRef();
+      ix = alloc_or_reuse_OldRef();
+      ref = OldRef__at(ix);
       ref->ga = a;
       ref->acc.tsw = (TSW) {.thrid  = thrid,
                             .szB    = szB,
@@ -4975,8 +5316,7 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
       ref->acc.rcec       = rcec;
       ctxt__rcinc(rcec);
 
-      VG_(HT_add_node) ( oldrefHT, ref );
-      OldRef_newest (ref);
+      OldRef__hash (ix);
    }
    event_map_stamp++;
 }
@@ -4996,6 +5336,7 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
    SizeT  ref_szB = 0;
 
    OldRef *cand_ref;
+   UInt   cand_ix;
    SizeT  cand_ref_szB;
    Addr   cand_a;
 
@@ -5022,15 +5363,20 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
       //      VG_(printf)("test %ld %p\n", j, cand_a);
 
       /* Find the first HT element for this address.
-         We might have several of these. They will be linked via ht_next.
+         We might have several of these. They will be linked via next.
          We however need to check various elements as the list contains
          all elements that map to the same bucket. */
-      for (cand_ref = VG_(HT_lookup)( oldrefHT, cand_a ); 
-           cand_ref; cand_ref = cand_ref->ht_next) {
+      for (cand_ix = oldref_buckets[oldref_hash(cand_a)];
+           cand_ix != OLDREF_NONE; cand_ix = OldRef__next(cand_ref)) {
+         cand_ref = OldRef__at(cand_ix);
          if (cand_ref->ga != cand_a)
             /* OldRef for another address in this HT bucket. Ignore. */
             continue;
 
+         if (OldRef__too_old(cand_ref))
+            /* Due to be discarded by the next age sweep. Ignore. */
+            continue;
+
          if (cand_ref->acc.tsw.thrid == thrid)
             /* This is an access by the same thread, but we're only
                interested in accesses from other threads.  Ignore. */
@@ -5047,7 +5393,7 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
             continue;
 
          /* We have a match. Keep this match if it is newer than
-            the previous match. Note that stamp are Unsigned Words, and
+            the previous match. Note that stamp are UInts, and
             for long running applications, event_map_stamp might have cycled.
             So, 'roll' each stamp using event_map_stamp to have the
             stamps in the good order, in case event_map_stamp recycled. */
@@ -5092,33 +5438,55 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
 }
 
 
+static Int cmp_OldRef_by_age ( const void* v1, const void* v2 )
+{
+   const OldRef* r1 = *(OldRef* const*)v1;
+   const OldRef* r2 = *(OldRef* const*)v2;
+   UInt d1 = r1->stamp - event_map_stamp;
+   UInt d2 = r2->stamp - event_map_stamp;
+   if (d1 < d2) return -1;
+   if (d1 > d2) return 1;
+   return 0;
+}
+
 void libhb_event_map_access_history ( Addr a, SizeT szB, Access_t fn )
 {
-   OldRef *ref = lru.next;
-   SizeT ref_szB;
-   Int n;
+   XArray* refs = VG_(newXA)( HG_(zalloc), "libhb.evm_access_history.1",
+                              HG_(free), sizeof(OldRef*) );
+   OldRef* ref;
+   SizeT   ref_szB;
+   UInt    ix;
+   Word    i;
+   Int     n;
+
+   /* Report the accesses oldest first. */
+   for (ix = 0; ix < oldrefN; ix++) {
+      ref = OldRef__at(ix);
+      if (ref->acc.rcec && !OldRef__too_old(ref)
+          && cmp_nonempty_intervals(a, szB, ref->ga, ref->acc.tsw.szB) == 0)
+         VG_(addToXA)( refs, &ref );
+   }
+   if (VG_(sizeXA)( refs ) > 1)
+      VG_(ssort)( VG_(indexXA)( refs, 0 ), VG_(sizeXA)( refs ),
+                  sizeof(OldRef*), cmp_OldRef_by_age );
 
-   while (ref != &mru) {
+   for (i = 0; i < VG_(sizeXA)( refs ); i++) {
+      ref = *(OldRef**)VG_(indexXA)( refs, i );
       ref_szB = ref->acc.tsw.szB;
-      if (cmp_nonempty_intervals(a, szB, ref->ga, ref_szB) == 0) {
-         RCEC* ref_rcec = ref->acc.rcec;
-         for (n = 0; n < HG_(clo_history_backtrace_size); n++) {
-            if (0 == ref_rcec->frames[n]) {
-               break;
-            }
+      RCEC* ref_rcec = ref->acc.rcec;
+      for (n = 0; n < HG_(clo_history_backtrace_size); n++) {
+         if (0 == ref_rcec->frames[n]) {
+            break;
          }
-         (*fn)(&ref_rcec->frames[0], n,
-               Thr__from_ThrID(ref->acc.tsw.thrid),
-               ref->ga,
-               ref_szB,
-               ref->acc.tsw.isW,
-               ref->acc.locksHeldW);
       }
-      tl_assert (ref->next == &mru
-                 || ((ref->stamp - event_map_stamp)
-                        < ref->next->stamp - event_map_stamp));
-      ref = ref->next;
+      (*fn)(&ref_rcec->frames[0], n,
+            Thr__from_ThrID(ref->acc.tsw.thrid),
+            ref->ga,
+            ref_szB,
+            ref->acc.tsw.isW,
+            ref->acc.locksHeldW);
    }
+   VG_(deleteXA)( refs );
 }
 
 static void event_map_init ( void )
@@ -5142,36 +5510,24 @@ static void event_map_init ( void )
    for (i = 0; i < N_RCEC_TAB; i++)
       contextTab[i] = NULL;
 
-   /* Oldref pool allocator */
-   oldref_pool_allocator = VG_(newPA)(
-                               sizeof(OldRef),
-                               1000 /* OldRefs per pool */,
-                               HG_(zalloc),
-                               "libhb.event_map_init.3 (OldRef pools)",
-                               HG_(free)
-                            );
+   /* Oldref ring, whose chunks are allocated as needed. */
+   oldref_chunks = HG_(zalloc)( "libhb.event_map_init.3 (OldRef chunks)",
+                                (HG_(clo_conflict_cache_size) / OLDREF_CHUNK
+                                 + 1) * sizeof(OldRef*) );
 
    /* Oldref hashtable */
-   tl_assert(!oldrefHT);
-   oldrefHT = VG_(HT_construct) ("libhb.event_map_init.4 (oldref hashtable)");
-
-   oldrefHTN = 0;
-   mru.prev = &lru;
-   mru.next = NULL;
-   lru.prev = NULL;
-   lru.next = &mru;
-   mru.acc = (Thr_n_RCEC) {.tsw = {.thrid = 0, 
-                                   .szB = 0, 
-                                   .isW = 0},
-                           .locksHeldW = 0, 
-                           .rcec = NULL};
-   lru.acc = mru.acc;
+   tl_assert(!oldref_buckets);
+   oldref_alloc_buckets( 12 );
+   oldrefN    = 0;
+   oldrefLive = 0;
+   event_map_next_sweep = oldref_sweep_interval();
 }
 
 static void event_map__check_reference_counts ( void )
 {
    RCEC*   rcec;
    OldRef* oldref;
+   UInt    ix;
    Word    i;
    UWord   nEnts = 0;
 
@@ -5194,14 +5550,13 @@ static void event_map__check_reference_counts ( void )
    tl_assert(stats__ctxt_tab_curr <= stats__ctxt_tab_max);
 
    /* visit all the referencing points, inc check ref counts */
-   VG_(HT_ResetIter)( oldrefHT );
-   oldref = VG_(HT_Next)( oldrefHT );
-   while (oldref) {
+   for (ix = 0; ix < oldrefN; ix++) {
+      oldref = OldRef__at(ix);
+      if (!oldref->acc.rcec)
+         continue;
       tl_assert (oldref->acc.tsw.thrid);
-      tl_assert (oldref->acc.rcec);
       tl_assert (oldref->acc.rcec->magic == RCEC_MAGIC);
       oldref->acc.rcec->rcX++;
-      oldref = VG_(HT_Next)( oldrefHT );
    }
 
    /* compare check ref counts with actual */
@@ -6125,8 +6480,7 @@ static void zsm_sset_range ( Addr a, SizeT len, SVal svNew )
       /* tag is 'a' with the in-line offset masked out, 
          eg a[31]..a[4] 0000 */
       Addr       tag = a & ~(N_LINE_ARANGE - 1);
-      UWord      wix = (a >> N_LINE_BITS) & (N_WAY_NENT - 1);
-      if (LIKELY(tag == cache_shmem.tags0[wix])) {
+      if (LIKELY(find_cacheline_no_fetch(tag) != NULL)) {
          n_New_in_cache++;
       } else {
          n_New_not_in_cache++;
@@ -6168,13 +6522,11 @@ static void zsm_sset_range ( Addr a, SizeT len, SVal svNew )
 
       while (1) {
          Addr tag;
-         UWord wix;
          if (aligned_start >= after_start)
             break;
          tl_assert(get_cacheline_offset(aligned_start) == 0);
          tag = aligned_start & ~(N_LINE_ARANGE - 1);
-         wix = (aligned_start >> N_LINE_BITS) & (N_WAY_NENT - 1);
-         if (tag == cache_shmem.tags0[wix]) {
+         if (find_cacheline_no_fetch(tag) != NULL) {
             UWord i;
             for (i = 0; i < N_LINE_ARANGE / 8; i++)
                zsm_swrite64( aligned_start + i * 8, svNew );
@@ -6594,6 +6946,7 @@ Thr* libhb_init (
       VTS singleton, tick and join operations. */
    temp_max_sized_VTS = VTS__new( "libhb.libhb_init.1", ThrID_MAX_VALID );
    temp_max_sized_VTS->id = VtsID_INVALID;
+   VtsID__init_caches();
    verydead_thread_tables_init();
    vts_set_init();
    vts_tab_init();
@@ -6683,12 +7036,18 @@ void libhb_shutdown ( Bool show_stats )
                   stats__secmaps_search, stats__secmaps_search_slow);
 
       VG_(printf)("%s","\n");
-      VG_(printf)("   cache: %'lu totrefs (%'lu misses)\n",
-                  stats__cache_totrefs, stats__cache_totmisses );
+      VG_(printf)("   cache: %'lu totrefs (%'lu misses, %'lu non-MRU hits)\n",
+                  stats__cache_totrefs, stats__cache_totmisses,
+                  stats__cache_way_hits );
+      VG_(printf)("   cache: %'lu lines, %d ways\n",
+                  (cache_shmem.set_mask + 1) << N_WAY_BITS, N_WAY_NENT );
       VG_(printf)("   cache: %'14lu Z-fetch,    %'14lu F-fetch\n",
                   stats__cache_Z_fetches, stats__cache_F_fetches );
       VG_(printf)("   cache: %'14lu Z-wback,    %'14lu F-wback\n",
                   stats__cache_Z_wbacks, stats__cache_F_wbacks );
+      VG_(printf)("   cache: %'14lu Z-fetch uniform, %'9lu Z-wback uniform\n",
+                  stats__cache_Z_fetches_uniform,
+                  stats__cache_Z_wbacks_uniform );
       VG_(printf)("   cache: %'14lu flushes_invals\n",
                   stats__cache_flushes_invals );
       VG_(printf)("   cache: %'14llu arange_New  %'14llu direct-to-Zreps\n",
@@ -6739,10 +7098,14 @@ void libhb_shutdown ( Bool show_stats )
                   stats__cmpLEQ_queries, stats__cmpLEQ_misses);
       VG_(printf)("   libhb: %'13llu join2  queries (%'llu misses)\n",
                   stats__join2_queries, stats__join2_misses);
+      VG_(printf)("   libhb: cmpLEQ and join2 caches: %'u entries each\n",
+                  n_vtsid_caches);
 
       VG_(printf)("%s","\n");
       VG_(printf)("   libhb: VTSops: tick %'lu,  join %'lu,  cmpLEQ %'lu\n",
                   stats__vts__tick, stats__vts__join,  stats__vts__cmpLEQ );
+      VG_(printf)("   libhb: VTSops: same thrids: join %'lu,  cmpLEQ %'lu\n",
+                  stats__vts__join_same, stats__vts__cmpLEQ_same );
       VG_(printf)("   libhb: VTSops: cmp_structural %'lu (%'lu slow)\n",
                   stats__vts__cmp_structural, stats__vts__cmp_structural_slow);
       VG_(printf)("   libhb: VTSset: find__or__clone_and_add %'lu"
@@ -6797,13 +7160,18 @@ void libhb_shutdown ( Bool show_stats )
       }
 
       VG_(printf)("%s","\n");
-      VG_(printf)( "   libhb: oldrefHTN %lu (%'d bytes)\n",
-                   oldrefHTN, (int)(oldrefHTN * sizeof(OldRef)));
-      tl_assert (oldrefHTN == VG_(HT_count_nodes) (oldrefHT));
+      VG_(printf)( "   libhb: oldrefs %u live of %u (%'lu bytes,"
+                   " %u buckets)\n",
+                   oldrefLive, oldrefN,
+                   (UWord)oldrefN * sizeof(OldRef)
+                   + ((UWord)sizeof(UInt) << oldref_bucket_bits),
+                   1U << oldref_bucket_bits);
       VG_(printf)( "   libhb: oldref lookup found=%lu notfound=%lu\n",
                    stats__evm__lookup_found, stats__evm__lookup_notfound);
-      if (VG_(clo_verbosity) > 1)
-         VG_(HT_print_stats) (oldrefHT, cmp_oldref_tsw);
+      VG_(printf)( "   libhb: oldref discards: clock %'lu (%'lu spared),"
+                   " age %'lu (%'lu sweeps)\n",
+                   stats__oldref_clock_discards, stats__oldref_clock_spared,
+                   stats__oldref_age_discards, stats__oldref_age_sweeps);
       VG_(printf)( "   libhb: oldref bind tsw/rcec "
                    "==/==:%'lu ==/!=:%'lu !=/!=:%'lu\n",
                    stats__ctxt_eq_tsw_eq_rcec, stats__ctxt_eq_tsw_neq_rcec,
@@ -7318,13 +7686,13 @@ UWord libhb_srange_get_abits (Addr a, UChar *abits, SizeT len)
       SVal       sv = SVal_INVALID;
       Addr       b = a + i;
       Addr       tag = b & ~(N_LINE_ARANGE - 1);
-      UWord      wix = (b >> N_LINE_BITS) & (N_WAY_NENT - 1);
+      CacheLine* cl = find_cacheline_no_fetch(tag);
       UWord      cloff = get_cacheline_offset(b);
 
       /* Note: we do not use get_cacheline(b) to avoid creating cachelines
          and/or SecMap for non addressable bytes. */
-      if (tag == cache_shmem.tags0[wix]) {
-         CacheLine copy = cache_shmem.lyns0[wix];
+      if (cl != NULL) {
+         CacheLine copy = *cl;
          /* We work on a copy of the cacheline, as we do not want to
             record the client request as a real read.
             The below is somewhat similar to zsm_sapply08__msmcread but
@@ -0,0 +1,45 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run with a small --conflict-cache-size and --conflict-cache-max-age.
+   The child writes 'a', then enough distinct words of 'big' to push
+   its record for 'a' out of the conflict cache, then 'b'.  The race
+   on 'b' is reported with the conflicting access; the race on 'a'
+   only without it. */
+
+#define N_BIG 40000
+
+int a = 0, b = 0;
+int big[N_BIG];
+
+void* child_fn ( void* arg )
+{
+   int i;
+   a = 1;
+   for (i = 0; i < N_BIG; i++)
+      big[i] = i;
+   b = 1;
+   return NULL;
+}
+
+int main ( void )
+{
+   const struct timespec delay = { 0, 100 * 1000 * 1000 };
+   pthread_t child;
+   int r;
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   nanosleep(&delay, 0);
+   r = b;
+   r += a;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+
+   return r == 2 ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Run with a small --lock-trace-limit, so that locks taken many times
+   stop having their acquisitions traced.  Lock order errors must
+   still be reported. */
+
+#define N_ITERS 10
+
+int main ( void )
+{
+   int r, i;
+   pthread_mutex_t mx1, mx2, mx3, mx4;
+   r = pthread_mutex_init( &mx1, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx2, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx3, NULL ); assert(r==0);
+   r = pthread_mutex_init( &mx4, NULL ); assert(r==0);
+
+   /* mx1 before mx2, many times.  Only the first time adds an edge,
+      so later acquisitions, including the one of mx2 below, are not
+      traced: the error shows no stack for it. */
+   for (i = 0; i < N_ITERS; i++) {
+      r = pthread_mutex_lock( &mx1 ); assert(r==0);
+      r = pthread_mutex_lock( &mx2 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx2 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx1 ); assert(r==0);
+   }
+
+   r = pthread_mutex_lock( &mx2 ); assert(r==0);
+   r = pthread_mutex_lock( &mx1 ); assert(r==0); /* error */
+   r = pthread_mutex_unlock( &mx1 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx2 ); assert(r==0);
+
+   /* mx3 and mx4 taken on their own many times, so neither is traced
+      any more when mx3 before mx4 first adds an edge.  The error
+      can't show where that order was established. */
+   for (i = 0; i < N_ITERS; i++) {
+      r = pthread_mutex_lock( &mx3 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx3 ); assert(r==0);
+      r = pthread_mutex_lock( &mx4 ); assert(r==0);
+      r = pthread_mutex_unlock( &mx4 ); assert(r==0);
+   }
+
+   r = pthread_mutex_lock( &mx3 ); assert(r==0);
+   r = pthread_mutex_lock( &mx4 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx4 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx3 ); assert(r==0);
+
+   r = pthread_mutex_lock( &mx4 ); assert(r==0);
+   r = pthread_mutex_lock( &mx3 ); assert(r==0); /* error */
+   r = pthread_mutex_unlock( &mx3 ); assert(r==0);
+   r = pthread_mutex_unlock( &mx4 ); assert(r==0);
+
+   r = pthread_mutex_destroy( &mx1 );
+   r = pthread_mutex_destroy( &mx2 );
+   r = pthread_mutex_destroy( &mx3 );
+   r = pthread_mutex_destroy( &mx4 );
+
+   return 0;
+}
@@ -0,0 +1,56 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run with a tiny --vts-cache-size, so that most VTS joins and
+   comparisons are computed rather than found in the caches.  Once all
+   the threads have taken the lock a few times, their vector
+   timestamps all mention the same threads, so the joins done at lock
+   acquisition and the comparisons done on each access to 'count' take
+   the same-thread-set path.  There is no race: any error reported is
+   a bug in that path. */
+
+#define N_THREADS 4
+#define N_ITERS   2000
+
+static pthread_mutex_t mx = PTHREAD_MUTEX_INITIALIZER;
+static int count = 0;
+
+static void* child_fn ( void* arg )
+{
+   int i;
+   for (i = 0; i < N_ITERS; i++) {
+      pthread_mutex_lock(&mx);
+      count++;
+      pthread_mutex_unlock(&mx);
+   }
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t child[N_THREADS];
+   int i;
+
+   for (i = 0; i < N_THREADS; i++) {
+      if (pthread_create(&child[i], NULL, child_fn, NULL)) {
+         perror("pthread_create");
+         exit(1);
+      }
+   }
+
+   for (i = 0; i < N_THREADS; i++) {
+      if (pthread_join(child[i], NULL)) {
+         perror("pthread join");
+         exit(1);
+      }
+   }
+
+   /* All the children's increments happen before this. */
+   if (count != N_THREADS * N_ITERS) {
+      fprintf(stderr, "count is wrong\n");
+      exit(1);
+   }
+
+   return 0;
+}
@@ -1540,6 +1540,12 @@ struct vki_flock64 {
 #define VKI_AT_EMPTY_PATH       0x1000  /* Allow empty relative pathname */
 #define VKI_AT_SYMLINK_NOFOLLOW 0x100   /* Do not follow symbolic links.  */
 
+//----------------------------------------------------------------------
+// From linux-2.6.8.1/include/linux/fadvise.h
+//----------------------------------------------------------------------
+
+#define VKI_POSIX_FADV_WILLNEED 3 /* Will need these pages.  */
+
 //----------------------------------------------------------------------
 // From linux-2.6.8.1/include/linux/sysctl.h
 //----------------------------------------------------------------------
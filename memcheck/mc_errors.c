@@ -1375,6 +1375,14 @@ static void describe_addr ( DiEpoch ep, Addr a, /*OUT*/AddrInfo* ai )
 
    /* No block found. Search a non-heap block description. */
    VG_(describe_addr) (ep, a, ai);
+
+   /* Blocks released from the freed queue may be kept allocated in
+      the client arena, to be reused by MC_(new_block).  Describe them
+      as if they had been handed back. */
+   if (ai->tag == Addr_Block
+       && ai->Addr.Block.block_kind == Block_ClientArenaMallocd
+       && MC_(is_cached_client_block)( a - ai->Addr.Block.rwoffset ))
+      ai->Addr.Block.block_kind = Block_ClientArenaFree;
 }
 
 void MC_(pp_describe_addr) ( DiEpoch ep, Addr a )
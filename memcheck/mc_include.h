@@ -125,6 +125,10 @@ Bool MC_(is_mempool_block)( MC_Chunk* mc_search );
    is found. */
 MC_Chunk* MC_(get_freed_block_bracketting)( Addr a );
 
+/* Is p the start of a client block that has left the freed queue but
+   is still kept allocated in the client arena for reuse? */
+Bool MC_(is_cached_client_block) ( Addr p );
+
 /* For efficient pooled alloc/free of the MC_Chunk. */
 extern PoolAlloc* MC_(chunk_poolalloc);
 
@@ -485,6 +489,12 @@ extern UInt MC_(leak_search_gen);
 // maintains the lcp.deltamode given in the last call to detect_memory_leaks
 extern LeakCheckDeltaMode MC_(detect_memory_leaks_last_delta_mode);
 
+// Must be called when a block with the given start address is inserted
+// in MC_(malloc_list), so that the next leak search can update the
+// sorted array of blocks built by the previous one rather than
+// rebuilding and sorting it from scratch.
+void MC_(lc_note_new_malloc_block) ( Addr data );
+
 // prints the list of blocks corresponding to the given loss_record_nr slice
 // (from/to) (up to maximum max_blocks)
 // Returns True if loss_record_nr_from identifies a correct loss record
@@ -509,6 +519,7 @@ extern HChar * MC_(snprintf_delta) (HChar * buf, Int size,
 
 Bool MC_(is_valid_aligned_word)     ( Addr a );
 Bool MC_(is_within_valid_secondary) ( Addr a );
+Addr MC_(find_valid_aligned_words)  ( Addr a, Addr end, Addr* run_end );
 
 // Prints as user msg a description of the given loss record.
 void MC_(pp_LossRecord)(UInt n_this_record, UInt n_total_records,
@@ -631,6 +642,10 @@ extern Long MC_(clo_freelist_vol);
    in the "big block" freed blocks queue. */
 extern Long MC_(clo_freelist_big_blocks);
 
+/* Blocks with a size < MC_(clo_freelist_small_blocks) will be put
+   in the "small block" freed blocks queue, released last. */
+extern Long MC_(clo_freelist_small_blocks);
+
 /* Do leak check at exit?  default: NO */
 extern LeakCheckMode MC_(clo_leak_check);
 
@@ -732,6 +747,17 @@ extern KeepStacktraces MC_(clo_keep_stacktraces);
 */
 extern Int MC_(clo_mc_level);
 
+/* Geometry of the origin tracking cache, when MC_(clo_mc_level) == 3.
+   Initial and maximum sizes in MB, and number of lines per set.
+   Default: 96, 384, 2 */
+extern UInt MC_(clo_origin_cache_size);
+extern UInt MC_(clo_origin_cache_max_size);
+extern UInt MC_(clo_origin_cache_ways);
+
+/* Should lines evicted from the origin cache be stored compressed
+   when they hold a single origin?  Default: YES */
+extern Bool MC_(clo_origin_cache_compress);
+
 /* Should we show mismatched frees?  Default: YES */
 extern Bool MC_(clo_show_mismatched_frees);
 
@@ -744,7 +770,9 @@ typedef
    enum {
       EdcNO = 1000,  // All operations instrumented cheaply
       EdcAUTO,       // Chosen dynamically by analysing the block
-      EdcYES         // All operations instrumented expensively
+      EdcYES,        // All operations instrumented expensively
+      EdcADAPTIVE    // Cheaply, then expensively for blocks which
+                     // might have given a false error
    }
    ExpensiveDefinednessChecks;
 
@@ -757,6 +785,12 @@ extern Bool MC_(clo_ignore_range_below_sp);
 extern UInt MC_(clo_ignore_range_below_sp__first_offset);
 extern UInt MC_(clo_ignore_range_below_sp__last_offset);
 
+/* Should code at guest address |a| be checked for undefined values?
+   This is False for code in objects selected by --uninstrument-objs,
+   or not selected by --instrument-objs.  Such code is only checked
+   for addressability errors. */
+Bool MC_(should_check_undefs_at) ( Addr a );
+
 
 /*------------------------------------------------------------*/
 /*--- Instrumentation                                      ---*/
@@ -782,6 +816,13 @@ VG_REGPARM(0) void MC_(helperc_value_check4_fail_no_o) ( void );
 VG_REGPARM(0) void MC_(helperc_value_check1_fail_no_o) ( void );
 VG_REGPARM(0) void MC_(helperc_value_check0_fail_no_o) ( void );
 
+/* Functions for --expensive-definedness-checks=adaptive */
+void MC_(helperc_adaptive_fail) ( UWord flag, UWord szB, UWord origin,
+                                  UWord expFailed );
+void MC_(helperc_adaptive_discard) ( void* gst, UWord base );
+UChar* MC_(adaptive_block_flag) ( Addr a );
+Bool MC_(adaptive_block_promoted) ( Addr a );
+
 /* V-bits load/store helpers */
 VG_REGPARM(1) void MC_(helperc_STOREV64be) ( Addr, ULong );
 VG_REGPARM(1) void MC_(helperc_STOREV64le) ( Addr, ULong );
@@ -839,6 +880,12 @@ IRSB* MC_(final_tidy) ( IRSB* );
 /* Check some assertions to do with the instrumentation machinery. */
 void MC_(do_instrumentation_startup_checks)( void );
 
+/* Print statistics about the instrumentation, for --stats=yes. */
+void MC_(print_instrumentation_stats)( void );
+
+/* Are host word equality comparisons always instrumented exactly? */
+Bool MC_(word_compares_are_exact)( void );
+
 #endif /* ndef __MC_INCLUDE_H */
 
 /*--------------------------------------------------------------------*/
@@ -331,22 +331,114 @@ Int find_chunk_for ( Addr       ptr,
 }
 
 
+// Sorting all the malloc chunks is a large part of the cost of a leak
+// search on a big heap.  So each leak search remembers the sorted start
+// addresses of the malloc chunks it found (lc_prev_mallocs), and the
+// start addresses of the blocks inserted in MC_(malloc_list) since then
+// are logged in lc_new_mallocs.  Every chunk now in MC_(malloc_list) is
+// in one of these two sets, so the next leak search can build its
+// sorted array by merging them, dropping the addresses that are not
+// (anymore) in MC_(malloc_list).  As MC_(malloc_list) is keyed by start
+// address, a start address identifies a chunk.
+// The log is dropped (and the next search does a full sort) if it grows
+// bigger than the heap was at the previous search.
+static Addr*   lc_prev_mallocs;
+static UInt    lc_n_prev_mallocs;
+static XArray* lc_new_mallocs;  // of Addr; NULL if not logging.
+
+static Int cmp_Addr ( const void* a1, const void* a2 )
+{
+   Addr a = *(const Addr*)a1;
+   Addr b = *(const Addr*)a2;
+   return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+void MC_(lc_note_new_malloc_block) ( Addr data )
+{
+   if (LIKELY(lc_new_mallocs == NULL))
+      return;
+   if (VG_(sizeXA)(lc_new_mallocs) >= VG_MAX(lc_n_prev_mallocs, 1024)) {
+      VG_(deleteXA)(lc_new_mallocs);
+      lc_new_mallocs = NULL;
+      return;
+   }
+   VG_(addToXA)(lc_new_mallocs, &data);
+}
+
+// Returns the malloc chunks sorted by address, in *pn_mallocs.
+// Also records them for the next call.
+static MC_Chunk**
+get_sorted_array_of_malloc_chunks(UInt* pn_mallocs)
+{
+   UInt n_mallocs, i, j, k;
+   Word n_new;
+   Addr a, prev_a;
+   MC_Chunk **mallocs, *mc;
+
+   if (lc_new_mallocs == NULL) {
+      mallocs = (MC_Chunk**) VG_(HT_to_array)( MC_(malloc_list), &n_mallocs );
+      if (n_mallocs > 0)
+         VG_(ssort)(mallocs, n_mallocs, sizeof(VgHashNode*),
+                    compare_MC_Chunks);
+   } else {
+      n_mallocs = VG_(HT_count_nodes)( MC_(malloc_list) );
+      mallocs = n_mallocs == 0 ? NULL
+         : VG_(malloc)( "mc.gsamc.1", n_mallocs * sizeof(MC_Chunk*) );
+      VG_(setCmpFnXA)(lc_new_mallocs, cmp_Addr);
+      VG_(sortXA)(lc_new_mallocs);
+      n_new = VG_(sizeXA)(lc_new_mallocs);
+      i = j = k = 0;
+      prev_a = 0;
+      while (i < lc_n_prev_mallocs || j < n_new) {
+         if (j == n_new
+             || (i < lc_n_prev_mallocs
+                 && lc_prev_mallocs[i]
+                    <= *(Addr*)VG_(indexXA)(lc_new_mallocs, j)))
+            a = lc_prev_mallocs[i++];
+         else
+            a = *(Addr*)VG_(indexXA)(lc_new_mallocs, j++);
+         if (k > 0 && a == prev_a)
+            continue;
+         prev_a = a;
+         mc = VG_(HT_lookup)( MC_(malloc_list), a );
+         if (mc != NULL) {
+            tl_assert(k < n_mallocs);
+            mallocs[k++] = mc;
+         }
+      }
+      tl_assert(k == n_mallocs);
+      VG_(deleteXA)(lc_new_mallocs);
+   }
+
+   if (lc_prev_mallocs)
+      VG_(free)(lc_prev_mallocs);
+   lc_prev_mallocs = n_mallocs == 0 ? NULL
+      : VG_(malloc)( "mc.gsamc.2", n_mallocs * sizeof(Addr) );
+   for (i = 0; i < n_mallocs; i++)
+      lc_prev_mallocs[i] = mallocs[i]->data;
+   lc_n_prev_mallocs = n_mallocs;
+   lc_new_mallocs = VG_(newXA)( VG_(malloc), "mc.gsamc.3", VG_(free),
+                                sizeof(Addr) );
+
+   *pn_mallocs = n_mallocs;
+   return mallocs;
+}
+
 static MC_Chunk**
 get_sorted_array_of_active_chunks(Int* pn_chunks)
 {
    UInt n_mallocs;
    MC_Chunk **mallocs;
 
-   // First we collect all the malloc chunks into an array and sort it.
-   // We do this because we want to query the chunks by interior
-   // pointers, requiring binary search.
-   mallocs = (MC_Chunk**) VG_(HT_to_array)( MC_(malloc_list), &n_mallocs );
+   // First we collect all the malloc chunks into an array sorted on
+   // address.  We do this because we want to query the chunks by
+   // interior pointers, requiring binary search.
+   mallocs = get_sorted_array_of_malloc_chunks( &n_mallocs );
    if (n_mallocs == 0) {
       tl_assert(mallocs == NULL);
       *pn_chunks = 0;
       return NULL;
    }
-   VG_(ssort)(mallocs, n_mallocs, sizeof(VgHashNode*), compare_MC_Chunks);
 
    // If there are no mempools (for most users, this is the case),
    //    n_mallocs and mallocs is the final result
@@ -482,6 +574,86 @@ static SizeT lc_chunks_n_frees_marker;
 // lc_extras[i] describe the same block).
 static LC_Extra* lc_extras;
 
+// Also the same number of entries as lc_chunks: lc_chunk_bounds[i] is the
+// extent [lo .. hi) of lc_chunks[i], as computed by find_chunk_for.  The
+// mark phase binary searches this flat array instead of dereferencing
+// lc_chunks[mid] at each probe, which on a big heap is a cache miss per
+// step for every candidate pointer.
+typedef
+   struct {
+      Addr lo;
+      Addr hi;
+   }
+   LC_Bounds;
+static LC_Bounds* lc_chunk_bounds;
+
+// A coarse and conservative map of the addresses covered by lc_chunks.
+// Most scanned words are not pointers to a block (integers, pixels,
+// floating point numbers, ...), and this map rejects most of them before
+// lc_is_a_chunk_ptr does the aspacemgr lookup and the binary search.
+// [lc_pf_lo .. lc_pf_hi) spans all the chunks, and bit i of lc_pf_bits
+// is set if some chunk overlaps granule i, ie. the range
+// [lc_pf_lo + (i << lc_pf_shift) .. lc_pf_lo + ((i+1) << lc_pf_shift)).
+// Granules are pages, made bigger if needed to bound the map size for
+// blocks scattered over a huge range.
+#define LC_PF_MIN_SHIFT 12
+static Addr   lc_pf_lo;
+static Addr   lc_pf_hi;
+static UInt   lc_pf_shift;
+static UWord* lc_pf_bits;
+
+#define LC_PF_BITS_PER_WORD (8 * sizeof(UWord))
+
+static void lc_build_prefilter ( void )
+{
+   Int   i;
+   UWord n_granules, max_granules, g, g_last;
+
+   if (lc_pf_bits) {
+      VG_(free)(lc_pf_bits);
+      lc_pf_bits = NULL;
+   }
+   lc_pf_lo = lc_pf_hi = 0;
+   if (lc_n_chunks == 0)
+      return;
+
+   // Chunks are sorted on their start, but an overlapping metapool block
+   // can end after the chunks following it.
+   lc_pf_lo = lc_chunk_bounds[0].lo;
+   for (i = 0; i < lc_n_chunks; i++)
+      lc_pf_hi = VG_MAX(lc_pf_hi, lc_chunk_bounds[i].hi);
+
+   // Allow about one byte per chunk, with a minimum of 128Kb.
+   max_granules = 8 * (UWord)lc_n_chunks + (1 << 20);
+   lc_pf_shift = LC_PF_MIN_SHIFT;
+   while (((lc_pf_hi - 1 - lc_pf_lo) >> lc_pf_shift) + 1 > max_granules)
+      lc_pf_shift++;
+   n_granules = ((lc_pf_hi - 1 - lc_pf_lo) >> lc_pf_shift) + 1;
+
+   lc_pf_bits = VG_(calloc)("mc.dml.4",
+                            (n_granules + LC_PF_BITS_PER_WORD - 1)
+                            / LC_PF_BITS_PER_WORD,
+                            sizeof(UWord));
+   for (i = 0; i < lc_n_chunks; i++) {
+      g      = (lc_chunk_bounds[i].lo - lc_pf_lo) >> lc_pf_shift;
+      g_last = (lc_chunk_bounds[i].hi - 1 - lc_pf_lo) >> lc_pf_shift;
+      for (; g <= g_last; g++)
+         lc_pf_bits[g / LC_PF_BITS_PER_WORD]
+            |= (UWord)1 << (g % LC_PF_BITS_PER_WORD);
+   }
+}
+
+// Returns False if ptr certainly does not point at or inside a chunk.
+static inline Bool lc_may_be_a_chunk_ptr ( Addr ptr )
+{
+   UWord g;
+   if (ptr < lc_pf_lo || ptr >= lc_pf_hi)
+      return False;
+   g = (ptr - lc_pf_lo) >> lc_pf_shift;
+   return (lc_pf_bits[g / LC_PF_BITS_PER_WORD]
+           >> (g % LC_PF_BITS_PER_WORD)) & 1;
+}
+
 // chunks will be converted and merged in loss record, maintained in lr_table
 // lr_table elements are kept from one leak_search to another to implement
 // the "print new/changed leaks" client request
@@ -539,6 +711,34 @@ static SizeT MC_(bytes_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
 static SizeT MC_(blocks_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
                                                 = {0,0,0,0};
 
+// As find_chunk_for(ptr, lc_chunks, lc_n_chunks), but searching
+// lc_chunk_bounds.  The probes are the same, so that the same chunk is
+// found even when metapool blocks overlap.
+static
+Int find_lc_chunk_for ( Addr ptr )
+{
+   Int lo, mid, hi, retVal;
+   retVal = -1;
+   lo = 0;
+   hi = lc_n_chunks-1;
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (ptr < lc_chunk_bounds[mid].lo) {
+         hi = mid-1;
+      } else if (ptr >= lc_chunk_bounds[mid].hi) {
+         lo = mid+1;
+      } else {
+         retVal = mid;
+         break;
+      }
+   }
+
+#  if VG_DEBUG_FIND_CHUNK
+   tl_assert(retVal == find_chunk_for ( ptr, lc_chunks, lc_n_chunks ));
+#  endif
+   return retVal;
+}
+
 // Determines if a pointer is to a chunk.  Returns the chunk number et al
 // via call-by-reference.
 static Bool
@@ -548,14 +748,16 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    MC_Chunk* ch;
    LC_Extra* ex;
 
-   // Quick filter. Note: implemented with am, not with get_vabits2
-   // as ptr might be random data pointing anywhere. On 64 bit
-   // platforms, getting va bits for random data can be quite costly
-   // due to the secondary map.
-   if (!VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
+   // Quick filters.  The first one rejects most of the values that are
+   // not pointers into the heap.  The second is implemented with am, not
+   // with get_vabits2 as ptr might be random data pointing anywhere.
+   // On 64 bit platforms, getting va bits for random data can be quite
+   // costly due to the secondary map.
+   if (!lc_may_be_a_chunk_ptr(ptr)
+       || !VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
       return False;
    } else {
-      ch_no = find_chunk_for(ptr, lc_chunks, lc_n_chunks);
+      ch_no = find_lc_chunk_for(ptr);
       tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
 
       if (ch_no == -1) {
@@ -1133,6 +1335,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
    }
    while (ptr < end) {
       Addr addr;
+      Addr run_end;
 
       // Skip invalid chunks.
       if (UNLIKELY((ptr % SM_SIZE) == 0)) {
@@ -1150,7 +1353,12 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
          }
       }
 
-      if ( MC_(is_valid_aligned_word)(ptr) ) {
+      // Find the next run of valid words in the rest of this page, and
+      // scan it.  This is equivalent to checking each word of the page
+      // with MC_(is_valid_aligned_word), but much cheaper.
+      ptr = MC_(find_valid_aligned_words)
+               (ptr, VG_MIN(end, VG_PGROUNDUP(ptr+1)), &run_end);
+      for (; ptr < run_end; ptr += sizeof(Addr)) {
          lc_scanned_szB += sizeof(Addr);
          // If the below read fails, we will longjmp to the loop begin.
          addr = *(Addr *)ptr;
@@ -1190,10 +1398,7 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
          } else {
             lc_push_if_a_chunk_ptr(addr, clique, cur_clique, is_prior_definite);
          }
-      } else if (0 && VG_DEBUG_LEAKCHECK) {
-         VG_(printf)("%#lx not valid\n", ptr);
       }
-      ptr += sizeof(Addr);
    }
 
    VG_(set_fault_catcher)(prev_catcher);
@@ -2047,6 +2252,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
    if (lc_n_chunks == 0) {
       tl_assert(lc_chunks == NULL);
+      lc_build_prefilter();
       if (lr_table != NULL) {
          // forget the previous recorded LossRecords as next leak search
          // can in any case just create new leaks.
@@ -2162,6 +2368,19 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
 
+   // Initialise lc_chunk_bounds.
+   if (lc_chunk_bounds) {
+      VG_(free)(lc_chunk_bounds);
+      lc_chunk_bounds = NULL;
+   }
+   lc_chunk_bounds = VG_(malloc)( "mc.dml.3", lc_n_chunks * sizeof(LC_Bounds) );
+   for (i = 0; i < lc_n_chunks; i++) {
+      lc_chunk_bounds[i].lo = lc_chunks[i]->data;
+      lc_chunk_bounds[i].hi = lc_chunks[i]->data + lc_chunks[i]->szB
+                              + (lc_chunks[i]->szB == 0 ? 1 : 0);
+   }
+   lc_build_prefilter();
+
    // Initialise lc_extras.
    if (lc_extras) {
       VG_(free)(lc_extras);
@@ -2189,7 +2408,10 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    }
 
    // Scan the memory root-set, pushing onto the mark stack any blocks
-   // pointed to.
+   // pointed to.  This is done in full by every search, delta ones
+   // included: only the sorted chunk array is carried over from the
+   // previous search.  Reusing its marks would need to know which
+   // roots and blocks lost a pointer since, and nothing records that.
    scan_memory_root_set(/*searched*/0, 0);
 
    // Scan GP registers for chunk pointers.
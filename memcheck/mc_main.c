@@ -31,7 +31,9 @@
 
 #include "pub_tool_basics.h"
 #include "pub_tool_aspacemgr.h"
+#include "pub_tool_debuginfo.h"     // VG_(find_DebugInfo)
 #include "pub_tool_gdbserver.h"
+#include "pub_tool_guest.h"         // VexGuestArchState
 #include "pub_tool_poolalloc.h"
 #include "pub_tool_hashtable.h"     // For mc_include.h
 #include "pub_tool_libcbase.h"
@@ -43,8 +45,10 @@
 #include "pub_tool_oset.h"
 #include "pub_tool_rangemap.h"
 #include "pub_tool_replacemalloc.h"
+#include "pub_tool_seqmatch.h"      // VG_(string_match)
 #include "pub_tool_tooliface.h"
 #include "pub_tool_threadstate.h"
+#include "pub_tool_vki.h"           // VKI_PAGE_SIZE
 #include "pub_tool_xarray.h"
 #include "pub_tool_xtree.h"
 #include "pub_tool_xtmemory.h"
@@ -173,10 +177,14 @@ static void ocache_sarp_Clear_Origins ( Addr, UWord ); /* fwds */
 
 #else
 
-/* Just handle the first 128G fast and the rest via auxiliary
-   primaries.  If you change this, Memcheck will assert at startup.
-   See the definition of UNALIGNED_OR_HIGH for extensive comments. */
-#  define N_PRIMARY_BITS  21
+/* Just handle the first 1T fast and the rest via auxiliary
+   primaries.  This covers all of the address space aspacem gives to
+   the client, the whole user address space of riscv64 Sv39, and the
+   high areas that some runtimes map with address hints (eg. the Go
+   heap at 0xc000000000).  If you change this, Memcheck will assert at
+   startup.  See the definition of UNALIGNED_OR_HIGH for extensive
+   comments. */
+#  define N_PRIMARY_BITS  24
 
 #endif
 
@@ -382,7 +390,28 @@ static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
 #else
 #define MC_MAIN_STATIC static
 #endif
+#if VG_WORDSIZE == 4
 MC_MAIN_STATIC SecMap* primary_map[N_PRIMARY_MAP];
+#  define PM_ENCODE(_sm)  (_sm)
+#  define PM_DECODE(_ent) (_ent)
+#else
+/* On 64-bit hosts the primary map is big (128M of virtual memory) and
+   most of it is never used.  So entries are stored relative to the
+   noaccess distinguished secondary: an all-zeroes entry stands for
+   &sm_distinguished[SM_DIST_NOACCESS].  The map then needs no
+   initialisation, and its pages stay the kernel's shared zero page
+   until some part of the address space they cover gets used.
+   Decoding is free on most hosts, as the base folds into the
+   addressing of the secondary map.  pm_max_written_off is the highest
+   entry ever written, so that the sanity checks can avoid reading
+   (and faulting in) the whole map. */
+MC_MAIN_STATIC UWord primary_map[N_PRIMARY_MAP];
+static UWord pm_max_written_off = 0;
+#  define PM_ENCODE(_sm) \
+      ((UWord)(_sm) - (UWord)&sm_distinguished[SM_DIST_NOACCESS])
+#  define PM_DECODE(_ent) \
+      ((SecMap*)((_ent) + (UWord)&sm_distinguished[SM_DIST_NOACCESS]))
+#endif
 
 
 /* An entry in the auxiliary primary map.  base must be a 64k-aligned
@@ -619,13 +648,13 @@ static INLINE UWord get_primary_map_low_offset ( Addr a )
   return pm_off;
 }
 
-static INLINE SecMap** get_secmap_low_ptr ( Addr a )
+static INLINE UWord get_secmap_low_off ( Addr a )
 {
    UWord pm_off = a >> 16;
 #  if VG_DEBUG_MEMORY >= 1
    tl_assert(pm_off < N_PRIMARY_MAP);
 #  endif
-   return &primary_map[ pm_off ];
+   return pm_off;
 }
 
 static INLINE SecMap** get_secmap_high_ptr ( Addr a )
@@ -634,16 +663,18 @@ static INLINE SecMap** get_secmap_high_ptr ( Addr a )
    return &am->sm;
 }
 
-static INLINE SecMap** get_secmap_ptr ( Addr a )
+static INLINE void set_secmap_low_off ( UWord pm_off, SecMap* sm )
 {
-   return ( a <= MAX_PRIMARY_ADDRESS
-          ? get_secmap_low_ptr(a)
-          : get_secmap_high_ptr(a));
+#  if VG_WORDSIZE == 8
+   if (UNLIKELY(pm_off > pm_max_written_off))
+      pm_max_written_off = pm_off;
+#  endif
+   primary_map[pm_off] = PM_ENCODE(sm);
 }
 
 static INLINE SecMap* get_secmap_for_reading_low ( Addr a )
 {
-   return *get_secmap_low_ptr(a);
+   return PM_DECODE(primary_map[ get_secmap_low_off(a) ]);
 }
 
 static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
@@ -653,10 +684,13 @@ static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
 
 static INLINE SecMap* get_secmap_for_writing_low(Addr a)
 {
-   SecMap** p = get_secmap_low_ptr(a);
-   if (UNLIKELY(is_distinguished_sm(*p)))
-      *p = copy_for_writing(*p);
-   return *p;
+   UWord   pm_off = get_secmap_low_off(a);
+   SecMap* sm     = PM_DECODE(primary_map[pm_off]);
+   if (UNLIKELY(is_distinguished_sm(sm))) {
+      sm = copy_for_writing(sm);
+      set_secmap_low_off(pm_off, sm);
+   }
+   return sm;
 }
 
 static INLINE SecMap* get_secmap_for_writing_high ( Addr a )
@@ -693,6 +727,15 @@ static INLINE SecMap* get_secmap_for_writing ( Addr a )
           : get_secmap_for_writing_high(a) );
 }
 
+/* Make 'sm' the secmap for 'a'. */
+static INLINE void set_secmap ( Addr a, SecMap* sm )
+{
+   if (a <= MAX_PRIMARY_ADDRESS)
+      set_secmap_low_off(get_secmap_low_off(a), sm);
+   else
+      *get_secmap_high_ptr(a) = sm;
+}
+
 /* If 'a' has a SecMap, produce it.  Else produce NULL.  But don't
    allocate one if one doesn't already exist.  This is used by the
    leak checker.
@@ -1672,7 +1715,6 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
    SecMap*  sm;
-   SecMap** sm_ptr;
    SecMap*  example_dsm;
 
    PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS);
@@ -1778,19 +1820,19 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    //------------------------------------------------------------------------
 
    // If it's distinguished, make it undistinguished if necessary.
-   sm_ptr = get_secmap_ptr(a);
-   if (is_distinguished_sm(*sm_ptr)) {
-      if (*sm_ptr == example_dsm) {
+   sm = get_secmap_for_reading(a);
+   if (is_distinguished_sm(sm)) {
+      if (sm == example_dsm) {
          // Sec-map already has the V+A bits that we want, so skip.
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_DIST_SM1_QUICK);
          a    = aNext;
          lenA = 0;
       } else {
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_DIST_SM1);
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         sm = copy_for_writing(sm);
+         set_secmap(a, sm);
       }
    }
-   sm = *sm_ptr;
 
    // 1 byte steps
    while (True) {
@@ -1836,17 +1878,17 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       if (lenB < SM_SIZE) break;
       tl_assert(is_start_of_sm(a));
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP64K);
-      sm_ptr = get_secmap_ptr(a);
-      if (!is_distinguished_sm(*sm_ptr)) {
+      sm = get_secmap_for_reading(a);
+      if (!is_distinguished_sm(sm)) {
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP64K_FREE_DIST_SM);
          // Free the non-distinguished sec-map that we're replacing.  This
          // case happens moderately often, enough to be worthwhile.
-         SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
+         SysRes sres = VG_(am_munmap_valgrind)((Addr)sm, sizeof(SecMap));
          tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
       }
-      update_SM_counts(*sm_ptr, example_dsm);
+      update_SM_counts(sm, example_dsm);
       // Make the sec-map entry point to the example DSM
-      *sm_ptr = example_dsm;
+      set_secmap(a, example_dsm);
       lenB -= SM_SIZE;
       a    += SM_SIZE;
    }
@@ -1862,18 +1904,18 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    tl_assert(is_start_of_sm(a) && lenB < SM_SIZE);
 
    // If it's distinguished, make it undistinguished if necessary.
-   sm_ptr = get_secmap_ptr(a);
-   if (is_distinguished_sm(*sm_ptr)) {
-      if (*sm_ptr == example_dsm) {
+   sm = get_secmap_for_reading(a);
+   if (is_distinguished_sm(sm)) {
+      if (sm == example_dsm) {
          // Sec-map already has the V+A bits that we want, so stop.
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_DIST_SM2_QUICK);
          return;
       } else {
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_DIST_SM2);
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         sm = copy_for_writing(sm);
+         set_secmap(a, sm);
       }
    }
-   sm = *sm_ptr;
 
    // 8-aligned, 8 byte steps
    while (True) {
@@ -2163,8 +2205,9 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    Memory is shadowed using a two level cache structure (ocacheL1 and
    ocacheL2).  Memory references are first directed to ocacheL1.  This
-   is a traditional 2-way set associative cache with 32-byte lines and
-   approximate LRU replacement within each set.
+   is a traditional set associative cache (2-way by default) with
+   32-byte lines and approximate LRU replacement within each set.  Its
+   size can grow at run time if the working set doesn't fit.
 
    A naive implementation would require storing one 32 bit otag for
    each byte of memory covered, a 4:1 space overhead.  Instead, there
@@ -2182,8 +2225,9 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
    zeroes to be installed.  However, ejecting a line containing
    nonzeroes risks losing origin information permanently.  In order to
    prevent such lossage, ejected nonzero lines are placed in a
-   secondary cache (ocacheL2), which is an OSet (AVL tree) of cache
-   lines.  This can grow arbitrarily large, and so should ensure that
+   secondary cache (ocacheL2), which is a hash table of cache lines,
+   optionally compressed.  This can grow arbitrarily large, and so
+   should ensure that
    Memcheck runs out of memory in preference to losing useful origin
    info due to cache size limitations.
 
@@ -2406,8 +2450,11 @@ static UWord stats_ocacheL1_found_at_N     = 0;
 static UWord stats_ocacheL1_misses         = 0;
 static UWord stats_ocacheL1_lossage        = 0;
 static UWord stats_ocacheL1_movefwds       = 0;
+static UWord stats_ocacheL1_grows          = 0;
+static UWord stats_ocache_zero_stores_elided = 0;
 
 static UWord stats__ocacheL2_finds         = 0;
+static UWord stats__ocacheL2_puts          = 0;
 static UWord stats__ocacheL2_adds          = 0;
 static UWord stats__ocacheL2_dels          = 0;
 static UWord stats__ocacheL2_misses        = 0;
@@ -2425,18 +2472,22 @@ static INLINE Bool is_valid_oc_tag ( Addr tag ) {
    return 0 == (tag & ((1 << OC_BITS_PER_LINE) - 1));
 }
 
-#define OC_LINES_PER_SET 2
-
-#define OC_N_SET_BITS    20
-#define OC_N_SETS        (1 << OC_N_SET_BITS)
-
-/* These settings give:
+/* The number of sets and the number of lines per set (ways) in the L1
+   are chosen at startup from --origin-cache-size and
+   --origin-cache-ways.  Both are powers of two.  The defaults, 2^20
+   sets of 2 lines, give:
    64 bit host: ocache:  100,663,296 sizeB    67,108,864 useful
    32 bit host: ocache:   92,274,688 sizeB    67,108,864 useful
-*/
+   The number of sets can later grow, up to --origin-cache-max-size,
+   if the L1 is found to be too small (see ocacheL1_maybe_grow). */
+#define OC_MIN_SET_BITS  12
+#define OC_MAX_SET_BITS  (VG_WORDSIZE == 8 ? 28 : 24)
 
 #define OC_MOVE_FORWARDS_EVERY_BITS 7
 
+/* How often, in L1 misses, to consider growing the L1. */
+#define OC_GROW_CHECK_EVERY_BITS 20
+
 
 /* Originally (pre Dec 2021) it was the case that this code had a
    parameterizable cache line size, set by changing OC_BITS_PER_LINE.
@@ -2446,7 +2497,6 @@ static INLINE Bool is_valid_oc_tag ( Addr tag ) {
    size is 32 bytes).  Changing that would require a bunch of re-tuning
    effort.  So let's set it in stone for now. */
 STATIC_ASSERT(OC_BITS_PER_LINE == 5);
-STATIC_ASSERT(OC_LINES_PER_SET == 2);
 
 /* Fundamentally we want an OCacheLine structure (see below) as follows:
       struct {
@@ -2523,50 +2573,156 @@ static inline UChar classify_OCacheLine ( OCacheLine* line )
    return 'z'; /* ZERO - no useful info */
 }
 
-typedef
-   struct {
-      OCacheLine line[OC_LINES_PER_SET];
-   }
-   OCacheSet;
+/* The L1 is an array of 2^ocacheL1_set_bits sets, each of which is
+   2^ocacheL1_way_bits consecutive lines, most recently used first
+   (approximately). */
+static OCacheLine* ocacheL1 = NULL;
+static UWord       ocacheL1_set_bits = 0;
+static UWord       ocacheL1_set_mask = 0;
+static UWord       ocacheL1_way_bits = 0;
+static UWord       ocacheL1_max_set_bits = 0;
+static UWord       ocacheL1_event_ctr = 0;
 
-typedef
-   struct {
-      OCacheSet set[OC_N_SETS];
-   }
-   OCache;
+static INLINE UWord ocacheL1_n_ways ( void ) {
+   return 1UL << ocacheL1_way_bits;
+}
+static INLINE SizeT ocacheL1_size ( void ) {
+   return (sizeof(OCacheLine) << ocacheL1_way_bits) << ocacheL1_set_bits;
+}
+static INLINE OCacheLine* ocacheL1_set ( Addr a ) {
+   UWord setno = (a >> OC_BITS_PER_LINE) & ocacheL1_set_mask;
+   return &ocacheL1[setno << ocacheL1_way_bits];
+}
+
+/* Allocate an L1 of 2^set_bits sets, with all lines empty.  Returns
+   NULL if out of memory. */
+static OCacheLine* alloc_ocacheL1 ( UWord set_bits )
+{
+   UWord  nLines = (1UL << set_bits) << ocacheL1_way_bits;
+   SysRes sres   = VG_(am_shadow_alloc)(nLines * sizeof(OCacheLine));
+   if (sr_isError(sres))
+      return NULL;
+   OCacheLine* lines = (void *)(Addr)sr_Res(sres);
+   for (UWord i = 0; i < nLines; i++)
+      lines[i].tag = 1/*invalid*/;
+   return lines;
+}
 
-static OCache* ocacheL1 = NULL;
-static UWord   ocacheL1_event_ctr = 0;
+/* Largest number of set bits giving an L1 no bigger than |szMB|. */
+static UWord ocacheL1_set_bits_for ( UInt szMB )
+{
+   ULong szB  = (ULong)szMB << 20;
+   UWord bits = OC_MIN_SET_BITS;
+   while (bits < OC_MAX_SET_BITS
+          && ((ULong)(sizeof(OCacheLine) << ocacheL1_way_bits) << (bits + 1))
+             <= szB)
+      bits++;
+   return bits;
+}
 
 static void init_ocacheL2 ( void ); /* fwds */
 static void init_OCache ( void )
 {
-   UWord line, set;
    tl_assert(MC_(clo_mc_level) >= 3);
    tl_assert(ocacheL1 == NULL);
-   SysRes sres = VG_(am_shadow_alloc)(sizeof(OCache));
-   if (sr_isError(sres)) {
+   ocacheL1_way_bits = 0;
+   while ((1U << ocacheL1_way_bits) < MC_(clo_origin_cache_ways))
+      ocacheL1_way_bits++;
+   tl_assert(ocacheL1_n_ways() == MC_(clo_origin_cache_ways));
+   tl_assert(ocacheL1_n_ways() >= 2);
+   ocacheL1_set_bits     = ocacheL1_set_bits_for(MC_(clo_origin_cache_size));
+   ocacheL1_set_mask     = (1UL << ocacheL1_set_bits) - 1;
+   ocacheL1_max_set_bits
+      = ocacheL1_set_bits_for(MC_(clo_origin_cache_max_size));
+   if (ocacheL1_max_set_bits < ocacheL1_set_bits)
+      ocacheL1_max_set_bits = ocacheL1_set_bits;
+   ocacheL1 = alloc_ocacheL1(ocacheL1_set_bits);
+   if (ocacheL1 == NULL) {
       VG_(out_of_memory_NORETURN)( "memcheck:allocating ocacheL1",
-                                   sizeof(OCache), sr_Err(sres) );
+                                   ocacheL1_size(), 0 );
    }
-   ocacheL1 = (void *)(Addr)sr_Res(sres);
-   tl_assert(ocacheL1 != NULL);
-   for (set = 0; set < OC_N_SETS; set++) {
-      for (line = 0; line < OC_LINES_PER_SET; line++) {
-         ocacheL1->set[set].line[line].tag = 1/*invalid*/;
+   init_ocacheL2();
+}
+
+/* Double the number of sets in the L1.  The set of a line is given by
+   the low bits of its line number, so the lines of old set |s| go to
+   either new set |s| or new set |s| + old number of sets.  Each has as
+   many ways as the old set, so no line is lost, and the lines keep
+   their relative order.  Returns False if out of memory. */
+static Bool ocacheL1_grow ( void )
+{
+   UWord       oldNSets = 1UL << ocacheL1_set_bits;
+   UWord       nWays    = ocacheL1_n_ways();
+   SizeT       oldSzB   = ocacheL1_size();
+   OCacheLine* old      = ocacheL1;
+   OCacheLine* nyu      = alloc_ocacheL1(ocacheL1_set_bits + 1);
+   if (nyu == NULL)
+      return False;
+
+   for (UWord s = 0; s < oldNSets; s++) {
+      OCacheLine* lo  = &nyu[s * nWays];
+      OCacheLine* hi  = &nyu[(s + oldNSets) * nWays];
+      UWord       nLo = 0, nHi = 0;
+      for (UWord w = 0; w < nWays; w++) {
+         OCacheLine* line = &old[s * nWays + w];
+         if (line->tag == 1/*invalid*/)
+            continue;
+         if ((line->tag >> OC_BITS_PER_LINE) & oldNSets)
+            hi[nHi++] = *line;
+         else
+            lo[nLo++] = *line;
       }
    }
-   init_ocacheL2();
+
+   ocacheL1 = nyu;
+   ocacheL1_set_bits++;
+   ocacheL1_set_mask = (1UL << ocacheL1_set_bits) - 1;
+   SysRes sres = VG_(am_munmap_valgrind)((Addr)old, oldSzB);
+   tl_assert2(! sr_isError(sres), "ocacheL1_grow: munmap failed\n");
+   stats_ocacheL1_grows++;
+   return True;
+}
+
+/* Called every 2^OC_GROW_CHECK_EVERY_BITS L1 misses.  Grow the L1 if,
+   since the previous call, more than 1 in 64 references missed, and
+   more than a quarter of the misses were for lines found in the L2.
+   The latter means the working set exceeds the L1, rather than that
+   the program is simply touching new memory.  Returns True if the L1
+   was grown. */
+static Bool ocacheL1_maybe_grow ( void )
+{
+   static UWord prev_finds = 0, prev_misses = 0, prev_L2_misses = 0;
+   UWord dFinds    = stats_ocacheL1_find - prev_finds;
+   UWord dMisses   = stats_ocacheL1_misses - prev_misses;
+   UWord dL2Misses = stats__ocacheL2_misses - prev_L2_misses;
+   Bool  grow      = dMisses * 64 > dFinds
+                     && (dMisses - dL2Misses) * 4 > dMisses;
+
+   prev_finds     = stats_ocacheL1_find;
+   prev_misses    = stats_ocacheL1_misses;
+   prev_L2_misses = stats__ocacheL2_misses;
+
+   if (!grow)
+      return False;
+   if (!ocacheL1_grow()) {
+      /* Out of memory.  Stay at the current size. */
+      ocacheL1_max_set_bits = ocacheL1_set_bits;
+      return False;
+   }
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "memcheck: origin cache grown to %lu MB\n",
+                   (UWord)(ocacheL1_size() >> 20));
+   return True;
 }
 
-static inline void moveLineForwards ( OCacheSet* set, UWord lineno )
+static inline void moveLineForwards ( OCacheLine* set, UWord lineno )
 {
    OCacheLine tmp;
    stats_ocacheL1_movefwds++;
-   tl_assert(lineno > 0 && lineno < OC_LINES_PER_SET);
-   tmp = set->line[lineno-1];
-   set->line[lineno-1] = set->line[lineno];
-   set->line[lineno] = tmp;
+   tl_assert(lineno > 0 && lineno < ocacheL1_n_ways());
+   tmp = set[lineno-1];
+   set[lineno-1] = set[lineno];
+   set[lineno] = tmp;
 }
 
 static inline void zeroise_OCacheLine ( OCacheLine* line, Addr tag ) {
@@ -2593,103 +2749,270 @@ static inline void zeroise_OCacheLine ( OCacheLine* line, Addr tag ) {
 //////////////////////////////////////////////////////////////
 //// OCache backing store
 
-// The backing store for ocacheL1 is, conceptually, an AVL tree of lines that
-// got ejected from the L1 (a "victim cache"), and which actually contain
-// useful info -- that is, for which classify_OCacheLine would return 'n' and
-// no other value.  However, the tree can grow large, and searching/updating
-// it can be hot paths.  Hence we "take out" 12 significant bits of the key by
-// having 4096 trees, and select one using HASH_OCACHE_TAG.
+// The backing store for ocacheL1 holds the lines that got ejected from the
+// L1 (a "victim cache"), and which actually contain useful info -- that is,
+// for which classify_OCacheLine would return 'n' and no other value.  It can
+// get large, and searching/updating it can be hot paths, so it is a pair of
+// open addressing hash tables using linear probing, keyed by tag:
+//
+// * ocacheL2_full holds OCacheLines verbatim.
 //
-// What that hash function returns isn't important so long as it is a pure
-// function of the tag values, and is < 4096.  However, it is critical for
-// performance of long SARPs.  Hence the extra shift of 11 bits.  This means
-// each tree conceptually is assigned to contiguous sequences of 2048 lines in
-// the "line address space", giving some locality of reference when scanning
-// linearly through address space, as is done by a SARP.  Changing that 11 to
-// 0 gives terrible performance on long SARPs, presumably because each new
-// line is in a different tree, hence we wind up thrashing the (CPU's) caches.
+// * ocacheL2_uniform holds lines in which all the represented origins
+//   are the same, in compressed form (OCacheLineU): the descr[] array
+//   and a single otag.  This is very common, since blocks of memory
+//   are typically made undefined all at once.  Such lines are only
+//   put here if --origin-cache-compress=yes.
 //
-// On 32-bit targets, we have to be a bit careful not to shift out so many
-// bits that not all 2^12 trees get used.  That leads to the constraint
-// (OC_BITS_PER_LINE + 11 + 12) < 32.  Note that the 11 is the only thing we
-// can change here.  In this case we have OC_BITS_PER_LINE == 5, hence the
-// inequality is (28 < 32) and so we're good.
+// A tag is in at most one of the two tables.
 //
-// The value 11 was determined empirically from various Firefox runs.  10 or
-// 12 also work pretty well.
+// The hash function keeps runs of 64 consecutive lines in consecutive
+// slots, and scatters the runs.  That gives some locality of reference
+// when scanning linearly through address space, as is done by a SARP,
+// without the clustering that an identity hash would give for regions
+// whose addresses differ by a multiple of the table size.
+
+typedef
+   struct {
+      Addr  tag;
+      UInt  otag;
+      UChar descr[OC_W32S_PER_LINE];
+   }
+   OCacheLineU;
+
+typedef
+   struct {
+      UChar*       slots;  /* entries of szB bytes, starting with a tag */
+      UWord        szB;
+      UWord        mask;   /* number of slots - 1 */
+      UWord        used;
+      const HChar* cc;
+   }
+   OCacheL2Table;
+
+static OCacheL2Table ocacheL2_full;
+static OCacheL2Table ocacheL2_uniform;
+
+#define OC_L2_INIT_SLOTS 1024
 
-static OSet* ocachesL2[4096];
+static inline UWord ocacheL2_hash ( Addr tag )
+{
+   UWord lineno = tag >> OC_BITS_PER_LINE;
+   ULong run    = lineno >> 6;
+   return lineno + (UWord)((run * 0x9E3779B97F4A7C15ULL) >> 32);
+}
 
-STATIC_ASSERT((OC_BITS_PER_LINE + 11 + 12) < 32);
-static inline UInt HASH_OCACHE_TAG ( Addr tag ) {
-   return (UInt)((tag >> (OC_BITS_PER_LINE + 11)) & 0xFFF);
+static inline Addr* ocacheL2_slot ( const OCacheL2Table* t, UWord i ) {
+   return (Addr*)(t->slots + i * t->szB);
 }
 
-static void* ocacheL2_malloc ( const HChar* cc, SizeT szB ) {
-   return VG_(malloc)(cc, szB);
+static void ocacheL2_init_table ( OCacheL2Table* t, UWord szB,
+                                  const HChar* cc, UWord nSlots )
+{
+   t->szB   = szB;
+   t->mask  = nSlots - 1;
+   t->used  = 0;
+   t->cc    = cc;
+   t->slots = VG_(malloc)(cc, nSlots * szB);
+   for (UWord i = 0; i < nSlots; i++)
+      *ocacheL2_slot(t, i) = 1/*invalid*/;
 }
-static void ocacheL2_free ( void* v ) {
-   VG_(free)( v );
+
+/* Find the entry with the given tag, or NULL if not present. */
+static inline void* ocacheL2_table_find ( const OCacheL2Table* t, Addr tag )
+{
+   UWord i = ocacheL2_hash(tag) & t->mask;
+   while (True) {
+      Addr* e = ocacheL2_slot(t, i);
+      if (*e == tag)
+         return e;
+      if (*e == 1/*invalid*/)
+         return NULL;
+      i = (i + 1) & t->mask;
+   }
 }
 
-/* Stats: # nodes currently in tree */
+static void ocacheL2_table_insert ( OCacheL2Table* t, const void* entry );
+
+/* Double the size of |t|. */
+static void ocacheL2_table_grow ( OCacheL2Table* t )
+{
+   OCacheL2Table old = *t;
+   ocacheL2_init_table(t, old.szB, old.cc, 2 * (old.mask + 1));
+   for (UWord i = 0; i <= old.mask; i++) {
+      Addr* e = ocacheL2_slot(&old, i);
+      if (*e != 1/*invalid*/)
+         ocacheL2_table_insert(t, e);
+   }
+   tl_assert(t->used == old.used);
+   VG_(free)(old.slots);
+}
+
+/* Add a copy of |entry| to |t|.  Its tag must not already be present. */
+static void ocacheL2_table_insert ( OCacheL2Table* t, const void* entry )
+{
+   Addr  tag = *(const Addr*)entry;
+   UWord i;
+   if (4 * (t->used + 1) > 3 * (t->mask + 1))
+      ocacheL2_table_grow(t);
+   i = ocacheL2_hash(tag) & t->mask;
+   while (*ocacheL2_slot(t, i) != 1/*invalid*/) {
+      tl_assert(*ocacheL2_slot(t, i) != tag);
+      i = (i + 1) & t->mask;
+   }
+   VG_(memcpy)(ocacheL2_slot(t, i), entry, t->szB);
+   t->used++;
+}
+
+/* Remove the entry with the given tag from |t|, if present.  Returns
+   True if it was.  The entries following it in its cluster are moved
+   back as needed, so that no tombstones are required. */
+static Bool ocacheL2_table_remove ( OCacheL2Table* t, Addr tag )
+{
+   UWord i = ocacheL2_hash(tag) & t->mask;
+   UWord j;
+   while (*ocacheL2_slot(t, i) != tag) {
+      if (*ocacheL2_slot(t, i) == 1/*invalid*/)
+         return False;
+      i = (i + 1) & t->mask;
+   }
+   j = i;
+   while (True) {
+      Addr* ej;
+      UWord k;
+      j  = (j + 1) & t->mask;
+      ej = ocacheL2_slot(t, j);
+      if (*ej == 1/*invalid*/)
+         break;
+      /* The entry at j may move to the hole at i only if its home
+         slot k is not cyclically in (i, j]. */
+      k = ocacheL2_hash(*ej) & t->mask;
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+      VG_(memcpy)(ocacheL2_slot(t, i), ej, t->szB);
+      i = j;
+   }
+   *ocacheL2_slot(t, i) = 1/*invalid*/;
+   tl_assert(t->used > 0);
+   t->used--;
+   return True;
+}
+
+/* Stats: # lines currently in the L2 */
 static UWord stats__ocacheL2_n_nodes = 0;
 
 static void init_ocacheL2 ( void )
 {
-   tl_assert(sizeof(Word) == sizeof(Addr)); /* since OCacheLine.tag :: Addr */
-   tl_assert(0 == offsetof(OCacheLine,tag));
-   for (UInt i = 0; i < 4096; i++) {
-      tl_assert(!ocachesL2[i]);
-      ocachesL2[i]
-         = VG_(OSetGen_Create)( offsetof(OCacheLine,tag),
-                                NULL, /* fast cmp */
-                                ocacheL2_malloc, "mc.ioL2", ocacheL2_free);
-   }
+   ocacheL2_init_table(&ocacheL2_full, sizeof(OCacheLine),
+                       "mc.ioL2.1", OC_L2_INIT_SLOTS);
+   ocacheL2_init_table(&ocacheL2_uniform, sizeof(OCacheLineU),
+                       "mc.ioL2.2", OC_L2_INIT_SLOTS);
    stats__ocacheL2_n_nodes = 0;
 }
 
-/* Find line with the given tag in the tree, or NULL if not found. */
-static inline OCacheLine* ocacheL2_find_tag ( Addr tag )
+static SizeT ocacheL2_size ( void )
 {
-   OCacheLine* line;
+   return (ocacheL2_full.mask + 1) * ocacheL2_full.szB
+          + (ocacheL2_uniform.mask + 1) * ocacheL2_uniform.szB;
+}
+
+/* If all the origins represented by |line| are the same, compress it
+   into |u| and return True. */
+static Bool compress_OCacheLine ( const OCacheLine* line,
+                                  /*OUT*/OCacheLineU* u )
+{
+   UInt otag = 0;
+   for (UWord i = 0; i < OC_W32S_PER_LINE; i++) {
+      if (line->u.main.descr[i] == 0)
+         continue;
+      if (otag == 0)
+         otag = line->u.main.w32[i];
+      else if (line->u.main.w32[i] != otag)
+         return False;
+   }
+   u->tag  = line->tag;
+   u->otag = otag;
+   for (UWord i = 0; i < OC_W32S_PER_LINE; i++)
+      u->descr[i] = line->u.main.descr[i];
+   return True;
+}
+
+/* The w32[] entries whose descr[] is zero are never looked at, so
+   they can be zeroed here. */
+static void decompress_OCacheLine ( const OCacheLineU* u,
+                                    /*OUT*/OCacheLine* line )
+{
+   line->tag = u->tag;
+   for (UWord i = 0; i < OC_W32S_PER_LINE; i++) {
+      line->u.main.descr[i] = u->descr[i];
+      line->u.main.w32[i]   = u->descr[i] ? u->otag : 0;
+   }
+}
+
+/* Copy the line with the given tag to |dst|, if it is present.
+   Returns True if it was. */
+static inline Bool ocacheL2_get_line ( Addr tag, /*OUT*/OCacheLine* dst )
+{
+   OCacheLine*  full;
+   OCacheLineU* uniform;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_finds++;
-   OSet* oset = ocachesL2[HASH_OCACHE_TAG(tag)];
-   line = VG_(OSetGen_Lookup)( oset, &tag );
-   return line;
+   full = ocacheL2_table_find(&ocacheL2_full, tag);
+   if (full) {
+      *dst = *full;
+      return True;
+   }
+   uniform = ocacheL2_table_find(&ocacheL2_uniform, tag);
+   if (uniform) {
+      decompress_OCacheLine(uniform, dst);
+      return True;
+   }
+   return False;
 }
 
-/* Delete the line with the given tag from the tree, if it is present, and
-   free up the associated memory. */
+/* Delete the line with the given tag, if it is present. */
 static void ocacheL2_del_tag ( Addr tag )
 {
-   OCacheLine* line;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_dels++;
-   OSet* oset = ocachesL2[HASH_OCACHE_TAG(tag)];
-   line = VG_(OSetGen_Remove)( oset, &tag );
-   if (line) {
-      VG_(OSetGen_FreeNode)(oset, line);
+   if (ocacheL2_table_remove(&ocacheL2_full, tag)
+       || ocacheL2_table_remove(&ocacheL2_uniform, tag)) {
       tl_assert(stats__ocacheL2_n_nodes > 0);
       stats__ocacheL2_n_nodes--;
    }
 }
 
-/* Add a copy of the given line to the tree.  It must not already be
-   present. */
-static void ocacheL2_add_line ( OCacheLine* line )
+/* Store a copy of |line|, replacing any line with the same tag. */
+static void ocacheL2_put_line ( const OCacheLine* line )
 {
-   OCacheLine* copy;
+   OCacheLineU   u;
+   OCacheL2Table *into, *other;
+   const void*   entry;
+   void*         old;
+
    tl_assert(is_valid_oc_tag(line->tag));
-   OSet* oset = ocachesL2[HASH_OCACHE_TAG(line->tag)];
-   copy = VG_(OSetGen_AllocNode)( oset, sizeof(OCacheLine) );
-   *copy = *line;
+   stats__ocacheL2_puts++;
+   if (MC_(clo_origin_cache_compress) && compress_OCacheLine(line, &u)) {
+      into  = &ocacheL2_uniform;
+      other = &ocacheL2_full;
+      entry = &u;
+   } else {
+      into  = &ocacheL2_full;
+      other = &ocacheL2_uniform;
+      entry = line;
+   }
+
+   old = ocacheL2_table_find(into, line->tag);
+   if (old) {
+      VG_(memcpy)(old, entry, into->szB);
+      return;
+   }
+   if (!ocacheL2_table_remove(other, line->tag)) {
+      stats__ocacheL2_n_nodes++;
+      if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
+         stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
+   }
    stats__ocacheL2_adds++;
-   VG_(OSetGen_Insert)( oset, copy );
-   stats__ocacheL2_n_nodes++;
-   if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
-      stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
+   ocacheL2_table_insert(into, entry);
 }
 
 ////
@@ -2698,46 +3021,49 @@ static void ocacheL2_add_line ( OCacheLine* line )
 __attribute__((noinline))
 static OCacheLine* find_OCacheLine_SLOW ( Addr a )
 {
-   OCacheLine *victim, *inL2;
+   OCacheLine *set, *victim;
    UChar c;
    UWord line;
-   UWord setno   = (a >> OC_BITS_PER_LINE) & (OC_N_SETS - 1);
+   UWord nWays   = ocacheL1_n_ways();
    UWord tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
    UWord tag     = a & tagmask;
-   tl_assert(setno < OC_N_SETS);
+
+   set = ocacheL1_set( a );
 
    /* we already tried line == 0; skip therefore. */
-   for (line = 1; line < OC_LINES_PER_SET; line++) {
-      if (ocacheL1->set[setno].line[line].tag == tag) {
-         switch (line) {
-         // with OC_LINES_PER_SET equal to 2 this is the only possible case
-         case 1:
+   for (line = 1; line < nWays; line++) {
+      if (set[line].tag == tag) {
+         if (line == 1)
             stats_ocacheL1_found_at_1++;
-            break;
-#if OC_LINES_PER_SET > 2
-         default:
+         else
             stats_ocacheL1_found_at_N++;
-            break;
-#endif
-         }
          if (UNLIKELY(0 == (ocacheL1_event_ctr++
                             & ((1<<OC_MOVE_FORWARDS_EVERY_BITS)-1)))) {
-            moveLineForwards( &ocacheL1->set[setno], line );
+            moveLineForwards( set, line );
             line--;
          }
-         return &ocacheL1->set[setno].line[line];
+         return &set[line];
       }
    }
 
    /* A miss.  Use the last slot.  Implicitly this means we're
       ejecting the line in the last slot. */
    stats_ocacheL1_misses++;
-   tl_assert(line == OC_LINES_PER_SET);
+   tl_assert(line == nWays);
    line--;
    tl_assert(line > 0);
 
+   /* Every so often, see whether the L1 should be bigger.  If it gets
+      bigger, the line's set changes. */
+   if (UNLIKELY(0 == (stats_ocacheL1_misses
+                      & ((1UL << OC_GROW_CHECK_EVERY_BITS) - 1)))
+       && ocacheL1_set_bits < ocacheL1_max_set_bits
+       && ocacheL1_maybe_grow()) {
+      set = ocacheL1_set( a );
+   }
+
    /* First, move the to-be-ejected line to the L2 cache. */
-   victim = &ocacheL1->set[setno].line[line];
+   victim = &set[line];
    c = classify_OCacheLine(victim);
    switch (c) {
       case 'e':
@@ -2755,58 +3081,98 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
          /* line contains at least one real, useful origin.  Copy it
             to the backing store. */
          stats_ocacheL1_lossage++;
-         inL2 = ocacheL2_find_tag( victim->tag );
-         if (inL2) {
-            *inL2 = *victim;
-         } else {
-            ocacheL2_add_line( victim );
-         }
+         ocacheL2_put_line( victim );
          break;
       default:
          tl_assert(0);
    }
 
-   /* Now we must reload the L1 cache from the backing tree, if
+   /* Now we must reload the L1 cache from the backing store, if
       possible. */
    tl_assert(tag != victim->tag); /* stay sane */
-   inL2 = ocacheL2_find_tag( tag );
-   if (inL2) {
-      /* We're in luck.  It's in the L2. */
-      ocacheL1->set[setno].line[line] = *inL2;
-   } else {
+   if (!ocacheL2_get_line( tag, &set[line] )) {
       /* Missed at both levels of the cache hierarchy.  We have to
          declare it as full of zeroes (unknown origins). */
       stats__ocacheL2_misses++;
-      zeroise_OCacheLine( &ocacheL1->set[setno].line[line], tag );
+      zeroise_OCacheLine( &set[line], tag );
    }
 
    /* Move it one forwards */
-   moveLineForwards( &ocacheL1->set[setno], line );
+   moveLineForwards( set, line );
    line--;
 
-   return &ocacheL1->set[setno].line[line];
+   return &set[line];
 }
 
 static INLINE OCacheLine* find_OCacheLine ( Addr a )
 {
-   UWord setno   = (a >> OC_BITS_PER_LINE) & (OC_N_SETS - 1);
-   UWord tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
-   UWord tag     = a & tagmask;
+   OCacheLine* set     = ocacheL1_set( a );
+   UWord       tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
+   UWord       tag     = a & tagmask;
 
    stats_ocacheL1_find++;
 
    if (OC_ENABLE_ASSERTIONS) {
-      tl_assert(setno >= 0 && setno < OC_N_SETS);
       tl_assert(0 == (tag & (4 * OC_W32S_PER_LINE - 1)));
    }
 
-   if (LIKELY(ocacheL1->set[setno].line[0].tag == tag)) {
-      return &ocacheL1->set[setno].line[0];
+   if (LIKELY(set[0].tag == tag)) {
+      return &set[0];
    }
 
    return find_OCacheLine_SLOW( a );
 }
 
+/* Find the line for a store of the zero otag to |a|.  Such a store
+   changes nothing if neither level of the cache holds a line for |a|,
+   since a line that is absent is implicitly all zeroes.  In that case
+   return NULL rather than evicting some other line to make room for a
+   zero line.  This is by far the most common kind of origin store. */
+__attribute__((noinline))
+static OCacheLine* find_OCacheLine_for_zero_store_SLOW ( Addr a )
+{
+   OCacheLine* set     = ocacheL1_set( a );
+   UWord       nWays   = ocacheL1_n_ways();
+   UWord       tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
+   UWord       tag     = a & tagmask;
+   UWord       line;
+
+   for (line = 1; line < nWays; line++) {
+      if (set[line].tag == tag)
+         return find_OCacheLine_SLOW( a );
+   }
+   if (ocacheL2_table_find(&ocacheL2_full, tag)
+       || ocacheL2_table_find(&ocacheL2_uniform, tag))
+      return find_OCacheLine_SLOW( a );
+
+   stats_ocache_zero_stores_elided++;
+   return NULL;
+}
+
+static INLINE OCacheLine* find_OCacheLine_for_zero_store ( Addr a )
+{
+   OCacheLine* set     = ocacheL1_set( a );
+   UWord       tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
+   UWord       tag     = a & tagmask;
+
+   stats_ocacheL1_find++;
+
+   if (LIKELY(set[0].tag == tag)) {
+      return &set[0];
+   }
+
+   return find_OCacheLine_for_zero_store_SLOW( a );
+}
+
+/* Find the line for an origin store of |d32| to |a|.  Returns NULL if
+   the store can be skipped. */
+static INLINE OCacheLine* find_OCacheLine_for_store ( Addr a, UWord d32 )
+{
+   if (LIKELY(d32 == 0))
+      return find_OCacheLine_for_zero_store( a );
+   return find_OCacheLine( a );
+}
+
 static INLINE void set_aligned_word64_Origin_to_undef ( Addr a, UInt otag )
 {
    //// BEGIN inlined, specialised version of MC_(helperc_b_store8)
@@ -4887,32 +5253,32 @@ STATIC_ASSERT(V_BITS8_UNDEFINED == 0xFF);
 
    On a 64-bit machine, it's more complex, since we're testing
    simultaneously for misalignment and for the address being at or
-   above 64G:
-
-   N_PRIMARY_BITS          == 20, so
-   N_PRIMARY_MAP           == 0x100000, so
-   N_PRIMARY_MAP-1         == 0xFFFFF, so
-   (N_PRIMARY_MAP-1) << 16 == 0xF'FFFF'0000, and so
-
-   MASK(1) = ~ ( (0x10000 - 1) | 0xF'FFFF'0000 )
-           = ~ ( 0xFFFF | 0xF'FFFF'0000 )
-           = ~ 0xF'FFFF'FFFF
-           = 0xFFFF'FFF0'0000'0000
-
-   MASK(2) = ~ ( (0x10000 - 2) | 0xF'FFFF'0000 )
-           = ~ ( 0xFFFE | 0xF'FFFF'0000 )
-           = ~ 0xF'FFFF'FFFE
-           = 0xFFFF'FFF0'0000'0001
-
-   MASK(4) = ~ ( (0x10000 - 4) | 0xF'FFFF'0000 )
-           = ~ ( 0xFFFC | 0xF'FFFF'0000 )
-           = ~ 0xF'FFFF'FFFC
-           = 0xFFFF'FFF0'0000'0003
-
-   MASK(8) = ~ ( (0x10000 - 8) | 0xF'FFFF'0000 )
-           = ~ ( 0xFFF8 | 0xF'FFFF'0000 )
-           = ~ 0xF'FFFF'FFF8
-           = 0xFFFF'FFF0'0000'0007
+   above 1T:
+
+   N_PRIMARY_BITS          == 24, so
+   N_PRIMARY_MAP           == 0x1000000, so
+   N_PRIMARY_MAP-1         == 0xFFFFFF, so
+   (N_PRIMARY_MAP-1) << 16 == 0xFF'FFFF'0000, and so
+
+   MASK(1) = ~ ( (0x10000 - 1) | 0xFF'FFFF'0000 )
+           = ~ ( 0xFFFF | 0xFF'FFFF'0000 )
+           = ~ 0xFF'FFFF'FFFF
+           = 0xFFFF'FF00'0000'0000
+
+   MASK(2) = ~ ( (0x10000 - 2) | 0xFF'FFFF'0000 )
+           = ~ ( 0xFFFE | 0xFF'FFFF'0000 )
+           = ~ 0xFF'FFFF'FFFE
+           = 0xFFFF'FF00'0000'0001
+
+   MASK(4) = ~ ( (0x10000 - 4) | 0xFF'FFFF'0000 )
+           = ~ ( 0xFFFC | 0xFF'FFFF'0000 )
+           = ~ 0xFF'FFFF'FFFC
+           = 0xFFFF'FF00'0000'0003
+
+   MASK(8) = ~ ( (0x10000 - 8) | 0xFF'FFFF'0000 )
+           = ~ ( 0xFFF8 | 0xFF'FFFF'0000 )
+           = ~ 0xFF'FFFF'FFF8
+           = 0xFFFF'FF00'0000'0007
 */
 
 /*------------------------------------------------------------*/
@@ -5798,6 +6164,91 @@ void MC_(helperc_value_checkN_fail_no_o) ( HWord sz ) {
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Adaptive definedness checking.                       ---*/
+/*------------------------------------------------------------*/
+
+/* With --expensive-definedness-checks=adaptive, blocks are at first
+   instrumented as for "auto".  A failed check of a value which depends
+   on a cheaply instrumented add, subtract or equality comparison in the
+   same block may be a false error.  So for such checks the V bits of
+   the value are also computed as the expensive instrumentation would,
+   and the failure handler is told whether the check fails with those
+   too.  If so, the error is real and is reported.  If not, it is
+   dropped, and the block is flagged instead.  Cheap translations test
+   their block's flag on entry, and once it is set they exit to have
+   themselves discarded, so that the block is retranslated with
+   expensive instrumentation throughout.
+
+   IR can't compute anything conditionally, so the expensive V bits are
+   computed on every run of such a check, not just when it fails.  That
+   only affects the values that such checks depend on, and only until
+   the block is first flagged. */
+
+typedef
+   struct _AdaptBlock {
+      struct _AdaptBlock* next;
+      Addr  key;       /* guest address of the block */
+      UChar promoted;  /* read by cheap translations of the block */
+   }
+   AdaptBlock;
+
+static VgHashTable* adapt_blocks = NULL;
+
+static ULong n_adapt_failed   = 0;
+static ULong n_adapt_reported = 0;
+static ULong n_adapt_promoted = 0;
+
+UChar* MC_(adaptive_block_flag) ( Addr a )
+{
+   AdaptBlock* ab = VG_(HT_lookup)( adapt_blocks, a );
+   if (!ab) {
+      ab = VG_(malloc)( "mc.abf.1", sizeof(AdaptBlock) );
+      ab->key      = a;
+      ab->promoted = 0;
+      VG_(HT_add_node)( adapt_blocks, ab );
+   }
+   return &ab->promoted;
+}
+
+Bool MC_(adaptive_block_promoted) ( Addr a )
+{
+   AdaptBlock* ab = VG_(HT_lookup)( adapt_blocks, a );
+   return ab != NULL && ab->promoted;
+}
+
+/* Called instead of the value check failure handlers above, for a
+   check which might only have failed because of cheap
+   instrumentation.  |expFailed| says whether the check fails under
+   expensive instrumentation too. */
+void MC_(helperc_adaptive_fail) ( UWord flag, UWord szB, UWord origin,
+                                  UWord expFailed )
+{
+   n_adapt_failed++;
+   if (!expFailed) {
+      if (*(UChar*)flag == 0) {
+         *(UChar*)flag = 1;
+         n_adapt_promoted++;
+      }
+      return;
+   }
+   n_adapt_reported++;
+   if (szB == 0)
+      MC_(record_cond_error) ( VG_(get_running_tid)(), (UInt)origin );
+   else
+      MC_(record_value_error) ( VG_(get_running_tid)(), (Int)szB,
+                                (UInt)origin );
+}
+
+/* Called on entry to a cheap translation whose block has been
+   flagged, just before it exits with Ijk_InvalICache. */
+void MC_(helperc_adaptive_discard) ( void* gst, UWord base )
+{
+   ((VexGuestArchState*)gst)->guest_CMSTART = base;
+   ((VexGuestArchState*)gst)->guest_CMLEN   = 1;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Metadata get/set functions, for client requests.     ---*/
 /*------------------------------------------------------------*/
@@ -5895,6 +6346,57 @@ Bool MC_(is_valid_aligned_word) ( Addr a )
 }
 
 
+/* For the memory leak detector: find the first run of consecutive
+   aligned words in [a, end) that are all to be regarded as valid, as
+   per MC_(is_valid_aligned_word).  a and end must be word aligned, and
+   [a, end) must be a non empty range inside one secondary map.  Returns
+   the start of the run, or end if there is no valid word, and sets
+   *run_end to the end of the run.  As the secondary map is only looked
+   up once, and is not looked at at all if it is a distinguished one,
+   this is a lot cheaper than calling MC_(is_valid_aligned_word) for
+   each word. */
+Addr MC_(find_valid_aligned_words) ( Addr a, Addr end, Addr* run_end )
+{
+   SecMap* sm;
+   Addr    b;
+
+   tl_assert(VG_IS_WORD_ALIGNED(a) && VG_IS_WORD_ALIGNED(end));
+   tl_assert(a < end && start_of_this_sm(a) == start_of_this_sm(end - 1));
+
+   if (UNLIKELY(gIgnoredAddressRanges != NULL)) {
+      // Rare case: check word by word.
+      while (a < end && !MC_(is_valid_aligned_word)(a))
+         a += sizeof(UWord);
+      for (b = a; b < end && MC_(is_valid_aligned_word)(b); b += sizeof(UWord))
+         ;
+      *run_end = b;
+      return a;
+   }
+
+   sm = get_secmap_for_reading(a);
+   if (sm == &sm_distinguished[SM_DIST_DEFINED]) {
+      *run_end = end;
+      return a;
+   }
+   if (is_distinguished_sm(sm)) {
+      *run_end = end;
+      return end;
+   }
+
+#  define IS_DEFINED_WORD(aaa)                                          \
+      (sizeof(UWord) == 8                                               \
+       ? sm->vabits16[SM_OFF_16(aaa)] == VA_BITS16_DEFINED              \
+       : sm->vabits8[SM_OFF(aaa)] == VA_BITS8_DEFINED)
+   while (a < end && !IS_DEFINED_WORD(a))
+      a += sizeof(UWord);
+   for (b = a; b < end && IS_DEFINED_WORD(b); b += sizeof(UWord))
+      ;
+#  undef IS_DEFINED_WORD
+   *run_end = b;
+   return a;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Initialisation                                       ---*/
 /*------------------------------------------------------------*/
@@ -5921,9 +6423,14 @@ static void init_shadow_memory ( void )
 
    /* Set up the primary map. */
    /* These entries gradually get overwritten as the used address
-      space expands. */
+      space expands.  On 64-bit hosts, the zero-initialised map already
+      refers to the noaccess secondary everywhere. */
+#  if VG_WORDSIZE == 4
    for (i = 0; i < N_PRIMARY_MAP; i++)
       primary_map[i] = &sm_distinguished[SM_DIST_NOACCESS];
+#  else
+   tl_assert(PM_DECODE(0) == &sm_distinguished[SM_DIST_NOACCESS]);
+#  endif
 
    /* Auxiliary primary maps */
    init_auxmap_L1_L2();
@@ -5951,10 +6458,22 @@ static Bool mc_cheap_sanity_check ( void )
    return True;
 }
 
+/* Could sm be a secondary map handed out by copy_for_writing?  It
+   must be the start of a page of Valgrind's own anonymous memory. */
+static Bool is_issued_sm ( const SecMap* sm )
+{
+   const NSegment* seg;
+   if (!VG_IS_PAGE_ALIGNED(sm))
+      return False;
+   seg = VG_(am_find_nsegment)( (Addr)sm );
+   return seg != NULL && seg->kind == SkAnonV;
+}
+
 static Bool mc_expensive_sanity_check ( void )
 {
    Int     i;
    Word    n_secmaps_found;
+   UWord   n_pm_ents;
    SecMap* sm;
    const HChar*  errmsg;
    Bool    bad = False;
@@ -6012,13 +6531,22 @@ static Bool mc_expensive_sanity_check ( void )
 
    /* n_secmaps_found is now the number referred to by the auxiliary
       primary map.  Now add on the ones referred to by the main
-      primary map. */
-   for (i = 0; i < N_PRIMARY_MAP; i++) {
-      if (primary_map[i] == NULL) {
-         bad = True;
-      } else {
-         if (!is_distinguished_sm(primary_map[i]))
-            n_secmaps_found++;
+      primary map.  On 64-bit hosts, the entries above
+      pm_max_written_off are all zero, ie. noaccess. */
+#  if VG_WORDSIZE == 4
+   n_pm_ents = N_PRIMARY_MAP;
+#  else
+   n_pm_ents = pm_max_written_off + 1;
+#  endif
+   for (i = 0; i < n_pm_ents; i++) {
+      sm = PM_DECODE(primary_map[i]);
+      if (!is_distinguished_sm(sm)) {
+         /* Else it must be one from copy_for_writing.  On 64-bit
+            hosts, a NULL test tells nothing, since any entry decodes
+            to something. */
+         if (!is_issued_sm(sm))
+            bad = True;
+         n_secmaps_found++;
       }
    }
 
@@ -6054,6 +6582,7 @@ static Bool mc_expensive_sanity_check ( void )
 Bool          MC_(clo_partial_loads_ok)       = True;
 Long          MC_(clo_freelist_vol)           = 20LL*1000LL*1000LL;
 Long          MC_(clo_freelist_big_blocks)    =  1LL*1000LL*1000LL;
+Long          MC_(clo_freelist_small_blocks)  =  0;
 LeakCheckMode MC_(clo_leak_check)             = LC_Summary;
 VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 UInt          MC_(clo_show_leak_kinds)        = R2S(Possible) | R2S(Unreached);
@@ -6071,6 +6600,10 @@ KeepStacktraces MC_(clo_keep_stacktraces)     = KS_alloc_and_free;
 Int           MC_(clo_mc_level)               = 2;
 Bool          MC_(clo_show_mismatched_frees)  = True;
 Bool          MC_(clo_show_realloc_size_zero) = True;
+UInt          MC_(clo_origin_cache_size)      = 96;
+UInt          MC_(clo_origin_cache_max_size)  = 384;
+UInt          MC_(clo_origin_cache_ways)      = 2;
+Bool          MC_(clo_origin_cache_compress)  = True;
 
 ExpensiveDefinednessChecks
               MC_(clo_expensive_definedness_checks) = EdcAUTO;
@@ -6079,6 +6612,68 @@ Bool          MC_(clo_ignore_range_below_sp)               = False;
 UInt          MC_(clo_ignore_range_below_sp__first_offset) = 0;
 UInt          MC_(clo_ignore_range_below_sp__last_offset)  = 0;
 
+/* The patterns given by --instrument-objs= and --uninstrument-objs=,
+   or NULL if the option wasn't given. */
+static XArray* /* of HChar* */ instrument_objs   = NULL;
+static XArray* /* of HChar* */ uninstrument_objs = NULL;
+
+/* Split the comma separated list of patterns |str| and append them to
+   |*patts|, creating it if needed. */
+static void add_obj_patterns ( XArray** patts, const HChar* str )
+{
+   HChar* copy = VG_(strdup)("mc.aop.1", str);
+   HChar* ssaveptr;
+   HChar* patt;
+
+   if (*patts == NULL)
+      *patts = VG_(newXA)(VG_(malloc), "mc.aop.2", VG_(free),
+                          sizeof(HChar*));
+   for (patt = VG_(strtok_r)(copy, ",", &ssaveptr);
+        patt != NULL;
+        patt = VG_(strtok_r)(NULL, ",", &ssaveptr))
+      VG_(addToXA)(*patts, &patt);
+}
+
+static Bool obj_matches_patterns ( const XArray* patts,
+                                   const HChar* filename,
+                                   const HChar* soname )
+{
+   Word i;
+   for (i = 0; i < VG_(sizeXA)(patts); i++) {
+      const HChar* patt = *(const HChar**)VG_(indexXA)(patts, i);
+      if (VG_(string_match)(patt, filename)
+          || (soname != NULL && VG_(string_match)(patt, soname)))
+         return True;
+   }
+   return False;
+}
+
+Bool MC_(should_check_undefs_at) ( Addr a )
+{
+   DebugInfo*   di;
+   const HChar* filename;
+   const HChar* soname;
+
+   if (LIKELY(instrument_objs == NULL && uninstrument_objs == NULL))
+      return True;
+
+   /* Code which isn't part of any object, for instance code generated
+      at run time, is always fully instrumented. */
+   di = VG_(find_DebugInfo)(VG_(current_DiEpoch)(), a);
+   if (di == NULL)
+      return True;
+
+   filename = VG_(DebugInfo_get_filename)(di);
+   soname   = VG_(DebugInfo_get_soname)(di);
+   if (uninstrument_objs != NULL
+       && obj_matches_patterns(uninstrument_objs, filename, soname))
+      return False;
+   if (instrument_objs != NULL
+       && !obj_matches_patterns(instrument_objs, filename, soname))
+      return False;
+   return True;
+}
+
 static const HChar * MC_(parse_leak_heuristics_tokens) =
    "-,stdstring,length64,newarray,multipleinheritance";
 /* The first heuristic value (LchNone) has no keyword, as this is
@@ -6159,6 +6754,10 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                         MC_(clo_freelist_big_blocks),
                         0, 10*1000*1000*1000LL) {}
 
+   else if VG_BINT_CLOM(cloPD, arg, "--freelist-small-blocks",
+                        MC_(clo_freelist_small_blocks),
+                        0, 10*1000*1000*1000LL) {}
+
    else if VG_XACT_CLOM(cloPD, arg, "--leak-check=no",
                        MC_(clo_leak_check), LC_Off) {}
    else if VG_XACT_CLOM(cloPD, arg, "--leak-check=summary",
@@ -6272,6 +6871,29 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                             MC_(clo_expensive_definedness_checks), EdcAUTO) {}
    else if VG_XACT_CLO(arg, "--expensive-definedness-checks=yes",
                             MC_(clo_expensive_definedness_checks), EdcYES) {}
+   else if VG_XACT_CLO(arg, "--expensive-definedness-checks=adaptive",
+                            MC_(clo_expensive_definedness_checks),
+                            EdcADAPTIVE) {}
+
+   else if VG_BINT_CLO(arg, "--origin-cache-size",
+                       MC_(clo_origin_cache_size), 1, 65536) {}
+   else if VG_BINT_CLO(arg, "--origin-cache-max-size",
+                       MC_(clo_origin_cache_max_size), 1, 65536) {}
+   else if VG_BINT_CLO(arg, "--origin-cache-ways",
+                       MC_(clo_origin_cache_ways), 2, 8) {
+      UInt ways = MC_(clo_origin_cache_ways);
+      if ((ways & (ways - 1)) != 0) {
+         VG_(fmsg_bad_option)(arg,
+            "--origin-cache-ways must be 2, 4 or 8.\n");
+      }
+   }
+   else if VG_BOOL_CLO(arg, "--origin-cache-compress",
+                       MC_(clo_origin_cache_compress)) {}
+
+   else if VG_STR_CLO(arg, "--instrument-objs", tmp_str)
+      add_obj_patterns(&instrument_objs, tmp_str);
+   else if VG_STR_CLO(arg, "--uninstrument-objs", tmp_str)
+      add_obj_patterns(&uninstrument_objs, tmp_str);
 
    else if VG_BOOL_CLO(arg, "--xtree-leak",
                        MC_(clo_xtree_leak)) {}
@@ -6314,11 +6936,21 @@ static void mc_print_usage(void)
 "    --xtree-leak-file=<file>         xtree leak report file [xtleak.kcg.%%p]\n"
 "    --undef-value-errors=no|yes      check for undefined value errors [yes]\n"
 "    --track-origins=no|yes           show origins of undefined values? [no]\n"
+"    --origin-cache-size=<number>     initial size of the origin cache, in MB [96]\n"
+"    --origin-cache-max-size=<number> size up to which the origin cache\n"
+"                                     may grow, in MB [384]\n"
+"    --origin-cache-ways=2|4|8        associativity of the origin cache [2]\n"
+"    --origin-cache-compress=no|yes   compress origin cache overflow [yes]\n"
 "    --partial-loads-ok=no|yes        too hard to explain here; see manual [yes]\n"
-"    --expensive-definedness-checks=no|auto|yes\n"
+"    --expensive-definedness-checks=no|auto|yes|adaptive\n"
 "                                     Use extra-precise definedness tracking [auto]\n"
+"    --instrument-objs=patt1,patt2,...    only check for undefined value\n"
+"                                     errors in code in matching objects [all]\n"
+"    --uninstrument-objs=patt1,patt2,...  don't check for undefined value\n"
+"                                     errors in code in matching objects [none]\n"
 "    --freelist-vol=<number>          volume of freed blocks queue     [20000000]\n"
 "    --freelist-big-blocks=<number>   releases first blocks with size>= [1000000]\n"
+"    --freelist-small-blocks=<number> releases last blocks with size< [0]\n"
 "    --workaround-gcc296-bugs=no|yes  self explanatory [no].  Deprecated.\n"
 "                                     Use --ignore-range-below-sp instead.\n"
 "    --ignore-ranges=0xPP-0xQQ[,0xRR-0xSS]   assume given addresses are OK\n"
@@ -7217,6 +7849,15 @@ static Bool mc_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          return True;
       }
 
+      case _VG_USERREQ__MEMCHECK_STRMEM_WORD_READS_OK:
+         /* Word-sized reads past a string's NUL are harmless only if
+            partial loads are allowed and the zero-byte test in
+            vg_replace_strmem.c is instrumented precisely.  That needs
+            the expensive interpretation of CmpEQ/CmpNE on words. */
+         *ret = MC_(clo_partial_loads_ok)
+                && MC_(word_compares_are_exact)();
+         return True;
+
    case _VG_USERREQ__MEMCHECK_VERIFY_ALIGNMENT: {
       struct AlignedAllocInfo *aligned_alloc_info  = (struct AlignedAllocInfo *)arg[1];
       tl_assert(aligned_alloc_info);
@@ -7824,7 +8465,9 @@ void VG_REGPARM(2) MC_(helperc_b_store1)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
 #if OC_PRECISION_STORE
    if (LIKELY(d32 == 0)) {
@@ -7871,7 +8514,9 @@ void VG_REGPARM(2) MC_(helperc_b_store2)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
 #if OC_PRECISION_STORE
    // Same logic as in the store1 case above.
@@ -7910,7 +8555,9 @@ void VG_REGPARM(2) MC_(helperc_b_store4)( Addr a, UWord d32 ) {
       tl_assert(lineoff >= 0 && lineoff < OC_W32S_PER_LINE);
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
    if (d32 == 0) {
       line->u.main.descr[lineoff] = 0;
@@ -7937,7 +8584,9 @@ void VG_REGPARM(2) MC_(helperc_b_store8)( Addr a, UWord d32 ) {
       tl_assert(lineoff == (lineoff & 6)); /*0,2,4,6*//*since 8-aligned*/
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
    if (d32 == 0) {
       line->u.main.descr[lineoff + 0] = 0;
@@ -7967,7 +8616,9 @@ void VG_REGPARM(2) MC_(helperc_b_store16)( Addr a, UWord d32 ) {
       tl_assert(lineoff == (lineoff & 4)); /*0,4*//*since 16-aligned*/
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
    if (d32 == 0) {
       line->u.main.descr[lineoff + 0] = 0;
@@ -8003,7 +8654,9 @@ void VG_REGPARM(2) MC_(helperc_b_store32)( Addr a, UWord d32 ) {
       tl_assert(lineoff == 0);
    }
 
-   line = find_OCacheLine( a );
+   line = find_OCacheLine_for_store( a, d32 );
+   if (!line)
+      return;
 
    if (d32 == 0) {
       line->u.main.descr[0] = 0;
@@ -8191,6 +8844,15 @@ static void mc_post_clo_init ( void )
                    MC_(clo_freelist_vol));
    }
 
+   if (MC_(clo_freelist_small_blocks) > MC_(clo_freelist_big_blocks)
+       && VG_(clo_verbosity) == 1 && !VG_(clo_xml)) {
+      VG_(message)(Vg_UserMsg,
+                   "Warning: --freelist-small-blocks value %lld is > the\n"
+                   "--freelist-big-blocks value %lld, which takes precedence\n",
+                   MC_(clo_freelist_small_blocks),
+                   MC_(clo_freelist_big_blocks));
+   }
+
    if (MC_(clo_workaround_gcc296_bugs)
        && VG_(clo_verbosity) == 1 && !VG_(clo_xml)) {
       VG_(umsg)(
@@ -8202,6 +8864,10 @@ static void mc_post_clo_init ( void )
 
    tl_assert( MC_(clo_mc_level) >= 1 && MC_(clo_mc_level) <= 3 );
 
+   if (MC_(clo_expensive_definedness_checks) == EdcADAPTIVE) {
+      adapt_blocks = VG_(HT_construct)( "mc.adapt_blocks" );
+   }
+
    if (MC_(clo_mc_level) == 3) {
       /* We're doing origin tracking. */
 #     ifdef PERF_FAST_STACK
@@ -8300,14 +8966,12 @@ static void mc_post_clo_init ( void )
    if (MC_(clo_mc_level) >= 3) {
       init_OCache();
       tl_assert(ocacheL1 != NULL);
-      for (UInt i = 0; i < 4096; i++ ) {
-         tl_assert(ocachesL2[i] != NULL);
-      }
+      tl_assert(ocacheL2_full.slots != NULL);
+      tl_assert(ocacheL2_uniform.slots != NULL);
    } else {
       tl_assert(ocacheL1 == NULL);
-      for (UInt i = 0; i < 4096; i++ ) {
-         tl_assert(ocachesL2[i] == NULL);
-      }
+      tl_assert(ocacheL2_full.slots == NULL);
+      tl_assert(ocacheL2_uniform.slots == NULL);
    }
 
    MC_(chunk_poolalloc) = VG_(newPA)
@@ -8385,7 +9049,13 @@ static void mc_print_stats (void)
    // Hardwiring this logic sucks, but I don't see how else to do it.
    max_secVBit_szB = max_secVBit_nodes *
          (3*sizeof(Word) + VG_ROUNDUP(sizeof(SecVBitNode), sizeof(void*)));
-   max_shmem_szB   = sizeof(primary_map) + max_SMs_szB + max_secVBit_szB;
+#  if VG_WORDSIZE == 4
+   max_shmem_szB   = sizeof(primary_map);
+#  else
+   // Only count the part of the primary map which was ever used.
+   max_shmem_szB   = (pm_max_written_off + 1) * sizeof(UWord);
+#  endif
+   max_shmem_szB  += max_SMs_szB + max_secVBit_szB;
 
    VG_(message)(Vg_DebugMsg,
       " memcheck: max sec V bit nodes:    %d (%luk, %luM)\n",
@@ -8399,6 +9069,14 @@ static void mc_print_stats (void)
       " memcheck: max shadow mem size:   %luk, %luM\n",
       max_shmem_szB / 1024, max_shmem_szB / (1024 * 1024));
 
+   MC_(print_instrumentation_stats)();
+   if (MC_(clo_expensive_definedness_checks) == EdcADAPTIVE) {
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: adaptive: %llu cheap checks failed, %llu reported, "
+         "%llu blocks promoted\n",
+         n_adapt_failed, n_adapt_reported, n_adapt_promoted);
+   }
+
    if (MC_(clo_mc_level) >= 3) {
       VG_(message)(Vg_DebugMsg,
                    " ocacheL1: %'14lu refs   %'14lu misses (%'lu lossage)\n",
@@ -8408,6 +9086,7 @@ static void mc_print_stats (void)
       VG_(message)(Vg_DebugMsg,
                    " ocacheL1: %'14lu at 0   %'14lu at 1\n",
                    stats_ocacheL1_find - stats_ocacheL1_misses
+                      - stats_ocache_zero_stores_elided
                       - stats_ocacheL1_found_at_1
                       - stats_ocacheL1_found_at_N,
                    stats_ocacheL1_found_at_1 );
@@ -8416,29 +9095,40 @@ static void mc_print_stats (void)
                    stats_ocacheL1_found_at_N,
                    stats_ocacheL1_movefwds );
       VG_(message)(Vg_DebugMsg,
-                   " ocacheL1: %'14lu sizeB  %'14d useful\n",
-                   (SizeT)sizeof(OCache),
-                   4 * OC_W32S_PER_LINE * OC_LINES_PER_SET * OC_N_SETS );
+                   " ocacheL1: %'14lu sizeB  %'14lu useful\n",
+                   ocacheL1_size(),
+                   (4 * OC_W32S_PER_LINE * ocacheL1_n_ways())
+                      << ocacheL1_set_bits );
+      VG_(message)(Vg_DebugMsg,
+                   " ocacheL1: %'14lu sets   %'14lu ways (%'lu grows)\n",
+                   1UL << ocacheL1_set_bits, ocacheL1_n_ways(),
+                   stats_ocacheL1_grows );
+      VG_(message)(Vg_DebugMsg,
+                   " ocacheL1: %'14lu zero stores elided\n",
+                   stats_ocache_zero_stores_elided );
       VG_(message)(Vg_DebugMsg,
                    " ocacheL2: %'14lu finds  %'14lu misses\n",
                    stats__ocacheL2_finds,
                    stats__ocacheL2_misses );
       VG_(message)(Vg_DebugMsg,
-                   " ocacheL2: %'14lu adds   %'14lu dels\n",
+                   " ocacheL2: %'14lu puts   %'14lu adds   %'lu dels\n",
+                   stats__ocacheL2_puts,
                    stats__ocacheL2_adds,
                    stats__ocacheL2_dels );
       VG_(message)(Vg_DebugMsg,
                    " ocacheL2:    %'9lu max nodes %'9lu curr nodes\n",
                    stats__ocacheL2_n_nodes_max,
                    stats__ocacheL2_n_nodes );
+      VG_(message)(Vg_DebugMsg,
+                   " ocacheL2: %'14lu full   %'14lu compressed (%'lu sizeB)\n",
+                   ocacheL2_full.used, ocacheL2_uniform.used,
+                   ocacheL2_size() );
       VG_(message)(Vg_DebugMsg,
                    " niacache: %'12lu refs   %'12lu misses\n",
                    stats__nia_cache_queries, stats__nia_cache_misses);
    } else {
       tl_assert(ocacheL1 == NULL);
-      for (UInt i = 0; i < 4096; i++ ) {
-         tl_assert(ocachesL2[1] == NULL);
-      }
+      tl_assert(ocacheL2_full.slots == NULL);
    }
 }
 
@@ -8680,9 +9370,7 @@ static void mc_pre_clo_init(void)
       if we need to, since the command line args haven't been
       processed yet.  Hence defer it to mc_post_clo_init. */
    tl_assert(ocacheL1 == NULL);
-   for (UInt i = 0; i < 4096; i++ ) {
-      tl_assert(ocachesL2[i] == NULL);
-   }
+   tl_assert(ocacheL2_full.slots == NULL);
 
    /* Check some important stuff.  See extensive comments above
       re UNALIGNED_OR_HIGH for background. */
@@ -8702,11 +9390,11 @@ static void mc_pre_clo_init(void)
    tl_assert(sizeof(Addr)  == 8);
    tl_assert(sizeof(UWord) == 8);
    tl_assert(sizeof(Word)  == 8);
-   tl_assert(MAX_PRIMARY_ADDRESS == 0x1FFFFFFFFFULL);
-   tl_assert(MASK(1) == 0xFFFFFFE000000000ULL);
-   tl_assert(MASK(2) == 0xFFFFFFE000000001ULL);
-   tl_assert(MASK(4) == 0xFFFFFFE000000003ULL);
-   tl_assert(MASK(8) == 0xFFFFFFE000000007ULL);
+   tl_assert(MAX_PRIMARY_ADDRESS == 0xFFFFFFFFFFULL);
+   tl_assert(MASK(1) == 0xFFFFFF0000000000ULL);
+   tl_assert(MASK(2) == 0xFFFFFF0000000001ULL);
+   tl_assert(MASK(4) == 0xFFFFFF0000000003ULL);
+   tl_assert(MASK(8) == 0xFFFFFF0000000007ULL);
 #  endif
 
    /* Check some assertions to do with the instrumentation machinery. */
@@ -83,26 +83,108 @@ MC_Chunk* create_MC_Chunk ( ThreadId tid, Addr p, SizeT szB,
 static inline
 void delete_MC_Chunk (MC_Chunk* mc);
 
+/* A cache of small client blocks released from the freed queue.
+   Handing them back with VG_(cli_free) and getting new ones with
+   VG_(cli_malloc) means splitting and coalescing arena blocks on
+   every malloc/free pair.  Instead, released blocks of less than
+   BCACHE_N_CLASSES * BCACHE_GRAN_SZB bytes are kept on per-size-class
+   LIFO lists, which new_block tries first.  A block goes in the class
+   for the largest multiple of BCACHE_GRAN_SZB its arena payload can
+   hold, and a request is served from the class for the smallest
+   multiple holding it, so a cached block is always big enough.  Only
+   blocks aligned to VG_(clo_alignment) are cached, and only requests
+   needing no more than that are served from the cache.
+
+   Cached blocks are noaccess, as they would be in the arena; the link
+   to the next block of the class lives in the first word of the
+   payload.  Blocks only get here once they leave the freed queue, so
+   the protection it gives against dangling pointers is unchanged.
+   Valgrind runs one thread at a time, so one set of lists serves all
+   threads. */
+#define BCACHE_GRAN_SZB   16
+#define BCACHE_N_CLASSES  32
+#define BCACHE_MAX_SZB    (4 * 1024 * 1024)
+
+static Addr  bcache_list[BCACHE_N_CLASSES];
+static SizeT bcache_szB = 0;   /* total payload size of the cached blocks */
+
+/* Get a client block of at least szB bytes, aligned to alignB. */
+static void* alloc_client_block ( SizeT alignB, SizeT szB )
+{
+   UWord c = (szB + BCACHE_GRAN_SZB - 1) / BCACHE_GRAN_SZB;
+   if (LIKELY(c < BCACHE_N_CLASSES && bcache_list[c] != 0
+              && alignB <= VG_(clo_alignment))) {
+      Addr p = bcache_list[c];
+      bcache_list[c] = *(Addr*)p;
+      bcache_szB -= VG_(cli_malloc_usable_size)( (void*)p );
+      return (void*)p;
+   }
+   return VG_(cli_malloc)( alignB, szB );
+}
+
+/* Release a client block obtained from alloc_client_block. */
+static void free_client_block ( Addr p )
+{
+   SizeT szB = VG_(cli_malloc_usable_size)( (void*)p );
+   UWord c   = szB / BCACHE_GRAN_SZB;
+   if (c < BCACHE_N_CLASSES
+       && szB >= sizeof(Addr)
+       && (p & (VG_(clo_alignment) - 1)) == 0
+       && bcache_szB + szB <= BCACHE_MAX_SZB) {
+      *(Addr*)p = bcache_list[c];
+      bcache_list[c] = p;
+      bcache_szB += szB;
+      return;
+   }
+   VG_(cli_free)( (void*)p );
+}
+
+/* Is p the start of a block in the cache?  For error descriptions,
+   which should call such a block free, as they would if it had gone
+   back to the arena. */
+Bool MC_(is_cached_client_block) ( Addr p )
+{
+   SizeT szB = VG_(cli_malloc_usable_size)( (void*)p );
+   UWord c   = szB / BCACHE_GRAN_SZB;
+   Addr  q;
+   if (c >= BCACHE_N_CLASSES)
+      return False;
+   for (q = bcache_list[c]; q != 0; q = *(Addr*)q)
+      if (q == p)
+         return True;
+   return False;
+}
+
 /* Records blocks after freeing. */
-/* Blocks freed by the client are queued in one of two lists of
+/* Blocks freed by the client are queued in one of three lists of
    freed blocks not yet physically freed:
    "big blocks" freed list.
-   "small blocks" freed list
+   "medium blocks" freed list.
+   "small blocks" freed list.
    The blocks with a size >= MC_(clo_freelist_big_blocks)
-   are linked in the big blocks freed list.
+   are linked in the big blocks freed list, and the blocks with a
+   size < MC_(clo_freelist_small_blocks) in the small blocks one.
+   Blocks are released from the big blocks list first and from the
+   small blocks list last.
    This allows a client to allocate and free big blocks
    (e.g. bigger than VG_(clo_freelist_vol)) without losing
-   immediately all protection against dangling pointers.
-   position [0] is for big blocks, [1] is for small blocks. */
-static MC_Chunk* freed_list_start[2]  = {NULL, NULL};
-static MC_Chunk* freed_list_end[2]    = {NULL, NULL};
+   immediately all protection against dangling pointers.  Keeping
+   small blocks the longest catches more dangling pointers per byte
+   of queue volume, as many small blocks fit in the space of one
+   bigger block.
+   position [0] is for big blocks, [1] is for medium blocks,
+   [2] is for small blocks. */
+#define N_FREED_LISTS 3
+static MC_Chunk* freed_list_start[N_FREED_LISTS]  = {NULL, NULL, NULL};
+static MC_Chunk* freed_list_end[N_FREED_LISTS]    = {NULL, NULL, NULL};
 
 /* Put a shadow chunk on the freed blocks queue, possibly freeing up
    some of the oldest blocks in the queue at the same time. */
 static void add_to_freed_queue ( MC_Chunk* mc )
 {
    const Bool show = False;
-   const int l = (mc->szB >= MC_(clo_freelist_big_blocks) ? 0 : 1);
+   const int l = (mc->szB >= MC_(clo_freelist_big_blocks) ? 0
+                  : mc->szB >= MC_(clo_freelist_small_blocks) ? 1 : 2);
 
    /* Put it at the end of the freed list, unless the block
       would be directly released any way : in this case, we
@@ -131,7 +213,7 @@ static void add_to_freed_queue ( MC_Chunk* mc )
 
 /* Release enough of the oldest blocks to bring the free queue
    volume below vg_clo_freelist_vol. 
-   Start with big block list first.
+   Start with big block list first, and end with the small block list.
    On entry, VG_(free_queue_volume) must be > MC_(clo_freelist_vol).
    On exit, VG_(free_queue_volume) will be <= MC_(clo_freelist_vol). */
 static void release_oldest_block(void)
@@ -139,9 +221,10 @@ static void release_oldest_block(void)
    const Bool show = False;
    int i;
    tl_assert (VG_(free_queue_volume) > MC_(clo_freelist_vol));
-   tl_assert (freed_list_start[0] != NULL || freed_list_start[1] != NULL);
+   tl_assert (freed_list_start[0] != NULL || freed_list_start[1] != NULL
+              || freed_list_start[2] != NULL);
 
-   for (i = 0; i < 2; i++) {
+   for (i = 0; i < N_FREED_LISTS; i++) {
       while (VG_(free_queue_volume) > MC_(clo_freelist_vol)
              && freed_list_start[i] != NULL) {
          MC_Chunk* mc1;
@@ -165,7 +248,7 @@ static void release_oldest_block(void)
 
          /* free MC_Chunk */
          if (MC_AllocCustom != mc1->allockind)
-            VG_(cli_free) ( (void*)(mc1->data) );
+            free_client_block ( mc1->data );
          delete_MC_Chunk ( mc1 );
       }
    }
@@ -174,7 +257,7 @@ static void release_oldest_block(void)
 MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
 {
    int i;
-   for (i = 0; i < 2; i++) {
+   for (i = 0; i < N_FREED_LISTS; i++) {
       MC_Chunk*  mc;
       mc = freed_list_start[i];
       while (mc) {
@@ -371,7 +454,7 @@ void* MC_(new_block) ( ThreadId tid,
       tl_assert(MC_AllocCustom == kind);
    } else {
       tl_assert(MC_AllocCustom != kind);
-      p = (Addr)VG_(cli_malloc)( alignB, szB );
+      p = (Addr)alloc_client_block( alignB, szB );
       if (!p) {
          return NULL;
       }
@@ -389,6 +472,8 @@ void* MC_(new_block) ( ThreadId tid,
    cmalloc_bs_mallocd += (ULong)szB;
    mc = create_MC_Chunk (tid, p, szB, orig_alignB, kind);
    VG_(HT_add_node)( table, mc );
+   if (table == MC_(malloc_list))
+      MC_(lc_note_new_malloc_block)( p );
 
    if (is_zeroed)
       MC_(make_mem_defined)( p, szB );
@@ -619,7 +704,7 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
    old_szB = old_mc->szB;
 
    /* Get new memory */
-   a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment), new_szB);
+   a_new = (Addr)alloc_client_block(VG_(clo_alignment), new_szB);
 
    if (a_new) {
       /* In all cases, even when the new size is smaller or unchanged, we
@@ -636,6 +721,7 @@ void* MC_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
 
       // Now insert the new mc (with a new 'data' field) into malloc_list.
       VG_(HT_add_node)( MC_(malloc_list), new_mc );
+      MC_(lc_note_new_malloc_block)( a_new );
 
       /* Retained part is copied, red zones set as normal */
 
@@ -43,4 +43,18 @@
                   _VG_USERREQ__MEMCHECK_RECORD_OVERLAP_ERROR,   \
                   s, src, dst, len, 0)
 
+/* With --partial-loads-ok=yes, aligned word loads that run off the
+   end of a block are not errors, so strlen and strcmp may fetch a
+   word at a time, provided word comparisons are instrumented exactly
+   (see MC_(word_compares_are_exact)).  Ask once and remember; the
+   options can't change. */
+static int mc_strmem_word_reads_ok = -1;
+
+#define STRMEM_WORD_READS_OK()                                  \
+  (mc_strmem_word_reads_ok >= 0                                 \
+   ? mc_strmem_word_reads_ok                                    \
+   : (mc_strmem_word_reads_ok = (int)VALGRIND_DO_CLIENT_REQUEST_EXPR( \
+         0, _VG_USERREQ__MEMCHECK_STRMEM_WORD_READS_OK,         \
+         0, 0, 0, 0, 0)))
+
 #include "../shared/vg_replace_strmem.c"
@@ -37,6 +37,7 @@
 #include "pub_tool_xarray.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_libcbase.h"
+#include "pub_tool_guest.h"         // VexGuestArchState
 
 #include "mc_include.h"
 
@@ -145,6 +146,7 @@ static IRType  shadowTypeV ( IRType ty );
 static IRExpr* expr2vbits ( struct _MCEnv* mce, IRExpr* e,
                             HowUsed hu/*use HuOth if unknown*/ );
 static IRTemp  findShadowTmpB ( struct _MCEnv* mce, IRTemp orig );
+static IRTemp  findExpShadowTmpV ( struct _MCEnv* mce, IRTemp orig );
 
 static IRExpr *i128_const_zero(void);
 
@@ -220,6 +222,48 @@ static void DetailLevelByOp__check_sanity ( const DetailLevelByOp* dlbo )
              || dlbo->dl_CmpEQ8_CmpNE8 == DLexpensive);
 }
 
+/* The per-target starting point for --expensive-definedness-checks=auto,
+   before analysis of the block to be instrumented.
+
+   On x86 and amd64, we'll routinely encounter code optimised by LLVM 5
+   and above.  Enable accurate interpretation of the following.  LLVM
+   uses adds for some bitfield inserts, and we get a lot of false errors
+   if the cheap interpretation is used, alas.  Could solve this much
+   better if we knew which of such adds came from x86/amd64 LEA
+   instructions, since these are the only ones really needing the
+   expensive interpretation, but that would require some way to tag them
+   in the _toIR.c front ends, which is a lot of faffing around.  So for
+   now we use preInstrumentationAnalysis() to detect adds which are used
+   only to construct memory addresses, which is an approximation to the
+   above, and is self-contained. */
+static void DetailLevelByOp__set_auto ( /*OUT*/DetailLevelByOp* dlbo )
+{
+   DetailLevelByOp__set_all( dlbo, DLcheap );
+#  if defined(VGA_x86)
+   dlbo->dl_Add32           = DLauto;
+   dlbo->dl_CmpEQ16_CmpNE16 = DLexpensive;
+   dlbo->dl_CmpEQ32_CmpNE32 = DLexpensive;
+#  elif defined(VGA_amd64)
+   dlbo->dl_Add32           = DLexpensive;
+   dlbo->dl_Add64           = DLauto;
+   dlbo->dl_CmpEQ16_CmpNE16 = DLexpensive;
+   dlbo->dl_CmpEQ32_CmpNE32 = DLexpensive;
+   dlbo->dl_CmpEQ64_CmpNE64 = DLexpensive;
+#  elif defined(VGA_ppc64le)
+   // Needed by (at least) set_AV_CR6() in the front end.
+   dlbo->dl_CmpEQ64_CmpNE64 = DLexpensive;
+#  elif defined(VGA_arm64)
+   dlbo->dl_CmpEQ32_CmpNE32 = DLexpensive;
+   dlbo->dl_CmpEQ64_CmpNE64 = DLexpensive;
+#  elif defined(VGA_arm)
+   dlbo->dl_CmpEQ32_CmpNE32 = DLexpensive;
+#  elif defined(VGA_riscv64)
+   // Needed by the word-at-a-time str* replacements; see
+   // MC_(word_compares_are_exact).
+   dlbo->dl_CmpEQ64_CmpNE64 = DLexpensive;
+#  endif
+}
+
 static UInt DetailLevelByOp__count ( const DetailLevelByOp* dlbo,
                                      DetailLevel dl )
 {
@@ -249,6 +293,18 @@ static UInt DetailLevelByOp__count ( const DetailLevelByOp* dlbo,
    When .kind is VSh or BSh then the tmp is holds a V- or B- value,
    and so .shadowV and .shadowB must be IRTemp_INVALID, since it is
    illogical for a shadow tmp itself to be shadowed.
+
+   When .kind is Orig, .defdV is True if .shadowV is known to hold an
+   all-defined value: either the tmp has been checked for definedness
+   (see complainIfUndefined), or it was computed from such values.
+   Checking it again is then pointless.
+
+   When .kind is Orig, .skipChk is True if checking the tmp is
+   pointless although its shadow is left as it is: the tmp must be
+   defined if one checked earlier was (see DefdParents).  Either that
+   check passed, or it failed and the error has been reported already.
+   Where a check would have been made, the shadow is made defined
+   without one.
 */
 typedef
    enum { Orig=1, VSh=2, BSh=3 }
@@ -257,12 +313,28 @@ typedef
 typedef
    struct {
       TempKind kind;
+      Bool     defdV;
+      Bool     skipChk;
       IRTemp   shadowV;
       IRTemp   shadowB;
    }
    TempMapEnt;
 
 
+/* For an original tmp |t|, the (up to two) original tmps whose V bits
+   are certainly all defined if those of |t| are.  For instance, in
+   cheap and expensive interpretation alike, the V bits of
+   Add64(t1,0x10:I64) are all defined only if those of t1 are.  So
+   once t2 = Add64(t1,0x10:I64) has been checked for definedness, t1
+   can be regarded as defined too, and also any t3 = Add64(t1,0x18:I64)
+   computed after that.  See |findDefdParents|. */
+typedef
+   struct {
+      IRTemp parent[2];
+   }
+   DefdParents;
+
+
 /* A |HowUsed| value carries analysis results about how values are used,
    pertaining to whether we need to instrument integer adds expensively or
    not.  The running state carries a (readonly) mapping from original tmp to
@@ -289,6 +361,11 @@ typedef
 STATIC_ASSERT(sizeof(HowUsed) == 1);
 
 
+/* How the V bits of a tmp depend on cheaply instrumented operations,
+   under --expensive-definedness-checks=adaptive; see findCheapDeps. */
+typedef enum { CdEXACT=0, CdDIRECT, CdIMPRECISE } CheapDep;
+
+
 /* Carries around state during memcheck instrumentation. */
 typedef
    struct _MCEnv {
@@ -314,7 +391,8 @@ typedef
       XArray* /* of TempMapEnt */ tmpMap;
 
       /* READONLY: contains details of which ops should be expensively
-         instrumented. */
+         instrumented.  Temporarily set to expensive for everything by
+         findExpShadowTmpV. */
       DetailLevelByOp dlbo;
 
       /* READONLY: for each original tmp, how the tmp is used.  This is
@@ -322,6 +400,11 @@ typedef
          0 .. #temps_in_sb-1 (same as for tmpMap). */
       HowUsed* tmpHowUsed;
 
+      /* READONLY: for each original tmp, the tmps which are known to
+         be defined if it is.  Computed by |findDefdParents|.  Valid
+         indices are 0 .. #temps_in_sb-1 (same as for tmpMap). */
+      DefdParents* tmpDefdParents;
+
       /* READONLY: the guest layout.  This indicates which parts of
          the guest state should be regarded as 'always defined'. */
       const VexGuestLayout* layout;
@@ -330,6 +413,41 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+      /* READONLY: if False, this block is only checked for
+         addressability errors, as selected by --instrument-objs and
+         --uninstrument-objs.  No undefined value errors are reported,
+         and all V bits written to registers and memory are defined,
+         so that checked code doesn't complain about values it gets
+         from here.  Always True if MC_(clo_mc_level) == 1. */
+      Bool checkUndefs;
+
+      /* READONLY: non-NULL if this block is cheaply instrumented under
+         --expensive-definedness-checks=adaptive.  For each original
+         tmp, says whether a failed check of it might be due to the
+         cheap instrumentation; see findCheapDeps. */
+      UChar* tmpCheapDep;
+
+      /* READONLY: non-NULL along with tmpCheapDep.  For each original
+         tmp, the expression assigned to it by an IRStmt_WrTmp, or NULL
+         if it is assigned some other way. */
+      IRExpr** tmpDefExpr;
+
+      /* MODIFIED: non-NULL along with tmpCheapDep.  For each original
+         tmp, the tmp holding its V bits as the expensive
+         interpretation computes them, if that has been needed; see
+         findExpShadowTmpV. */
+      IRTemp* tmpExpShadow;
+
+      /* MODIFIED: True while findExpShadowTmpV is computing V bits. */
+      Bool inExpShadow;
+
+      /* READONLY: the guest address of the block. */
+      Addr blockAddr;
+
+      /* MODIFIED: the block's promotion flag, once a check which
+         might promote it has been generated. */
+      UChar* adaptFlag;
    }
    MCEnv;
 
@@ -368,6 +486,8 @@ static IRTemp newTemp ( MCEnv* mce, IRType ty, TempKind kind )
    TempMapEnt ent;
    IRTemp     tmp = newIRTemp(mce->sb->tyenv, ty);
    ent.kind    = kind;
+   ent.defdV   = False;
+   ent.skipChk = False;
    ent.shadowV = IRTemp_INVALID;
    ent.shadowB = IRTemp_INVALID;
    newIx = VG_(addToXA)( mce->tmpMap, &ent );
@@ -423,9 +543,37 @@ static void newShadowTmpV ( MCEnv* mce, IRTemp orig )
       ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
       tl_assert(ent->kind == Orig);
       ent->shadowV = tmpV;
+      ent->defdV   = False;
+      ent->skipChk = False;
    }
 }
 
+/* Record that the current shadow of the given original tmp is known
+   to be all-defined. */
+static void setDefdV ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt* ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   ent->defdV = True;
+}
+
+/* Record that checks of the given original tmp are pointless; see
+   TempMapEnt. */
+static void setSkipChk ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt* ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   ent->skipChk = True;
+}
+
+/* Is there no point in checking the given original tmp? */
+static Bool isSkipChk ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt* ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   return ent->defdV || ent->skipChk;
+}
+
 
 /*------------------------------------------------------------*/
 /*--- IRAtoms -- a subset of IRExprs                       ---*/
@@ -466,6 +614,61 @@ static Bool isShadowAtom ( MCEnv* mce, IRAtom* a1 )
    return False;
 }
 
+/* Is this original atom known to be all-defined?  Constants always
+   are; tmps are if so recorded in their tmpMap entry. */
+static Bool isKnownDefdAtom ( MCEnv* mce, IRAtom* a1 )
+{
+   if (a1->tag == Iex_Const)
+      return True;
+   if (a1->tag == Iex_RdTmp) {
+      TempMapEnt* ent = VG_(indexXA)( mce->tmpMap, a1->Iex.RdTmp.tmp );
+      tl_assert(ent->kind == Orig);
+      return ent->defdV;
+   }
+   return False;
+}
+
+/* Is the value of the (flat) original expression |e| known to be
+   all-defined?  This is so if |e| computes a pure function of atoms
+   which are all known to be defined, since no V-bit interpretation
+   produces undefinedness from defined operands.  Loads and guest
+   state reads of course need to be instrumented as usual. */
+static Bool isKnownDefdExpr ( MCEnv* mce, IRExpr* e )
+{
+   Int i;
+   switch (e->tag) {
+      case Iex_Const:
+      case Iex_RdTmp:
+         return isKnownDefdAtom(mce, e);
+      case Iex_Unop:
+         return isKnownDefdAtom(mce, e->Iex.Unop.arg);
+      case Iex_Binop:
+         return isKnownDefdAtom(mce, e->Iex.Binop.arg1)
+                && isKnownDefdAtom(mce, e->Iex.Binop.arg2);
+      case Iex_Triop:
+         return isKnownDefdAtom(mce, e->Iex.Triop.details->arg1)
+                && isKnownDefdAtom(mce, e->Iex.Triop.details->arg2)
+                && isKnownDefdAtom(mce, e->Iex.Triop.details->arg3);
+      case Iex_Qop:
+         return isKnownDefdAtom(mce, e->Iex.Qop.details->arg1)
+                && isKnownDefdAtom(mce, e->Iex.Qop.details->arg2)
+                && isKnownDefdAtom(mce, e->Iex.Qop.details->arg3)
+                && isKnownDefdAtom(mce, e->Iex.Qop.details->arg4);
+      case Iex_ITE:
+         return isKnownDefdAtom(mce, e->Iex.ITE.cond)
+                && isKnownDefdAtom(mce, e->Iex.ITE.iftrue)
+                && isKnownDefdAtom(mce, e->Iex.ITE.iffalse);
+      case Iex_CCall:
+         for (i = 0; e->Iex.CCall.args[i]; i++) {
+            if (!isKnownDefdAtom(mce, e->Iex.CCall.args[i]))
+               return False;
+         }
+         return True;
+      default:
+         return False;
+   }
+}
+
 /* (used for sanity checks only): check that both args are atoms and
    are identically-kinded. */
 static Bool sameKindedAtoms ( IRAtom* a1, IRAtom* a2 )
@@ -1575,6 +1778,103 @@ static void setHelperAnns ( MCEnv* mce, IRDirty* di ) {
 }
 
 
+/* Statistics about definedness checks: how many were generated, how
+   many were avoided because the value was already known to be
+   defined, and how many tmps were found to be defined as a side effect
+   of checking another one (see DefdParents).  Checks on the latter are
+   avoided here. */
+static ULong n_defd_checks_made    = 0;
+static ULong n_defd_checks_avoided = 0;
+static ULong n_defd_tmps_implied   = 0;
+
+/* The original tmp |tmp| has just been checked.  There is then no
+   point in checking the tmps which must be defined if it is,
+   recursively.  Their shadows are left alone until they would be
+   checked themselves: if the check failed, they really are undefined,
+   and their other uses (stores, Puts and so on) must still say so. */
+static void setDefdParents ( MCEnv* mce, IRTemp tmp )
+{
+   Int i;
+   if (mce->tmpDefdParents == NULL)
+      return;
+   for (i = 0; i < 2; i++) {
+      IRTemp p = mce->tmpDefdParents[tmp].parent[i];
+      if (p == IRTemp_INVALID || isSkipChk(mce, p))
+         continue;
+      setSkipChk(mce, p);
+      n_defd_tmps_implied++;
+      setDefdParents(mce, p);
+   }
+}
+
+/* For --expensive-definedness-checks=adaptive.  Find the tmp holding
+   the V bits of the original tmp |orig| as the expensive
+   interpretation of everything in the block would compute them,
+   generating code to compute them if that hasn't been done yet.  Tmps
+   whose V bits are the same either way, are known to be defined, or
+   are not assigned by a WrTmp, just give their usual shadow.  Shadows
+   are read as they are now, not as they were when |orig| was assigned;
+   that makes no difference except for operands which have since been
+   checked, and so made defined. */
+static IRTemp findExpShadowTmpV ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt*     ent;
+   DetailLevelByOp dlbo;
+   Bool            inExpShadow;
+   IRExpr*         vbits;
+   IRTemp          tmpV;
+
+   tl_assert(mce->tmpCheapDep);
+   ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   if (mce->tmpCheapDep[orig] == CdEXACT || ent->defdV
+       || mce->tmpDefExpr[orig] == NULL)
+      return findShadowTmpV(mce, orig);
+
+   if (mce->tmpExpShadow[orig] == IRTemp_INVALID) {
+      dlbo        = mce->dlbo;
+      inExpShadow = mce->inExpShadow;
+      DetailLevelByOp__set_all( &mce->dlbo, DLexpensive );
+      mce->inExpShadow = True;
+      vbits = expr2vbits( mce, mce->tmpDefExpr[orig], HuOth );
+      mce->dlbo        = dlbo;
+      mce->inExpShadow = inExpShadow;
+      tmpV = newTemp( mce, shadowTypeV(mce->sb->tyenv->types[orig]), VSh );
+      assign('V', mce, tmpV, vbits);
+      mce->tmpExpShadow[orig] = tmpV;
+   }
+   return mce->tmpExpShadow[orig];
+}
+
+/* |atom| has just been checked, so set its shadow tmp to be defined
+   -- but only in the case where |guard| evaluates to True at run-time.
+   Do the update by setting the orig->shadow mapping for tmp to reflect
+   the fact that this shadow is getting a new value. */
+static void setCheckedDefined ( MCEnv* mce, IRAtom* atom, IRExpr* guard )
+{
+   IRTemp tmp;
+   IRType ty;
+   tl_assert(atom->tag == Iex_RdTmp);
+   tmp = atom->Iex.RdTmp.tmp;
+   ty  = shadowTypeV(typeOfIRTemp(mce->sb->tyenv, tmp));
+   if (guard == NULL) {
+      // guard is 'always True', hence update unconditionally
+      newShadowTmpV(mce, tmp);
+      assign('V', mce, findShadowTmpV(mce, tmp), definedOfType(ty));
+      setDefdV(mce, tmp);
+   } else {
+      // update the temp only conditionally.  Do this by copying
+      // its old value when the guard is False.
+      // The old value ..
+      IRTemp old_tmpV = findShadowTmpV(mce, tmp);
+      newShadowTmpV(mce, tmp);
+      IRAtom* new_tmpV
+         = assignNew('V', mce, ty,
+                     IRExpr_ITE(guard, definedOfType(ty), mkexpr(old_tmpV)));
+      assign('V', mce, findShadowTmpV(mce, tmp), new_tmpV);
+   }
+}
+
 /* Check the supplied *original* |atom| for undefinedness, and emit a
    complaint if so.  Once that happens, mark it as defined.  This is
    possible because the atom is either a tmp or literal.  If it's a
@@ -1605,20 +1905,37 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
    void*    fn;
    const HChar* nm;
    IRExpr** args;
-   Int      nargs;
+   Int      nargs, regparms;
+   Bool     adaptive;
 
    // Don't do V bit tests if we're not reporting undefined value errors.
-   if (MC_(clo_mc_level) == 1)
+   if (MC_(clo_mc_level) == 1 || !mce->checkUndefs)
       return;
 
    if (guard)
       tl_assert(isOriginalAtom(mce, guard));
 
+   /* Nothing to do if |atom| is already known to be defined, for
+      instance because it was checked earlier in this block.  Constants
+      are trivially defined and aren't counted. */
+   tl_assert(isOriginalAtom(mce, atom));
+   if (atom->tag == Iex_Const)
+      return;
+   if (atom->tag == Iex_RdTmp && isSkipChk(mce, atom->Iex.RdTmp.tmp)) {
+      n_defd_checks_avoided++;
+      /* A check would have made it defined from here on, and later
+         uses mustn't complain about it either.  That includes uses in
+         other blocks, through stores and Puts. */
+      if (!isKnownDefdAtom(mce, atom))
+         setCheckedDefined(mce, atom, guard);
+      return;
+   }
+   n_defd_checks_made++;
+
    /* Since the original expression is atomic, there's no duplicated
       work generated by making multiple V-expressions for it.  So we
       don't really care about the possibility that someone else may
       also create a V-interpretion for it. */
-   tl_assert(isOriginalAtom(mce, atom));
    vatom = expr2vbits( mce, atom, HuOth );
    tl_assert(isShadowAtom(mce, vatom));
    tl_assert(sameKindedAtoms(atom, vatom));
@@ -1643,12 +1960,39 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
       origin = NULL;
    }
 
-   fn    = NULL;
-   nm    = NULL;
-   args  = NULL;
-   nargs = -1;
-
-   switch (sz) {
+   fn       = NULL;
+   nm       = NULL;
+   args     = NULL;
+   nargs    = -1;
+   regparms = -1;
+
+   adaptive = mce->tmpCheapDep != NULL && atom->tag == Iex_RdTmp
+              && mce->tmpCheapDep[atom->Iex.RdTmp.tmp] == CdIMPRECISE;
+   if (adaptive) {
+      /* A failure might be due to the cheap instrumentation.  So pass
+         the helper the outcome of the check under the expensive
+         interpretation too.  It reports the error only if that fails
+         as well, and otherwise promotes the block; see "Adaptive
+         definedness checking" in mc_main.c. */
+      IRAtom* xcond
+         = mkPCastTo( mce, Ity_I1,
+                      mkexpr( findExpShadowTmpV(mce, atom->Iex.RdTmp.tmp) ));
+      IRAtom* xfail
+         = assignNew( 'V', mce, mce->hWordTy,
+                      unop( mce->hWordTy == Ity_I64 ? Iop_1Uto64
+                                                    : Iop_1Uto32, xcond ));
+      if (mce->adaptFlag == NULL)
+         mce->adaptFlag = MC_(adaptive_block_flag)( mce->blockAddr );
+      fn       = &MC_(helperc_adaptive_fail);
+      nm       = "MC_(helperc_adaptive_fail)";
+      args     = mkIRExprVec_4( mkIRExpr_HWord( (HWord)mce->adaptFlag ),
+                                mkIRExpr_HWord( sz ),
+                                origin ? origin : mkIRExpr_HWord( 0 ),
+                                xfail );
+      nargs    = 4;
+      regparms = 0;
+   }
+   else switch (sz) {
       case 0:
          if (origin) {
             fn    = &MC_(helperc_value_check0_fail_w_o);
@@ -1719,14 +2063,18 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
          VG_(tool_panic)("unexpected szB");
    }
 
+   if (regparms == -1)
+      regparms = nargs;
+
    tl_assert(fn);
    tl_assert(nm);
    tl_assert(args);
-   tl_assert(nargs >= 0 && nargs <= 2);
+   tl_assert(nargs >= 0 && nargs <= 4);
+   tl_assert(regparms >= 0 && regparms <= 2);
    tl_assert( (MC_(clo_mc_level) == 3 && origin != NULL)
               || (MC_(clo_mc_level) == 2 && origin == NULL) );
 
-   di = unsafeIRDirty_0_N( nargs/*regparms*/, nm, 
+   di = unsafeIRDirty_0_N( regparms, nm, 
                            VG_(fnptr_to_fnentry)( fn ), args );
    di->guard = cond; // and cond is PCast-to-1(atom#)
 
@@ -1742,32 +2090,15 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
    setHelperAnns( mce, di );
    stmt( 'V', mce, IRStmt_Dirty(di));
 
-   /* If |atom| is shadowed by an IRTemp, set the shadow tmp to be
-      defined -- but only in the case where the guard evaluates to
-      True at run-time.  Do the update by setting the orig->shadow
-      mapping for tmp to reflect the fact that this shadow is getting
-      a new value. */
    tl_assert(isIRAtom(vatom));
    /* sameKindedAtoms ... */
    if (vatom->tag == Iex_RdTmp) {
       tl_assert(atom->tag == Iex_RdTmp);
-      if (guard == NULL) {
-         // guard is 'always True', hence update unconditionally
-         newShadowTmpV(mce, atom->Iex.RdTmp.tmp);
-         assign('V', mce, findShadowTmpV(mce, atom->Iex.RdTmp.tmp), 
-                          definedOfType(ty));
-      } else {
-         // update the temp only conditionally.  Do this by copying
-         // its old value when the guard is False.
-         // The old value ..
-         IRTemp old_tmpV = findShadowTmpV(mce, atom->Iex.RdTmp.tmp);
-         newShadowTmpV(mce, atom->Iex.RdTmp.tmp);
-         IRAtom* new_tmpV
-            = assignNew('V', mce, shadowTypeV(ty),
-                        IRExpr_ITE(guard, definedOfType(ty),
-                                          mkexpr(old_tmpV)));
-         assign('V', mce, findShadowTmpV(mce, atom->Iex.RdTmp.tmp), new_tmpV);
-      }
+      setCheckedDefined(mce, atom, guard);
+      /* A failure here might not be reported, and then the operands
+         may well be undefined. */
+      if (guard == NULL && !adaptive)
+         setDefdParents(mce, atom->Iex.RdTmp.tmp);
    }
 }
 
@@ -1836,6 +2167,8 @@ void do_shadow_PUT ( MCEnv* mce,  Int offset,
 
    ty = typeOfIRExpr(mce->sb->tyenv, vatom);
    tl_assert(ty != Ity_I1);
+   if (!mce->checkUndefs)
+      vatom = definedOfType(ty);
    if (isAlwaysDefd(mce, offset, sizeofIRType(ty))) {
       /* later: no ... */
       /* emit code to emit a complaint if any of the vbits are 1. */
@@ -1882,6 +2215,8 @@ void do_shadow_PUTI ( MCEnv* mce, IRPutI *puti)
    tl_assert(sameKindedAtoms(atom, vatom));
    ty   = descr->elemTy;
    tyS  = shadowTypeV(ty);
+   if (!mce->checkUndefs)
+      vatom = definedOfType(tyS);
    arrSize = descr->nElems * sizeofIRType(ty);
    tl_assert(ty != Ity_I1);
    tl_assert(isOriginalAtom(mce,ix));
@@ -5895,6 +6230,8 @@ IRExpr* expr2vbits ( MCEnv* mce, IRExpr* e,
                                   e->Iex.GetI.ix, e->Iex.GetI.bias );
 
       case Iex_RdTmp:
+         if (mce->inExpShadow)
+            return IRExpr_RdTmp( findExpShadowTmpV(mce, e->Iex.RdTmp.tmp) );
          return IRExpr_RdTmp( findShadowTmpV(mce, e->Iex.RdTmp.tmp) );
 
       case Iex_Const:
@@ -6053,7 +6390,7 @@ void do_shadow_Store ( MCEnv* mce,
    // If we're not doing undefined value checking, pretend that this value
    // is "all valid".  That lets Vex's optimiser remove some of the V bit
    // shadow computation ops that precede it.
-   if (MC_(clo_mc_level) == 1) {
+   if (MC_(clo_mc_level) == 1 || !mce->checkUndefs) {
       switch (ty) {
          case Ity_V256: // V256 weirdness -- used four times
                         c = IRConst_V256(V_BITS32_DEFINED); break;
@@ -6763,7 +7100,7 @@ static void do_shadow_CAS_single ( MCEnv* mce, IRCAS* cas )
    IROp   opCasCmpEQ;
    Int    elemSzB;
    IRType elemTy;
-   Bool   otrak = MC_(clo_mc_level) >= 3; /* a shorthand */
+   Bool   otrak = MC_(clo_mc_level) >= 3 && mce->checkUndefs;
 
    /* single CAS */
    tl_assert(cas->oldHi == IRTemp_INVALID);
@@ -6857,7 +7194,7 @@ static void do_shadow_CAS_double ( MCEnv* mce, IRCAS* cas )
    IROp   opCasCmpEQ, opOr, opXor;
    Int    elemSzB, memOffsLo, memOffsHi;
    IRType elemTy;
-   Bool   otrak = MC_(clo_mc_level) >= 3; /* a shorthand */
+   Bool   otrak = MC_(clo_mc_level) >= 3 && mce->checkUndefs;
 
    /* double CAS */
    tl_assert(cas->oldHi != IRTemp_INVALID);
@@ -7859,10 +8196,29 @@ static void schemeS ( MCEnv* mce, IRStmt* st )
          break;
       }
 
-      case Ist_WrTmp:
+      case Ist_WrTmp: {
+         IRExpr* data = st->Ist.WrTmp.data;
+         if (data->tag == Iex_Load && data->Iex.Load.ty != Ity_V256) {
+            /* MC_(instrument) calls us for loads after their V bits
+               have been computed, so only consult the origin cache if
+               some of the loaded bits are undefined.  Otherwise the
+               origin will never be reported, and zero will do.
+               mkPCastTo can't collapse V256s, so those always do the
+               origin load. */
+            IRAtom* vbits = mkexpr(findShadowTmpV(mce, st->Ist.WrTmp.tmp));
+            IRAtom* undef = mkPCastTo(mce, Ity_I1, vbits);
+            tl_assert(isIRAtom(data->Iex.Load.addr));
+            assign( 'B', mce, findShadowTmpB(mce, st->Ist.WrTmp.tmp),
+                              expr2ori_Load_guarded_General(
+                                 mce, data->Iex.Load.ty,
+                                 data->Iex.Load.addr, 0/*bias*/,
+                                 undef, mkU32(0) ));
+            break;
+         }
          assign( 'B', mce, findShadowTmpB(mce, st->Ist.WrTmp.tmp),
-                           schemeE(mce, st->Ist.WrTmp.data) );
+                           schemeE(mce, data) );
          break;
+      }
 
       case Ist_MBE:
       case Ist_NoOp:
@@ -8674,6 +9030,262 @@ static void preInstrumentationAnalysis ( /*OUT*/HowUsed** useEnvP,
 }
 
 
+/* Compute, for each original tmp in |sb_in|, its DefdParents: the
+   operands of its defining expression which must be defined if it is.
+   This mirrors how expr2vbits handles those expressions, and so must
+   be computed after |mce->dlbo| has been finalised.  Only ops whose
+   shadow is Left/PCast of the UifU of the operands (or a widening,
+   which is self-shadowing) qualify.  The expensive schemes for
+   CmpEQ/CmpNE can give a defined result from partially undefined
+   operands, so those ops only qualify when cheaply instrumented. */
+static DefdParents* findDefdParents ( const MCEnv* mce, const IRSB* sb_in )
+{
+   const UInt nOrigTmps = (UInt)sb_in->tyenv->types_used;
+   DefdParents* parents
+      = VG_(malloc)("mc.findDefdParents.1", nOrigTmps * sizeof(DefdParents));
+   for (UInt i = 0; i < nOrigTmps; i++) {
+      parents[i].parent[0] = IRTemp_INVALID;
+      parents[i].parent[1] = IRTemp_INVALID;
+   }
+
+   for (Int i = 0; i < sb_in->stmts_used; i++) {
+      const IRStmt* st = sb_in->stmts[i];
+      if (st->tag != Ist_WrTmp)
+         continue;
+      IRTemp  dst = st->Ist.WrTmp.tmp;
+      IRExpr* e   = st->Ist.WrTmp.data;
+      IRAtom* arg1 = NULL;
+      IRAtom* arg2 = NULL;
+      tl_assert(dst < nOrigTmps);
+
+      if (e->tag == Iex_Unop) {
+         switch (e->Iex.Unop.op) {
+            case Iop_8Uto16:  case Iop_8Sto16:
+            case Iop_8Uto32:  case Iop_8Sto32:
+            case Iop_8Uto64:  case Iop_8Sto64:
+            case Iop_16Uto32: case Iop_16Sto32:
+            case Iop_16Uto64: case Iop_16Sto64:
+            case Iop_32Uto64: case Iop_32Sto64:
+               arg1 = e->Iex.Unop.arg;
+               break;
+            default:
+               break;
+         }
+      }
+      else if (e->tag == Iex_Binop) {
+         Bool cheapEQ = False;
+         switch (e->Iex.Binop.op) {
+            case Iop_CmpEQ64: case Iop_CmpNE64:
+               cheapEQ = mce->dlbo.dl_CmpEQ64_CmpNE64 != DLexpensive;
+               break;
+            case Iop_CmpEQ32: case Iop_CmpNE32:
+               cheapEQ = mce->dlbo.dl_CmpEQ32_CmpNE32 != DLexpensive;
+               break;
+            case Iop_CmpEQ16: case Iop_CmpNE16:
+               cheapEQ = mce->dlbo.dl_CmpEQ16_CmpNE16 != DLexpensive;
+               break;
+            case Iop_CmpEQ8: case Iop_CmpNE8:
+               cheapEQ = mce->dlbo.dl_CmpEQ8_CmpNE8 != DLexpensive;
+               break;
+            default:
+               break;
+         }
+         switch (e->Iex.Binop.op) {
+            case Iop_CmpEQ64: case Iop_CmpNE64:
+            case Iop_CmpEQ32: case Iop_CmpNE32:
+            case Iop_CmpEQ16: case Iop_CmpNE16:
+            case Iop_CmpEQ8:  case Iop_CmpNE8:
+               if (!cheapEQ)
+                  break;
+               /* fallthrough */
+            case Iop_Add64: case Iop_Sub64: case Iop_Mul64:
+            case Iop_Add32: case Iop_Sub32: case Iop_Mul32:
+            case Iop_Add16: case Iop_Sub16: case Iop_Mul16:
+            case Iop_Add8:  case Iop_Sub8:  case Iop_Mul8:
+            case Iop_CmpLE64S: case Iop_CmpLE64U:
+            case Iop_CmpLT64S: case Iop_CmpLT64U:
+            case Iop_CmpLE32S: case Iop_CmpLE32U:
+            case Iop_CmpLT32S: case Iop_CmpLT32U:
+               arg1 = e->Iex.Binop.arg1;
+               arg2 = e->Iex.Binop.arg2;
+               break;
+            default:
+               break;
+         }
+      }
+
+      if (arg1 && arg1->tag == Iex_RdTmp)
+         parents[dst].parent[0] = arg1->Iex.RdTmp.tmp;
+      if (arg2 && arg2->tag == Iex_RdTmp)
+         parents[dst].parent[1] = arg2->Iex.RdTmp.tmp;
+   }
+
+   return parents;
+}
+
+
+/* For --expensive-definedness-checks=adaptive.  Compute, for each
+   original tmp in |sb_in|, whether its V bits depend on an add,
+   subtract or equality comparison in |sb_in| which |dlbo| and
+   |tmpHowUsed| don't have instrumented expensively, and so might be
+   less precise than under expensive instrumentation.  The V bits of
+   loads, Gets and the results of CASs and LLSCs come from shadow
+   memory or state, so none of those introduce a dependency.
+
+   An add or subtract of operands which are exact, or are themselves
+   such adds or subtracts, is CdDIRECT rather than CdIMPRECISE: both
+   interpretations give it undefined bits exactly when an operand has
+   some, so checking it directly gives the same answer either way.
+   That covers most address computations.  It isn't so for equality
+   comparisons. */
+
+static UChar* findCheapDeps ( const DetailLevelByOp* dlbo,
+                              const HowUsed* tmpHowUsed,
+                              const IRSB* sb_in )
+{
+   const UInt nOrigTmps = (UInt)sb_in->tyenv->types_used;
+   UChar* deps = VG_(calloc)("mc.findCheapDeps.1", nOrigTmps, sizeof(UChar));
+   Int    i, j;
+
+#  define DEP(_atom) \
+      ((_atom)->tag == Iex_RdTmp && deps[(_atom)->Iex.RdTmp.tmp] != CdEXACT)
+   /* As in expr2vbits_Binop. */
+#  define CHEAP(_dl) \
+      ((_dl) == DLcheap \
+       || ((_dl) == DLauto && tmpHowUsed \
+           && tmpHowUsed[st->Ist.WrTmp.tmp] != HuOth))
+#  define IMPRECISE(_atom) \
+      ((_atom)->tag == Iex_RdTmp \
+       && deps[(_atom)->Iex.RdTmp.tmp] == CdIMPRECISE)
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      const IRStmt* st = sb_in->stmts[i];
+      const IRExpr* e;
+      Bool dep   = False;
+      Bool cheap = False;
+
+      if (st->tag == Ist_Dirty) {
+         const IRDirty* d = st->Ist.Dirty.details;
+         if (d->tmp == IRTemp_INVALID)
+            continue;
+         for (j = 0; d->args[j]; j++) {
+            if (!is_IRExpr_VECRET_or_GSPTR(d->args[j]) && DEP(d->args[j]))
+               dep = True;
+         }
+         deps[d->tmp] = dep ? CdIMPRECISE : CdEXACT;
+         continue;
+      }
+      if (st->tag != Ist_WrTmp)
+         continue;
+
+      e = st->Ist.WrTmp.data;
+      switch (e->tag) {
+         case Iex_RdTmp:
+            deps[st->Ist.WrTmp.tmp] = deps[e->Iex.RdTmp.tmp];
+            continue;
+         case Iex_Unop:
+            dep = DEP(e->Iex.Unop.arg);
+            break;
+         case Iex_Binop:
+            dep = DEP(e->Iex.Binop.arg1) || DEP(e->Iex.Binop.arg2);
+            switch (e->Iex.Binop.op) {
+               case Iop_Add64: cheap = CHEAP(dlbo->dl_Add64); break;
+               case Iop_Sub64: cheap = CHEAP(dlbo->dl_Sub64); break;
+               case Iop_Add32: cheap = CHEAP(dlbo->dl_Add32); break;
+               case Iop_Sub32: cheap = CHEAP(dlbo->dl_Sub32); break;
+               case Iop_CmpEQ64: case Iop_CmpNE64:
+                  dep = dep || dlbo->dl_CmpEQ64_CmpNE64 != DLexpensive;
+                  break;
+               case Iop_CmpEQ32: case Iop_CmpNE32:
+                  dep = dep || dlbo->dl_CmpEQ32_CmpNE32 != DLexpensive;
+                  break;
+               case Iop_CmpEQ16: case Iop_CmpNE16:
+                  dep = dep || dlbo->dl_CmpEQ16_CmpNE16 != DLexpensive;
+                  break;
+               case Iop_CmpEQ8: case Iop_CmpNE8:
+                  dep = dep || dlbo->dl_CmpEQ8_CmpNE8 != DLexpensive;
+                  break;
+               default:
+                  break;
+            }
+            switch (e->Iex.Binop.op) {
+               case Iop_Add64: case Iop_Sub64:
+               case Iop_Add32: case Iop_Sub32:
+                  if ((cheap || dep) && !IMPRECISE(e->Iex.Binop.arg1)
+                      && !IMPRECISE(e->Iex.Binop.arg2)) {
+                     deps[st->Ist.WrTmp.tmp] = CdDIRECT;
+                     continue;
+                  }
+                  break;
+               default:
+                  break;
+            }
+            dep = dep || cheap;
+            break;
+         case Iex_Triop:
+            dep = DEP(e->Iex.Triop.details->arg1)
+                  || DEP(e->Iex.Triop.details->arg2)
+                  || DEP(e->Iex.Triop.details->arg3);
+            break;
+         case Iex_Qop:
+            dep = DEP(e->Iex.Qop.details->arg1)
+                  || DEP(e->Iex.Qop.details->arg2)
+                  || DEP(e->Iex.Qop.details->arg3)
+                  || DEP(e->Iex.Qop.details->arg4);
+            break;
+         case Iex_ITE:
+            dep = DEP(e->Iex.ITE.cond) || DEP(e->Iex.ITE.iftrue)
+                  || DEP(e->Iex.ITE.iffalse);
+            break;
+         case Iex_CCall:
+            for (j = 0; e->Iex.CCall.args[j]; j++) {
+               if (DEP(e->Iex.CCall.args[j]))
+                  dep = True;
+            }
+            break;
+         default:
+            break;
+      }
+      deps[st->Ist.WrTmp.tmp] = dep ? CdIMPRECISE : CdEXACT;
+   }
+
+#  undef DEP
+#  undef CHEAP
+#  undef IMPRECISE
+   return deps;
+}
+
+
+void MC_(print_instrumentation_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+      " memcheck: definedness checks: %llu emitted, %llu avoided, "
+      "%llu tmps implied defined\n",
+      n_defd_checks_made, n_defd_checks_avoided, n_defd_tmps_implied);
+}
+
+
+/* Are equality comparisons of host words instrumented expensively in
+   every block, whatever it contains?  The bogus-literal analysis is no
+   help here, since a compiler may hoist such literals out of the block
+   which does the comparison. */
+Bool MC_(word_compares_are_exact) ( void )
+{
+   DetailLevelByOp dlbo;
+   switch (MC_(clo_expensive_definedness_checks)) {
+      case EdcNO:
+         return False;
+      case EdcYES:
+      case EdcADAPTIVE:
+         return True;
+      default:
+         DetailLevelByOp__set_auto( &dlbo );
+         return (sizeof(UWord) == 8 ? dlbo.dl_CmpEQ64_CmpNE64
+                                    : dlbo.dl_CmpEQ32_CmpNE32)
+                == DLexpensive;
+   }
+}
+
 IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                         IRSB* sb_in, 
                         const VexGuestLayout* layout, 
@@ -8682,16 +9294,24 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
                         IRType gWordTy, IRType hWordTy )
 {
    Bool    verboze = 0||False;
-   Int     i, j, first_stmt;
+   Bool    isLoad;
+   Int     i, j, first_stmt, gate;
    IRStmt* st;
    MCEnv   mce;
    IRSB*   sb_out;
+   IREndness hostEnd;
 
    if (gWordTy != hWordTy) {
       /* We don't currently support this case. */
       VG_(tool_panic)("host/guest word size mismatch");
    }
 
+#  if defined(VG_BIGENDIAN)
+   hostEnd = Iend_BE;
+#  else
+   hostEnd = Iend_LE;
+#  endif
+
    /* Check we're not completely nuts */
    tl_assert(sizeof(UWord)  == sizeof(void*));
    tl_assert(sizeof(Word)   == sizeof(void*));
@@ -8715,7 +9335,16 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    mce.trace          = verboze;
    mce.layout         = layout;
    mce.hWordTy        = hWordTy;
+   mce.checkUndefs    = MC_(clo_mc_level) == 1
+                        || MC_(should_check_undefs_at)(vge->base[0]);
    mce.tmpHowUsed     = NULL;
+   mce.tmpDefdParents = NULL;
+   mce.tmpCheapDep    = NULL;
+   mce.tmpDefExpr     = NULL;
+   mce.tmpExpShadow   = NULL;
+   mce.inExpShadow    = False;
+   mce.blockAddr      = closure->nraddr;
+   mce.adaptFlag      = NULL;
 
    /* BEGIN decide on expense levels for instrumentation. */
 
@@ -8733,47 +9362,37 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       DetailLevelByOp__set_all( &mce.dlbo, DLexpensive );
    }
    else {
-      tl_assert(MC_(clo_expensive_definedness_checks) == EdcAUTO);
+      tl_assert(MC_(clo_expensive_definedness_checks) == EdcAUTO
+                || MC_(clo_expensive_definedness_checks) == EdcADAPTIVE);
       /* We'll make our own selection, based on known per-target constraints
          and also on analysis of the block to be instrumented.  First, set
-         up default values for detail levels.
-
-         On x86 and amd64, we'll routinely encounter code optimised by LLVM
-         5 and above.  Enable accurate interpretation of the following.
-         LLVM uses adds for some bitfield inserts, and we get a lot of false
-         errors if the cheap interpretation is used, alas.  Could solve this
-         much better if we knew which of such adds came from x86/amd64 LEA
-         instructions, since these are the only ones really needing the
-         expensive interpretation, but that would require some way to tag
-         them in the _toIR.c front ends, which is a lot of faffing around.
-         So for now we use preInstrumentationAnalysis() to detect adds which
-         are used only to construct memory addresses, which is an
-         approximation to the above, and is self-contained.*/
-#     if defined(VGA_x86)
-      mce.dlbo.dl_Add32           = DLauto;
-      mce.dlbo.dl_CmpEQ16_CmpNE16 = DLexpensive;
-      mce.dlbo.dl_CmpEQ32_CmpNE32 = DLexpensive;
-#     elif defined(VGA_amd64)
-      mce.dlbo.dl_Add32           = DLexpensive;
-      mce.dlbo.dl_Add64           = DLauto;
-      mce.dlbo.dl_CmpEQ16_CmpNE16 = DLexpensive;
-      mce.dlbo.dl_CmpEQ32_CmpNE32 = DLexpensive;
-      mce.dlbo.dl_CmpEQ64_CmpNE64 = DLexpensive;
-#     elif defined(VGA_ppc64le)
-      // Needed by (at least) set_AV_CR6() in the front end.
-      mce.dlbo.dl_CmpEQ64_CmpNE64 = DLexpensive;
-#     elif defined(VGA_arm64)
-      mce.dlbo.dl_CmpEQ32_CmpNE32 = DLexpensive;
-      mce.dlbo.dl_CmpEQ64_CmpNE64 = DLexpensive;
-#     elif defined(VGA_arm)
-      mce.dlbo.dl_CmpEQ32_CmpNE32 = DLexpensive;
-#     endif
+         up default values for detail levels. */
+      DetailLevelByOp__set_auto( &mce.dlbo );
+
+      /* With --expensive-definedness-checks=adaptive, also do all
+         equality comparisons expensively.  Otherwise they are the
+         commonest reason for reevaluating a check (see
+         complainIfUndefined), which costs more than doing them
+         expensively in the first place. */
+      if (MC_(clo_expensive_definedness_checks) == EdcADAPTIVE) {
+         mce.dlbo.dl_CmpEQ64_CmpNE64 = DLexpensive;
+         mce.dlbo.dl_CmpEQ32_CmpNE32 = DLexpensive;
+         mce.dlbo.dl_CmpEQ16_CmpNE16 = DLexpensive;
+         mce.dlbo.dl_CmpEQ8_CmpNE8   = DLexpensive;
+      }
 
       /* preInstrumentationAnalysis() will allocate &mce.tmpHowUsed and then
          fill it in. */
       Bool hasBogusLiterals = False;
       preInstrumentationAnalysis( &mce.tmpHowUsed, &hasBogusLiterals, sb_in );
 
+      /* With --expensive-definedness-checks=adaptive, a block which a
+         check has shown to need it is instrumented as if it had bogus
+         literals. */
+      if (MC_(clo_expensive_definedness_checks) == EdcADAPTIVE
+          && MC_(adaptive_block_promoted)( mce.blockAddr ))
+         hasBogusLiterals = True;
+
       if (hasBogusLiterals) {
          /* This happens very rarely.  In this case just select expensive
             for everything, and throw away the tmp-use analysis results. */
@@ -8784,11 +9403,33 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
          /* Nothing.  mce.tmpHowUsed contains tmp-use analysis results,
             which will be used for some subset of Iop_{Add,Sub}{32,64},
             based on which ones are set to DLauto for this target. */
+         if (MC_(clo_expensive_definedness_checks) == EdcADAPTIVE
+             && MC_(clo_mc_level) >= 2 && mce.checkUndefs) {
+            /* Be ready to reevaluate checks expensively; see
+               complainIfUndefined. */
+            mce.tmpCheapDep  = findCheapDeps( &mce.dlbo, mce.tmpHowUsed,
+                                            sb_in );
+            mce.tmpDefExpr   = VG_(calloc)( "mc.MC_(instrument).3",
+                                            sb_in->tyenv->types_used,
+                                            sizeof(IRExpr*) );
+            mce.tmpExpShadow = VG_(malloc)( "mc.MC_(instrument).4",
+                                            sb_in->tyenv->types_used
+                                            * sizeof(IRTemp) );
+            for (i = 0; i < sb_in->tyenv->types_used; i++)
+               mce.tmpExpShadow[i] = IRTemp_INVALID;
+            for (i = 0; i < sb_in->stmts_used; i++) {
+               st = sb_in->stmts[i];
+               if (st->tag == Ist_WrTmp)
+                  mce.tmpDefExpr[st->Ist.WrTmp.tmp] = st->Ist.WrTmp.data;
+            }
+         }
       }
    }
 
    DetailLevelByOp__check_sanity( &mce.dlbo );
 
+   mce.tmpDefdParents = findDefdParents( &mce, sb_in );
+
    if (0) {
       // Debug printing: which tmps have been identified as PCast-only use
       if (mce.tmpHowUsed) {
@@ -8819,6 +9460,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    for (i = 0; i < sb_in->tyenv->types_used; i++) {
       TempMapEnt ent;
       ent.kind    = Orig;
+      ent.defdV   = False;
+      ent.skipChk = False;
       ent.shadowV = IRTemp_INVALID;
       ent.shadowB = IRTemp_INVALID;
       VG_(addToXA)( mce.tmpMap, &ent );
@@ -8892,6 +9535,11 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    tl_assert(i < sb_in->stmts_used);
    tl_assert(sb_in->stmts[i]->tag == Ist_IMark);
 
+   /* Where the adaptive promotion test goes, if needed: just after the
+      first IMark, which is copied to the output before anything else
+      is generated for the first instruction. */
+   gate = sb_out->stmts_used + 1;
+
    for (/* use current i*/; i < sb_in->stmts_used; i++) {
 
       st = sb_in->stmts[i];
@@ -8903,9 +9551,13 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
          VG_(printf)("\n");
       }
 
-      if (MC_(clo_mc_level) == 3) {
+      /* Origins for a load are computed after its V bits, so that
+         schemeS can skip the origin load when they are all defined. */
+      isLoad = st->tag == Ist_WrTmp && st->Ist.WrTmp.data->tag == Iex_Load;
+
+      if (MC_(clo_mc_level) == 3 && mce.checkUndefs) {
          /* See comments on case Ist_CAS below. */
-         if (st->tag != Ist_CAS) 
+         if (st->tag != Ist_CAS && !isLoad)
             schemeS( &mce, st );
       }
 
@@ -8918,6 +9570,13 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
             tl_assert(dst < (UInt)sb_in->tyenv->types_used);
             HowUsed hu = mce.tmpHowUsed ? mce.tmpHowUsed[dst]
                                         : HuOth/*we don't know, so play safe*/;
+            if (isKnownDefdExpr(&mce, st->Ist.WrTmp.data)) {
+               IRType ty = typeOfIRTemp(sb_in->tyenv, dst);
+               assign( 'V', &mce, findShadowTmpV(&mce, dst),
+                                  definedOfType(shadowTypeV(ty)) );
+               setDefdV(&mce, dst);
+               break;
+            }
             assign( 'V', &mce, findShadowTmpV(&mce, st->Ist.WrTmp.tmp), 
                                expr2vbits( &mce, st->Ist.WrTmp.data, hu ));
             break;
@@ -8997,6 +9656,9 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
       } /* switch (st->tag) */
 
+      if (MC_(clo_mc_level) == 3 && mce.checkUndefs && isLoad)
+         schemeS( &mce, st );
+
       if (0 && verboze) {
          for (j = first_stmt; j < sb_out->stmts_used; j++) {
             VG_(printf)("   ");
@@ -9033,6 +9695,58 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       VG_(printf)("\n");
    }
 
+   /* If a check might promote the block, the block must on entry test
+      whether that has happened, and if so exit to have itself
+      discarded and retranslated.  The guest state is up to date at
+      that point, so the block can safely be rerun from the start. */
+   if (mce.adaptFlag) {
+      IRAtom*  flag;
+      IRAtom*  cond;
+      IRDirty* di;
+      Int      n = sb_out->stmts_used;
+
+      tl_assert(sb_out->stmts[gate - 1]->tag == Ist_IMark);
+      flag = assignNew( 'V', &mce, Ity_I8,
+                        IRExpr_Load( hostEnd, Ity_I8,
+                                     mkIRExpr_HWord( (HWord)mce.adaptFlag ) ));
+      cond = assignNew( 'V', &mce, Ity_I1,
+                        binop( Iop_CmpNE8, flag, mkU8( 0 ) ));
+      di = unsafeIRDirty_0_N( 0/*regparms*/,
+                              "MC_(helperc_adaptive_discard)",
+                              VG_(fnptr_to_fnentry)(
+                                 &MC_(helperc_adaptive_discard) ),
+                              mkIRExprVec_2( IRExpr_GSPTR(),
+                                             mkIRExpr_HWord( vge->base[0] ) ));
+      di->guard = cond;
+      di->nFxState = 2;
+      di->fxState[0].fx        = Ifx_Write;
+      di->fxState[0].offset    = offsetof(VexGuestArchState, guest_CMSTART);
+      di->fxState[0].size      = sizeof(((VexGuestArchState*)0)->guest_CMSTART);
+      di->fxState[0].nRepeats  = 0;
+      di->fxState[0].repeatLen = 0;
+      di->fxState[1].fx        = Ifx_Write;
+      di->fxState[1].offset    = offsetof(VexGuestArchState, guest_CMLEN);
+      di->fxState[1].size      = sizeof(((VexGuestArchState*)0)->guest_CMLEN);
+      di->fxState[1].nRepeats  = 0;
+      di->fxState[1].repeatLen = 0;
+      stmt( 'V', &mce, IRStmt_Dirty(di) );
+      stmt( 'V', &mce, IRStmt_Exit( cond, Ijk_InvalICache,
+                                    gWordTy == Ity_I64
+                                       ? IRConst_U64( mce.blockAddr )
+                                       : IRConst_U32( mce.blockAddr ),
+                                    layout->offset_IP ));
+
+      /* Move the new statements from the end of the block to |gate|. */
+      j = sb_out->stmts_used - n;
+      IRStmt** moved = VG_(malloc)( "mc.MC_(instrument).2",
+                                    j * sizeof(IRStmt*) );
+      VG_(memcpy)( moved, &sb_out->stmts[n], j * sizeof(IRStmt*) );
+      VG_(memmove)( &sb_out->stmts[gate + j], &sb_out->stmts[gate],
+                    (n - gate) * sizeof(IRStmt*) );
+      VG_(memcpy)( &sb_out->stmts[gate], moved, j * sizeof(IRStmt*) );
+      VG_(free)( moved );
+   }
+
    /* If this fails, there's been some serious snafu with tmp management,
       that should be investigated. */
    tl_assert( VG_(sizeXA)( mce.tmpMap ) == mce.sb->tyenv->types_used );
@@ -9041,6 +9755,12 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    if (mce.tmpHowUsed) {
       VG_(free)( mce.tmpHowUsed );
    }
+   VG_(free)( mce.tmpDefdParents );
+   if (mce.tmpCheapDep) {
+      VG_(free)( mce.tmpCheapDep );
+      VG_(free)( mce.tmpDefExpr );
+      VG_(free)( mce.tmpExpShadow );
+   }
 
    tl_assert(mce.sb == sb_out);
    return sb_out;
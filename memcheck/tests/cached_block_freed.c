@@ -0,0 +1,27 @@
+#include <stdlib.h>
+/* To be run with --freelist-vol=1 --freelist-big-blocks=0, so that a
+   freed block leaves the freed queue at the next malloc.  Small blocks
+   which do are kept in memcheck's block cache, still allocated in the
+   client arena.  An access to one must still be described as being to
+   an unallocated block. */
+static void jumped(void)
+{
+   ;
+}
+int main(int argc, char *argv[])
+{
+   char *small = NULL;
+   char *other = NULL;
+
+   small = malloc (20);
+   free(small);
+
+   /* Releases small from the freed queue.  other is of another size,
+      so small stays in the cache. */
+   other = malloc (200);
+
+   if (small[2] > 0x0) jumped();
+
+   free(other);
+   return 0;
+}
@@ -0,0 +1,29 @@
+// A pointer with undefined V bits is used as q+1 and then as q.  The
+// second use needn't be checked, as the first check implies it.  But
+// q must still become defined at that point, as a check would have
+// made it, so storing it and testing the stored copy later gives no
+// second error.
+
+#include "../memcheck.h"
+
+char buf[16];
+char * volatile pp = buf;
+char *g;
+volatile char sink;
+
+__attribute__((noinline)) void f (char *q)
+{
+   sink = q[1];
+   sink = q[0];
+   g = q;
+}
+
+int main (void)
+{
+   char *q = pp;
+   VALGRIND_MAKE_MEM_UNDEFINED(&q, sizeof(q));
+   f(q);
+   if (g == buf)
+      sink = 1;
+   return 0;
+}
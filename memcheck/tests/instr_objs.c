@@ -0,0 +1,20 @@
+/* Both main and so_is_set in instr_objsso.so branch on an undefined
+   value.  With instr_objsso.so left out of the definedness checks,
+   only the branch here is reported, and the value so_is_set returns
+   is defined.  The tests set LD_BIND_NOW: a lazily bound call goes
+   through ld.so, and if that isn't checked either, the argument
+   becomes defined on the way. */
+
+extern int so_is_set ( int x );
+
+int main ( void )
+{
+   int u[1];
+   int n = 0;
+
+   if (so_is_set(u[0]))
+      n++;
+   if (u[0])
+      n++;
+   return n > 2;
+}
@@ -0,0 +1,10 @@
+/* Branches on its argument.  Built into instr_objsso.so, which
+   instr_objs.vgtest and uninstr_objs.vgtest exclude from undefined
+   value checking. */
+
+int so_is_set ( int x )
+{
+   if (x)
+      return 1;
+   return 0;
+}
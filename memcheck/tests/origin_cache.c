@@ -0,0 +1,41 @@
+// Run with a small origin cache which can't grow, so that the origins
+// of a big block are mostly evicted from the L1 and kept in the L2,
+// compressed or not.  They must still be reported correctly when the
+// block's contents are used.
+
+#include <stdlib.h>
+#include "../memcheck.h"
+
+#define BIG (16 * 1024 * 1024)
+
+static volatile int n;
+
+int main (void)
+{
+   char* big;
+   int*  mixed;
+   int   i;
+
+   // Every line of this block has the same origin.
+   big = malloc (BIG);
+
+   // A block whose lines get origins from two sources: the heap
+   // allocation, and the client request below for every other word.
+   mixed = malloc (BIG);
+   for (i = 0; i < BIG / sizeof(int); i += 2)
+      mixed[i] = 0;
+   for (i = 0; i < BIG / sizeof(int); i += 16)
+      VALGRIND_MAKE_MEM_UNDEFINED (&mixed[i], sizeof(int));
+
+   // Look at the first lines, which have long left the L1.
+   if (big[0] == 'x')
+      n++;
+   if (mixed[1] == 1)
+      n++;
+   if (mixed[16] == 1)
+      n++;
+
+   free (mixed);
+   free (big);
+   return 0;
+}
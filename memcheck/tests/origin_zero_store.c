@@ -0,0 +1,68 @@
+// Mix stores of defined values, whose origin is zero, with stores and
+// loads of undefined values, and check that the origins of the
+// undefined values are still reported correctly.  Loads of fully
+// defined values don't look at origins at all, and zero origin stores
+// to memory which the origin cache doesn't hold are skipped.
+
+#include <stdlib.h>
+#include <string.h>
+#include "../memcheck.h"
+
+#define BIG (4 * 1024 * 1024)
+
+static char big[BIG];
+static volatile int n;
+
+__attribute__((noinline))
+static void store_undef (int* p)
+{
+   int undef;
+   *p = undef;
+}
+
+int main (void)
+{
+   int* p;
+   int  i;
+
+   // Overwrite the start of an undefined block with defined values.
+   // The block's origins are in the cache, so these zero origin
+   // stores must clear them.
+   p = malloc (16 * sizeof(int));
+   for (i = 0; i < 8; i++)
+      p[i] = i;
+   for (i = 0; i < 8; i++)
+      if (p[i] == 42)
+         n++;
+   if (p[8] == 42)
+      n++;
+
+   // A partially defined load still gets the origin of its undefined
+   // bytes.
+   ((char*)p)[12 * sizeof(int)] = 0;
+   if (p[12] > 42)
+      n++;
+
+   // Zero origin stores to a big defined array, most of which can't be
+   // in the origin cache.  An undefined value stored after them keeps
+   // its origin.
+   memset (big, 0, BIG);
+   for (i = 0; i < BIG; i += 64)
+      big[i] = i;
+   store_undef ((int*)&big[BIG / 2]);
+   if (*(int*)&big[BIG / 2] == 42)
+      n++;
+
+   // Make it defined again: it must not be reported any more.
+   *(int*)&big[BIG / 2] = 0;
+   if (*(int*)&big[BIG / 2] == 42)
+      n++;
+
+   // Finally, a block made undefined by a client request.
+   VALGRIND_MAKE_MEM_UNDEFINED (&p[4], sizeof(int));
+   if (p[4] == 42)
+      n++;
+
+   free (p);
+   return 0;
+}
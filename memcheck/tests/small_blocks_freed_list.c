@@ -0,0 +1,34 @@
+#include <stdlib.h>
+/* To be run with --freelist-vol=10000 --freelist-big-blocks=8000
+   --freelist-small-blocks=100 */
+static void jumped(void)
+{
+   ;
+}
+int main(int argc, char *argv[])
+{
+   char *small = NULL;
+   char *medium1 = NULL;
+   char *medium2 = NULL;
+   char *other = NULL;
+
+   /* The small block is freed first, so it is the oldest one in the
+      free list. */
+   small = malloc (50);
+   free(small);
+   medium1 = malloc (6000);
+   free(medium1);
+   medium2 = malloc (6000);
+   free(medium2);
+
+   /* The free list is now over its volume, so this malloc releases
+      medium1 to make room.  small, although older, is kept. */
+   other = malloc (10);
+
+   if (small[10] > 0x0) jumped();
+   if (medium1[10] > 0x0) jumped();
+   if (medium2[10] > 0x0) jumped();
+
+   free(other);
+   return 0;
+}
@@ -0,0 +1,84 @@
+// Checks strlen and strcmp at every alignment and for every short
+// length, on heap blocks whose last bytes are the terminating NUL or
+// undefined.  With --partial-loads-ok=yes, and word comparisons
+// instrumented expensively, the replacements read whole aligned words,
+// which must neither change the results nor report the bytes beyond the
+// NUL.  str_wordwise_edc forces the latter on targets where "auto"
+// doesn't.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../memcheck.h"
+
+// Stop the compiler from evaluating the calls itself.
+static size_t (* volatile my_strlen)(const char *) = strlen;
+static int (* volatile my_strcmp)(const char *, const char *) = strcmp;
+
+static int sign (int x)
+{
+   return x < 0 ? -1 : x > 0;
+}
+
+// A copy of s at offset off in a block that ends undef undefined
+// bytes after the NUL.
+static char *place (const char *s, size_t off, size_t undef)
+{
+   size_t len = strlen (s);
+   char *b = malloc (off + len + 1 + undef);
+   memset (b, 'x', off);
+   memcpy (b + off, s, len + 1);
+   VALGRIND_MAKE_MEM_UNDEFINED (b + off + len + 1, undef);
+   return b;
+}
+
+int main (void)
+{
+   static const char text[] = "The spazzy orange tiger jumped over "
+                              "the tawny jaguar.";
+   int errs = 0;
+   size_t len, off1, off2, undef, diff;
+   char s[sizeof text], t[sizeof text];
+
+   for (len = 0; len < 20; len++) {
+      memcpy (s, text, len);
+      s[len] = 0;
+      for (off1 = 0; off1 < 8; off1++) {
+         for (undef = 0; undef < 8; undef++) {
+            char *a = place (s, off1, undef);
+            if (my_strlen (a + off1) != len)
+               errs++;
+            for (off2 = 0; off2 < 8; off2++) {
+               // diff == len compares s against a longer string.
+               for (diff = 0; diff <= len; diff++) {
+                  int exp;
+                  char *b;
+                  memcpy (t, s, len + 1);
+                  if (diff < len) {
+                     t[diff] = 'A';
+                  } else {
+                     t[len] = '!';
+                     t[len + 1] = 0;
+                  }
+                  exp = diff < len ? sign (s[diff] - 'A') : -1;
+                  b = place (t, off2, undef);
+                  if (sign (my_strcmp (a + off1, b + off2)) != exp
+                      || sign (my_strcmp (b + off2, a + off1)) != -exp)
+                     errs++;
+                  free (b);
+               }
+               {
+                  char *b = place (s, off2, undef);
+                  if (my_strcmp (a + off1, b + off2) != 0)
+                     errs++;
+                  free (b);
+               }
+            }
+            free (a);
+         }
+      }
+   }
+
+   fprintf (stderr, "mismatches: %d\n", errs);
+   return 0;
+}
@@ -0,0 +1,26 @@
+// Checks that strlen really reads whole aligned words where
+// str_wordwise expects it to, with the default definedness checking.
+// A byte in the middle of the string is made inaccessible.  Read on
+// its own, that gives an invalid read.  Read as part of an aligned
+// word, with --partial-loads-ok=yes, the load is allowed but the byte
+// is undefined, so deciding whether the word holds the NUL depends on
+// an uninitialised value.
+
+#include <stdlib.h>
+#include <string.h>
+#include "../memcheck.h"
+
+// Stop the compiler from evaluating the call itself.
+static size_t (* volatile my_strlen)(const char *) = strlen;
+
+int main (void)
+{
+   char *b = malloc (32);
+   memset (b, 'x', 31);
+   b[31] = 0;
+   VALGRIND_MAKE_MEM_NOACCESS (b + 17, 1);
+   my_strlen (b);
+   VALGRIND_MAKE_MEM_DEFINED (b + 17, 1);
+   free (b);
+   return 0;
+}
@@ -0,0 +1,59 @@
+// This artificial program walks in step through a few arrays that lie
+// a multiple of 4MB apart, from two threads that take turns under a
+// lock, then sweeps repeatedly through one big array.  It was written
+// to tune the cache that Helgrind keeps in front of its compressed
+// shadow memory: the arrays all map to the same sets of that cache,
+// and the sweep keeps writing back and fetching lines that hold a
+// single shadow value.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NARRAYS  3
+#define SPACING  (4 << 20)
+#define WALK     (64 << 10)
+#define NWALKS   50
+#define SWEEP    (64 << 20)
+#define NSWEEPS  4
+
+static pthread_mutex_t mx = PTHREAD_MUTEX_INITIALIZER;
+static char* base;
+
+static void* walker ( void* arg )
+{
+   long t = (long)arg;
+   int  w, i, a;
+
+   for (w = 0; w < NWALKS; w++) {
+      pthread_mutex_lock(&mx);
+      for (i = 0; i < WALK; i += sizeof(long))
+         for (a = 0; a < NARRAYS; a++)
+            *(long*)(base + a * SPACING + i + t * 64) += 1;
+      pthread_mutex_unlock(&mx);
+   }
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t thr[2];
+   long t, i, sum = 0;
+   int  s;
+
+   base = calloc(1, SWEEP);
+
+   for (t = 0; t < 2; t++)
+      pthread_create(&thr[t], NULL, walker, (void*)t);
+   for (t = 0; t < 2; t++)
+      pthread_join(thr[t], NULL);
+
+   for (s = 0; s < NSWEEPS; s++)
+      for (i = 0; i < SWEEP; i += sizeof(long))
+         *(long*)(base + i) = s;
+
+   for (i = 0; i < SWEEP; i += 4096)
+      sum += *(long*)(base + i);
+   printf("%ld\n", sum);
+   return 0;
+}
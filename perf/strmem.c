@@ -0,0 +1,41 @@
+// This artificial program spends most of its time in strlen and strcmp
+// on heap strings of mixed lengths and alignments.  Under Memcheck both
+// are replaced by the versions in shared/vg_replace_strmem.c, so it
+// measures those rather than the code of the C library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSTRS  1000
+#define REPS   2000
+
+// Stop the compiler from evaluating the calls itself.
+static size_t (* volatile my_strlen)(const char *) = strlen;
+static int (* volatile my_strcmp)(const char *, const char *) = strcmp;
+
+int main ( void )
+{
+   char* strs[NSTRS];
+   size_t total = 0;
+   int i, r, cmp = 0;
+
+   for (i = 0; i < NSTRS; i++) {
+      int len = 1 + (i * 37) % 200;
+      int off = i % 8;
+      char* s = malloc(off + len + 1);
+      memset(s + off, 'a' + i % 4, len);
+      s[off + len] = 0;
+      strs[i] = s + off;
+   }
+
+   for (r = 0; r < REPS; r++) {
+      for (i = 0; i < NSTRS; i++) {
+         total += my_strlen(strs[i]);
+         cmp += my_strcmp(strs[i], strs[(i + r) % NSTRS]) < 0;
+      }
+   }
+
+   printf("%zu %d\n", total, cmp);
+   return 0;
+}
@@ -188,6 +188,21 @@ static inline void my_exit ( int x )
 #define FOR_COPY(x) x
 #endif
 
+// True if strlen and strcmp may fetch aligned words that extend past
+// the terminating NUL.  A tool that defines this must accept such
+// loads, and must instrument STRMEM_HAS_ZERO_BYTE precisely enough
+// that the bytes after the NUL don't affect its outcome.  That relies
+// on borrows running towards those bytes, hence little-endian only.
+#if !defined(STRMEM_WORD_READS_OK) || !defined(VG_LITTLEENDIAN)
+#undef STRMEM_WORD_READS_OK
+#define STRMEM_WORD_READS_OK() 0
+#endif
+
+// Nonzero iff some byte of the UWord w is zero.
+#define STRMEM_ONES ((UWord)-1 / 0xFF)
+#define STRMEM_HAS_ZERO_BYTE(w) \
+   ((((w) - STRMEM_ONES) & ~(w) & (STRMEM_ONES << 7)) != 0)
+
 #ifndef VALGRIND_CHECK_VALUE_IS_DEFINED
 #define VALGRIND_CHECK_VALUE_IS_DEFINED(__lvalue) 1
 #endif
@@ -497,6 +512,16 @@ static inline void my_exit ( int x )
       ( const char* str )  \
    { \
       SizeT i = 0; \
+      if (STRMEM_WORD_READS_OK()) { \
+         /* Step to a word boundary, skip whole words without a */ \
+         /* zero byte, then find the NUL in the last one below. */ \
+         while ((((Addr)str + i) & (sizeof(UWord) - 1)) != 0) { \
+            if (str[i] == 0) return i; \
+            i++; \
+         } \
+         while (!STRMEM_HAS_ZERO_BYTE(*(const UWord*)(str + i))) \
+            i += sizeof(UWord); \
+      } \
       while (str[i] != 0) i++; \
       return i; \
    }
@@ -924,6 +949,28 @@ static inline void my_exit ( int x )
    { \
       register UChar c1; \
       register UChar c2; \
+      if (STRMEM_WORD_READS_OK() \
+          && ((((Addr)s1) ^ ((Addr)s2)) & (sizeof(UWord) - 1)) == 0) { \
+         /* Compare up to a word boundary, then skip whole words */ \
+         /* that are equal and contain no NUL, leaving the byte */ \
+         /* loop below to find where the strings end or differ. */ \
+         while ((((Addr)s1) & (sizeof(UWord) - 1)) != 0) { \
+            c1 = *(const UChar *)s1; \
+            c2 = *(const UChar *)s2; \
+            if (c1 != c2 || c1 == 0) break; \
+            s1++; s2++; \
+         } \
+         if ((((Addr)s1) & (sizeof(UWord) - 1)) == 0) { \
+            while (True) { \
+               UWord w1 = *(const UWord*)s1; \
+               /* Look for a NUL before comparing, as w1 != w2 */ \
+               /* may depend on undefined bytes after one. */ \
+               if (STRMEM_HAS_ZERO_BYTE(w1)) break; \
+               if (w1 != *(const UWord*)s2) break; \
+               s1 += sizeof(UWord); s2 += sizeof(UWord); \
+            } \
+         } \
+      } \
       while (True) { \
          c1 = *(const UChar *)s1; \
          c2 = *(const UChar *)s2; \